@@ -53,6 +53,11 @@ inline void AtomicIncrement(volatile u32& target) {
 	__sync_add_and_fetch(&target, 1);
 }
 
+// Sets target to desired if it's equal to expected. Returns true if it was.
+inline bool AtomicCompareAndSwap(volatile u32& target, u32 expected, u32 desired) {
+	return __sync_bool_compare_and_swap(&target, expected, desired);
+}
+
 inline u32 AtomicLoad(volatile u32& src) {
 	return src; // 32-bit reads are always atomic.
 }
@@ -59,6 +59,11 @@ inline void AtomicDecrement(volatile u32& target) {
 	InterlockedDecrement((volatile LONG*)&target);
 }
 
+// Sets target to desired if it's equal to expected. Returns true if it was.
+inline bool AtomicCompareAndSwap(volatile u32& target, u32 expected, u32 desired) {
+	return (u32)InterlockedCompareExchange((volatile LONG*)&target, (LONG)desired, (LONG)expected) == expected;
+}
+
 inline u32 AtomicLoad(volatile u32& src) {
 	return src; // 32-bit reads are always atomic.
 }
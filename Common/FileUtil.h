@@ -196,6 +196,31 @@ private:
 	bool m_good;
 };
 
+// A whole file mapped read-only. Only the pages actually touched get read from disk, so this is
+// the cheap way to pick a small part out of a large file.
+class MappedFile : NonCopyable
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const std::string& filename);
+	void Close();
+
+	bool IsOpen() const { return m_data != NULL; }
+	const u8* GetData() const { return m_data; }
+	size_t GetSize() const { return m_size; }
+
+private:
+	const u8* m_data;
+	size_t m_size;
+#ifdef _WIN32
+	// HANDLEs, windows.h can't be included here.
+	void* m_file;
+	void* m_mapping;
+#endif
+};
+
 }  // namespace
 
 #endif
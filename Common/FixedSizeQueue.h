@@ -25,6 +25,11 @@
 
 // TODO: "inline" storage?
 
+#include <algorithm>
+#include <cstring>
+
+#include "ChunkFile.h"
+
 template <class T, int N>
 class FixedSizeQueue
 {
@@ -69,6 +74,27 @@ public:
 		count--;
 	}
 
+	// Block versions of push and pop, at most two memcpys each. T must be POD for these,
+	// and pushArray must not be given more than room().
+	void pushArray(const T *src, int num) {
+		int firstPart = std::min(num, N - tail);
+		memcpy(storage + tail, src, firstPart * sizeof(T));
+		memcpy(storage, src + firstPart, (num - firstPart) * sizeof(T));
+		tail = (tail + num) % N;
+		count += num;
+	}
+
+	// Returns the number actually popped, which is less than num if there aren't enough.
+	int popArray(T *dest, int num) {
+		num = std::min(num, count);
+		int firstPart = std::min(num, N - head);
+		memcpy(dest, storage + head, firstPart * sizeof(T));
+		memcpy(dest + firstPart, storage, (num - firstPart) * sizeof(T));
+		head = (head + num) % N;
+		count -= num;
+		return num;
+	}
+
 	T pop_front() {
 		const T &temp = storage[head];
 		pop();
@@ -82,9 +108,33 @@ public:
 		return count;
 	}
 
+	int room() const {
+		return N - count;
+	}
+
   bool empty() {
     return count;
   }
+
+	// Only the queued items are stored, oldest first.
+	void DoState(PointerWrap &p)
+	{
+		int n = count;
+		p.Do(n);
+		if (p.GetMode() == PointerWrap::MODE_READ)
+		{
+			p.DoArray(storage, n);
+			head = 0;
+			tail = n % N;
+			count = n;
+		}
+		else
+		{
+			int firstPart = std::min(n, N - head);
+			p.DoArray(storage + head, firstPart);
+			p.DoArray(storage, n - firstPart);
+		}
+	}
 };
 
 #endif // _FIXED_SIZE_QUEUE_H_
@@ -16,13 +16,336 @@
 // http://code.google.com/p/dolphin-emu/
 
 #include <algorithm>
+#include <ctype.h>
+#include <stdarg.h>
+#include <time.h>
+#ifdef _WIN32
+#include <sys/timeb.h>
+#else
+#include <sys/time.h>
+#endif
 
 #include "LogManager.h"
 #include "ConsoleListener.h"
+#include "Atomic.h"
 #include "Timer.h"
 #include "Thread.h"
 #include "FileUtil.h"
 
+#ifndef va_copy
+#define va_copy(dst, src) ((dst) = (src))
+#endif
+
+enum
+{
+	LOG_RECORD_DATA_SIZE = 480,
+	// Records per thread, must be a power of two.
+	LOG_RING_SIZE = 2048,
+};
+
+// The format string, followed by the arguments in their va_arg types. Strings are copied,
+// truncated if they don't fit. Anything the capture can't handle is formatted right away.
+struct LogRecord
+{
+	u64 time;
+	const char *file;
+	int line;
+	u8 level;
+	u8 type;
+	bool preformatted;
+	char data[LOG_RECORD_DATA_SIZE];
+};
+
+// Single producer (the thread it belongs to), single consumer (whoever drains).
+struct LogRing
+{
+	LogRing() : head(0), tail(0), dropped(0), droppedReported(0) {}
+
+	LogRecord records[LOG_RING_SIZE];
+	volatile u32 head;
+	volatile u32 tail;
+	// Messages that didn't fit. Only the drainer touches droppedReported.
+	volatile u32 dropped;
+	u32 droppedReported;
+};
+
+enum LogArgType
+{
+	LOG_ARG_NONE,
+	LOG_ARG_INT,
+	LOG_ARG_LONG,
+	LOG_ARG_LONGLONG,
+	LOG_ARG_SIZE,
+	LOG_ARG_DOUBLE,
+	LOG_ARG_STRING,
+	LOG_ARG_POINTER,
+	LOG_ARG_UNSUPPORTED,
+};
+
+// Parses a conversion spec, p points right after the '%'. Returns what follows it, and sets
+// stars to the number of '*' widths/precisions, which take an int argument each.
+static const char *ParseFormatSpec(const char *p, LogArgType &type, int &stars)
+{
+	stars = 0;
+	while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0')
+		p++;
+	if (*p == '*')
+	{
+		stars++;
+		p++;
+	}
+	while (isdigit((unsigned char)*p))
+		p++;
+	if (*p == '.')
+	{
+		p++;
+		if (*p == '*')
+		{
+			stars++;
+			p++;
+		}
+		while (isdigit((unsigned char)*p))
+			p++;
+	}
+
+	int longs = 0;
+	bool sizeType = false;
+	bool longDouble = false;
+	while (true)
+	{
+		if (*p == 'h')
+			p++;
+		else if (*p == 'l')
+		{
+			longs++;
+			p++;
+		}
+		else if (*p == 'z' || *p == 't')
+		{
+			sizeType = true;
+			p++;
+		}
+		else if (*p == 'j' || *p == 'q')
+		{
+			longs = 2;
+			p++;
+		}
+		else if (*p == 'L')
+		{
+			longDouble = true;
+			p++;
+		}
+		else if (*p == 'I' && p[1] == '6' && p[2] == '4')
+		{
+			longs = 2;
+			p += 3;
+		}
+		else if (*p == 'I' && p[1] == '3' && p[2] == '2')
+			p += 3;
+		else
+			break;
+	}
+
+	switch (*p)
+	{
+	case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+		type = sizeType ? LOG_ARG_SIZE : (longs >= 2 ? LOG_ARG_LONGLONG : (longs == 1 ? LOG_ARG_LONG : LOG_ARG_INT));
+		break;
+	case 'c':
+		type = longs == 0 ? LOG_ARG_INT : LOG_ARG_UNSUPPORTED;
+		break;
+	case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+		type = longDouble ? LOG_ARG_UNSUPPORTED : LOG_ARG_DOUBLE;
+		break;
+	case 's':
+		type = longs == 0 ? LOG_ARG_STRING : LOG_ARG_UNSUPPORTED;
+		break;
+	case 'p':
+		type = LOG_ARG_POINTER;
+		break;
+	case '%':
+		type = LOG_ARG_NONE;
+		break;
+	default:
+		type = LOG_ARG_UNSUPPORTED;
+		break;
+	}
+	return *p ? p + 1 : p;
+}
+
+template <typename T>
+static bool PutLogArg(char *&out, const char *end, T value)
+{
+	if ((size_t)(end - out) < sizeof(T))
+		return false;
+	memcpy(out, &value, sizeof(T));
+	out += sizeof(T);
+	return true;
+}
+
+template <typename T>
+static T GetLogArg(const char *&in)
+{
+	T value;
+	memcpy(&value, in, sizeof(T));
+	in += sizeof(T);
+	return value;
+}
+
+static bool CaptureLogArgs(LogRecord &rec, const char *format, va_list args)
+{
+	char *out = rec.data;
+	const char *end = rec.data + sizeof(rec.data);
+	size_t formatLen = strlen(format) + 1;
+	if (formatLen > sizeof(rec.data))
+		return false;
+	memcpy(out, format, formatLen);
+	out += formatLen;
+
+	const char *p = format;
+	while (*p)
+	{
+		if (*p++ != '%')
+			continue;
+
+		LogArgType type;
+		int stars;
+		p = ParseFormatSpec(p, type, stars);
+		if (type == LOG_ARG_UNSUPPORTED)
+			return false;
+		for (int i = 0; i < stars; i++)
+		{
+			if (!PutLogArg(out, end, va_arg(args, int)))
+				return false;
+		}
+
+		bool fits = true;
+		switch (type)
+		{
+		case LOG_ARG_INT: fits = PutLogArg(out, end, va_arg(args, int)); break;
+		case LOG_ARG_LONG: fits = PutLogArg(out, end, va_arg(args, long)); break;
+		case LOG_ARG_LONGLONG: fits = PutLogArg(out, end, va_arg(args, long long)); break;
+		case LOG_ARG_SIZE: fits = PutLogArg(out, end, va_arg(args, size_t)); break;
+		case LOG_ARG_DOUBLE: fits = PutLogArg(out, end, va_arg(args, double)); break;
+		case LOG_ARG_POINTER: fits = PutLogArg(out, end, va_arg(args, void *)); break;
+		case LOG_ARG_STRING:
+			{
+				const char *str = va_arg(args, const char *);
+				if (!str)
+					str = "(null)";
+				size_t room = end - out;
+				if (room == 0)
+					return false;
+				size_t len = 0;
+				while (len < room - 1 && str[len])
+					len++;
+				memcpy(out, str, len);
+				out[len] = '\0';
+				out += len + 1;
+			}
+			break;
+		default:
+			break;
+		}
+		if (!fits)
+			return false;
+	}
+	return true;
+}
+
+static void FormatLogRecord(const LogRecord &rec, char *out, size_t outSize)
+{
+	if (rec.preformatted)
+	{
+		strncpy(out, rec.data, outSize);
+		out[outSize - 1] = '\0';
+		return;
+	}
+
+	const char *p = rec.data;
+	const char *in = rec.data + strlen(rec.data) + 1;
+	size_t used = 0;
+	while (*p && used < outSize - 1)
+	{
+		if (*p != '%')
+		{
+			out[used++] = *p++;
+			continue;
+		}
+
+		// Each spec is formatted on its own, with any '*' replaced by its value.
+		const char *specStart = p;
+		LogArgType type;
+		int stars;
+		p = ParseFormatSpec(p + 1, type, stars);
+		char spec[64];
+		size_t specLen = 0;
+		for (const char *s = specStart; s < p && specLen < sizeof(spec) - 12; s++)
+		{
+			if (*s == '*')
+				specLen += sprintf(spec + specLen, "%d", GetLogArg<int>(in));
+			else
+				spec[specLen++] = *s;
+		}
+		spec[specLen] = '\0';
+
+		size_t room = outSize - used;
+		int written = 0;
+		switch (type)
+		{
+		case LOG_ARG_NONE: written = snprintf(out + used, room, "%%"); break;
+		case LOG_ARG_INT: written = snprintf(out + used, room, spec, GetLogArg<int>(in)); break;
+		case LOG_ARG_LONG: written = snprintf(out + used, room, spec, GetLogArg<long>(in)); break;
+		case LOG_ARG_LONGLONG: written = snprintf(out + used, room, spec, GetLogArg<long long>(in)); break;
+		case LOG_ARG_SIZE: written = snprintf(out + used, room, spec, GetLogArg<size_t>(in)); break;
+		case LOG_ARG_DOUBLE: written = snprintf(out + used, room, spec, GetLogArg<double>(in)); break;
+		case LOG_ARG_POINTER: written = snprintf(out + used, room, spec, GetLogArg<void *>(in)); break;
+		case LOG_ARG_STRING:
+			written = snprintf(out + used, room, spec, in);
+			in += strlen(in) + 1;
+			break;
+		default:
+			break;
+		}
+
+		if (written < 0 || (size_t)written >= room)
+		{
+			used = outSize - 1;
+			break;
+		}
+		used += written;
+	}
+	out[used] = '\0';
+}
+
+// Milliseconds since 1970, cheap enough to take on every message.
+static u64 GetLogTime()
+{
+#ifdef _WIN32
+	struct timeb tp;
+	(void)::ftime(&tp);
+	return (u64)tp.time * 1000 + tp.millitm;
+#else
+	struct timeval t;
+	(void)gettimeofday(&t, NULL);
+	return (u64)t.tv_sec * 1000 + t.tv_usec / 1000;
+#endif
+}
+
+// Same as Timer::GetTimeFormatted, for a time taken earlier.
+static void FormatLogTime(u64 time, char formattedTime[13])
+{
+	char tmp[13];
+	time_t sysTime = (time_t)(time / 1000);
+	strftime(tmp, 6, "%M:%S", localtime(&sysTime));
+	sprintf(formattedTime, "%s:%03d", tmp, (int)(time % 1000));
+}
+
+static bool LogRecordEarlier(const LogRecord *a, const LogRecord *b)
+{
+	return a->time < b->time;
+}
+
 void GenericLog(LogTypes::LOG_LEVELS level, LogTypes::LOG_TYPE type, 
 		const char *file, int line, const char* fmt, ...)
 {
@@ -77,10 +400,32 @@ LogManager::LogManager()
 #endif
 #endif
 	}
+
+#ifdef _WIN32
+	m_ringTls = TlsAlloc();
+#else
+	pthread_key_create(&m_ringKey, NULL);
+#endif
+	m_quitting = false;
+	m_writerThread = new std::thread(&LogManager::RunWriterThread, this);
 }
 
 LogManager::~LogManager()
 {
+	// The writer drains once more after seeing this.
+	m_quitting = true;
+	m_writerThread->join();
+	delete m_writerThread;
+
+	for (size_t i = 0; i < m_rings.size(); i++)
+		delete m_rings[i];
+	m_rings.clear();
+#ifdef _WIN32
+	TlsFree(m_ringTls);
+#else
+	pthread_key_delete(m_ringKey);
+#endif
+
 	for (int i = 0; i < LogTypes::NUMBER_OF_LOGS; ++i)
 	{
 #ifndef ANDROID
@@ -120,25 +465,141 @@ void LogManager::LoadConfig(IniFile::Section *section)
   }
 }
 
+LogRing *LogManager::GetThreadRing()
+{
+#ifdef _WIN32
+	LogRing *ring = (LogRing *)TlsGetValue(m_ringTls);
+#else
+	LogRing *ring = (LogRing *)pthread_getspecific(m_ringKey);
+#endif
+	if (ring)
+		return ring;
+
+	// First message from this thread. Rings stay around until shutdown, even if the thread ends.
+	ring = new LogRing();
+	{
+		std::lock_guard<std::mutex> lk(m_ringsLock);
+		m_rings.push_back(ring);
+	}
+#ifdef _WIN32
+	TlsSetValue(m_ringTls, ring);
+#else
+	pthread_setspecific(m_ringKey, ring);
+#endif
+	return ring;
+}
+
 void LogManager::Log(LogTypes::LOG_LEVELS level, LogTypes::LOG_TYPE type, const char *file, int line, const char *format, va_list args)
 {
-	char temp[MAX_MSGLEN];
-	char msg[MAX_MSGLEN * 2];
 	LogContainer *log = m_Log[type];
 	if (!log || !log->IsEnabled() || level > log->GetLevel() || ! log->HasListeners())
 		return;
 
-	CharArrayFromFormatV(temp, MAX_MSGLEN, format, args);
+	LogRing *ring = GetThreadRing();
+	u32 head = ring->head;
+	if (head - Common::AtomicLoadAcquire(ring->tail) >= LOG_RING_SIZE)
+	{
+		// Full. Rather lose messages than stall the thread, the writer reports how many.
+		Common::AtomicStore(ring->dropped, ring->dropped + 1);
+		return;
+	}
+
+	LogRecord &rec = ring->records[head & (LOG_RING_SIZE - 1)];
+	rec.time = GetLogTime();
+	rec.file = file;
+	rec.line = line;
+	rec.level = (u8)level;
+	rec.type = (u8)type;
+
+	va_list argsCopy;
+	va_copy(argsCopy, args);
+	rec.preformatted = !CaptureLogArgs(rec, format, argsCopy);
+	va_end(argsCopy);
+	if (rec.preformatted)
+		CharArrayFromFormatV(rec.data, sizeof(rec.data), format, args);
+
+	Common::AtomicStoreRelease(ring->head, head + 1);
+}
+
+int LogManager::Drain()
+{
+	std::lock_guard<std::mutex> drainLock(m_drainLock);
+
+	std::vector<LogRing *> rings;
+	{
+		std::lock_guard<std::mutex> lk(m_ringsLock);
+		rings = m_rings;
+	}
 
 	static const char level_to_char[7] = "-NEWID";
-  char formattedTime[13];
-  Common::Timer::GetTimeFormatted(formattedTime);
-	sprintf(msg, "%s %s:%u %c[%s]: %s\n",
-		formattedTime,
-		file, line, level_to_char[(int)level],
-		log->GetShortName(), temp);
-
-	log->Trigger(level, msg);
+	char temp[MAX_MSGLEN];
+	char msg[MAX_MSGLEN * 2];
+
+	std::vector<u32> heads(rings.size());
+	m_drained.clear();
+	for (size_t i = 0; i < rings.size(); i++)
+	{
+		LogRing *ring = rings[i];
+		heads[i] = Common::AtomicLoadAcquire(ring->head);
+		for (u32 pos = ring->tail; pos != heads[i]; pos++)
+			m_drained.push_back(&ring->records[pos & (LOG_RING_SIZE - 1)]);
+
+		u32 dropped = Common::AtomicLoad(ring->dropped);
+		if (dropped != ring->droppedReported)
+		{
+			sprintf(msg, "%u log messages dropped, the writer couldn't keep up\n", dropped - ring->droppedReported);
+			m_Log[LogTypes::MASTER_LOG]->Trigger(LogTypes::LWARNING, msg);
+			ring->droppedReported = dropped;
+		}
+	}
+
+	// Each ring is in order already, this interleaves the threads.
+	std::stable_sort(m_drained.begin(), m_drained.end(), LogRecordEarlier);
+	for (size_t i = 0; i < m_drained.size(); i++)
+	{
+		const LogRecord &rec = *m_drained[i];
+		LogContainer *log = m_Log[rec.type];
+		FormatLogRecord(rec, temp, sizeof(temp));
+
+		char formattedTime[13];
+		FormatLogTime(rec.time, formattedTime);
+		sprintf(msg, "%s %s:%u %c[%s]: %s\n",
+			formattedTime,
+			rec.file, rec.line, level_to_char[(int)rec.level],
+			log->GetShortName(), temp);
+
+		log->Trigger((LogTypes::LOG_LEVELS)rec.level, msg);
+	}
+
+	for (size_t i = 0; i < rings.size(); i++)
+		Common::AtomicStoreRelease(rings[i]->tail, heads[i]);
+	return (int)m_drained.size();
+}
+
+void LogManager::Flush()
+{
+	Drain();
+}
+
+void LogManager::RunWriterThread(LogManager *logManager)
+{
+	logManager->WriterThread();
+}
+
+void LogManager::WriterThread()
+{
+	Common::SetCurrentThreadName("Log writer");
+
+	while (true)
+	{
+		// Checked before draining, so that the last drain gets everything.
+		bool quitting = m_quitting;
+		int count = Drain();
+		if (quitting)
+			break;
+		if (count == 0)
+			Common::SleepCurrentThread(2);
+	}
 }
 
 void LogManager::Init()
@@ -25,7 +25,11 @@
 #include "IniFile.h"
 
 #include <set>
+#include <vector>
 #include <string.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 
 #define	MAX_MESSAGES 8000   
 #define MAX_MSGLEN  1024
@@ -97,6 +101,8 @@ private:
 };
 
 class ConsoleListener;
+struct LogRecord;
+struct LogRing;
 
 class LogManager : NonCopyable
 {
@@ -107,8 +113,27 @@ private:
 	DebuggerLogListener *m_debuggerLog;
 	static LogManager *m_logManager;  // Singleton. Ugh.
 
+	// Log() only copies the format and its arguments into a ring owned by the calling thread.
+	// The writer thread formats the messages and hands them to the listeners.
+	std::vector<LogRing *> m_rings;
+	std::mutex m_ringsLock;
+	std::mutex m_drainLock;
+	std::vector<const LogRecord *> m_drained;
+	std::thread *m_writerThread;
+	volatile bool m_quitting;
+#ifdef _WIN32
+	unsigned long m_ringTls;
+#else
+	pthread_key_t m_ringKey;
+#endif
+
 	LogManager();
 	~LogManager();
+
+	LogRing *GetThreadRing();
+	int Drain();
+	void WriterThread();
+	static void RunWriterThread(LogManager *logManager);
 public:
 
 	static u32 GetMaxLevel() { return MAX_LOGLEVEL;	}
@@ -166,6 +191,9 @@ public:
 		return m_debuggerLog;
 	}
 
+	// Waits until everything logged so far has been passed on to the listeners.
+	void Flush();
+
 	static LogManager* GetInstance()
 	{
 		return m_logManager;
@@ -20,6 +20,7 @@
 
 #include "Common.h" // Local
 #include "StringUtil.h"
+#include "LogManager.h"
 
 bool DefaultMsgHandler(const char* caption, const char* text, bool yes_no, int Style);
 static MsgAlertHandler msg_handler = DefaultMsgHandler;
@@ -90,6 +91,9 @@ bool MsgAlert(bool yes_no, int Style, const char* format, ...)
 	va_end(args);
 
 	ERROR_LOG(MASTER_LOG, "%s: %s", caption.c_str(), buffer);
+	// Asserts may crash right after this, so get the log out to disk first.
+	if (LogManager::GetInstance())
+		LogManager::GetInstance()->Flush();
 
 	// Don't ignore questions, especially AskYesNo, PanicYesNo could be ignored
 	if (msg_handler && (AlertEnabled || Style == QUESTION || Style == CRITICAL))
@@ -41,16 +41,22 @@ void CConfig::Load(const char *iniFileName)
 
 	IniFile::Section *general = iniFile.GetOrCreateSection("General");
 
-	bSpeedLimit = false;
 	general->Get("FirstRun", &bFirstRun, true);
 	general->Get("AutoLoadLast", &bAutoLoadLast, false);
 	general->Get("AutoRun", &bAutoRun, false);
 	general->Get("Jit", &bJIT, false);
+	general->Get("SpeedLimit", &bSpeedLimit, false);
 	general->Get("ConfirmOnQuit", &bConfirmOnQuit, false);
 	general->Get("IgnoreBadMemAccess", &bIgnoreBadMemAccess, true);
 	general->Get("DisplayFramebuffer", &bDisplayFramebuffer, false);
 	general->Get("CurrentDirectory", &currentDirectory, "");
+	general->Get("FunctionCacheDirectory", &functionCacheDirectory, "cache");
 	general->Get("ShowFPSCounter", &bShowFPSCounter, false);
+	general->Get("RewindSnapshotInterval", &iRewindSnapshotInterval, 0);
+
+	IniFile::Section *graphics = iniFile.GetOrCreateSection("Graphics");
+	graphics->Get("SoftwareRendering", &bSoftwareRendering, false);
+	graphics->Get("AutoFrameSkip", &bAutoFrameSkip, false);
 
 	IniFile::Section *sound = iniFile.GetOrCreateSection("Sound");
 	sound->Get("Enable", &bEnableSound, true);
@@ -71,11 +77,18 @@ void CConfig::Save()
 		general->Set("AutoLoadLast", bAutoLoadLast);
 		general->Set("AutoRun", bAutoRun);
 		general->Set("Jit", bJIT);
+		general->Set("SpeedLimit", bSpeedLimit);
 		general->Set("ConfirmOnQuit", bConfirmOnQuit);
 		general->Set("IgnoreBadMemAccess", bIgnoreBadMemAccess);
 		general->Set("DisplayFramebuffer", bDisplayFramebuffer);
 		general->Set("CurrentDirectory", currentDirectory);
+		general->Set("FunctionCacheDirectory", functionCacheDirectory);
 		general->Set("ShowFPSCounter", bShowFPSCounter);
+		general->Set("RewindSnapshotInterval", iRewindSnapshotInterval);
+
+		IniFile::Section *graphics = iniFile.GetOrCreateSection("Graphics");
+		graphics->Set("SoftwareRendering", bSoftwareRendering);
+		graphics->Set("AutoFrameSkip", bAutoFrameSkip);
 
 		IniFile::Section *sound = iniFile.GetOrCreateSection("Sound");
 		sound->Set("Enable", bEnableSound);
@@ -43,11 +43,18 @@ public:
 	bool bConfirmOnQuit;
 	bool bIgnoreBadMemAccess;
 	bool bDisplayFramebuffer;
+	bool bSoftwareRendering;
+	bool bAutoFrameSkip;
+	// Frames between rewind snapshots, 0 to disable rewind.
+	int iRewindSnapshotInterval;
 
 	bool bShowAnalogStick;
 	bool bShowFPSCounter;
 
 	std::string currentDirectory;
+	// Where the functions found in executables without symbols are kept, so the scan only has to
+	// be done on the first boot. Empty to always scan.
+	std::string functionCacheDirectory;
 
 	void Load(const char *iniFileName = "ppsspp.ini");
 	void Save();
@@ -24,6 +24,7 @@
 #include "MIPS/MIPS.h"
 
 #include "Host.h"
+#include "SaveState.h"
 
 #include "Debugger/Breakpoints.h"
 
@@ -113,6 +114,10 @@ reswitch:
 #endif
 			break;
 
+		case CORE_NEXTFRAME:
+			SaveState::Process();
+			break;
+
 		case CORE_POWERDOWN:
 		case CORE_ERROR:
 			//1: Exit loop!!
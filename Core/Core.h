@@ -38,7 +38,9 @@ enum CoreState
 	CORE_RUNNING,
 	CORE_STEPPING,
 	CORE_POWERDOWN,
-	CORE_ERROR
+	CORE_ERROR,
+	// Stopped at a vblank for SaveState::Process(), then goes back to running.
+	CORE_NEXTFRAME,
 };
 
 
@@ -20,6 +20,7 @@
 
 #include "MsgHandler.h"
 #include "StdMutex.h"
+#include "ChunkFile.h"
 #include "CoreTiming.h"
 #include "Core.h"
 
@@ -29,6 +30,16 @@ int CPU_HZ = 222000000;
 #define INITIAL_SLICE_LENGTH 20000
 #define MAX_SLICE_LENGTH 100000000
 
+// Each thread has its own current context, so instances can run side by side.
+#ifdef _WIN32
+#define CORETIMING_THREAD_LOCAL __declspec(thread)
+#elif defined(__APPLE__)
+// No __thread here, all threads share one current context.
+#define CORETIMING_THREAD_LOCAL
+#else
+#define CORETIMING_THREAD_LOCAL __thread
+#endif
+
 namespace CoreTiming
 {
 
@@ -38,8 +49,6 @@ struct EventType
 	const char *name;
 };
 
-std::vector<EventType> event_types;
-
 struct BaseEvent
 {
 	s64 time;
@@ -56,23 +65,88 @@ struct LinkedListItem : public T
 
 typedef LinkedListItem<BaseEvent> Event;
 
-Event *first;
-Event *tsFirst;
-Event *tsLast;
+// Everything one emulator instance schedules with.
+struct Context
+{
+	Context()
+		: first(0), tsFirst(0), tsLast(0), eventPool(0), eventTsPool(0), allocatedTsEvents(0),
+		  downcount(INITIAL_SLICE_LENGTH), slicelength(INITIAL_SLICE_LENGTH), globalTimer(0), idledCycles(0),
+		  advanceCallback(0)
+	{
+	}
+
+	~Context()
+	{
+		FreeList(first);
+		FreeList(tsFirst);
+		FreeList(eventPool);
+		FreeList(eventTsPool);
+	}
+
+	static void FreeList(Event *ev)
+	{
+		while (ev)
+		{
+			Event *next = ev->next;
+			delete ev;
+			ev = next;
+		}
+	}
+
+	std::vector<EventType> event_types;
+
+	Event *first;
+	Event *tsFirst;
+	Event *tsLast;
 
-// event pools
-Event *eventPool = 0;
-Event *eventTsPool = 0;
-int allocatedTsEvents = 0;
+	// event pools
+	Event *eventPool;
+	Event *eventTsPool;
+	int allocatedTsEvents;
 
-int downcount, slicelength;
+	int downcount, slicelength;
 
-s64 globalTimer;
-s64 idledCycles;
+	s64 globalTimer;
+	s64 idledCycles;
 
-static std::recursive_mutex externalEventSection;
+	std::recursive_mutex externalEventSection;
+
+	void (*advanceCallback)(int cyclesExecuted);
+};
+
+// Threads that never pick a context share this one, so a single instance works without
+// calling SetCurrentContext at all.
+static Context defaultContext;
+static CORETIMING_THREAD_LOCAL Context *current = &defaultContext;
+
+Context *CreateContext()
+{
+	return new Context();
+}
+
+void DestroyContext(Context *ctx)
+{
+	if (ctx == &defaultContext)
+		return;
+	if (current == ctx)
+		current = &defaultContext;
+	delete ctx;
+}
+
+void SetCurrentContext(Context *ctx)
+{
+	current = ctx ? ctx : &defaultContext;
+}
+
+Context *GetCurrentContext()
+{
+	return current;
+}
 
-void (*advanceCallback)(int cyclesExecuted) = NULL;
+int *GetDowncountPtr()
+{
+	return &current->downcount;
+}
 
 void SetClockFrequencyMHz(int cpuMhz)
 {
@@ -87,121 +161,133 @@ int GetClockFrequencyMHz()
 
 Event* GetNewEvent()
 {
-	if(!eventPool)
+	Context *ctx = current;
+	if(!ctx->eventPool)
 		return new Event;
 
-	Event* ev = eventPool;
-	eventPool = ev->next;
+	Event* ev = ctx->eventPool;
+	ctx->eventPool = ev->next;
 	return ev;
 }
 
 Event* GetNewTsEvent()
 {
-	allocatedTsEvents++;
+	Context *ctx = current;
+	ctx->allocatedTsEvents++;
 
-	if(!eventTsPool)
+	if(!ctx->eventTsPool)
 		return new Event;
 
-	Event* ev = eventTsPool;
-	eventTsPool = ev->next;
+	Event* ev = ctx->eventTsPool;
+	ctx->eventTsPool = ev->next;
 	return ev;
 }
 
 void FreeEvent(Event* ev)
 {
-	ev->next = eventPool;
-	eventPool = ev;
+	Context *ctx = current;
+	ev->next = ctx->eventPool;
+	ctx->eventPool = ev;
 }
 
 void FreeTsEvent(Event* ev)
 {
-	ev->next = eventTsPool;
-	eventTsPool = ev;
-	allocatedTsEvents--;
+	Context *ctx = current;
+	ev->next = ctx->eventTsPool;
+	ctx->eventTsPool = ev;
+	ctx->allocatedTsEvents--;
 }
 
 int RegisterEvent(const char *name, TimedCallback callback)
 {
+	Context *ctx = current;
 	EventType type;
 	type.name = name;
 	type.callback = callback;
-	event_types.push_back(type);
-	return (int)event_types.size() - 1;
+	ctx->event_types.push_back(type);
+	return (int)ctx->event_types.size() - 1;
 }
 
 void UnregisterAllEvents()
 {
-	if (first)
+	Context *ctx = current;
+	if (ctx->first)
 		PanicAlert("Cannot unregister events with events pending");
-	event_types.clear();
+	ctx->event_types.clear();
 }
 
 void Init()
 {
-	downcount = INITIAL_SLICE_LENGTH;
-	slicelength = INITIAL_SLICE_LENGTH;
-	globalTimer = 0;
-	idledCycles = 0;
+	Context *ctx = current;
+	ctx->downcount = INITIAL_SLICE_LENGTH;
+	ctx->slicelength = INITIAL_SLICE_LENGTH;
+	ctx->globalTimer = 0;
+	ctx->idledCycles = 0;
 }
 
 void Shutdown()
 {
+	Context *ctx = current;
 	MoveEvents();
 	ClearPendingEvents();
 	UnregisterAllEvents();
 
-	while(eventPool)
+	while(ctx->eventPool)
 	{
-		Event *ev = eventPool;
-		eventPool = ev->next;
+		Event *ev = ctx->eventPool;
+		ctx->eventPool = ev->next;
 		delete ev;
 	}
 
-	std::lock_guard<std::recursive_mutex> lk(externalEventSection);
-	while(eventTsPool)
+	std::lock_guard<std::recursive_mutex> lk(ctx->externalEventSection);
+	while(ctx->eventTsPool)
 	{
-		Event *ev = eventTsPool;
-		eventTsPool = ev->next;
+		Event *ev = ctx->eventTsPool;
+		ctx->eventTsPool = ev->next;
 		delete ev;
 	}
 }
 
 u64 GetTicks()
 {
-	return (u64)globalTimer; 
+	Context *ctx = current;
+	return (u64)ctx->globalTimer; 
 }
 
 u64 GetIdleTicks()
 {
-	return (u64)idledCycles;
+	Context *ctx = current;
+	return (u64)ctx->idledCycles;
 }
 
 
 // This is to be called when outside threads, such as the graphics thread, wants to
 // schedule things to be executed on the main thread.
-void ScheduleEvent_Threadsafe(int cyclesIntoFuture, int event_type, u64 userdata)
+void ScheduleEvent_Threadsafe(s64 cyclesIntoFuture, int event_type, u64 userdata)
 {
-	std::lock_guard<std::recursive_mutex> lk(externalEventSection);
+	Context *ctx = current;
+	std::lock_guard<std::recursive_mutex> lk(ctx->externalEventSection);
 	Event *ne = GetNewTsEvent();
-	ne->time = globalTimer + cyclesIntoFuture;
+	ne->time = ctx->globalTimer + cyclesIntoFuture;
 	ne->type = event_type;
 	ne->next = 0;
 	ne->userdata = userdata;
-	if(!tsFirst)
-		tsFirst = ne;
-	if(tsLast)
-		tsLast->next = ne;
-	tsLast = ne;
+	if(!ctx->tsFirst)
+		ctx->tsFirst = ne;
+	if(ctx->tsLast)
+		ctx->tsLast->next = ne;
+	ctx->tsLast = ne;
 }
 
 // Same as ScheduleEvent_Threadsafe(0, ...) EXCEPT if we are already on the CPU thread
 // in which case the event will get handled immediately, before returning.
 void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata)
 {
+	Context *ctx = current;
 	if(false) //Core::IsCPUThread())
 	{
-		std::lock_guard<std::recursive_mutex> lk(externalEventSection);
-		event_types[event_type].callback(userdata, 0);
+		std::lock_guard<std::recursive_mutex> lk(ctx->externalEventSection);
+		ctx->event_types[event_type].callback(userdata, 0);
 	}
 	else
 		ScheduleEvent_Threadsafe(0, event_type, userdata);
@@ -209,18 +295,20 @@ void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata)
 
 void ClearPendingEvents()
 {
-	while (first)
+	Context *ctx = current;
+	while (ctx->first)
 	{
-		Event *e = first->next;
-		FreeEvent(first);
-		first = e;
+		Event *e = ctx->first->next;
+		FreeEvent(ctx->first);
+		ctx->first = e;
 	}
 }
 
 void AddEventToQueue(Event* ne)
 {
+	Context *ctx = current;
 	Event* prev = NULL;
-	Event** pNext = &first;
+	Event** pNext = &ctx->first;
 	for(;;)
 	{
 		Event*& next = *pNext;
@@ -238,25 +326,28 @@ void AddEventToQueue(Event* ne)
 // This must be run ONLY from within the cpu thread
 // cyclesIntoFuture may be VERY inaccurate if called from anything else
 // than Advance 
-void ScheduleEvent(int cyclesIntoFuture, int event_type, u64 userdata)
+void ScheduleEvent(s64 cyclesIntoFuture, int event_type, u64 userdata)
 {
+	Context *ctx = current;
 	Event *ne = GetNewEvent();
 	ne->userdata = userdata;
 	ne->type = event_type;
-	ne->time = globalTimer + cyclesIntoFuture;
+	ne->time = ctx->globalTimer + cyclesIntoFuture;
 	AddEventToQueue(ne);
 }
 
 void RegisterAdvanceCallback(void (*callback)(int cyclesExecuted))
 {
-	advanceCallback = callback;
+	Context *ctx = current;
+	ctx->advanceCallback = callback;
 }
 
 bool IsScheduled(int event_type) 
 {
-	if (!first)
+	Context *ctx = current;
+	if (!ctx->first)
 		return false;
-	Event *e = first;
+	Event *e = ctx->first;
 	while (e) {
 		if (e->type == event_type)
 			return true;
@@ -267,24 +358,25 @@ bool IsScheduled(int event_type)
 
 void RemoveEvent(int event_type)
 {
-	if (!first)
+	Context *ctx = current;
+	if (!ctx->first)
 		return;
-	while(first)
+	while(ctx->first)
 	{
-		if (first->type == event_type)
+		if (ctx->first->type == event_type)
 		{
-			Event *next = first->next;
-			FreeEvent(first);
-			first = next;
+			Event *next = ctx->first->next;
+			FreeEvent(ctx->first);
+			ctx->first = next;
 		}
 		else
 		{
 			break;
 		}
 	}
-	if (!first)
+	if (!ctx->first)
 		return;
-	Event *prev = first;
+	Event *prev = ctx->first;
 	Event *ptr = prev->next;
 	while (ptr)
 	{
@@ -302,31 +394,52 @@ void RemoveEvent(int event_type)
 	}
 }
 
+s64 UnscheduleEvent(int event_type, u64 userdata)
+{
+	Context *ctx = current;
+	Event *prev = 0;
+	for (Event *ptr = ctx->first; ptr; prev = ptr, ptr = ptr->next)
+	{
+		if (ptr->type == event_type && ptr->userdata == userdata)
+		{
+			s64 cyclesLeft = ptr->time - ctx->globalTimer;
+			if (prev)
+				prev->next = ptr->next;
+			else
+				ctx->first = ptr->next;
+			FreeEvent(ptr);
+			return cyclesLeft < 0 ? 0 : cyclesLeft;
+		}
+	}
+	return -1;
+}
+
 void RemoveThreadsafeEvent(int event_type)
 {
-	std::lock_guard<std::recursive_mutex> lk(externalEventSection);
-	if (!tsFirst)
+	Context *ctx = current;
+	std::lock_guard<std::recursive_mutex> lk(ctx->externalEventSection);
+	if (!ctx->tsFirst)
 	{
 		return;
 	}
-	while(tsFirst)
+	while(ctx->tsFirst)
 	{
-		if (tsFirst->type == event_type)
+		if (ctx->tsFirst->type == event_type)
 		{
-			Event *next = tsFirst->next;
-			FreeTsEvent(tsFirst);
-			tsFirst = next;
+			Event *next = ctx->tsFirst->next;
+			FreeTsEvent(ctx->tsFirst);
+			ctx->tsFirst = next;
 		}
 		else
 		{
 			break;
 		}
 	}
-	if (!tsFirst)
+	if (!ctx->tsFirst)
 	{
 		return;
 	}
-	Event *prev = tsFirst;
+	Event *prev = ctx->tsFirst;
 	Event *ptr = prev->next;
 	while (ptr)
 	{
@@ -353,18 +466,19 @@ void RemoveAllEvents(int event_type)
 //This raise only the events required while the fifo is processing data
 void ProcessFifoWaitEvents()
 {
+	Context *ctx = current;
 	MoveEvents();
 
-	if (!first)
+	if (!ctx->first)
 		return;
 
-	while (first)
+	while (ctx->first)
 	{
-		if (first->time <= globalTimer)
+		if (ctx->first->time <= ctx->globalTimer)
 		{
-			Event* evt = first;
-			first = first->next;
-			event_types[evt->type].callback(evt->userdata, (int)(globalTimer - evt->time));
+			Event* evt = ctx->first;
+			ctx->first = ctx->first->next;
+			ctx->event_types[evt->type].callback(evt->userdata, (int)(ctx->globalTimer - evt->time));
 			FreeEvent(evt);
 		}
 		else
@@ -376,44 +490,46 @@ void ProcessFifoWaitEvents()
 
 void MoveEvents()
 {
-	std::lock_guard<std::recursive_mutex> lk(externalEventSection);
+	Context *ctx = current;
+	std::lock_guard<std::recursive_mutex> lk(ctx->externalEventSection);
 		// Move events from async queue into main queue
-	while (tsFirst)
+	while (ctx->tsFirst)
 	{
-		Event *next = tsFirst->next;
-		AddEventToQueue(tsFirst);
-		tsFirst = next;
+		Event *next = ctx->tsFirst->next;
+		AddEventToQueue(ctx->tsFirst);
+		ctx->tsFirst = next;
 	}
-	tsLast = NULL;
+	ctx->tsLast = NULL;
 
 	// Move free events to threadsafe pool
-	while(allocatedTsEvents > 0 && eventPool)
+	while(ctx->allocatedTsEvents > 0 && ctx->eventPool)
 	{		    
-		Event *ev = eventPool;
-		eventPool = ev->next;
-		ev->next = eventTsPool;
-		eventTsPool = ev;
-		allocatedTsEvents--;
+		Event *ev = ctx->eventPool;
+		ctx->eventPool = ev->next;
+		ev->next = ctx->eventTsPool;
+		ctx->eventTsPool = ev;
+		ctx->allocatedTsEvents--;
 	}
 }
 
 void Advance()
 {
+	Context *ctx = current;
 	MoveEvents();		
 
-	int cyclesExecuted = slicelength - downcount;
-	globalTimer += cyclesExecuted;
-	downcount = slicelength;
+	int cyclesExecuted = ctx->slicelength - ctx->downcount;
+	ctx->globalTimer += cyclesExecuted;
+	ctx->downcount = ctx->slicelength;
 
-	while (first)
+	while (ctx->first)
 	{
-		if (first->time <= globalTimer)
+		if (ctx->first->time <= ctx->globalTimer)
 		{
 //			LOG(CPU, "[Scheduler] %s		 (%lld, %lld) ", 
 //				first->name ? first->name : "?", (u64)globalTimer, (u64)first->time);
-			Event* evt = first;
-			first = first->next;
-			event_types[evt->type].callback(evt->userdata, (int)(globalTimer - evt->time));
+			Event* evt = ctx->first;
+			ctx->first = ctx->first->next;
+			ctx->event_types[evt->type].callback(evt->userdata, (int)(ctx->globalTimer - evt->time));
 			FreeEvent(evt);
 		}
 		else
@@ -421,25 +537,26 @@ void Advance()
 			break;
 		}
 	}
-	if (!first) 
+	if (!ctx->first) 
 	{
 		// WARN_LOG(CPU, "WARNING - no events in queue. Setting downcount to 10000");
-		downcount += 10000;
+		ctx->downcount += 10000;
 	}
 	else
 	{
-		slicelength = (int)(first->time - globalTimer);
-		if (slicelength > MAX_SLICE_LENGTH)
-			slicelength = MAX_SLICE_LENGTH;
-		downcount = slicelength;
+		// Events can be further away than an int of cycles, clamp before narrowing.
+		s64 cyclesToEvent = ctx->first->time - ctx->globalTimer;
+		ctx->slicelength = cyclesToEvent > MAX_SLICE_LENGTH ? MAX_SLICE_LENGTH : (int)cyclesToEvent;
+		ctx->downcount = ctx->slicelength;
 	}
-	if (advanceCallback)
-		advanceCallback(cyclesExecuted);
+	if (ctx->advanceCallback)
+		ctx->advanceCallback(cyclesExecuted);
 }
 
 void LogPendingEvents()
 {
-	Event *ptr = first;
+	Context *ctx = current;
+	Event *ptr = ctx->first;
 	while (ptr)
 	{
 		//INFO_LOG(CPU, "PENDING: Now: %lld Pending: %lld Type: %d", globalTimer, ptr->time, ptr->type);
@@ -449,31 +566,96 @@ void LogPendingEvents()
 
 void Idle(int maxIdle)
 {
-	int cyclesDown = downcount;
+	Context *ctx = current;
+	int cyclesDown = ctx->downcount;
 	if (maxIdle != 0 && cyclesDown > maxIdle)
 		cyclesDown = maxIdle;
 
 	DEBUG_LOG(CPU, "Idle for %i cycles! (%f ms)", cyclesDown, cyclesDown / (float)(CPU_HZ * 0.001f));
 
-	idledCycles += cyclesDown;
-	downcount -= cyclesDown;
+	ctx->idledCycles += cyclesDown;
+	ctx->downcount -= cyclesDown;
+}
+
+void DoState(PointerWrap &p)
+{
+	Context *ctx = current;
+	std::lock_guard<std::recursive_mutex> lk(ctx->externalEventSection);
+	MoveEvents();
+
+	// Event types are stored by name, so that a state still loads if the registration
+	// order changes between builds.
+	int numTypes = (int)ctx->event_types.size();
+	p.Do(numTypes);
+	std::vector<int> typeMap;
+	for (int i = 0; i < numTypes; i++)
+	{
+		std::string name = i < (int)ctx->event_types.size() ? ctx->event_types[i].name : "";
+		p.Do(name);
+		if (p.GetMode() != PointerWrap::MODE_READ)
+			continue;
+		int type = -1;
+		for (size_t j = 0; j < ctx->event_types.size(); j++)
+			if (name == ctx->event_types[j].name)
+				type = (int)j;
+		if (type == -1)
+			ERROR_LOG(CPU, "Savestate has an event type that no longer exists: %s", name.c_str());
+		typeMap.push_back(type);
+	}
+
+	int count = 0;
+	for (Event *ptr = ctx->first; ptr; ptr = ptr->next)
+		count++;
+	p.Do(count);
+
+	if (p.GetMode() == PointerWrap::MODE_READ)
+	{
+		ClearPendingEvents();
+		for (int i = 0; i < count; i++)
+		{
+			BaseEvent ev;
+			p.Do(ev);
+			if (ev.type < 0 || ev.type >= numTypes || typeMap[ev.type] == -1)
+				continue;
+			Event *ne = GetNewEvent();
+			ne->time = ev.time;
+			ne->userdata = ev.userdata;
+			ne->type = typeMap[ev.type];
+			AddEventToQueue(ne);
+		}
+	}
+	else
+	{
+		for (Event *ptr = ctx->first; ptr; ptr = ptr->next)
+		{
+			BaseEvent ev = *ptr;
+			p.Do(ev);
+		}
+	}
+
+	p.Do(ctx->downcount);
+	p.Do(ctx->slicelength);
+	p.Do(ctx->globalTimer);
+	p.Do(ctx->idledCycles);
+	p.DoMarker("CoreTiming");
 }
 
 std::string GetScheduledEventsSummary()
 {
-	Event *ptr = first;
+	Context *ctx = current;
+	Event *ptr = ctx->first;
 	std::string text = "Scheduled events\n";
 	text.reserve(1000);
 	while (ptr)
 	{
 		unsigned int t = ptr->type;
-		if (t >= event_types.size())
+		if (t >= ctx->event_types.size())
 			PanicAlert("Invalid event type"); // %i", t);
-		const char *name = event_types[ptr->type].name;
+		const char *name = ctx->event_types[ptr->type].name;
 		if (!name)
 			name = "[unknown]";
 		char temp[512];
-		sprintf(temp, "%s : %i %08x%08x\n", event_types[ptr->type].name, (int)ptr->time, (u32)(ptr->userdata >> 32), (u32)(ptr->userdata));
+		sprintf(temp, "%s : %i %08x%08x\n", ctx->event_types[ptr->type].name, (int)ptr->time, (u32)(ptr->userdata >> 32), (u32)(ptr->userdata));
 		text += temp;
 		ptr = ptr->next;
 	}
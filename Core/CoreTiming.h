@@ -35,6 +35,8 @@
 
 #include <string>
 
+class PointerWrap;
+
 //const int CPU_HZ = 222000000;
 extern int CPU_HZ;
 
@@ -58,6 +60,16 @@ inline int usToCycles(int us) {
 	return (int)(CPU_HZ / 1000000 * us);
 }
 
+// For waits from the game, which are u32 microseconds: past about 9.6 seconds that's more
+// cycles than an int holds.
+inline s64 usToCycles(u64 us) {
+	return (s64)(CPU_HZ / 1000000) * (s64)us;
+}
+
+inline s64 cyclesToUs(s64 cycles) {
+	return cycles / (CPU_HZ / 1000000);
+}
+
 namespace CoreTiming
 {
 	void Init();
@@ -74,14 +86,17 @@ namespace CoreTiming
 
 	// userdata MAY NOT CONTAIN POINTERS. userdata might get written and reloaded from disk,
 	// when we implement state saves.
-	void ScheduleEvent(int cyclesIntoFuture, int event_type, u64 userdata=0);
-	void ScheduleEvent_Threadsafe(int cyclesIntoFuture, int event_type, u64 userdata=0);
+	void ScheduleEvent(s64 cyclesIntoFuture, int event_type, u64 userdata=0);
+	void ScheduleEvent_Threadsafe(s64 cyclesIntoFuture, int event_type, u64 userdata=0);
 	void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata=0);
 
 	// We only permit one event of each type in the queue at a time.
 	void RemoveEvent(int event_type);
 	void RemoveThreadsafeEvent(int event_type);
 	void RemoveAllEvents(int event_type);
+	// Removes the one event of this type scheduled with this userdata. Returns how many cycles
+	// were left until it, or -1 if there was no such event.
+	s64 UnscheduleEvent(int event_type, u64 userdata);
 	bool IsScheduled(int event_type);
 	void Advance();
 	void MoveEvents();
@@ -95,14 +110,33 @@ namespace CoreTiming
 
 	void LogPendingEvents();
 
+	// Saves or restores the pending events and the timers. Event callbacks are not saved,
+	// the types must already have been registered (by the HLE modules) before loading.
+	void DoState(PointerWrap &p);
+
 	void RegisterAdvanceCallback(void (*callback)(int cyclesExecuted));
 
 	std::string GetScheduledEventsSummary();
 
 	void SetClockFrequencyMHz(int cpuMhz);
 	int GetClockFrequencyMHz();
-	extern int downcount;
-	extern int slicelength;
+
+	// All the scheduler state (events, pools, timers, downcount) lives in a context, and
+	// every call above works on the calling thread's current one. Threads that never set
+	// one share a default context. CPU_HZ is still process wide.
+	struct Context;
+	Context *CreateContext();
+	// Frees the context and its pending events. If it was the calling thread's current
+	// context, the thread goes back to the default one.
+	void DestroyContext(Context *ctx);
+	// NULL selects the default context. Threads that schedule with ScheduleEvent_Threadsafe
+	// for an instance must select that instance's context first.
+	void SetCurrentContext(Context *ctx);
+	Context *GetCurrentContext();
+
+	// The current context's downcount. The JIT bakes this address into its blocks, so a JIT
+	// cache must only be run with the context it was compiled under.
+	int *GetDowncountPtr();
 
 }; // end of namespace
 
@@ -54,7 +54,34 @@ static u32 ComputeHash(u32 start, u32 size)
 
 void SymbolMap::SortSymbols()
 {
-  std::sort(entries, entries + numEntries);
+	std::sort(entries, entries + numEntries);
+	indexDirty = true;
+}
+
+void SymbolMap::UpdateIndex()
+{
+	if (!indexDirty)
+		return;
+
+	index.resize(numEntries);
+	for (int i = 0; i < numEntries; i++)
+	{
+		IndexEntry &ie = index[i];
+		ie.start = entries[i].vaddress;
+		ie.end = entries[i].vaddress + entries[i].size;
+		if (ie.end < ie.start)
+			ie.end = 0xFFFFFFFF;
+		ie.num = i;
+	}
+	std::sort(index.begin(), index.end());
+
+	u32 maxEnd = 0;
+	for (size_t i = 0; i < index.size(); i++)
+	{
+		maxEnd = std::max(maxEnd, index[i].end);
+		index[i].maxEnd = maxEnd;
+	}
+	indexDirty = false;
 }
 
 void SymbolMap::AnalyzeBackwards()
@@ -113,6 +140,7 @@ void SymbolMap::ResetSymbolMap()
 	}
 #endif
 	numEntries=0;
+	indexDirty = true;
 }
 
 
@@ -123,6 +151,7 @@ void SymbolMap::AddSymbol(const char *symbolname, unsigned int vaddress, size_t
 	e.vaddress = vaddress;
 	e.size = size;
 	e.type=st;
+	indexDirty = true;
 }
 
 bool SymbolMap::LoadSymbolMap(const char *filename)
@@ -201,33 +230,17 @@ void SymbolMap::SaveSymbolMap(const char *filename)
 
 int SymbolMap::GetSymbolNum(unsigned int address, SymbolType symmask)
 {
-	int start=0;
+	UpdateIndex();
 
-	for (int i = 0; i < numEntries; i += 100)
+	// Innermost first, if symbols are nested.
+	std::vector<IndexEntry>::const_iterator iter = std::upper_bound(index.begin(), index.end(), address, IndexStartsAfter);
+	while (iter != index.begin())
 	{
-		if (address >= entries[i].vaddress)
-			start = i;
-		else
-			break;
-	}
-	
-	if (start<0) start=0;
-
-	for (int i=start; i<numEntries; i++)
-	{
-		unsigned int addr = entries[i].vaddress;
-		if ((address >= addr))
-		{
-			if (address < addr+entries[i].size)
-			{
-				if (entries[i].type & symmask)
-					return i;
-				else
-					return -1;
-			}
-		}
-		else
+		--iter;
+		if (iter->maxEnd <= address)
 			break;
+		if (address < iter->end && (entries[iter->num].type & symmask))
+			return iter->num;
 	}
 	return -1;
 }
@@ -34,11 +34,14 @@ typedef struct HWND__ *HWND;
 class SymbolMap
 {
 public:
+	SymbolMap() : numEntries(0), indexDirty(true) {}
+
 	bool LoadSymbolMap(const char *filename);
 	void SaveSymbolMap(const char *filename);
 	void AddSymbol(const char *symbolname, unsigned int vaddress, size_t size, SymbolType symbol);
 	void ResetSymbolMap();
 	void AnalyzeBackwards();
+	// Binary search in the address index, so cheap enough to call for every instruction.
 	int GetSymbolNum(unsigned int address, SymbolType symmask=ST_FUNCTION);
 	char *GetDescription(unsigned int address);
 #ifdef _WIN32
@@ -56,6 +59,9 @@ public:
 	void IncreaseRunCount(int num);
 	unsigned int GetRunCount(int num);
 	void SortSymbols();
+	// Rebuilds the address index if symbols have been added or moved. GetSymbolNum does this
+	// itself, but it must be done up front before looking symbols up from several threads.
+	void UpdateIndex();
 
 	void UseFuncSignaturesFile(const char *filename, u32 maxAddress);
 	void CompileFuncSignaturesFile(const char *filename);
@@ -89,9 +95,28 @@ private:
 		}
 	};
 
+	// Sorted by start, maxEnd is the highest end of this and all earlier ones. Looking backwards
+	// from the last symbol starting at or before an address, nothing further back can contain
+	// it once maxEnd is below it.
+	struct IndexEntry
+	{
+		u32 start;
+		u32 end;
+		u32 maxEnd;
+		int num;
+
+		bool operator <(const IndexEntry &other) const {
+			return start < other.start || (start == other.start && num < other.num);
+		}
+	};
+	static bool IndexStartsAfter(u32 address, const IndexEntry &ie) { return address < ie.start; }
+
 	int numEntries;
 	MapEntry entries[65536*2];
 
+	std::vector<IndexEntry> index;
+	bool indexDirty;
+
 
 
 };
@@ -55,6 +55,22 @@ bool ElfReader::LoadInto(u32 vaddr)
 {
 	DEBUG_LOG(LOADER,"String section: %i", header->e_shstrndx);
 
+	if (size < sizeof(Elf32_Ehdr) || header->e_phnum > 32 ||
+		header->e_phoff + header->e_phnum * sizeof(Elf32_Phdr) > size ||
+		header->e_shoff + header->e_shnum * sizeof(Elf32_Shdr) > size)
+	{
+		ERROR_LOG(LOADER, "ELF headers out of bounds, file truncated?");
+		return false;
+	}
+	for (int i = 0; i < header->e_phnum; i++)
+	{
+		if (segments[i].p_type == PT_LOAD && segments[i].p_offset + segments[i].p_filesz > size)
+		{
+			ERROR_LOG(LOADER, "Segment %i (%08x bytes at %08x) is past the end of the file", i, (u32)segments[i].p_filesz, (u32)segments[i].p_offset);
+			return false;
+		}
+	}
+
 	//TODO - Check header->e_ident here
 	//let's dump string section
 	/*
@@ -34,6 +34,7 @@ class ElfReader
 {
 	char *base;
 	u32 *base32;
+	size_t size;
 	Elf32_Ehdr *header;
 	Elf32_Phdr *segments;
 	Elf32_Shdr *sections;
@@ -42,10 +43,13 @@ class ElfReader
 	bool bRelocate;
 	u32 entryPoint;
 public:
-	ElfReader(void *ptr)
+	// The data isn't copied, so it can point straight into a mapped file. Size is only used for
+	// bounds checking.
+	ElfReader(void *ptr, size_t size_)
 	{
-		INFO_LOG(LOADER, "ElfReader: %p", ptr);
+		INFO_LOG(LOADER, "ElfReader: %p, %i bytes", ptr, (int)size_);
 		base = (char*)ptr;
+		size = size_;
 		base32 = (u32 *)ptr;
 		header = (Elf32_Ehdr*)ptr;
 		segments = (Elf32_Phdr *)(base + header->e_phoff);
@@ -15,20 +15,23 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
-extern "C"
-{
-#include "zlib.h"
-};
+#include <algorithm>
 
+#include "CPUDetect.h"
 #include "BlockDevices.h"
 
+#ifdef _WIN32
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#endif
+
 FileBlockDevice::FileBlockDevice(std::string _filename)
 : filename(_filename)
 {
 	f = fopen(_filename.c_str(), "rb");
-	fseek(f,0,SEEK_END);
-	filesize = ftell(f);
-	fseek(f,0,SEEK_SET);
+	fseeko(f,0,SEEK_END);
+	filesize = (size_t)ftello(f);
+	fseeko(f,0,SEEK_SET);
 }
 
 FileBlockDevice::~FileBlockDevice()
@@ -38,8 +41,17 @@ FileBlockDevice::~FileBlockDevice()
 
 bool FileBlockDevice::ReadBlock(int blockNumber, u8 *outPtr) 
 {
-	fseek(f, blockNumber * GetBlockSize(), SEEK_SET);
-	fread(outPtr, 2048, 1, f);
+	return ReadBlocks(blockNumber, 1, outPtr);
+}
+
+bool FileBlockDevice::ReadBlocks(u32 minBlock, int count, u8 *outPtr)
+{
+	fseeko(f, (s64)minBlock * GetBlockSize(), SEEK_SET);
+	if (fread(outPtr, GetBlockSize(), count, f) != (size_t)count)
+	{
+		ERROR_LOG(LOADER, "Could not read %i blocks at %i", count, minBlock);
+		return false;
+	}
 	return true;
 }
 
@@ -71,6 +83,14 @@ typedef struct ciso_header
 
 // TODO: Need much better error handling.
 
+enum
+{
+	// 512KB of decompressed blocks.
+	CSO_CACHE_BLOCKS = 256,
+	CSO_PREFETCH_BLOCKS = 64,
+	CSO_MAX_THREADS = 4,
+};
+
 CISOFileBlockDevice::CISOFileBlockDevice(std::string _filename)
 : filename(_filename)
 {
@@ -108,66 +128,257 @@ CISOFileBlockDevice::CISOFileBlockDevice(std::string _filename)
 
 	index = new u32[indexSize];
 	fread(index, 4, indexSize, f);
+
+	z = CISOWorkerPool::CreateInflater();
+
+	// The emulator thread has plenty to do, leave it a core.
+	int numThreads = std::min(std::max(cpu_info.num_cores - 1, 0), (int)CSO_MAX_THREADS);
+	pool = new CISOWorkerPool(numThreads);
+	cache.resize(CSO_CACHE_BLOCKS);
+	for (size_t i = 0; i < cache.size(); i++)
+	{
+		cache[i].block = -1;
+		cache[i].lastUse = 0;
+		cache[i].pending = false;
+		cache[i].data.resize(blockSize);
+	}
+	useCounter = 0;
+	nextSequentialBlock = 0xFFFFFFFF;
+	INFO_LOG(LOADER, "CSO: %i blocks, %i decompression threads", numBlocks, numThreads);
 }
 
 CISOFileBlockDevice::~CISOFileBlockDevice()
 {
+	for (size_t i = 0; i < cache.size(); i++)
+	{
+		if (cache[i].pending)
+			pool->Wait(&cache[i].job);
+	}
+	delete pool;
+	CISOWorkerPool::DestroyInflater(z);
 	fclose(f);
 	delete [] index;
 }
 
 bool CISOFileBlockDevice::ReadBlock(int blockNumber, u8 *outPtr) 
 {
-	u32 idx = index[blockNumber];
-	u32 idx2 = index[blockNumber+1];
-  u8 inbuffer[4096]; //too big
-  z_stream z;
-	
-	int plain = idx & 0x80000000;
-	
-	idx = (idx & 0x7FFFFFFF) << indexShift;
-	idx2 = (idx2 & 0x7FFFFFFF) << indexShift;
+	return ReadBlocks(blockNumber, 1, outPtr);
+}
 
-	u32 compressedReadPos = idx;
-	u32 compressedReadSize = idx2 - idx;
+// Reads the compressed data of blocks minBlock to endBlock (exclusive) into readBuffer. They're
+// stored in order, so that's one read.
+bool CISOFileBlockDevice::ReadCompressed(u32 minBlock, u32 endBlock)
+{
+	u32 firstPos = (index[minBlock] & 0x7FFFFFFF) << indexShift;
+	u32 endPos = (index[endBlock] & 0x7FFFFFFF) << indexShift;
+	if (endPos < firstPos)
+	{
+		ERROR_LOG(LOADER, "Bad CSO index at block %i", minBlock);
+		return false;
+	}
+	readBuffer.resize(endPos - firstPos + 1);
+	fseeko(f, firstPos, SEEK_SET);
+	if (fread(&readBuffer[0], 1, endPos - firstPos, f) != endPos - firstPos)
+	{
+		ERROR_LOG(LOADER, "Could not read blocks %i-%i of the CSO", minBlock, endBlock - 1);
+		return false;
+	}
+	return true;
+}
 
-	fseek(f, compressedReadPos, SEEK_SET);
-	fread(inbuffer, compressedReadSize, 1, f);
+bool CISOFileBlockDevice::ReadFromCache(int slot, u8 *outPtr)
+{
+	CacheSlot &cs = cache[slot];
+	if (cs.pending)
+	{
+		pool->Wait(&cs.job);
+		cs.pending = false;
+		if (!cs.job.ok)
+		{
+			ERROR_LOG(LOADER, "block %d: prefetched inflate failed", cs.block);
+			cachedBlocks.erase(cs.block);
+			cs.block = -1;
+			return false;
+		}
+	}
+	memcpy(outPtr, &cs.data[0], blockSize);
+	cs.lastUse = useCounter;
+	return true;
+}
 
-	if (plain)
+// The least recently used slot that isn't being inflated into, or -1 if they all are.
+int CISOFileBlockDevice::AllocCacheSlot()
+{
+	int best = -1;
+	for (int i = 0; i < (int)cache.size(); i++)
+	{
+		// Prefetched blocks that were never read still count as pending until checked here.
+		if (cache[i].pending)
+		{
+			if (!pool->IsDone(&cache[i].job))
+				continue;
+			cache[i].pending = false;
+			if (!cache[i].job.ok)
+			{
+				ERROR_LOG(LOADER, "block %d: prefetched inflate failed", cache[i].block);
+				cachedBlocks.erase(cache[i].block);
+				cache[i].block = -1;
+			}
+		}
+		if (best == -1 || cache[i].block == -1 || cache[i].lastUse < cache[best].lastUse)
+		{
+			best = i;
+			if (cache[i].block == -1)
+				break;
+		}
+	}
+	if (best != -1 && cache[best].block != -1)
 	{
-		memset(outPtr, 0, 2048);
-		memcpy(outPtr, inbuffer, compressedReadSize);
+		cachedBlocks.erase(cache[best].block);
+		cache[best].block = -1;
 	}
-	else
+	return best;
+}
+
+void CISOFileBlockDevice::Prefetch(u32 minBlock, u32 endBlock)
+{
+	endBlock = std::min(endBlock, (u32)numBlocks);
+	// Most of the window is usually already in flight from the last read.
+	while (minBlock < endBlock && cachedBlocks.find(minBlock) != cachedBlocks.end())
+		minBlock++;
+	if (minBlock >= endBlock || !ReadCompressed(minBlock, endBlock))
+		return;
+
+	u32 firstPos = (index[minBlock] & 0x7FFFFFFF) << indexShift;
+	for (u32 block = minBlock; block < endBlock; block++)
 	{
-		memset(outPtr, 0, 2048);
-		z.zalloc = Z_NULL;
-		z.zfree = Z_NULL;
-		z.opaque = Z_NULL;
-		if(inflateInit2(&z, -15) != Z_OK)
+		if (cachedBlocks.find(block) != cachedBlocks.end())
+			continue;
+		int slot = AllocCacheSlot();
+		if (slot == -1)
+			break;
+
+		u32 idx = index[block];
+		u32 idx2 = index[block + 1];
+		bool plain = (idx & 0x80000000) != 0;
+		idx = (idx & 0x7FFFFFFF) << indexShift;
+		idx2 = (idx2 & 0x7FFFFFFF) << indexShift;
+
+		CacheSlot &cs = cache[slot];
+		cs.block = block;
+		cs.lastUse = useCounter;
+		cachedBlocks[block] = slot;
+		if (plain)
 		{
-			ERROR_LOG(LOADER, "deflateInit ERROR : %s\n", (z.msg) ? z.msg : "???");
-			return 1;
+			// Alignment padding may follow the block.
+			u32 size = std::min(idx2 - idx, blockSize);
+			memcpy(&cs.data[0], &readBuffer[idx - firstPos], size);
+			memset(&cs.data[size], 0, blockSize - size);
+			continue;
 		}
-		z.avail_in = compressedReadSize;
-		z.next_out = outPtr;
-		z.avail_out = blockSize;
-		z.next_in = inbuffer;
-
-		int status = inflate(&z, Z_FULL_FLUSH);
-		if(status != Z_STREAM_END)
-			//if (status != Z_OK)
+
+		// The read buffer gets reused, so the job needs its own copy.
+		cs.compressed.assign(readBuffer.begin() + (idx - firstPos), readBuffer.begin() + (idx2 - firstPos));
+		cs.job.type = CISOWorkerPool::JOB_INFLATE;
+		cs.job.in = cs.compressed.empty() ? 0 : &cs.compressed[0];
+		cs.job.inSize = (u32)cs.compressed.size();
+		cs.job.out = &cs.data[0];
+		cs.job.outSize = blockSize;
+		cs.pending = true;
+		pool->Submit(&cs.job);
+	}
+}
+
+bool CISOFileBlockDevice::ReadBlocks(u32 minBlock, int count, u8 *outPtr)
+{
+	if (count <= 0)
+		return true;
+	if (minBlock + count > (u32)numBlocks)
+	{
+		ERROR_LOG(LOADER, "Read of blocks %i-%i past the end of the CSO", minBlock, minBlock + count - 1);
+		return false;
+	}
+	useCounter++;
+
+	// Whatever is cached first, then the rest in one read.
+	u32 firstMissing = 0xFFFFFFFF, endMissing = 0;
+	for (int i = 0; i < count; i++)
+	{
+		std::map<int, int>::iterator iter = cachedBlocks.find(minBlock + i);
+		if (iter != cachedBlocks.end() && ReadFromCache(iter->second, outPtr + i * blockSize))
+			continue;
+		firstMissing = std::min(firstMissing, minBlock + i);
+		endMissing = minBlock + i + 1;
+	}
+
+	bool ok = true;
+	if (endMissing != 0)
+	{
+		if (!ReadCompressed(firstMissing, endMissing))
+			return false;
+
+		u32 firstPos = (index[firstMissing] & 0x7FFFFFFF) << indexShift;
+		std::vector<CISOWorkerPool::Job> jobs;
+		jobs.reserve(endMissing - firstMissing);
+		for (u32 block = firstMissing; block < endMissing; block++)
 		{
-			ERROR_LOG(LOADER, "block %d:inflate : %s[%d]\n", blockNumber, (z.msg) ? z.msg : "error", status);
-			return 1;
+			if (cachedBlocks.find(block) != cachedBlocks.end())
+				continue;
+
+			u8 *out = outPtr + (block - minBlock) * blockSize;
+			u32 idx = index[block];
+			u32 idx2 = index[block + 1];
+			bool plain = (idx & 0x80000000) != 0;
+			idx = (idx & 0x7FFFFFFF) << indexShift;
+			idx2 = (idx2 & 0x7FFFFFFF) << indexShift;
+			u8 *in = &readBuffer[idx - firstPos];
+
+			if (plain)
+			{
+				// Alignment padding may follow the block.
+				u32 size = std::min(idx2 - idx, blockSize);
+				memcpy(out, in, size);
+				memset(out + size, 0, blockSize - size);
+			}
+			else if (endMissing - firstMissing == 1)
+			{
+				if (!CISOWorkerPool::InflateBlock(z, in, idx2 - idx, out, blockSize))
+				{
+					ERROR_LOG(LOADER, "block %d: inflate failed", block);
+					memset(out, 0, blockSize);
+					ok = false;
+				}
+			}
+			else
+			{
+				// Straight into the destination.
+				CISOWorkerPool::Job job;
+				job.type = CISOWorkerPool::JOB_INFLATE;
+				job.in = in;
+				job.inSize = idx2 - idx;
+				job.out = out;
+				job.outSize = blockSize;
+				jobs.push_back(job);
+				pool->Submit(&jobs.back());
+			}
 		}
-		int cmp_size = blockSize - z.avail_out;
-		if (cmp_size != (int)blockSize)
+		for (size_t i = 0; i < jobs.size(); i++)
 		{
-			ERROR_LOG(LOADER, "block %d : block size error %d != %d\n", blockNumber, cmp_size, blockSize);
-			return 1;
+			pool->Wait(&jobs[i]);
+			if (!jobs[i].ok)
+			{
+				ERROR_LOG(LOADER, "block %d: inflate failed", minBlock + (int)((jobs[i].out - outPtr) / blockSize));
+				memset(jobs[i].out, 0, blockSize);
+				ok = false;
+			}
 		}
 	}
-	return true;
+
+	// Reading on from where the last read ended, so the next blocks are probably wanted next.
+	bool sequential = minBlock == nextSequentialBlock;
+	nextSequentialBlock = minBlock + count;
+	if (sequential && pool->GetNumThreads() > 0)
+		Prefetch(minBlock + count, minBlock + count + CSO_PREFETCH_BLOCKS);
+
+	return ok;
 }
@@ -24,13 +24,30 @@
 // with CISO images.
 
 #include "../../Globals.h"
+#include <map>
 #include <string>
+#include <vector>
+
+#include "CISOWorkerPool.h"
+
+struct z_stream_s;
 
 class BlockDevice
 {
 public:
 	virtual ~BlockDevice() {}
 	virtual bool ReadBlock(int blockNumber, u8 *outPtr) = 0;
+	// Reads count consecutive blocks straight into outPtr. Devices that can do better than
+	// one block at a time override this.
+	virtual bool ReadBlocks(u32 minBlock, int count, u8 *outPtr)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			if (!ReadBlock(minBlock + i, outPtr + i * GetBlockSize()))
+				return false;
+		}
+		return true;
+	}
 	int GetBlockSize() const { return 2048;}  // forced, it cannot be changed by subclasses
 	virtual int GetNumBlocks() = 0;
 };
@@ -44,10 +61,40 @@ class CISOFileBlockDevice : public BlockDevice
 	int indexShift;
 	u32 blockSize;
 	int numBlocks;
+	// For single blocks, which aren't worth handing to another thread. Reset for each block
+	// rather than set up again.
+	z_stream_s *z;
+	// Compressed data for a whole ReadBlocks.
+	std::vector<u8> readBuffer;
+
+	// Reads that are more than one block are inflated on the pool, straight into the
+	// destination. When reads are sequential, the blocks after them are inflated ahead of
+	// time into the cache.
+	CISOWorkerPool *pool;
+	struct CacheSlot
+	{
+		int block;
+		u32 lastUse;
+		bool pending;
+		std::vector<u8> compressed;
+		std::vector<u8> data;
+		CISOWorkerPool::Job job;
+	};
+	// Never resized, pending jobs point into the slots.
+	std::vector<CacheSlot> cache;
+	std::map<int, int> cachedBlocks;
+	u32 useCounter;
+	u32 nextSequentialBlock;
+
+	bool ReadCompressed(u32 minBlock, u32 endBlock);
+	bool ReadFromCache(int slot, u8 *outPtr);
+	int AllocCacheSlot();
+	void Prefetch(u32 minBlock, u32 endBlock);
 public:
 	CISOFileBlockDevice(std::string _filename);
 	~CISOFileBlockDevice();
 	bool ReadBlock(int blockNumber, u8 *outPtr);
+	bool ReadBlocks(u32 minBlock, int count, u8 *outPtr);
 	int GetNumBlocks() { return numBlocks;}
 };
 
@@ -61,5 +108,6 @@ public:
 	FileBlockDevice(std::string _filename);
 	~FileBlockDevice();
 	bool ReadBlock(int blockNumber, u8 *outPtr);
+	bool ReadBlocks(u32 minBlock, int count, u8 *outPtr);
 	int GetNumBlocks() {return (int)(filesize/GetBlockSize());}
 };
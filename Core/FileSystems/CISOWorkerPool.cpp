@@ -0,0 +1,216 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+
+extern "C"
+{
+#include "zlib.h"
+};
+
+#include <cstdio>
+
+#include "Log.h"
+#include "Thread.h"
+#include "CISOWorkerPool.h"
+
+CISOWorkerPool::CISOWorkerPool(int numThreads, int deflateLevel_)
+	: quitting(false), deflateLevel(deflateLevel_), inflater(0), deflater(0)
+{
+	for (int i = 0; i < numThreads; i++)
+		workers.push_back(new std::thread(WorkerThread, this, i));
+}
+
+CISOWorkerPool::~CISOWorkerPool()
+{
+	{
+		std::unique_lock<std::mutex> lk(mutex);
+		quitting = true;
+	}
+	jobCond.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i]->join();
+		delete workers[i];
+	}
+	workers.clear();
+
+	if (inflater)
+		DestroyInflater(inflater);
+	if (deflater)
+		DestroyDeflater(deflater);
+}
+
+void CISOWorkerPool::Submit(Job *job)
+{
+	job->done = false;
+	job->ok = false;
+	job->resultSize = 0;
+
+	if (workers.empty())
+	{
+		if (job->type == JOB_INFLATE && !inflater)
+			inflater = CreateInflater();
+		if (job->type == JOB_DEFLATE && !deflater)
+			deflater = CreateDeflater(deflateLevel);
+		RunJob(job, inflater, deflater);
+		job->done = true;
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lk(mutex);
+		queue.push_back(job);
+	}
+	jobCond.notify_one();
+}
+
+void CISOWorkerPool::Wait(Job *job)
+{
+	std::unique_lock<std::mutex> lk(mutex);
+	while (!job->done)
+		doneCond.wait(lk);
+}
+
+bool CISOWorkerPool::IsDone(Job *job)
+{
+	std::unique_lock<std::mutex> lk(mutex);
+	return job->done;
+}
+
+void CISOWorkerPool::WorkerThread(CISOWorkerPool *pool, int index)
+{
+	char name[32];
+	sprintf(name, "CSO worker %i", index);
+	Common::SetCurrentThreadName(name);
+
+	// Made on first use, a pool that only inflates never needs the much bigger deflater.
+	z_stream_s *inflater = 0;
+	z_stream_s *deflater = 0;
+	while (true)
+	{
+		Job *job;
+		{
+			std::unique_lock<std::mutex> lk(pool->mutex);
+			while (!pool->quitting && pool->queue.empty())
+				pool->jobCond.wait(lk);
+			if (pool->quitting)
+				break;
+			job = pool->queue.front();
+			pool->queue.pop_front();
+		}
+
+		if (job->type == JOB_INFLATE && !inflater)
+			inflater = CreateInflater();
+		if (job->type == JOB_DEFLATE && !deflater)
+			deflater = CreateDeflater(pool->deflateLevel);
+		RunJob(job, inflater, deflater);
+
+		{
+			std::unique_lock<std::mutex> lk(pool->mutex);
+			job->done = true;
+		}
+		pool->doneCond.notify_all();
+	}
+
+	if (inflater)
+		DestroyInflater(inflater);
+	if (deflater)
+		DestroyDeflater(deflater);
+}
+
+void CISOWorkerPool::RunJob(Job *job, z_stream_s *inflater, z_stream_s *deflater)
+{
+	if (job->type == JOB_INFLATE)
+	{
+		job->ok = InflateBlock(inflater, job->in, job->inSize, job->out, job->outSize);
+		job->resultSize = job->ok ? job->outSize : 0;
+	}
+	else
+	{
+		job->resultSize = DeflateBlock(deflater, job->in, job->inSize, job->out, job->outSize);
+		job->ok = job->resultSize != 0;
+	}
+}
+
+z_stream_s *CISOWorkerPool::CreateInflater()
+{
+	z_stream *z = new z_stream;
+	z->zalloc = Z_NULL;
+	z->zfree = Z_NULL;
+	z->opaque = Z_NULL;
+	if (inflateInit2(z, -15) != Z_OK)
+		ERROR_LOG(LOADER, "inflateInit2 failed : %s", (z->msg) ? z->msg : "???");
+	return z;
+}
+
+z_stream_s *CISOWorkerPool::CreateDeflater(int level)
+{
+	z_stream *z = new z_stream;
+	z->zalloc = Z_NULL;
+	z->zfree = Z_NULL;
+	z->opaque = Z_NULL;
+	if (deflateInit2(z, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		ERROR_LOG(LOADER, "deflateInit2 failed : %s", (z->msg) ? z->msg : "???");
+	return z;
+}
+
+void CISOWorkerPool::DestroyInflater(z_stream_s *z)
+{
+	inflateEnd(z);
+	delete z;
+}
+
+void CISOWorkerPool::DestroyDeflater(z_stream_s *z)
+{
+	deflateEnd(z);
+	delete z;
+}
+
+bool CISOWorkerPool::InflateBlock(z_stream_s *z, const u8 *in, u32 inSize, u8 *out, u32 outSize)
+{
+	inflateReset(z);
+	z->avail_in = inSize;
+	z->next_in = (Bytef *)in;
+	z->avail_out = outSize;
+	z->next_out = out;
+
+	int status = inflate(z, Z_FULL_FLUSH);
+	if (status != Z_STREAM_END)
+	{
+		ERROR_LOG(LOADER, "inflate : %s[%d]", (z->msg) ? z->msg : "error", status);
+		return false;
+	}
+	if (z->avail_out != 0)
+	{
+		ERROR_LOG(LOADER, "block size error %d != %d", outSize - z->avail_out, outSize);
+		return false;
+	}
+	return true;
+}
+
+u32 CISOWorkerPool::DeflateBlock(z_stream_s *z, const u8 *in, u32 inSize, u8 *out, u32 outSize)
+{
+	deflateReset(z);
+	z->avail_in = inSize;
+	z->next_in = (Bytef *)in;
+	z->avail_out = outSize;
+	z->next_out = out;
+
+	if (deflate(z, Z_FINISH) != Z_STREAM_END)
+		return 0;
+	return outSize - z->avail_out;
+}
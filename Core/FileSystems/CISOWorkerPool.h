@@ -0,0 +1,94 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "../../Globals.h"
+#include "StdMutex.h"
+#include "StdConditionVariable.h"
+#include "StdThread.h"
+
+struct z_stream_s;
+
+// Inflates and deflates CSO blocks on a few threads. Each thread keeps its own zlib streams and
+// just resets them between blocks. Jobs are independent, the owner submits them and waits for
+// each one. With no threads, Submit does the work right away.
+class CISOWorkerPool
+{
+public:
+	enum JobType
+	{
+		JOB_INFLATE,
+		JOB_DEFLATE,
+	};
+
+	struct Job
+	{
+		JobType type;
+		const u8 *in;
+		u32 inSize;
+		u8 *out;
+		// Inflate: the exact size the block must come out as. Deflate: the room in out, the
+		// block is stored plain if it doesn't compress to less than that.
+		u32 outSize;
+
+		// Set when done.
+		u32 resultSize;
+		bool ok;
+		bool done;
+	};
+
+	CISOWorkerPool(int numThreads, int deflateLevel = 9);
+	~CISOWorkerPool();
+
+	int GetNumThreads() const { return (int)workers.size(); }
+
+	// The job must stay put until it's been waited for.
+	void Submit(Job *job);
+	void Wait(Job *job);
+	// Like Wait, but just checks.
+	bool IsDone(Job *job);
+
+	// Raw deflate streams, as CSO uses, for doing a block on the calling thread.
+	static z_stream_s *CreateInflater();
+	static z_stream_s *CreateDeflater(int level);
+	static void DestroyInflater(z_stream_s *z);
+	static void DestroyDeflater(z_stream_s *z);
+	static bool InflateBlock(z_stream_s *z, const u8 *in, u32 inSize, u8 *out, u32 outSize);
+	// Returns the compressed size, or 0 if it didn't fit in outSize.
+	static u32 DeflateBlock(z_stream_s *z, const u8 *in, u32 inSize, u8 *out, u32 outSize);
+
+private:
+	static void WorkerThread(CISOWorkerPool *pool, int index);
+	static void RunJob(Job *job, z_stream_s *inflater, z_stream_s *deflater);
+
+	std::vector<std::thread *> workers;
+	std::deque<Job *> queue;
+	std::mutex mutex;
+	std::condition_variable jobCond;
+	std::condition_variable doneCond;
+	bool quitting;
+	int deflateLevel;
+
+	// For Submit when there are no threads.
+	z_stream_s *inflater;
+	z_stream_s *deflater;
+};
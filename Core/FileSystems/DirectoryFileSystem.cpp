@@ -111,7 +111,11 @@ u32 DirectoryFileSystem::OpenFile(std::string filename, FileAccess access)
 	entry.hFile = CreateFile(fullName.c_str(), desired, sharemode, 0, openmode, 0, 0);
 	bool success = entry.hFile != INVALID_HANDLE_VALUE;
 #else
-  entry.hFile = fopen(fullName.c_str(), access & FILEACCESS_WRITE ? "wb" : "rb");
+  // Like OPEN_EXISTING above, only truncate when creating.
+  const char *mode = "rb";
+  if (access & FILEACCESS_WRITE)
+    mode = (access & FILEACCESS_CREATE) ? "wb" : "r+b";
+  entry.hFile = fopen(fullName.c_str(), mode);
   bool success = entry.hFile != 0;
 #endif
 
@@ -15,6 +15,9 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <algorithm>
+#include <cctype>
+
 #include "Globals.h"
 #include "Log.h"
 #include "ISOFileSystem.h"
@@ -129,11 +132,70 @@ ISOFileSystem::ISOFileSystem(IHandleAllocator *_hAlloc, BlockDevice *_blockDevic
 	u32 rootSize = desc.root.dataLengthLE;
 
 	ReadDirectory(rootSector, rootSize, treeroot);
+	BuildIndex();
 }
 
 ISOFileSystem::~ISOFileSystem()
 {
 	delete blockDevice;
+	delete treeroot;
+}
+
+// FNV-1a, on lower case.
+static u32 HashPath(const std::string &path)
+{
+	u32 hash = 2166136261U;
+	for (size_t i = 0; i < path.size(); i++)
+		hash = (hash ^ (u8)tolower((u8)path[i])) * 16777619U;
+	return hash;
+}
+
+void ISOFileSystem::IndexDirectory(TreeEntry *dir, std::vector<TreeEntry *> &all)
+{
+	for (size_t i = 0; i < dir->children.size(); i++)
+	{
+		TreeEntry *e = dir->children[i];
+		e->fullPath = dir == treeroot ? e->name : dir->fullPath + "/" + e->name;
+		all.push_back(e);
+		if (e->isDirectory)
+			IndexDirectory(e, all);
+	}
+}
+
+void ISOFileSystem::BuildIndex()
+{
+	std::vector<TreeEntry *> all;
+	IndexDirectory(treeroot, all);
+
+	size_t size = 16;
+	while (size < all.size() * 2)
+		size *= 2;
+	PathIndexEntry empty = {0, 0};
+	pathIndex.assign(size, empty);
+
+	for (size_t i = 0; i < all.size(); i++)
+	{
+		TreeEntry *e = all[i];
+		u32 hash = HashPath(e->fullPath);
+		size_t slot;
+		for (slot = hash & (size - 1); pathIndex[slot].entry; slot = (slot + 1) & (size - 1))
+		{
+			// The first one wins, like it would walking the tree.
+			if (pathIndex[slot].hash == hash && !strcasecmp(pathIndex[slot].entry->fullPath.c_str(), e->fullPath.c_str()))
+				break;
+		}
+		if (!pathIndex[slot].entry)
+		{
+			pathIndex[slot].hash = hash;
+			pathIndex[slot].entry = e;
+		}
+
+		if (!e->isDirectory && e->size > 0)
+			filesBySector.push_back(e);
+	}
+	std::stable_sort(filesBySector.begin(), filesBySector.end(), CompareStartingPosition);
+
+	INFO_LOG(FILESYS, "Indexed %i files and directories", (int)all.size());
 }
 
 void ISOFileSystem::ReadDirectory(u32 startsector, u32 dirsize, TreeEntry *root)
@@ -212,46 +274,53 @@ ISOFileSystem::TreeEntry *ISOFileSystem::GetFromPath(std::string path)
 		return &entireISO;
 	}
 
-	if (path[0] == '/')
-		path.erase(0,1);
+	// Same form as fullPath: no leading, trailing or doubled slashes.
+	std::string normalized;
+	normalized.reserve(path.size());
+	for (size_t i = 0; i < path.size(); i++)
+	{
+		if (path[i] == '/' && (normalized.empty() || normalized[normalized.size() - 1] == '/'))
+			continue;
+		normalized += path[i];
+	}
+	if (!normalized.empty() && normalized[normalized.size() - 1] == '/')
+		normalized.resize(normalized.size() - 1);
 
-	TreeEntry *e = treeroot;
-	if (path.length() == 0)
-		return e;
+	if (normalized.empty())
+		return treeroot;
 
-	while (true)
+	u32 hash = HashPath(normalized);
+	size_t mask = pathIndex.size() - 1;
+	for (size_t slot = hash & mask; pathIndex[slot].entry; slot = (slot + 1) & mask)
 	{
-		TreeEntry *ne = 0;
-		std::string name = "";
-		if (path.length()>0)
-		{
-			for (size_t i=0; i<e->children.size(); i++)
-			{
-				std::string n = e->children[i]->name;
-				if (path.compare(0, n.length(), n) == 0) //TODO : bad
-				{
-					//yay we got it
-					ne = e->children[i];
-					name = n;
-					break;
-				}
-			}
-		}
-		if (ne)
-		{
-			e = ne;
-			size_t l = name.length();
-			path.erase(0, l);
-			if (path.length() == 0 || (path.length()==1 && path[0] == '/'))
-				return e;
-			path.erase(0, 1);
-		}
+		const PathIndexEntry &pe = pathIndex[slot];
+		if (pe.hash == hash && !strcasecmp(pe.entry->fullPath.c_str(), normalized.c_str()))
+			return pe.entry;
+	}
+
+	ERROR_LOG(FILESYS,"File %s not found", path.c_str());
+	return 0;
+}
+
+ISOFileSystem::TreeEntry *ISOFileSystem::GetFromSector(u32 sector)
+{
+	u64 pos = (u64)sector * 2048;
+	// The last file starting at or before the sector.
+	size_t lo = 0, hi = filesBySector.size();
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (filesBySector[mid]->startingPosition <= pos)
+			lo = mid + 1;
 		else
-		{
-			ERROR_LOG(FILESYS,"File %s not found", path.c_str());
-			return 0;
-		}
+			hi = mid;
 	}
+	if (lo == 0)
+		return 0;
+	TreeEntry *e = filesBySector[lo - 1];
+	if (pos < (u64)e->startingPosition + e->size)
+		return e;
+	return 0;
 }
 
 u32 ISOFileSystem::OpenFile(std::string filename, FileAccess access)
@@ -265,7 +334,8 @@ u32 ISOFileSystem::OpenFile(std::string filename, FileAccess access)
 		sscanf(filename.c_str(), "%08x", &sectorStart);
 		filename.erase(0,filename.find('_') + 5);
 		sscanf(filename.c_str(), "%08x", &readSize);
-		INFO_LOG(FILESYS, "Got a raw sector read %s, sector %08x, size %08x", yo.c_str(), sectorStart, readSize);
+		TreeEntry *file = GetFromSector(sectorStart);
+		INFO_LOG(FILESYS, "Got a raw sector read %s, sector %08x, size %08x (%s)", yo.c_str(), sectorStart, readSize, file ? file->fullPath.c_str() : "not in a file");
 		u32 newHandle = hAlloc->GetNewHandle();
 		entry.seekPos = 0;
 		entry.file = 0;
@@ -328,12 +398,12 @@ size_t ISOFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size)
 		if (e.file != 0 && e.file->isBlockSectorMode)
 		{
 			// Whole sectors! Shortcut to this simple code.
-			for (int i = 0; i < size; i++)
-			{
-				blockDevice->ReadBlock(e.seekPos, pointer + i * 2048);
-				e.seekPos++;
-			}
-			return size;
+			if (e.seekPos + size > (s64)blockDevice->GetNumBlocks())
+				size = std::max((s64)blockDevice->GetNumBlocks() - (s64)e.seekPos, (s64)0);
+			if (size > 0)
+				blockDevice->ReadBlocks(e.seekPos, (int)size, pointer);
+			e.seekPos += (u32)size;
+			return (size_t)size;
 		}
 
 		u32 position;
@@ -364,7 +434,9 @@ size_t ISOFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size)
 
 		u8 theSector[2048];
 
-		while (remain > 0)
+		// Only a partial first or last sector goes through theSector, all the whole ones in
+		// between are read in one go straight into the destination.
+		if (remain > 0 && (posInSector != 0 || remain < 2048))
 		{
 			blockDevice->ReadBlock(secNum, theSector);
 			size_t bytesToCopy = 2048-posInSector;
@@ -375,9 +447,25 @@ size_t ISOFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size)
 			totalRead += (u32)bytesToCopy;
 			pointer += bytesToCopy;
 			remain -= bytesToCopy;
-			posInSector = 0;
 			secNum++;
 		}
+
+		int wholeSectors = (int)(remain / 2048);
+		if (wholeSectors > 0)
+		{
+			blockDevice->ReadBlocks(secNum, wholeSectors, pointer);
+			totalRead += wholeSectors * 2048;
+			pointer += wholeSectors * 2048;
+			remain -= wholeSectors * 2048;
+			secNum += wholeSectors;
+		}
+
+		if (remain > 0)
+		{
+			blockDevice->ReadBlock(secNum, theSector);
+			memcpy(pointer, theSector, (size_t)remain);
+			totalRead += (u32)remain;
+		}
 		e.seekPos += size;
 		return totalRead;
 	}
@@ -473,7 +561,7 @@ std::vector<PSPFileInfo> ISOFileSystem::GetDirListing(std::string path)
 		x.size = e->size;
 		x.type = e->isDirectory ? FILETYPE_DIRECTORY : FILETYPE_NORMAL;
 		x.isOnSectorSystem = true;
-		x.startSector = entry->startingPosition/2048;
+		x.startSector = e->startingPosition/2048;
 		myVector.push_back(x);
 	}
 	return myVector;
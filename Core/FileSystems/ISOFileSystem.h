@@ -38,6 +38,8 @@ class ISOFileSystem : public IFileSystem
 		}
 
 		std::string name;
+		// From the root, without the leading slash.
+		std::string fullPath;
 		u32 flags;
 		u32 startingPosition;
 		s64 size;
@@ -65,8 +67,23 @@ class ISOFileSystem : public IFileSystem
 
 	TreeEntry entireISO;
 
+	// Every file and directory by full path, hashed and compared case insensitively like the
+	// PSP does. Open addressing, built once after the directories are read.
+	struct PathIndexEntry
+	{
+		u32 hash;
+		TreeEntry *entry;
+	};
+	std::vector<PathIndexEntry> pathIndex;
+	// Files sorted by where they start, for finding the file a sector belongs to.
+	std::vector<TreeEntry *> filesBySector;
+	static bool CompareStartingPosition(const TreeEntry *a, const TreeEntry *b) { return a->startingPosition < b->startingPosition; }
+
 	void ReadDirectory(u32 startsector, u32 dirsize, TreeEntry *root);
+	void IndexDirectory(TreeEntry *dir, std::vector<TreeEntry *> &all);
+	void BuildIndex();
 	TreeEntry *GetFromPath(std::string path);
+	TreeEntry *GetFromSector(u32 sector);
 
 public:
 	ISOFileSystem(IHandleAllocator *_hAlloc, BlockDevice *_blockDevice);
@@ -16,6 +16,7 @@
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
 #include <set>
+#include "ChunkFile.h"
 #include "MetaFileSystem.h"
 
 IFileSystem *MetaFileSystem::GetHandleOwner(u32 handle)
@@ -197,3 +198,8 @@ size_t MetaFileSystem::SeekFile(u32 handle, s32 position, FileMove type)
 		return 0;
 }
 
+void MetaFileSystem::DoState(PointerWrap &p)
+{
+	p.Do(currentDirectory);
+	p.DoMarker("MetaFileSystem");
+}
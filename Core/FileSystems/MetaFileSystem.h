@@ -19,6 +19,8 @@
 
 #include "FileSystem.h"
 
+class PointerWrap;
+
 class MetaFileSystem : public IHandleAllocator, public IFileSystem
 {
 public:
@@ -63,6 +65,9 @@ public:
 	void SetCurrentDirectory(const std::string &dir) {
 		currentDirectory = dir;
 	}
+
+	// Only the current directory, open files are reopened by their owners.
+	void DoState(PointerWrap &p);
 private:
 	u32 current;
 	struct System
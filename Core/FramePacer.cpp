@@ -0,0 +1,183 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstring>
+
+#include "base/timeutil.h"
+
+#include "../GPU/GPUInterface.h"
+#include "Config.h"
+#include "CoreTiming.h"
+#include "FramePacer.h"
+
+namespace FramePacer
+{
+
+// (9MHz * 1)/(525 * 286)
+static const double FRAME_SECONDS = 1.0 / 59.9400599;
+// Skipping more than this many frames in a row makes the game look frozen.
+static const int MAX_CONSECUTIVE_SKIPS = 4;
+// After a stall this long (loading, the debugger...) don't try to catch up.
+static const double MAX_LAG_SECONDS = 0.25;
+
+// STATE BEGIN
+static double nextFrameTime;
+static double frameStartTime;
+static double timingStart[FRAMETIMING_COUNT];
+static double timingTotal[FRAMETIMING_COUNT];
+
+static bool skipping;
+static int consecutiveSkips;
+static int skippedFrames;
+
+static FrameTimings lastTimings;
+static u64 frameStartTicks;
+static u64 frameStartIdleTicks;
+
+static double fpsStartTime;
+static int fpsFrameCount;
+static float actualFps;
+// STATE END
+
+void Init()
+{
+	double now = real_time_now();
+	nextFrameTime = now;
+	frameStartTime = now;
+	memset(timingStart, 0, sizeof(timingStart));
+	memset(timingTotal, 0, sizeof(timingTotal));
+	memset(&lastTimings, 0, sizeof(lastTimings));
+	frameStartTicks = CoreTiming::GetTicks();
+	frameStartIdleTicks = CoreTiming::GetIdleTicks();
+
+	skipping = false;
+	consecutiveSkips = 0;
+	skippedFrames = 0;
+	if (gpu)
+		gpu->SetSkipDrawing(false);
+
+	fpsStartTime = now;
+	fpsFrameCount = 0;
+	actualFps = 0.0f;
+}
+
+void BeginTiming(FrameTimingCategory category)
+{
+	timingStart[category] = real_time_now();
+}
+
+void EndTiming(FrameTimingCategory category)
+{
+	timingTotal[category] += real_time_now() - timingStart[category];
+}
+
+void EndFrame()
+{
+	double now = real_time_now();
+	bool throttle = g_Config.bSpeedLimit;
+
+	nextFrameTime += FRAME_SECONDS;
+	double throttleTime = 0.0;
+	if (throttle && now < nextFrameTime)
+	{
+		int ms = (int)((nextFrameTime - now) * 1000.0);
+		if (ms > 0)
+			sleep_ms(ms);
+		double wokeUp = real_time_now();
+		throttleTime = wokeUp - now;
+		now = wokeUp;
+	}
+
+	bool late = now > nextFrameTime;
+	// Unthrottled, never bank time when running fast. Either way, give up on catching up after a long stall.
+	if (now - nextFrameTime > MAX_LAG_SECONDS || (!throttle && nextFrameTime > now))
+	{
+		nextFrameTime = now;
+		late = false;
+	}
+
+	lastTimings.ge = timingTotal[FRAMETIMING_GE];
+	lastTimings.present = timingTotal[FRAMETIMING_PRESENT];
+	lastTimings.throttle = throttleTime;
+	lastTimings.total = now - frameStartTime;
+	lastTimings.cpu = lastTimings.total - lastTimings.ge - lastTimings.present - lastTimings.throttle;
+	if (lastTimings.cpu < 0.0)
+		lastTimings.cpu = 0.0;
+	lastTimings.skipped = skipping;
+
+	u64 ticks = CoreTiming::GetTicks();
+	u64 idleTicks = CoreTiming::GetIdleTicks();
+	lastTimings.cycles = (s64)(ticks - frameStartTicks);
+	lastTimings.idledCycles = (s64)(idleTicks - frameStartIdleTicks);
+	frameStartTicks = ticks;
+	frameStartIdleTicks = idleTicks;
+
+	DEBUG_LOG(HLE, "Frame: %.2fms (cpu %.2f, ge %.2f, present %.2f, throttle %.2f), %lld of %lld cycles idled%s",
+		lastTimings.total * 1000.0, lastTimings.cpu * 1000.0, lastTimings.ge * 1000.0,
+		lastTimings.present * 1000.0, lastTimings.throttle * 1000.0,
+		(long long)lastTimings.idledCycles, (long long)lastTimings.cycles, skipping ? " skipped" : "");
+
+	memset(timingTotal, 0, sizeof(timingTotal));
+	frameStartTime = now;
+
+	fpsFrameCount++;
+	if (now - fpsStartTime >= 1.0)
+	{
+		actualFps = (float)(fpsFrameCount / (now - fpsStartTime));
+		fpsFrameCount = 0;
+		fpsStartTime = now;
+	}
+
+	// Now decide about the next frame.
+	bool skipNext = g_Config.bAutoFrameSkip && late && consecutiveSkips < MAX_CONSECUTIVE_SKIPS;
+	if (skipNext)
+	{
+		consecutiveSkips++;
+		skippedFrames++;
+	}
+	else
+		consecutiveSkips = 0;
+
+	if (skipNext != skipping)
+	{
+		skipping = skipNext;
+		if (gpu)
+			gpu->SetSkipDrawing(skipping);
+	}
+}
+
+bool IsSkippingFrame()
+{
+	return skipping;
+}
+
+const FrameTimings &GetLastFrameTimings()
+{
+	return lastTimings;
+}
+
+float GetActualFPS()
+{
+	return actualFps;
+}
+
+int GetSkippedFrames()
+{
+	return skippedFrames;
+}
+
+}  // namespace FramePacer
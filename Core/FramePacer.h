@@ -0,0 +1,72 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include "../Globals.h"
+
+// Keeps emulated vblanks in step with host time.
+//
+// Called once per emulated vblank. When throttling, it sleeps the emulation thread so that frames
+// are presented at the PSP's 59.94Hz. With auto frameskip enabled, it tells the GPU to skip drawing
+// (but not state updates) for the next frame whenever we're running behind.
+//
+// It also keeps track of where the host time of each frame went, see FrameTimings.
+
+enum FrameTimingCategory
+{
+	FRAMETIMING_GE,       // Display list processing.
+	FRAMETIMING_PRESENT,  // Showing the frame on the host, including waiting for the swap.
+	FRAMETIMING_COUNT,
+};
+
+struct FrameTimings
+{
+	// All in seconds of host time. cpu is whatever is left of the frame after the others,
+	// mostly emulated CPU and HLE. throttle is the time spent sleeping to hold the frame rate.
+	double cpu;
+	double ge;
+	double present;
+	double throttle;
+	double total;
+	bool skipped;
+
+	// Emulated CPU cycles in the frame, and how many of them were skipped by idling.
+	s64 cycles;
+	s64 idledCycles;
+};
+
+namespace FramePacer
+{
+
+void Init();
+
+// Called at each vblank, after the frame has been presented.
+void EndFrame();
+
+// Whether drawing is currently being skipped.
+bool IsSkippingFrame();
+
+void BeginTiming(FrameTimingCategory category);
+void EndTiming(FrameTimingCategory category);
+
+const FrameTimings &GetLastFrameTimings();
+// Averaged over the last second or so.
+float GetActualFPS();
+int GetSkippedFrames();
+
+}  // namespace FramePacer
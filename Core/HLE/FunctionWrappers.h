@@ -84,3 +84,33 @@ template<u32 func(u32, u32, u32, u32, u32, u32)> void WrapU_UUUUUU() {
   u32 retval = func(PARAM(0), PARAM(1), PARAM(2), PARAM(3), PARAM(4), PARAM(5));
   RETURN(retval);
 }
+
+template<u32 func(u32, int)> void WrapU_UI() {
+  u32 retval = func(PARAM(0), PARAM(1));
+  RETURN(retval);
+}
+
+template<u32 func(u32, int, int)> void WrapU_UII() {
+  u32 retval = func(PARAM(0), PARAM(1), PARAM(2));
+  RETURN(retval);
+}
+
+template<u32 func(u32, u32, int)> void WrapU_UUI() {
+  u32 retval = func(PARAM(0), PARAM(1), PARAM(2));
+  RETURN(retval);
+}
+
+template<u32 func(u32, int, u32, int, int)> void WrapU_UIUII() {
+  u32 retval = func(PARAM(0), PARAM(1), PARAM(2), PARAM(3), PARAM(4));
+  RETURN(retval);
+}
+
+template<u32 func(u32, int, int, int, int, int)> void WrapU_UIIIII() {
+  u32 retval = func(PARAM(0), PARAM(1), PARAM(2), PARAM(3), PARAM(4), PARAM(5));
+  RETURN(retval);
+}
+
+template<u32 func(u32, int, int, int, int, int, int)> void WrapU_UIIIIII() {
+  u32 retval = func(PARAM(0), PARAM(1), PARAM(2), PARAM(3), PARAM(4), PARAM(5), PARAM(6));
+  RETURN(retval);
+}
@@ -29,14 +29,102 @@
 
 static std::vector<HLEModule> moduleDB;
 
+// Open addressing hash table over every (module, NID), and every module by name with
+// funcIndex -1. Imports are resolved through this at load time, hundreds of them per game.
+struct HLELookupEntry
+{
+	u32 hash;
+	u32 nib;
+	int moduleIndex;
+	int funcIndex;
+};
+
+static std::vector<HLELookupEntry> lookupTable;
+static u32 lookupCount;
+
+static const int HLE_LOOKUP_EMPTY = -1;
+
+static u32 HashModuleName(const char *name)
+{
+	// FNV-1a
+	u32 hash = 2166136261U;
+	for (const char *p = name; *p; p++)
+		hash = (hash ^ (u8)*p) * 16777619U;
+	return hash;
+}
+
+static u32 LookupSlot(u32 nameHash, u32 nib, bool module)
+{
+	u32 hash = module ? nameHash : nameHash ^ (nib * 0x9E3779B1U);
+	return (hash ^ (hash >> 15)) & (u32)(lookupTable.size() - 1);
+}
+
+static const HLELookupEntry *LookupFind(const char *name, u32 nib, bool module)
+{
+	if (lookupTable.empty())
+		return 0;
+
+	u32 nameHash = HashModuleName(name);
+	u32 mask = (u32)lookupTable.size() - 1;
+	for (u32 slot = LookupSlot(nameHash, nib, module); ; slot = (slot + 1) & mask)
+	{
+		const HLELookupEntry &e = lookupTable[slot];
+		if (e.moduleIndex == HLE_LOOKUP_EMPTY)
+			return 0;
+		if (e.hash == nameHash && (e.funcIndex == -1) == module && (module || e.nib == nib) &&
+			!strcmp(moduleDB[e.moduleIndex].name, name))
+			return &e;
+	}
+}
+
+// Keeps the first one, like a search through the function table would.
+static void LookupInsert(const HLELookupEntry &entry)
+{
+	const HLEModule &m = moduleDB[entry.moduleIndex];
+	bool module = entry.funcIndex == -1;
+	if (LookupFind(m.name, entry.nib, module))
+		return;
+
+	u32 mask = (u32)lookupTable.size() - 1;
+	u32 slot = LookupSlot(entry.hash, entry.nib, module);
+	while (lookupTable[slot].moduleIndex != HLE_LOOKUP_EMPTY)
+		slot = (slot + 1) & mask;
+	lookupTable[slot] = entry;
+	lookupCount++;
+}
+
+// Keeps the table at most half full.
+static void LookupReserve(u32 count)
+{
+	size_t size = lookupTable.empty() ? 1024 : lookupTable.size();
+	while (count * 2 > size)
+		size *= 2;
+	if (size == lookupTable.size())
+		return;
+
+	std::vector<HLELookupEntry> old;
+	old.swap(lookupTable);
+	HLELookupEntry empty = {0, 0, HLE_LOOKUP_EMPTY, -1};
+	lookupTable.assign(size, empty);
+	lookupCount = 0;
+	for (size_t i = 0; i < old.size(); i++)
+	{
+		if (old[i].moduleIndex != HLE_LOOKUP_EMPTY)
+			LookupInsert(old[i]);
+	}
+}
+
 void HLEInit()
 {
 	RegisterAllModules();
+	INFO_LOG(HLE, "Registered %i HLE modules, %i lookup entries", (int)moduleDB.size(), lookupCount);
 }
 
 void HLEShutdown()
 {
 	moduleDB.clear();
+	lookupTable.clear();
+	lookupCount = 0;
 }
 
 /*
@@ -69,25 +157,32 @@ void RegisterModule(const char *name, int numFunctions, const HLEFunction *funcT
 {
 	HLEModule module = {name, numFunctions, funcTable};
 	moduleDB.push_back(module);
+
+	LookupReserve(lookupCount + numFunctions + 1);
+	HLELookupEntry entry;
+	entry.hash = HashModuleName(name);
+	entry.moduleIndex = (int)moduleDB.size() - 1;
+	entry.nib = 0;
+	entry.funcIndex = -1;
+	LookupInsert(entry);
+	for (int i = 0; i < numFunctions; i++)
+	{
+		entry.nib = funcTable[i].ID;
+		entry.funcIndex = i;
+		LookupInsert(entry);
+	}
 }
 
 int GetModuleIndex(const char *moduleName)
 {
-	for (size_t i = 0; i < moduleDB.size(); i++)
-		if (strcmp(moduleName, moduleDB[i].name) == 0)
-			return (int)i;
-	return -1;
+	const HLELookupEntry *e = LookupFind(moduleName, 0, true);
+	return e ? e->moduleIndex : -1;
 }
 
 int GetFuncIndex(int moduleIndex, u32 nib)
 {
-	const HLEModule &module = moduleDB[moduleIndex];
-	for (int i = 0; i < module.numFunctions; i++)
-	{
-		if (module.funcTable[i].ID == nib)
-			return i;
-	}
-	return -1;
+	const HLELookupEntry *e = LookupFind(moduleDB[moduleIndex].name, nib, false);
+	return e ? e->funcIndex : -1;
 }
 
 u32 GetNibByName(const char *moduleName, const char *function)
@@ -104,13 +199,9 @@ u32 GetNibByName(const char *moduleName, const char *function)
 
 const HLEFunction *GetFunc(const char *moduleName, u32 nib)
 {
-	int moduleIndex = GetModuleIndex(moduleName);
-	if (moduleIndex != -1)
-	{
-		int idx = GetFuncIndex(moduleIndex, nib);
-		if (idx != -1)
-			return &(moduleDB[moduleIndex].funcTable[idx]);
-	}
+	const HLELookupEntry *e = LookupFind(moduleName, nib, false);
+	if (e)
+		return &(moduleDB[e->moduleIndex].funcTable[e->funcIndex]);
 	return 0;
 }
 
@@ -129,18 +220,14 @@ const char *GetFuncName(const char *moduleName, u32 nib)
 
 u32 GetSyscallOp(const char *moduleName, u32 nib)
 {
+	const HLELookupEntry *e = LookupFind(moduleName, nib, false);
+	if (e)
+		return (0x0000000c | (e->moduleIndex<<18) | (e->funcIndex<<6));
+
 	int modindex = GetModuleIndex(moduleName);
 	if (modindex != -1)
 	{
-		int funcindex = GetFuncIndex(modindex, nib);
-		if (funcindex != -1)
-		{
-			return (0x0000000c | (modindex<<18) | (funcindex<<6));
-		}
-		else
-		{
-			return (0x0003FFCC | (modindex<<18));  // invalid syscall
-		}
+		return (0x0003FFCC | (modindex<<18));  // invalid syscall
 	}
 	else
 	{
@@ -166,7 +253,7 @@ const char *GetFuncName(int moduleIndex, int func)
 	if (moduleIndex >= 0 && moduleIndex < (int)moduleDB.size())
 	{
 		const HLEModule &module = moduleDB[moduleIndex];
-		if (func>=0 && func <= module.numFunctions)
+		if (func>=0 && func < module.numFunctions)
 		{
 			return module.funcTable[func].name;
 		}
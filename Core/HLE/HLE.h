@@ -69,7 +69,3 @@ u32 GetSyscallOp(const char *module, u32 nib);
 void WriteSyscall(const char *module, u32 nib, u32 address);
 void CallSyscall(u32 op);
 
-// Need to be able to save entire kernel state
-int GetStateSize();
-void SaveState(u8 *ptr);
-void LoadState(const u8 *ptr);
@@ -15,53 +15,211 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <algorithm>
+#include <cstring>
+
 #include "__sceAudio.h"
 #include "sceAudio.h"
 #include "sceKernel.h"
 #include "sceKernelThread.h"
-#include "StdMutex.h"
 #include "CommonTypes.h"
+#include "Atomic.h"
 #include "../CoreTiming.h"
 #include "../MemMap.h"
 #include "../Host.h"
 
-// While buffers == MAX_BUFFERS, block on blocking write
-// non-blocking writes will return busy, I guess
-
-#define MAX_BUFFERS 2
-#define MIN_BUFFERS 1
+#if !defined(ANDROID) && (defined(_M_X64) || (defined(_M_IX86) && (defined(_MSC_VER) || defined(__SSE2__))))
+#define AUDIO_SSE2
+#include <emmintrin.h>
+#endif
 
-std::recursive_mutex section;
+// Channels are mixed on the emu thread, a block at a time as emulated time passes, into
+// outRing. The host's audio callback (__AudioMix) only copies out of outRing, so it never
+// takes a lock or touches the channels.
+//
+// Mixing is driven only by CoreTiming, one hardware sized block at a time, so what gets
+// mixed (and when waiting threads wake up) depends on emulated time alone and is the same
+// on every run. The host side absorbs the drift between emulated and real time by
+// resampling slightly to keep outRing at a steady fill level.
 
 int eventAudioUpdate = -1;
 
-const int audioIntervalMs = 20;
+const int audioSampleRate = 44100;
+// Stereo frames mixed per update, the PSP outputs in multiples of this.
+const int mixBlockSize = 64;
+
+// Cycles per block don't divide evenly, the remainder (in 1/audioSampleRate cycles) is
+// carried over so that the output rate is exact over time.
+static int mixCycleRemainder = 0;
+
+static AudioDumpCallback dumpCallback = 0;
+
+// Single producer (emu thread), single consumer (host audio thread) ring of stereo s16.
+// Holds ~185ms, anything beyond that is dropped as the host isn't keeping up.
+const u32 outRingFrames = 8192;
+static s16 outRing[outRingFrames * 2];
+// Frame counters, only ever increase (wrapping). Written by one side each.
+static volatile u32 outRingHead = 0;
+static volatile u32 outRingTail = 0;
+
+static s32 mixBuffer[mixBlockSize * 2];
+static s16 chanBuffer[mixBlockSize * 2];
+static s16 mixOutput[mixBlockSize * 2];
+
+// PSP volumes go from 0 to 0x8000 (unity), but up to 0xFFFF is accepted. Halved here so
+// that they fit a signed 16-bit multiply, with 0x4000 as unity.
+static inline int AdjustVolume(int vol)
+{
+	if (vol < 0)
+		return 0;
+	if (vol > 0xFFFF)
+		vol = 0xFFFF;
+	return vol >> 1;
+}
+
+static void MixChannel(s32 *mix, const s16 *samples, int numFrames, int leftVol, int rightVol)
+{
+	int i = 0;
+#ifdef AUDIO_SSE2
+	const __m128i vol = _mm_set_epi16(rightVol, leftVol, rightVol, leftVol, rightVol, leftVol, rightVol, leftVol);
+	for (; i + 4 <= numFrames; i += 4)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i *)(samples + i * 2));
+		__m128i lo = _mm_mullo_epi16(s, vol);
+		__m128i hi = _mm_mulhi_epi16(s, vol);
+		__m128i prod0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 14);
+		__m128i prod1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 14);
+		__m128i *m = (__m128i *)(mix + i * 2);
+		_mm_storeu_si128(m, _mm_add_epi32(_mm_loadu_si128(m), prod0));
+		_mm_storeu_si128(m + 1, _mm_add_epi32(_mm_loadu_si128(m + 1), prod1));
+	}
+#endif
+	for (; i < numFrames; i++)
+	{
+		mix[i * 2] += (samples[i * 2] * leftVol) >> 14;
+		mix[i * 2 + 1] += (samples[i * 2 + 1] * rightVol) >> 14;
+	}
+}
+
+static void ClampBuffer(s16 *out, const s32 *mix, int numSamples)
+{
+	int i = 0;
+#ifdef AUDIO_SSE2
+	for (; i + 8 <= numSamples; i += 8)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i *)(mix + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(mix + i + 4));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(a, b));
+	}
+#endif
+	for (; i < numSamples; i++)
+	{
+		s32 sample = mix[i];
+		if (sample > 32767)
+			sample = 32767;
+		else if (sample < -32768)
+			sample = -32768;
+		out[i] = (s16)sample;
+	}
+}
+
+// Producer side. Returns the number of frames that fit.
+static int PushOutput(const s16 *samples, int numFrames)
+{
+	u32 head = Common::AtomicLoadAcquire(outRingHead);
+	u32 tail = outRingTail;
+	int space = (int)(outRingFrames - (tail - head));
+	if (numFrames > space)
+		numFrames = space;
+
+	u32 pos = tail % outRingFrames;
+	int firstPart = std::min(numFrames, (int)(outRingFrames - pos));
+	memcpy(outRing + pos * 2, samples, firstPart * 2 * sizeof(s16));
+	memcpy(outRing, samples + firstPart * 2, (numFrames - firstPart) * 2 * sizeof(s16));
+
+	Common::AtomicStoreRelease(outRingTail, tail + numFrames);
+	return numFrames;
+}
+
+static void __AudioMixBlock()
+{
+	memset(mixBuffer, 0, sizeof(mixBuffer));
+
+	bool anyActive = false;
+	for (int i = 0; i < MAX_CHANNEL; i++)
+	{
+		AudioChannel &chan = chans[i];
+		if (!chan.reserved && chan.sampleQueue.size() == 0)
+			continue;
+
+		int frames = chan.sampleQueue.popArray(chanBuffer, mixBlockSize * 2) / 2;
+		if (frames > 0)
+		{
+			MixChannel(mixBuffer, chanBuffer, frames, AdjustVolume(chan.leftVolume), AdjustVolume(chan.rightVolume));
+			anyActive = true;
+		}
+
+		if (chan.sampleQueue.size() < chan.sampleCount)
+			chan.triggered = true;
+	}
+
+	// Keep the host fed with silence rather than letting it underrun.
+	if (anyActive)
+		ClampBuffer(mixOutput, mixBuffer, mixBlockSize * 2);
+	else
+		memset(mixOutput, 0, sizeof(mixOutput));
+	PushOutput(mixOutput, mixBlockSize);
+
+	if (dumpCallback)
+		dumpCallback(mixOutput, mixBlockSize);
+}
+
+static int __AudioNextBlockCycles()
+{
+	s64 total = (s64)CPU_HZ * mixBlockSize + mixCycleRemainder;
+	mixCycleRemainder = (int)(total % audioSampleRate);
+	return (int)(total / audioSampleRate);
+}
 
 void hleAudioUpdate(u64 userdata, int cyclesLate)
 {
+	__AudioMixBlock();
 	host->UpdateSound();
 	__AudioUpdate();
 
-	CoreTiming::ScheduleEvent(msToCycles(audioIntervalMs), eventAudioUpdate, 0);
+	CoreTiming::ScheduleEvent(__AudioNextBlockCycles() - cyclesLate, eventAudioUpdate, 0);
 }
 
 void __AudioInit()
 {
 	eventAudioUpdate = CoreTiming::RegisterEvent("AudioUpdate", &hleAudioUpdate);
 
-	CoreTiming::ScheduleEvent(msToCycles(1), eventAudioUpdate, 0);
-	for (int i = 0; i < 8; i++)
+	mixCycleRemainder = 0;
+	CoreTiming::ScheduleEvent(__AudioNextBlockCycles(), eventAudioUpdate, 0);
+	for (int i = 0; i < MAX_CHANNEL; i++)
 		chans[i].clear();
 }
 
+void __AudioDoState(PointerWrap &p)
+{
+	p.Do(mixCycleRemainder);
+	for (int i = 0; i < MAX_CHANNEL; i++)
+		chans[i].DoState(p);
+	p.DoMarker("sceAudio");
+}
+
 void __AudioShutdown()
 {
 }
 
+void __AudioSetDumpCallback(AudioDumpCallback callback)
+{
+	dumpCallback = callback;
+}
+
 void __AudioUpdate()
 {
 	// DEBUG_LOG(HLE, "Updating audio");
-	section.lock();
 	for (int i = 0; i < MAX_CHANNEL; i++)
 	{
 		if (chans[i].triggered)
@@ -73,19 +231,16 @@ void __AudioUpdate()
 			__KernelTriggerWait(WAITTYPE_AUDIOCHANNEL, (SceUID)i, true);
 		}
 	}
-	section.unlock();
 }
 
 u32 __AudioEnqueue(AudioChannel &chan, int chanNum, bool blocking)
 {
-	section.lock();
 	if (chan.sampleAddress == 0)
 		return SCE_ERROR_AUDIO_NOT_OUTPUT;
 	if (chan.sampleQueue.size() > chan.sampleCount*2) {
 		// Block!
 		if (blocking) {
 			__KernelWaitCurThread(WAITTYPE_AUDIOCHANNEL, (SceUID)chanNum, 0, 0, false);
-			section.unlock();
 			return 0;
 		}
 		else
@@ -93,70 +248,97 @@ u32 __AudioEnqueue(AudioChannel &chan, int chanNum, bool blocking)
 			return SCE_ERROR_AUDIO_CHANNEL_BUSY;
 		}
 	}
+
+	int inSamples = chan.format == PSP_AUDIO_FORMAT_STEREO ? chan.sampleCount * 2 : chan.sampleCount;
+	if (!Memory::IsValidAddress(chan.sampleAddress) || !Memory::IsValidAddress(chan.sampleAddress + inSamples * 2 - 1))
+	{
+		ERROR_LOG(HLE, "__AudioEnqueue: bad sample address %08x", chan.sampleAddress);
+		return 0;
+	}
+
+	const s16 *src = (const s16 *)Memory::GetPointer(chan.sampleAddress);
 	if (chan.format == PSP_AUDIO_FORMAT_STEREO)
 	{
-		for (u32 i = 0; i < chan.sampleCount * 2; i++)
-		{
-			chan.sampleQueue.push((s16)Memory::Read_U16(chan.sampleAddress + 2 * i));
-		}
+		int num = std::min(inSamples, chan.sampleQueue.room());
+		chan.sampleQueue.pushArray(src, num & ~1);
 	}
 	else if (chan.format == PSP_AUDIO_FORMAT_MONO)
 	{
-		for (u32 i = 0; i < chan.sampleCount; i++)
+		// Expand to stereo
+		const int expandedSize = 512;
+		s16 expanded[expandedSize];
+		int num = std::min(inSamples, chan.sampleQueue.room() / 2);
+		for (int done = 0; done < num; )
 		{
-			// Expand to stereo
-			s16 sample = (s16)Memory::Read_U16(chan.sampleAddress + 2 * i);
-			chan.sampleQueue.push(sample);
-			chan.sampleQueue.push(sample);
+			int chunk = std::min(num - done, expandedSize / 2);
+			for (int i = 0; i < chunk; i++)
+			{
+				expanded[i * 2] = src[done + i];
+				expanded[i * 2 + 1] = src[done + i];
+			}
+			chan.sampleQueue.pushArray(expanded, chunk * 2);
+			done += chunk;
 		}
 	}
-	section.unlock();
 	return 0;
 }
 
+// Host side rate control. The ring is kept around this many frames ahead of the host, or
+// twice what it asks for at a time if that's more.
+const int hostTargetFill = 2048;
+// How far the host's playback rate may be pushed from 1.0, in 1/65536ths (~0.5%).
+const int hostMaxRateAdjust = 0x148;
+
+// Position between the ring's head frame and the next, 16.16. Host thread only.
+static u32 hostResampleFrac = 0;
 
 int __AudioMix(short *outstereo, int numSamples)
 {
-	memset(outstereo, 0, numSamples*sizeof(short)*2);
-
-	// Disable Audio for now.
-	// return numSamples;
+	u32 tail = Common::AtomicLoadAcquire(outRingTail);
+	u32 head = outRingHead;
+	int avail = (int)(tail - head);
 
-	section.lock();
-
-	int numActiveChans = 0;
-
-	for (int j = 0; j < MAX_CHANNEL; j++)
+	int target = std::max(hostTargetFill, numSamples * 2);
+	// After a pause or a stall there can be far too much queued, rather than play catch-up
+	// for seconds just skip ahead.
+	if (avail > target * 2)
 	{
-		numActiveChans += chans[j].running ? 1 : 0;
+		head += avail - target;
+		avail = target;
 	}
 
-	if (!numActiveChans)
-	{
-		section.unlock();
-		return numSamples;
-	}
+	// Consume slightly faster than real time when ahead of the target, and slower when behind.
+	// Proportional to the error, so it settles instead of oscillating.
+	int adjust = (int)(((s64)(avail - target) * hostMaxRateAdjust) / target);
+	if (adjust > hostMaxRateAdjust)
+		adjust = hostMaxRateAdjust;
+	else if (adjust < -hostMaxRateAdjust)
+		adjust = -hostMaxRateAdjust;
+	const u32 step = 0x10000 + adjust;
 
-	for (int i = 0; i < MAX_CHANNEL; i++)
+	// Linear interpolation needs the frame after the current one as well.
+	int s = 0;
+	for (; s < numSamples && avail >= 2; s++)
 	{
-		for (int s = 0; s < numSamples; s++)
-		{
-			if (chans[i].sampleQueue.size() >= 2)
-			{
-				s16 sample1 = chans[i].sampleQueue.front();
-				chans[i].sampleQueue.pop();
-				s16 sample2 = chans[i].sampleQueue.front();
-				chans[i].sampleQueue.pop();
+		const s16 *a = outRing + (head % outRingFrames) * 2;
+		const s16 *b = outRing + ((head + 1) % outRingFrames) * 2;
+		// Only 15 bits of the fraction, a full 16 would overflow the multiply when
+		// the samples swing from one extreme to the other.
+		int frac = (int)(hostResampleFrac >> 1);
+		outstereo[s * 2] = (s16)(a[0] + (((b[0] - a[0]) * frac) >> 15));
+		outstereo[s * 2 + 1] = (s16)(a[1] + (((b[1] - a[1]) * frac) >> 15));
 
-				outstereo[s*2] += sample1 / 4;//(sample * chans[i].vol1) >> 8;
-				outstereo[s*2+1] += sample2 / 4;//.(sample * chans[i].vol2) >> 8;
-			}
-		}
-		if (chans[i].sampleQueue.size() < chans[i].sampleCount)
-		{
-			chans[i].triggered = true;
-		}
+		hostResampleFrac += step;
+		u32 advance = hostResampleFrac >> 16;
+		hostResampleFrac &= 0xFFFF;
+		head += advance;
+		avail -= advance;
 	}
-	section.unlock();
+
+	Common::AtomicStoreRelease(outRingHead, head);
+
+	// Underrun, pad with silence.
+	if (s < numSamples)
+		memset(outstereo + s * 2, 0, (numSamples - s) * 2 * sizeof(short));
 	return numSamples;
 }
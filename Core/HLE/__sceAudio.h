@@ -23,9 +23,16 @@
 
 void __AudioInit();
 void __AudioUpdate();
+void __AudioDoState(PointerWrap &p);
 void __AudioShutdown();
 
 // May return SCE_ERROR_AUDIO_CHANNEL_BUSY if buffer too large
 u32 __AudioEnqueue(AudioChannel &chan, int chanNum, bool blocking);
 
+// Host side, called from the audio thread. Never blocks.
 int __AudioMix(short *outstereo, int numSamples);
+
+// Called on the emu thread with each block of mixed output as it's produced, for dumping.
+// The output only depends on emulated time, so it's the same from run to run.
+typedef void (*AudioDumpCallback)(const s16 *stereo, int numFrames);
+void __AudioSetDumpCallback(AudioDumpCallback callback);
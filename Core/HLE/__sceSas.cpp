@@ -0,0 +1,703 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+#include "ChunkFile.h"
+#include "Hash.h"
+#include "Log.h"
+#include "../MemMap.h"
+
+#include "__sceSas.h"
+
+#if !defined(ANDROID) && (defined(_M_X64) || (defined(_M_IX86) && (defined(_MSC_VER) || defined(__SSE2__))))
+#define SAS_SSE2
+#include <emmintrin.h>
+#endif
+
+// VAG is a Sony ADPCM audio compression format, which goes all the way back to the PSX.
+// It compresses 28 16-bit samples into a block of 16 bytes: a filter/shift byte, a flags byte,
+// then 14 bytes of 4-bit deltas. The filters are in 1/64ths.
+static const int vagFilters[5][2] =
+{
+	{   0,   0 },
+	{  60,   0 },
+	{ 115, -52 },
+	{  98, -55 },
+	{ 122, -60 },
+};
+
+enum
+{
+	VAG_FLAG_LOOP_END = 0x01,
+	VAG_FLAG_LOOP_START = 0x04,
+	VAG_FLAG_END = 0x07,
+};
+
+static inline s16 ClampS16(int sample)
+{
+	if (sample > 32767)
+		return 32767;
+	if (sample < -32768)
+		return -32768;
+	return (s16)sample;
+}
+
+void DecodeVag(const u8 *data, int size, VagSamples &out)
+{
+	const int numBlocks = size / 16;
+	out.pcm.clear();
+	out.pcm.reserve(numBlocks * 28);
+	out.loopStart = 0;
+
+	bool foundLoop = false;
+	int s_1 = 0;
+	int s_2 = 0;
+	for (int b = 0; b < numBlocks; b++)
+	{
+		const u8 *block = data + b * 16;
+		int predict_nr = block[0] >> 4;
+		int shift_factor = block[0] & 0xf;
+		int flags = block[1];
+		if (flags == VAG_FLAG_END)
+			break;
+		if (predict_nr > 4)
+			predict_nr = 0;
+		if ((flags & VAG_FLAG_LOOP_START) && !foundLoop)
+		{
+			out.loopStart = (int)out.pcm.size();
+			foundLoop = true;
+		}
+
+		const int f0 = vagFilters[predict_nr][0];
+		const int f1 = vagFilters[predict_nr][1];
+		for (int i = 0; i < 28; i++)
+		{
+			int d = block[2 + i / 2];
+			int nibble = (i & 1) ? (d >> 4) : (d & 0xf);
+			// Sign extend the nibble into the top of a 16-bit value.
+			int s = (s16)(nibble << 12) >> shift_factor;
+			int sample = ClampS16(s + ((s_1 * f0 + s_2 * f1) >> 6));
+			out.pcm.push_back((s16)sample);
+			s_2 = s_1;
+			s_1 = sample;
+		}
+
+		if (flags & VAG_FLAG_LOOP_END)
+			break;
+	}
+}
+
+// Keyed by address and size, entries are checked against the hash of the data on each lookup.
+typedef std::map<u64, VagSamples *> VagCache;
+static VagCache vagCache;
+
+static void DropVag(VagCache::iterator iter)
+{
+	VagSamples *vag = iter->second;
+	vagCache.erase(iter);
+	vag->stale = true;
+	if (vag->refCount == 0)
+		delete vag;
+}
+
+VagSamples *__SasAcquireVag(u32 addr, int size)
+{
+	if (size <= 0 || !Memory::IsValidAddress(addr) || !Memory::IsValidAddress(addr + size - 1))
+	{
+		ERROR_LOG(HLE, "Bad VAG range %08x, %i bytes", addr, size);
+		return 0;
+	}
+
+	const u8 *data = Memory::GetPointer(addr);
+	u32 hash = HashFletcher(data, size & ~1);
+	u64 key = ((u64)addr << 32) | (u32)size;
+
+	VagCache::iterator iter = vagCache.find(key);
+	if (iter != vagCache.end())
+	{
+		VagSamples *vag = iter->second;
+		if (vag->hash == hash)
+		{
+			vag->refCount++;
+			return vag;
+		}
+		// Overwritten without us hearing about it.
+		DropVag(iter);
+	}
+
+	VagSamples *vag = new VagSamples();
+	vag->addr = addr;
+	vag->size = size;
+	vag->hash = hash;
+	vag->refCount = 1;
+	vag->stale = false;
+	DecodeVag(data, size, *vag);
+	vagCache[key] = vag;
+	DEBUG_LOG(HLE, "Decoded VAG at %08x, %i bytes to %i samples", addr, size, (int)vag->pcm.size());
+	return vag;
+}
+
+void __SasReleaseVag(VagSamples *vag)
+{
+	if (!vag)
+		return;
+	vag->refCount--;
+	if (vag->refCount == 0 && vag->stale)
+		delete vag;
+}
+
+void __SasInvalidateVagCache(u32 addr, int size)
+{
+	addr &= 0x3FFFFFFF;
+	u32 end = addr + size;
+	for (VagCache::iterator iter = vagCache.begin(); iter != vagCache.end(); )
+	{
+		const VagSamples *vag = iter->second;
+		u32 vagAddr = vag->addr & 0x3FFFFFFF;
+		if (vagAddr < end && addr < vagAddr + vag->size)
+			DropVag(iter++);
+		else
+			++iter;
+	}
+}
+
+void __SasClearVagCache()
+{
+	while (!vagCache.empty())
+		DropVag(vagCache.begin());
+}
+
+int __SasResampleVoice(s16 *dest, int numSamples, const VagSamples &vag, int &pos, int &frac, int pitch, bool loop)
+{
+	const int total = (int)vag.pcm.size();
+	if (total == 0)
+		return 0;
+	const s16 *pcm = &vag.pcm[0];
+	const int loopStart = vag.loopStart < total ? vag.loopStart : 0;
+	const int loopLength = total - loopStart;
+	if (pitch < 0)
+		pitch = 0;
+
+	int i = 0;
+	if (pitch == PSP_SAS_PITCH_BASE && frac == 0)
+	{
+		// Played at the original rate, straight copies.
+		while (i < numSamples)
+		{
+			while (pos >= total)
+			{
+				if (!loop)
+					return i;
+				pos -= loopLength;
+			}
+			int chunk = std::min(numSamples - i, total - pos);
+			memcpy(dest + i, pcm + pos, chunk * sizeof(s16));
+			i += chunk;
+			pos += chunk;
+		}
+		return i;
+	}
+
+	for (; i < numSamples; i++)
+	{
+		while (pos >= total)
+		{
+			if (!loop)
+				return i;
+			pos -= loopLength;
+		}
+		int a = pcm[pos];
+		int b;
+		if (pos + 1 < total)
+			b = pcm[pos + 1];
+		else
+			b = loop ? pcm[loopStart] : 0;
+		dest[i] = (s16)(a + (((b - a) * frac) >> PSP_SAS_PITCH_BASE_SHIFT));
+
+		frac += pitch;
+		pos += frac >> PSP_SAS_PITCH_BASE_SHIFT;
+		frac &= PSP_SAS_PITCH_BASE - 1;
+	}
+	return i;
+}
+
+void __SasMixToBus(s32 *bus, const s16 *samples, int numSamples, int volLeft, int volRight)
+{
+	// Keep them in range for a signed 16-bit multiply, 8x louder than unity is plenty.
+	volLeft = std::max(-0x8000, std::min(volLeft, 0x7FFF));
+	volRight = std::max(-0x8000, std::min(volRight, 0x7FFF));
+
+	int i = 0;
+#ifdef SAS_SSE2
+	const __m128i vol = _mm_set_epi16(volRight, volLeft, volRight, volLeft, volRight, volLeft, volRight, volLeft);
+	for (; i + 8 <= numSamples; i += 8)
+	{
+		__m128i mono = _mm_loadu_si128((const __m128i *)(samples + i));
+		__m128i halves[2] = { _mm_unpacklo_epi16(mono, mono), _mm_unpackhi_epi16(mono, mono) };
+		__m128i *b = (__m128i *)(bus + i * 2);
+		for (int h = 0; h < 2; h++)
+		{
+			__m128i lo = _mm_mullo_epi16(halves[h], vol);
+			__m128i hi = _mm_mulhi_epi16(halves[h], vol);
+			__m128i prod0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), PSP_SAS_VOL_SHIFT);
+			__m128i prod1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), PSP_SAS_VOL_SHIFT);
+			_mm_storeu_si128(b + h * 2, _mm_add_epi32(_mm_loadu_si128(b + h * 2), prod0));
+			_mm_storeu_si128(b + h * 2 + 1, _mm_add_epi32(_mm_loadu_si128(b + h * 2 + 1), prod1));
+		}
+	}
+#endif
+	for (; i < numSamples; i++)
+	{
+		bus[i * 2] += (samples[i] * volLeft) >> PSP_SAS_VOL_SHIFT;
+		bus[i * 2 + 1] += (samples[i] * volRight) >> PSP_SAS_VOL_SHIFT;
+	}
+}
+
+void __SasClampBus(s16 *out, const s32 *bus, int numSamples)
+{
+	const int numValues = numSamples * 2;
+	int i = 0;
+#ifdef SAS_SSE2
+	for (; i + 8 <= numValues; i += 8)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i *)(bus + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(bus + i + 4));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(a, b));
+	}
+#endif
+	for (; i < numValues; i++)
+		out[i] = ClampS16(bus[i]);
+}
+
+void SasEnvelope::SetDefaults()
+{
+	// Until the game says otherwise, voices play at full volume from key on and stop at key off.
+	attackRate = PSP_SAS_ENVELOPE_FREQ_MAX;
+	decayRate = 0;
+	sustainRate = 0;
+	releaseRate = PSP_SAS_ENVELOPE_FREQ_MAX;
+	attackType = PSP_SAS_ADSR_CURVE_MODE_LINEAR_INCREASE;
+	decayType = PSP_SAS_ADSR_CURVE_MODE_LINEAR_DECREASE;
+	sustainType = PSP_SAS_ADSR_CURVE_MODE_LINEAR_DECREASE;
+	releaseType = PSP_SAS_ADSR_CURVE_MODE_LINEAR_DECREASE;
+	sustainLevel = PSP_SAS_ENVELOPE_HEIGHT_MAX;
+	state = STATE_OFF;
+	height = 0;
+}
+
+// 7-bit rates: the low two bits are a mantissa, the rest a shift. 0x7F means never.
+static int SimpleRate(int n)
+{
+	n &= 0x7F;
+	if (n == 0x7F)
+		return 0;
+	int rate = ((7 - (n & 3)) << 26) >> (n >> 2);
+	return rate == 0 ? 1 : rate;
+}
+
+void SasEnvelope::SetSimple(u32 env1, u32 env2)
+{
+	env1 &= 0xFFFF;
+	env2 &= 0xFFFF;
+
+	attackRate = SimpleRate(env1 >> 8);
+	attackType = (env1 & 0x8000) ? PSP_SAS_ADSR_CURVE_MODE_LINEAR_BENT : PSP_SAS_ADSR_CURVE_MODE_LINEAR_INCREASE;
+
+	int decay = (env1 >> 4) & 0xF;
+	decayRate = decay == 0 ? PSP_SAS_ENVELOPE_FREQ_MAX : (int)(0x80000000U >> decay);
+	decayType = PSP_SAS_ADSR_CURVE_MODE_EXPONENT_DECREASE;
+	sustainLevel = ((env1 & 0xF) + 1) << 26;
+
+	sustainRate = SimpleRate(env2 >> 6);
+	switch (env2 >> 13)
+	{
+	case 0: sustainType = PSP_SAS_ADSR_CURVE_MODE_LINEAR_INCREASE; break;
+	case 2: sustainType = PSP_SAS_ADSR_CURVE_MODE_LINEAR_DECREASE; break;
+	case 4: sustainType = PSP_SAS_ADSR_CURVE_MODE_LINEAR_BENT; break;
+	case 6: sustainType = PSP_SAS_ADSR_CURVE_MODE_EXPONENT_DECREASE; break;
+	default:
+		WARN_LOG(HLE, "Unknown simple ADSR sustain mode %i", env2 >> 13);
+		sustainType = PSP_SAS_ADSR_CURVE_MODE_LINEAR_DECREASE;
+		break;
+	}
+
+	int release = env2 & 0x1F;
+	if (env2 & 0x20)
+	{
+		releaseType = PSP_SAS_ADSR_CURVE_MODE_EXPONENT_DECREASE;
+		releaseRate = release == 0 ? PSP_SAS_ENVELOPE_FREQ_MAX : (int)(0x80000000U >> release);
+	}
+	else
+	{
+		releaseType = PSP_SAS_ADSR_CURVE_MODE_LINEAR_DECREASE;
+		if (release == 31)
+			releaseRate = 0;
+		else if (release == 30)
+			releaseRate = 0x40000000;
+		else if (release == 29)
+			releaseRate = 1;
+		else
+			releaseRate = 0x10000000 >> release;
+	}
+}
+
+void SasEnvelope::KeyOn()
+{
+	state = STATE_ATTACK;
+	height = 0;
+}
+
+void SasEnvelope::KeyOff()
+{
+	if (state != STATE_OFF)
+		state = STATE_RELEASE;
+}
+
+// Below this the exponential curves are inaudible, and would take forever to get to 0.
+static const s64 envelopeSilence = 0x10000;
+
+static s64 WalkCurve(s64 height, int type, int rate)
+{
+	switch (type)
+	{
+	case PSP_SAS_ADSR_CURVE_MODE_LINEAR_INCREASE:
+		height += rate;
+		break;
+	case PSP_SAS_ADSR_CURVE_MODE_LINEAR_DECREASE:
+		height -= rate;
+		break;
+	case PSP_SAS_ADSR_CURVE_MODE_LINEAR_BENT:
+		// Fast up to 3/4, then a quarter as fast.
+		height += height < (PSP_SAS_ENVELOPE_HEIGHT_MAX / 4) * 3 ? rate : rate / 4;
+		break;
+	case PSP_SAS_ADSR_CURVE_MODE_EXPONENT_DECREASE:
+		height -= (height * rate) >> 31;
+		if (rate > 0 && height < envelopeSilence)
+			height = 0;
+		break;
+	case PSP_SAS_ADSR_CURVE_MODE_EXPONENT_INCREASE:
+		height += ((PSP_SAS_ENVELOPE_HEIGHT_MAX - height) * rate) >> 31;
+		if (rate > 0 && height > PSP_SAS_ENVELOPE_HEIGHT_MAX - envelopeSilence)
+			height = PSP_SAS_ENVELOPE_HEIGHT_MAX;
+		break;
+	case PSP_SAS_ADSR_CURVE_MODE_DIRECT:
+		height = rate;
+		break;
+	}
+	return std::max((s64)0, std::min(height, (s64)PSP_SAS_ENVELOPE_HEIGHT_MAX));
+}
+
+void SasEnvelope::Step()
+{
+	switch (state)
+	{
+	case STATE_ATTACK:
+		height = WalkCurve(height, attackType, attackRate);
+		if (height >= PSP_SAS_ENVELOPE_HEIGHT_MAX)
+			state = STATE_DECAY;
+		break;
+	case STATE_DECAY:
+		height = WalkCurve(height, decayType, decayRate);
+		if (height <= sustainLevel)
+		{
+			height = sustainLevel;
+			state = STATE_SUSTAIN;
+		}
+		break;
+	case STATE_SUSTAIN:
+		height = WalkCurve(height, sustainType, sustainRate);
+		if (height <= 0)
+			state = STATE_RELEASE;
+		break;
+	case STATE_RELEASE:
+		height = WalkCurve(height, releaseType, releaseRate);
+		if (height <= 0)
+			state = STATE_OFF;
+		break;
+	}
+}
+
+// Delay in samples and feedback in 1/128ths for each effect type. Echo and delay take theirs from
+// sceSasRevParam instead. The real thing is a full reverb, this is only meant to be close enough.
+static const int reverbPresets[][2] =
+{
+	{  1024,  40 },	// room
+	{  1536,  48 },	// studio small
+	{  2560,  56 },	// studio medium
+	{  4096,  64 },	// studio large
+	{  6144,  80 },	// hall
+	{ 12288,  96 },	// space
+	{     0,   0 },	// echo
+	{     0,   0 },	// delay
+	{   512, 104 },	// pipe
+};
+
+SasReverb::SasReverb()
+	: type(PSP_SAS_EFFECT_TYPE_OFF), delay(0), feedback(0), volumeLeft(0), volumeRight(0),
+	  dryOn(true), wetOn(false), lineLength(0), lineFeedback(0), linePos(0)
+{
+}
+
+void SasReverb::SetType(int t)
+{
+	if (t < PSP_SAS_EFFECT_TYPE_OFF || t > PSP_SAS_EFFECT_TYPE_PIPE)
+		t = PSP_SAS_EFFECT_TYPE_OFF;
+	type = t;
+	Reset();
+}
+
+void SasReverb::SetParam(int d, int f)
+{
+	delay = std::max(0, std::min(d, 127));
+	feedback = std::max(0, std::min(f, 127));
+	if (type == PSP_SAS_EFFECT_TYPE_ECHO || type == PSP_SAS_EFFECT_TYPE_DELAY)
+		Reset();
+}
+
+void SasReverb::Reset()
+{
+	if (type == PSP_SAS_EFFECT_TYPE_OFF)
+	{
+		lineLength = 0;
+		lineFeedback = 0;
+	}
+	else if (type == PSP_SAS_EFFECT_TYPE_ECHO || type == PSP_SAS_EFFECT_TYPE_DELAY)
+	{
+		lineLength = (delay + 1) * 128;
+		lineFeedback = type == PSP_SAS_EFFECT_TYPE_ECHO ? feedback : 0;
+	}
+	else
+	{
+		lineLength = reverbPresets[type][0];
+		lineFeedback = reverbPresets[type][1];
+	}
+	line.assign(lineLength * 2, 0);
+	linePos = 0;
+}
+
+void SasReverb::Process(s32 *bus, const s32 *send, int numSamples)
+{
+	if (lineLength == 0)
+		return;
+	for (int i = 0; i < numSamples; i++)
+	{
+		s32 *tap = &line[linePos * 2];
+		s32 wetLeft = tap[0];
+		s32 wetRight = tap[1];
+		tap[0] = send[i * 2] + ((wetLeft * lineFeedback) >> 7);
+		tap[1] = send[i * 2 + 1] + ((wetRight * lineFeedback) >> 7);
+		bus[i * 2] += (wetLeft * volumeLeft) >> PSP_SAS_VOL_SHIFT;
+		bus[i * 2 + 1] += (wetRight * volumeRight) >> PSP_SAS_VOL_SHIFT;
+		if (++linePos == lineLength)
+			linePos = 0;
+	}
+}
+
+void SasReverb::DoState(PointerWrap &p)
+{
+	p.Do(type);
+	p.Do(delay);
+	p.Do(feedback);
+	p.Do(volumeLeft);
+	p.Do(volumeRight);
+	p.Do(dryOn);
+	p.Do(wetOn);
+	p.Do(lineLength);
+	p.Do(lineFeedback);
+	p.Do(linePos);
+	p.Do(line);
+	p.DoMarker("SasReverb");
+}
+
+SasInstance::SasInstance(int grainSize_, int maxVoices_, int outputMode_, int sampleRate_)
+	: grainSize(grainSize_), maxVoices(maxVoices_), outputMode(outputMode_), sampleRate(sampleRate_)
+{
+	memset(voices, 0, sizeof(voices));
+	for (int i = 0; i < NUM_VOICES; i++)
+	{
+		voices[i].pitch = PSP_SAS_PITCH_BASE;
+		voices[i].volumeLeft = PSP_SAS_VOL_MAX;
+		voices[i].volumeRight = PSP_SAS_VOL_MAX;
+		voices[i].envelope.SetDefaults();
+	}
+	mixBus.resize(grainSize * 2);
+	sendBus.resize(grainSize * 2);
+	voiceBuffer.resize(grainSize);
+}
+
+SasInstance::~SasInstance()
+{
+	for (int i = 0; i < NUM_VOICES; i++)
+		__SasReleaseVag(voices[i].vag);
+}
+
+void SasInstance::Activate(int voiceNum)
+{
+	if (std::find(activeVoices.begin(), activeVoices.end(), voiceNum) == activeVoices.end())
+		activeVoices.push_back(voiceNum);
+}
+
+void SasInstance::KeyOn(int voiceNum, VagSamples *vag)
+{
+	SasVoice &voice = voices[voiceNum];
+	__SasReleaseVag(voice.vag);
+	voice.vag = vag;
+	voice.playingAddr = voice.vagAddr;
+	voice.playingSize = voice.size;
+	voice.samplePos = 0;
+	voice.sampleFrac = 0;
+	voice.playing = vag != 0;
+	voice.envelope.KeyOn();
+	if (voice.playing)
+		Activate(voiceNum);
+}
+
+void SasInstance::KeyOff(int voiceNum)
+{
+	voices[voiceNum].envelope.KeyOff();
+}
+
+void SasInstance::Mix(s16 *out, const s16 *mixIn, int mixVolLeft, int mixVolRight)
+{
+	s32 *bus = &mixBus[0];
+	s32 *send = &sendBus[0];
+	s16 *buffer = &voiceBuffer[0];
+
+	if (mixIn)
+	{
+		for (int i = 0; i < grainSize; i++)
+		{
+			bus[i * 2] = (mixIn[i * 2] * mixVolLeft) >> PSP_SAS_VOL_SHIFT;
+			bus[i * 2 + 1] = (mixIn[i * 2 + 1] * mixVolRight) >> PSP_SAS_VOL_SHIFT;
+		}
+	}
+	else
+		memset(bus, 0, grainSize * 2 * sizeof(s32));
+
+	const bool sendOn = reverb.type != PSP_SAS_EFFECT_TYPE_OFF && reverb.wetOn;
+	if (sendOn)
+		memset(send, 0, grainSize * 2 * sizeof(s32));
+
+	for (size_t i = 0; i < activeVoices.size(); )
+	{
+		SasVoice &voice = voices[activeVoices[i]];
+		if (voice.playing && !voice.paused)
+		{
+			// Written to while playing, pick up the new data at the same position.
+			if (voice.vag && voice.vag->stale)
+			{
+				VagSamples *fresh = __SasAcquireVag(voice.playingAddr, voice.playingSize);
+				__SasReleaseVag(voice.vag);
+				voice.vag = fresh;
+			}
+
+			int count = 0;
+			if (voice.vag)
+			{
+				const int startPos = voice.samplePos;
+				const s64 advance = (voice.sampleFrac + (s64)voice.pitch * grainSize) >> PSP_SAS_PITCH_BASE_SHIFT;
+				count = __SasResampleVoice(buffer, grainSize, *voice.vag, voice.samplePos, voice.sampleFrac, voice.pitch, voice.loop != 0);
+
+				// Looped during this grain, so SetVoice data (streaming games swap buffers
+				// this way) starts from the next one.
+				const bool switched = voice.playingAddr != voice.vagAddr || voice.playingSize != voice.size;
+				if (switched && count == grainSize && voice.loop && startPos + advance >= (s64)voice.vag->pcm.size())
+				{
+					__SasReleaseVag(voice.vag);
+					voice.vag = __SasAcquireVag(voice.vagAddr, voice.size);
+					voice.playingAddr = voice.vagAddr;
+					voice.playingSize = voice.size;
+					voice.samplePos = 0;
+					if (!voice.vag)
+						voice.playing = false;
+				}
+			}
+
+			SasEnvelope &envelope = voice.envelope;
+			for (int s = 0; s < count; s++)
+			{
+				envelope.Step();
+				// Height is 30 bits, down to 15 for the multiply.
+				buffer[s] = (s16)((buffer[s] * (int)(envelope.height >> 15)) >> 15);
+				if (envelope.Off())
+				{
+					count = s + 1;
+					voice.playing = false;
+					break;
+				}
+			}
+
+			if (reverb.dryOn)
+				__SasMixToBus(bus, buffer, count, voice.volumeLeft, voice.volumeRight);
+			if (sendOn)
+				__SasMixToBus(send, buffer, count, voice.volumeLeftSend, voice.volumeRightSend);
+			if (count < grainSize)
+				voice.playing = false;
+		}
+
+		if (!voice.playing)
+		{
+			activeVoices[i] = activeVoices.back();
+			activeVoices.pop_back();
+		}
+		else
+			++i;
+	}
+
+	if (sendOn)
+		reverb.Process(bus, send, grainSize);
+
+	__SasClampBus(out, bus, grainSize);
+}
+
+u32 SasInstance::GetEndFlags() const
+{
+	u32 endFlags = 0;
+	for (int i = 0; i < maxVoices; i++)
+	{
+		if (!voices[i].playing)
+			endFlags |= 1 << i;
+	}
+	return endFlags;
+}
+
+void SasInstance::DoState(PointerWrap &p)
+{
+	for (int i = 0; i < NUM_VOICES; i++)
+	{
+		SasVoice &voice = voices[i];
+		p.Do(voice);
+		// The decoded samples aren't saved, just decode again from memory. Only ever loaded
+		// into a fresh instance, so there's no old reference to drop.
+		if (p.GetMode() == PointerWrap::MODE_READ)
+		{
+			voice.vag = 0;
+			if (voice.playing)
+			{
+				voice.vag = __SasAcquireVag(voice.playingAddr, voice.playingSize);
+				voice.playing = voice.vag != 0;
+			}
+		}
+	}
+	p.Do(activeVoices);
+	reverb.DoState(p);
+	p.DoMarker("SasInstance");
+}
@@ -0,0 +1,234 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+
+#pragma once
+
+#include <vector>
+
+#include "CommonTypes.h"
+
+class PointerWrap;
+
+// The mixing side of sceSas: VAG decoding and the decoded sample cache, envelopes, reverb and
+// the instances themselves. sceSas.cpp keeps the HLE functions and maps cores to instances.
+
+// Pitch and volume are fixed point, 0x1000 is 1.0.
+enum
+{
+	PSP_SAS_PITCH_BASE = 0x1000,
+	PSP_SAS_PITCH_BASE_SHIFT = 12,
+	PSP_SAS_VOL_MAX = 0x1000,
+	PSP_SAS_VOL_SHIFT = 12,
+};
+
+// A VAG decoded to PCM. Games basically never generate VAG on the fly, so each one is only
+// decoded the first time a voice is keyed on with it.
+struct VagSamples
+{
+	u32 addr;
+	int size;
+	u32 hash;
+
+	std::vector<s16> pcm;
+	// Sample to go back to when looping, from the block flags. 0 if there's no loop point.
+	int loopStart;
+
+	int refCount;
+	// Overwritten since decoding. Voices still using it pick up a fresh decode on their next grain.
+	bool stale;
+};
+
+// Decodes size bytes of VAG ADPCM, stopping early at the end block if there is one.
+void DecodeVag(const u8 *data, int size, VagSamples &out);
+
+// Looks up (or decodes) the VAG at addr, checking that its contents haven't changed, and adds
+// a reference. Returns NULL if the range is invalid.
+VagSamples *__SasAcquireVag(u32 addr, int size);
+void __SasReleaseVag(VagSamples *vag);
+// The guest wrote to this range, drop anything decoded from it.
+void __SasInvalidateVagCache(u32 addr, int size);
+void __SasClearVagCache();
+
+// Resamples a voice by pitch into dest, advancing pos (in samples) and frac (the fraction of a
+// sample, in 1/PSP_SAS_PITCH_BASE). Returns the number of samples produced, which is less than
+// numSamples if the VAG ended without looping.
+int __SasResampleVoice(s16 *dest, int numSamples, const VagSamples &vag, int &pos, int &frac, int pitch, bool loop);
+
+// Adds mono samples to a stereo 32-bit bus, with PSP_SAS_VOL_MAX as unity.
+void __SasMixToBus(s32 *bus, const s16 *samples, int numSamples, int volLeft, int volRight);
+// Saturates the stereo bus down to 16 bits.
+void __SasClampBus(s16 *out, const s32 *bus, int numSamples);
+
+enum
+{
+	PSP_SAS_ENVELOPE_HEIGHT_MAX = 0x40000000,
+	PSP_SAS_ENVELOPE_FREQ_MAX = 0x7FFFFFFF,
+};
+
+enum SasCurveMode
+{
+	PSP_SAS_ADSR_CURVE_MODE_LINEAR_INCREASE = 0,
+	PSP_SAS_ADSR_CURVE_MODE_LINEAR_DECREASE = 1,
+	PSP_SAS_ADSR_CURVE_MODE_LINEAR_BENT = 2,
+	PSP_SAS_ADSR_CURVE_MODE_EXPONENT_DECREASE = 3,
+	PSP_SAS_ADSR_CURVE_MODE_EXPONENT_INCREASE = 4,
+	PSP_SAS_ADSR_CURVE_MODE_DIRECT = 5,
+};
+
+// Which of the four parts sceSasSetADSR / SetADSRMode change.
+enum
+{
+	PSP_SAS_ADSR_ATTACK = 1,
+	PSP_SAS_ADSR_DECAY = 2,
+	PSP_SAS_ADSR_SUSTAIN = 4,
+	PSP_SAS_ADSR_RELEASE = 8,
+};
+
+enum SasReverbType
+{
+	PSP_SAS_EFFECT_TYPE_OFF = -1,
+	PSP_SAS_EFFECT_TYPE_ROOM = 0,
+	PSP_SAS_EFFECT_TYPE_UNK1 = 1,
+	PSP_SAS_EFFECT_TYPE_UNK2 = 2,
+	PSP_SAS_EFFECT_TYPE_UNK3 = 3,
+	PSP_SAS_EFFECT_TYPE_HALL = 4,
+	PSP_SAS_EFFECT_TYPE_SPACE = 5,
+	PSP_SAS_EFFECT_TYPE_ECHO = 6,
+	PSP_SAS_EFFECT_TYPE_DELAY = 7,
+	PSP_SAS_EFFECT_TYPE_PIPE = 8,
+};
+
+// Envelope height goes from 0 to PSP_SAS_ENVELOPE_HEIGHT_MAX and is stepped once per sample.
+// Rates are how much it moves per sample, for the exponential curves in 1/2^31ths of the
+// distance left.
+struct SasEnvelope
+{
+	enum State { STATE_OFF, STATE_ATTACK, STATE_DECAY, STATE_SUSTAIN, STATE_RELEASE };
+
+	int attackRate;
+	int decayRate;
+	int sustainRate;
+	int releaseRate;
+	int attackType;
+	int decayType;
+	int sustainType;
+	int releaseType;
+	int sustainLevel;
+
+	int state;
+	s64 height;
+
+	void SetDefaults();
+	// The packed PSX style parameters of sceSasSetSimpleADSR.
+	void SetSimple(u32 env1, u32 env2);
+	void KeyOn();
+	void KeyOff();
+	void Step();
+	bool Off() const { return state == STATE_OFF; }
+};
+
+struct SasVoice
+{
+	u32 vagAddr;
+	int size;
+	int loop;
+	int volumeLeft;
+	int volumeRight;
+	int volumeLeftSend;	// volume to "Send" (audio-lingo) to the effects processing engine, like reverb
+	int volumeRightSend;
+	int pitch;
+	bool playing;
+	bool paused;
+
+	// Position in the decoded samples, and the fraction of a sample in 1/PSP_SAS_PITCH_BASE.
+	int samplePos;
+	int sampleFrac;
+	SasEnvelope envelope;
+
+	VagSamples *vag;
+	// What vag was acquired from. SetVoice only changes vagAddr/size, which take over on the
+	// next key on or loop.
+	u32 playingAddr;
+	int playingSize;
+};
+
+// The effect unit, fed from each voice's send volumes. A single stereo feedback delay, with the
+// delay and feedback picked by the type, or given by sceSasRevParam for echo and delay.
+class SasReverb
+{
+public:
+	SasReverb();
+
+	void SetType(int type);
+	void SetParam(int delay, int feedback);
+	// Adds the effect output for the send bus into the output bus.
+	void Process(s32 *bus, const s32 *send, int numSamples);
+	void DoState(PointerWrap &p);
+
+	int type;
+	int delay;
+	int feedback;
+	int volumeLeft;
+	int volumeRight;
+	bool dryOn;
+	bool wetOn;
+
+private:
+	void Reset();
+
+	std::vector<s32> line;
+	int lineLength;
+	int lineFeedback;
+	int linePos;
+};
+
+class SasInstance
+{
+public:
+	enum { NUM_VOICES = 32, MAX_GRAIN = 2048 };
+
+	SasInstance(int grainSize, int maxVoices, int outputMode, int sampleRate);
+	~SasInstance();
+
+	// Takes over the reference to vag.
+	void KeyOn(int voiceNum, VagSamples *vag);
+	void KeyOff(int voiceNum);
+
+	// Mixes a grain of stereo output. If mixIn is given (sceSasCoreWithMix) it is added in at
+	// mixVolLeft/Right first, then the voices, then the effect.
+	void Mix(s16 *out, const s16 *mixIn = 0, int mixVolLeft = 0, int mixVolRight = 0);
+
+	u32 GetEndFlags() const;
+	void DoState(PointerWrap &p);
+
+	SasVoice voices[NUM_VOICES];
+	SasReverb reverb;
+	int grainSize;
+	int maxVoices;
+	int outputMode;
+	int sampleRate;
+
+private:
+	void Activate(int voiceNum);
+	// Only these get mixed, the rest cost nothing.
+	std::vector<int> activeVoices;
+
+	std::vector<s32> mixBus;
+	std::vector<s32> sendBus;
+	std::vector<s16> voiceBuffer;
+};
@@ -70,6 +70,19 @@ struct AudioChannel
     running = false;
     sampleQueue.clear();
   }
+
+  void DoState(PointerWrap &p) {
+    p.Do(reserved);
+    p.Do(sampleAddress);
+    p.Do(sampleCount);
+    p.Do(running);
+    p.Do(triggered);
+    p.Do(leftVolume);
+    p.Do(rightVolume);
+    p.Do(format);
+    sampleQueue.DoState(p);
+    p.DoMarker("AudioChannel");
+  }
 };
 
 
@@ -15,6 +15,7 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include "ChunkFile.h"
 #include "HLE.h"
 #include "../MIPS/MIPS.h"
 #include "StdMutex.h"
@@ -48,6 +49,15 @@ static std::recursive_mutex ctrlMutex;
 // Functions so that the rest of the emulator can control what the sceCtrl interface should return
 // to the game:
 
+// The pad itself is live host input, only what the game set up is saved.
+void __CtrlDoState(PointerWrap &p)
+{
+	std::lock_guard<std::recursive_mutex> guard(ctrlMutex);
+	p.Do(ctrlInited);
+	p.Do(analogEnabled);
+	p.DoMarker("sceCtrl");
+}
+
 void __CtrlButtonDown(u32 buttonBit)
 {
   std::lock_guard<std::recursive_mutex> guard(ctrlMutex);
@@ -32,6 +32,9 @@ void Register_sceCtrl();
 #define CTRL_LTRIGGER   0x0100
 #define CTRL_RTRIGGER   0x0200
 
+class PointerWrap;
+
+void __CtrlDoState(PointerWrap &p);
 void __CtrlButtonDown(u32 buttonBit);
 void __CtrlButtonUp(u32 buttonBit);
 // -1 to 1, try to keep it in the circle
@@ -31,6 +31,8 @@
 
 //#include "base/timeutil.h"
 
+#include "ChunkFile.h"
+
 #include "../Core/CoreTiming.h"
 #include "../MIPS/MIPS.h"
 #include "../HLE/HLE.h"
@@ -46,6 +48,10 @@
 #include "../../GPU/GLES/Framebuffer.h"
 #include "../../GPU/GLES/ShaderManager.h"
 #include "../../GPU/GPUState.h"
+#include "../../GPU/GPUInterface.h"
+#include "../System.h"
+#include "../FramePacer.h"
+#include "../SaveState.h"
 
 extern ShaderManager shaderManager;
 
@@ -107,6 +113,31 @@ void __DisplayInit()
 	vCount = 0;
 
 	InitGfxState();
+	FramePacer::Init();
+}
+
+static void __DisplayDoFramebufState(PointerWrap &p, FrameBufferState &fb)
+{
+	p.Do(fb.topaddr);
+	p.Do(fb.pspFramebufFormat);
+	p.Do(fb.pspFramebufLinesize);
+	if (p.GetMode() == PointerWrap::MODE_READ)
+	{
+		// Same as in sceDisplaySetFramebuf.
+		fb.pspframebuf = Memory::GetPointer((0x44000000)|(fb.topaddr & 0x1FFFFF));
+	}
+}
+
+void __DisplayDoState(PointerWrap &p)
+{
+	__DisplayDoFramebufState(p, framebuf);
+	__DisplayDoFramebufState(p, latchedFramebuf);
+	p.Do(framebufIsLatched);
+	p.Do(hCount);
+	p.Do(vCount);
+	p.Do(isVblank);
+	p.Do(vblankWaitingThreads);
+	p.DoMarker("sceDisplay");
 }
 
 void hleEnterVblank(u64 userdata, int cyclesLate)
@@ -136,20 +167,41 @@ void hleEnterVblank(u64 userdata, int cyclesLate)
 	// Yeah, this has to be the right moment to end the frame. Should possibly blit the right buffer
 	// depending on what's set in sceDisplaySetFramebuf, in order to support half-framerate games -
 	// an initial hack could be to NOT end the frame if the buffer didn't change? that should work okay.
+	if (gpu)
 	{
+		FramePacer::BeginTiming(FRAMETIMING_GE);
+		gpu->Flush();
+		FramePacer::EndTiming(FRAMETIMING_GE);
+	}
+
+	// Nothing was drawn during a skipped frame, so there's nothing new to show either.
+	if (!FramePacer::IsSkippingFrame())
+	{
+		FramePacer::BeginTiming(FRAMETIMING_PRESENT);
 		host->EndFrame();
 
 		host->BeginFrame();
-		if (g_Config.bDisplayFramebuffer)
+
+		// The software renderer only ever draws into PSP memory, so always show it.
+		const CoreParameter &coreParam = PSP_CoreParameter();
+		bool showFramebuffer = g_Config.bDisplayFramebuffer || coreParam.gpuCore == GPU_SOFTWARE;
+		if (showFramebuffer && !coreParam.headLess)
 		{
 			INFO_LOG(HLE, "Drawing the framebuffer");
 			DisplayDrawer_DrawFramebuffer(framebuf.pspframebuf, framebuf.pspFramebufFormat, framebuf.pspFramebufLinesize);
 		}
-
-		shaderManager.DirtyShader();
-		shaderManager.DirtyUniform(DIRTY_ALL);
+		FramePacer::EndTiming(FRAMETIMING_PRESENT);
 	}
 
+	shaderManager.DirtyShader();
+	shaderManager.DirtyUniform(DIRTY_ALL);
+
+	FramePacer::EndFrame();
+
+	// Between frames is the only safe point for savestates, stop here if one is pending.
+	if (SaveState::NextFrame())
+		coreState = CORE_NEXTFRAME;
+
 	// TODO: Find a way to tell the CPU core to stop emulating here, when running on Android.
 }
 
@@ -17,6 +17,9 @@
 
 #pragma once
 
+class PointerWrap;
+
 void __DisplayInit();
+void __DisplayDoState(PointerWrap &p);
 
 void Register_sceDisplay();
@@ -15,6 +15,7 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include "ChunkFile.h"
 #include "HLE.h"
 #include "../MIPS/MIPS.h"
 #include "../System.h"
@@ -23,8 +24,8 @@
 #include "sceKernelCallback.h"
 #include "sceKernelInterrupt.h"
 
-// TODO: Bad dependency.
-#include "../../GPU/GLES/DisplayListInterpreter.h"
+#include "../../GPU/GPUInterface.h"
+#include "../FramePacer.h"
 
 // TODO: This doesn't really belong here
 static int state;
@@ -35,6 +36,12 @@ void __GeInit()
 	state = 0;
 }
 
+void __GeDoState(PointerWrap &p)
+{
+	p.Do(state);
+	p.DoMarker("sceGe");
+}
+
 void __GeShutdown()
 {
 
@@ -61,13 +68,15 @@ u32 sceGeEdramGetSize()
 
 u32 sceGeListEnQueue(u32 listAddress, u32 stallAddress, u32 callbackId, u32 optParamAddr)
 {
-	if (PSP_CoreParameter().gpuCore == GPU_NULL)
+	if (!gpu)
 	{
 		DEBUG_LOG(HLE,"No GPU - ignoring sceGeListEnqueue");
 		return 0;
 	}
 
-	u32 listID = GPU::EnqueueList(listAddress, stallAddress);
+	FramePacer::BeginTiming(FRAMETIMING_GE);
+	u32 listID = gpu->EnqueueList(listAddress, stallAddress);
+	FramePacer::EndTiming(FRAMETIMING_GE);
 	// HACKY
 	if (listID)
 		state = SCE_GE_LIST_STALLING;
@@ -83,7 +92,15 @@ u32 sceGeListEnQueue(u32 listAddress, u32 stallAddress, u32 callbackId, u32 optP
 
 u32 sceGeListEnQueueHead(u32 listAddress, u32 stallAddress, u32 callbackId, u32 optParamAddr)
 {
-	u32 listID = GPU::EnqueueList(listAddress,stallAddress);
+	if (!gpu)
+	{
+		DEBUG_LOG(HLE,"No GPU - ignoring sceGeListEnQueueHead");
+		return 0;
+	}
+
+	FramePacer::BeginTiming(FRAMETIMING_GE);
+	u32 listID = gpu->EnqueueList(listAddress,stallAddress);
+	FramePacer::EndTiming(FRAMETIMING_GE);
 	// HACKY
 	if (listID)
 		state = SCE_GE_LIST_STALLING;
@@ -102,7 +119,12 @@ void sceGeListUpdateStallAddr(u32 displayListID, u32 stallAddress)
 	DEBUG_LOG(HLE,"sceGeListUpdateStallAddr(dlid=%i,stalladdr=%08x)",
 		displayListID,stallAddress);
 
-	GPU::UpdateStall(displayListID, stallAddress);
+	if (gpu)
+	{
+		FramePacer::BeginTiming(FRAMETIMING_GE);
+		gpu->UpdateStall(displayListID, stallAddress);
+		FramePacer::EndTiming(FRAMETIMING_GE);
+	}
 }
 
 void sceGeListSync(u32 displayListID, u32 mode) //0 : wait for completion		1:check and return
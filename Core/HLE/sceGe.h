@@ -36,5 +36,8 @@ typedef struct PspGeCallbackData
 
 void Register_sceGe_user();
 
+class PointerWrap;
+
 void __GeInit();
+void __GeDoState(PointerWrap &p);
 void __GeShutdown();
@@ -20,6 +20,8 @@
 #undef DeleteFile
 #endif
 
+#include "ChunkFile.h"
+
 #include "../System.h"
 #include "HLE.h"
 #include "../MIPS/MIPS.h"
@@ -123,7 +125,7 @@ struct dirent {
 class FileNode : public KernelObject
 {
 public:
-	FileNode() : callbackID(0), callbackArg(0), asyncResult(0), pendingAsyncResult(false), sectorBlockMode(false) {}
+	FileNode() : access(FILEACCESS_NONE), handle(0), callbackID(0), callbackArg(0), asyncResult(0), pendingAsyncResult(false), sectorBlockMode(false) {}
 	~FileNode()
 	{
 		pspFileSystem.CloseFile(handle);
@@ -135,9 +137,34 @@ public:
 		sprintf(ptr, "Seekpos: %08x", (u32)pspFileSystem.GetSeekPos(handle));
 	}
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_BADF; }
-	int GetIDType() const { return 0; }
+	int GetIDType() const { return PPSSPP_KERNEL_TMID_File; }
+
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(fullpath);
+		p.Do(access);
+		u32 seekPos = p.GetMode() == PointerWrap::MODE_READ ? 0 : (u32)pspFileSystem.GetSeekPos(handle);
+		p.Do(seekPos);
+		p.Do(callbackID);
+		p.Do(callbackArg);
+		p.Do(asyncResult);
+		p.Do(pendingAsyncResult);
+		p.Do(sectorBlockMode);
+		p.DoMarker("FileNode");
+
+		if (p.GetMode() == PointerWrap::MODE_READ)
+		{
+			// The file was already there or created when it was first opened, don't create it again.
+			handle = pspFileSystem.OpenFile(fullpath, (FileAccess)(access & ~FILEACCESS_CREATE));
+			if (handle != 0)
+				pspFileSystem.SeekFile(handle, (s32)seekPos, FILEMOVE_BEGIN);
+			else
+				ERROR_LOG(HLE, "Savestate: could not reopen %s", fullpath.c_str());
+		}
+	}
 
 	std::string fullpath;
+	FileAccess access;
 	u32 handle;
 
 	u32 callbackID;
@@ -149,6 +176,11 @@ public:
 	bool sectorBlockMode;
 };
 
+KernelObject *__KernelFileNodeObject()
+{
+	return new FileNode;
+}
+
 void __IoInit()
 {
 	INFO_LOG(HLE, "Starting up I/O...");
@@ -184,6 +216,12 @@ void __IoInit()
 	pspFileSystem.Mount("flash1:",	new EmptyFileSystem());
 }
 
+void __IoDoState(PointerWrap &p)
+{
+	pspFileSystem.DoState(p);
+	p.DoMarker("sceIo");
+}
+
 void __IoShutdown()
 {
 
@@ -278,6 +316,8 @@ void sceIoRead()	 //(int fd, void *data, int size);
 		{
 			u8 *data = (u8*)Memory::GetPointer(PARAM(1));
 			int size = PARAM(2);
+			// The host read won't go through the write fault handler.
+			Memory::MarkDirty(PARAM(1), size);
 			f->asyncResult = RETURN((u32)pspFileSystem.ReadFile(f->handle, data, size));
 			DEBUG_LOG(HLE,"%i=sceIoRead(%d, %08x , %i)",f->asyncResult, id, PARAM(1), size);
 		}
@@ -411,6 +451,7 @@ void sceIoOpen()	 //(const char* file, int mode);
 	SceUID id = kernelObjects.Create(f);
 	f->handle = h;
 	f->fullpath = filename;
+	f->access = (FileAccess)access;
 	f->asyncResult = id;
 	DEBUG_LOG(HLE,"%i=sceIoOpen(%s, %08x)",id,filename,mode);
 	RETURN(id);
@@ -757,13 +798,29 @@ public:
 	const char *GetName() {return name.c_str();}
 	const char *GetTypeName() {return "DirListing";}
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_BADF; }
-	int GetIDType() const { return 0; }
+	int GetIDType() const { return PPSSPP_KERNEL_TMID_DirList; }
+
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(name);
+		p.Do(index);
+		p.DoMarker("DirListing");
+
+		// The listing itself is read again, it may have changed since if files were written.
+		if (p.GetMode() == PointerWrap::MODE_READ)
+			listing = pspFileSystem.GetDirListing(name);
+	}
 
 	std::string name;
 	std::vector<PSPFileInfo> listing;
 	int index;
 };
 
+KernelObject *__KernelDirListingObject()
+{
+	return new DirListing;
+}
+
 void sceIoDopen() //(const char *path); 
 {
 	const char *path = Memory::GetCharPointer(PARAM(0));
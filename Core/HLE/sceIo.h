@@ -20,8 +20,13 @@
 #include <string>
 #include "HLE.h"
 
+class KernelObject;
+
 void __IoInit();
+void __IoDoState(PointerWrap &p);
 void __IoShutdown();
+KernelObject *__KernelFileNodeObject();
+KernelObject *__KernelDirListingObject();
 
 void Register_IoFileMgrForUser();
 void Register_StdioForUser();
@@ -15,6 +15,9 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include "ChunkFile.h"
+#include "LogManager.h"
+
 #include "HLE.h"
 #include "../MIPS/MIPS.h"
 #include "../MIPS/MIPSCodeUtils.h"
@@ -33,6 +36,8 @@
 #include "sceGe.h"
 #include "sceIo.h"
 #include "sceKernel.h"
+#include "sceSas.h"
+#include "__sceSas.h"
 #include "sceKernelAlarm.h"
 #include "sceKernelCallback.h"
 #include "sceKernelInterrupt.h"
@@ -40,6 +45,7 @@
 #include "sceKernelMemory.h"
 #include "sceKernelMutex.h"
 #include "sceKernelMbx.h"
+#include "sceKernelModule.h"
 #include "sceKernelMsgPipe.h"
 #include "sceKernelInterrupt.h"
 #include "sceKernelSemaphore.h"
@@ -48,6 +54,7 @@
 #include "sceKernelTime.h"
 #include "sceUtility.h"
 #include "sceUmd.h"
+#include "sceCtrl.h"
 
 extern MetaFileSystem pspFileSystem;
 
@@ -77,6 +84,7 @@ void __KernelInit()
 	__GeInit();
 	__UtilityInit();
 	__UmdInit();
+	__SasInit();
 
 	kernelRunning = true;
 	INFO_LOG(HLE, "Kernel initialized.");
@@ -93,6 +101,7 @@ void __KernelShutdown()
 	INFO_LOG(HLE, "Shutting down kernel - %i kernel objects alive", kernelObjects.GetCount());
 	kernelObjects.Clear();
 
+	__SasShutdown();
 	__GeShutdown();
 	__AudioShutdown();
 	__IoShutdown();
@@ -106,11 +115,39 @@ void __KernelShutdown()
 	kernelRunning = false;
 }
 
+bool __KernelDoState(PointerWrap &p)
+{
+	// Objects first: on load, deleting the old ones frees their memory blocks, which the
+	// allocators then overwrite.
+	bool ok = kernelObjects.DoState(p);
+	p.DoMarker("KernelObjects");
+
+	__KernelMemoryDoState(p);
+	__KernelThreadingDoState(p);
+	__KernelModuleDoState(p);
+	__IoDoState(p);
+	__AudioDoState(p);
+	__DisplayDoState(p);
+	__InterruptsDoState(p);
+	__GeDoState(p);
+	__CtrlDoState(p);
+	__UtilityDoState(p);
+	__UmdDoState(p);
+	__SasDoState(p);
+	p.DoMarker("Kernel");
+	return ok;
+}
+
 void sceKernelExitGame()
 {
 	INFO_LOG(HLE,"sceKernelExitGame");
 	if (PSP_CoreParameter().headLess)
+	{
+		// exit() skips the writer thread's last drain.
+		if (LogManager::GetInstance())
+			LogManager::GetInstance()->Flush();
 		exit(0);
+	}
 	else
 		PanicAlert("Game exited");
 	Core_Stop();
@@ -165,12 +202,16 @@ void sceKernelDcacheWritebackAll()
 {
 	//RETURN(0);
 }
+// Games write back the range before handing it to the Media Engine, which is what sceSas
+// runs on, so this is a good hint that decoded VAG data is out of date.
 void sceKernelDcacheWritebackRange()
 {
+	__SasInvalidateVagCache(PARAM(0), PARAM(1));
 	//RETURN(0);
 }
 void sceKernelDcacheWritebackInvalidateRange()
 {
+	__SasInvalidateVagCache(PARAM(0), PARAM(1));
 	//RETURN(0);
 }
 void sceKernelDcacheWritebackInvalidateAll()
@@ -223,6 +264,76 @@ void KernelObjectPool::Clear()
 	}
 	memset(pool, 0, sizeof(KernelObject*)*maxCount);
 }
+KernelObject *KernelObjectPool::CreateByIDType(int type)
+{
+	switch (type)
+	{
+	case SCE_KERNEL_TMID_Thread:
+		return __KernelThreadObject();
+	case SCE_KERNEL_TMID_Semaphore:
+		return __KernelSemaphoreObject();
+	case SCE_KERNEL_TMID_EventFlag:
+		return __KernelEventFlagObject();
+	case SCE_KERNEL_TMID_Mbox:
+		return __KernelMbxObject();
+	case SCE_KERNEL_TMID_Vpl:
+		return __KernelVPLObject();
+	case SCE_KERNEL_TMID_Fpl:
+		return __KernelFPLObject();
+	case SCE_KERNEL_TMID_Mpipe:
+		return __KernelMsgPipeObject();
+	case SCE_KERNEL_TMID_Callback:
+		return __KernelCallbackObject();
+	case SCE_KERNEL_TMID_VTimer:
+		return __KernelVTimerObject();
+	case SCE_KERNEL_TMID_Mutex:
+		return __KernelMutexObject();
+	case SCE_KERNEL_TMID_LwMutex:
+		return __KernelLwMutexObject();
+	case PPSSPP_KERNEL_TMID_Module:
+		return __KernelModuleObject();
+	case PPSSPP_KERNEL_TMID_File:
+		return __KernelFileNodeObject();
+	case PPSSPP_KERNEL_TMID_DirList:
+		return __KernelDirListingObject();
+	case PPSSPP_KERNEL_TMID_PMB:
+		return __KernelMemoryPMBObject();
+	default:
+		return 0;
+	}
+}
+
+bool KernelObjectPool::DoState(PointerWrap &p)
+{
+	if (p.GetMode() == PointerWrap::MODE_READ)
+		Clear();
+
+	p.DoArray(occupied, maxCount);
+	for (int i = 0; i < maxCount; i++)
+	{
+		if (!occupied[i])
+			continue;
+
+		int type = p.GetMode() == PointerWrap::MODE_READ ? 0 : pool[i]->GetIDType();
+		p.Do(type);
+		if (p.GetMode() == PointerWrap::MODE_READ)
+		{
+			pool[i] = CreateByIDType(type);
+			if (!pool[i])
+			{
+				// Nothing after this can be trusted.
+				ERROR_LOG(HLE, "Savestate has a kernel object of unknown type %08x", type);
+				occupied[i] = false;
+				p.SetMode(PointerWrap::MODE_MEASURE);
+				return false;
+			}
+			pool[i]->uid = i + handleOffset;
+		}
+		pool[i]->DoState(p);
+	}
+	return true;
+}
+
 KernelObject *&KernelObjectPool::operator [](SceUID handle)
 {
 	_dbg_assert_msg_(HLE, IsValid(handle), "GRABBING UNALLOCED KERNEL OBJ");
@@ -291,8 +402,8 @@ const HLEFunction ThreadManForUser[] =
 	{0x60107536,0,"sceKernelDeleteLwMutex"},
 	{0x19CFF145,0,"sceKernelCreateLwMutex"},
 	{0xf8170fbe,&WrapU_U<sceKernelDeleteMutex>,"sceKernelDeleteMutex"},
-	{0xB011B11F,&WrapU_UUU<sceKernelLockMutex>,"sceKernelLockMutex"},
-	{0x5bf4dd27,&WrapU_UUU<sceKernelLockMutexCB>,"sceKernelLockMutexCB"},
+	{0xB011B11F,sceKernelLockMutex,"sceKernelLockMutex"},
+	{0x5bf4dd27,sceKernelLockMutexCB,"sceKernelLockMutexCB"},
 	{0x6b30100f,&WrapU_UU<sceKernelUnlockMutex>,"sceKernelUnlockMutex"},
 	{0xb7d098c6,&WrapU_CUU<sceKernelCreateMutex>,"sceKernelCreateMutex"},
 	// NOTE: LockLwMutex and UnlockLwMutex are in Kernel_Library, see sceKernelInterrupt.cpp.
@@ -268,6 +268,8 @@ void sceKernelIcacheInvalidateAll();
 #define KERNELOBJECT_MAX_NAME_LENGTH 31
 
 class KernelObjectPool;
+class PointerWrap;
+struct WaitQueue;
 
 class KernelObject
 {
@@ -284,9 +286,17 @@ public:
   // Implement this in all subclasses:
   // static u32 GetMissingErrorCode()
 
-  // Future
-  // void Serialize(ChunkFile)
-  // void DeSerialize(ChunkFile)
+	// The queues of threads waiting on this object, if it has any, so that waiting threads can be
+	// linked back in after loading a state.
+	virtual WaitQueue *GetWaitQueue(int index) {return 0;}
+	// Called when a queued thread stops waiting without this object waking it, on a timeout or
+	// when the thread is deleted. Objects that serve their queue in order should try again, the
+	// threads that were behind it might be able to go now.
+	virtual void RecheckWaitingThreads() {}
+
+	// Saves or restores everything but the uid. On load, the pool recreates each object from its
+	// GetIDType(), see KernelObjectPool::CreateByIDType.
+	virtual void DoState(PointerWrap &p) = 0;
 };
 
 enum TMIDPurpose
@@ -308,6 +318,13 @@ enum TMIDPurpose
   SCE_KERNEL_TMID_DelayThread = 65,
   SCE_KERNEL_TMID_SuspendThread = 66,
   SCE_KERNEL_TMID_DormantThread = 67,
+
+  // Not real threadman types, these only tell the other kernel objects apart in savestates.
+  // sceKernelGetThreadmanIdType reports them as 0.
+  PPSSPP_KERNEL_TMID_Module = 0x100001,
+  PPSSPP_KERNEL_TMID_File,
+  PPSSPP_KERNEL_TMID_DirList,
+  PPSSPP_KERNEL_TMID_PMB,
 };
 
 class KernelObjectPool
@@ -369,10 +386,22 @@ public:
 	void List();
 	void Clear();
 	int GetCount();
+
+	// On load, all current objects are deleted first. Returns false if an object could not be
+	// recreated, nothing after it is loaded then.
+	bool DoState(PointerWrap &p);
+
+private:
+	// An empty object of the given type, for loading into.
+	static KernelObject *CreateByIDType(int type);
 };
 
 extern KernelObjectPool kernelObjects;
 
+// Savestates for the whole kernel: the object pool and the state of every HLE module.
+// Returns false if something could not be saved or loaded.
+bool __KernelDoState(PointerWrap &p);
+
 
 void Register_ThreadManForUser();
 void Register_LoadExecForUser();
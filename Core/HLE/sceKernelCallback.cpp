@@ -17,6 +17,8 @@
 
 // Refer to http://code.google.com/p/yaupspe/source/detail?r=741987a938f87e55ac284f8c2af6d40b4fb30ffc#
 
+#include "ChunkFile.h"
+
 #include "HLE.h"
 #include "../MIPS/MIPS.h"
 #include "../MIPS/MIPSCodeUtils.h"
@@ -57,6 +59,30 @@ public:
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_UNKNOWN_CBID; }
 	int GetIDType() const { return SCE_KERNEL_TMID_Callback; }
 
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(size);
+		p.Do(name);
+		p.Do(entrypoint);
+		p.Do(threadId);
+		p.Do(argument);
+		p.Do(notifyCount);
+		p.Do(savedPC);
+		p.Do(savedRA);
+		p.Do(savedV0);
+		p.Do(savedV1);
+		p.Do(savedIdRegister);
+		p.Do(numParameters);
+		p.Do(parameters);
+		p.Do(forceDelete);
+		// Actions are host code, only callbacks created by the game itself can be restored.
+		if (actionAfter && p.GetMode() == PointerWrap::MODE_WRITE)
+			ERROR_LOG(HLE, "Callback %s has an action, it will be lost on load", name);
+		if (p.GetMode() == PointerWrap::MODE_READ)
+			actionAfter = 0;
+		p.DoMarker("Callback");
+	}
+
 	SceUInt size;
 	char name[32];
 	u32 entrypoint;
@@ -89,6 +115,11 @@ public:
 // CALLBACKS
 //////////////////////////////////////////////////////////////////////////
 
+KernelObject *__KernelCallbackObject()
+{
+	return new Callback;
+}
+
 
 // Internal API
 u32 __KernelCreateCallback(const char *name, u32 entrypoint, u32 callbackArg, Action *actionAfter)
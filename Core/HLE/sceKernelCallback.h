@@ -19,8 +19,11 @@
 
 #include "Action.h"
 
+class KernelObject;
+
 // Internal access - used by sceSetGeCallback
 u32 __KernelCreateCallback(const char *name, u32 entrypoint, u32 signalArg, Action *actionAfter = 0);
+KernelObject *__KernelCallbackObject();
 
 void sceKernelCreateCallback();
 void sceKernelDeleteCallback();
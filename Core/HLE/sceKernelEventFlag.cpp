@@ -17,6 +17,8 @@
 
 //http://code.google.com/p/jpcsp/source/browse/trunk/src/jpcsp/HLE/kernel/managers/EventFlagManager.java?r=1263
 
+#include "ChunkFile.h"
+
 #include "HLE.h"
 #include "../MIPS/MIPS.h"
 
@@ -37,14 +39,6 @@ struct NativeEventFlag
 	int numWaitThreads;
 };
 
-struct EventFlagTh
-{
-	SceUID tid;
-	u32 bits;
-	u32 wait;
-	u32 outAddr;
-};
-
 class EventFlag : public KernelObject
 {
 public:
@@ -63,14 +57,30 @@ public:
 	}
 	int GetIDType() const { return SCE_KERNEL_TMID_EventFlag; }
 
+	WaitQueue *GetWaitQueue(int index) { return index == 0 ? &waitingThreads : 0; }
+
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(nef);
+		p.Do(waitingThreads);
+		p.DoMarker("EventFlag");
+	}
+
 	NativeEventFlag nef;
-	std::vector<EventFlagTh> waitingThreads;
+	WaitQueue waitingThreads;
 };
 
+KernelObject *__KernelEventFlagObject()
+{
+	return new EventFlag;
+}
+
 
 /** Event flag creation attributes */
 enum PspEventFlagAttributes
 {
+	/** Wake waiting threads in priority order, rather than first come first served */
+	PSP_EVENT_WAITPRIORITY = 0x100,
 	/** Allow the event flag to be waited upon by multiple threads */
 	PSP_EVENT_WAITMULTIPLE = 0x200
 };
@@ -100,6 +110,7 @@ void sceKernelCreateEventFlag()
 	e->nef.initPattern = PARAM(2);
 	e->nef.currentPattern = e->nef.initPattern;
 	e->nef.numWaitThreads = 0;
+	__KernelInitWaitQueue(e->waitingThreads, (e->nef.attr & PSP_EVENT_WAITPRIORITY) != 0);
 
 	DEBUG_LOG(HLE,"%i=sceKernelCreateEventFlag(\"%s\", %08x, %08x, %08x)", id, e->nef.name, e->nef.attr, e->nef.currentPattern, PARAM(3));
 	RETURN(id);
@@ -132,6 +143,10 @@ void sceKernelDeleteEventFlag()
 {
 	SceUID uid = PARAM(0);
 	DEBUG_LOG(HLE,"sceKernelDeleteEventFlag(%i)", uid);
+	u32 error;
+	EventFlag *e = kernelObjects.Get<EventFlag>(uid, error);
+	if (e)
+		__KernelResumeAllFromWait(e->waitingThreads, SCE_KERNEL_ERROR_WAIT_DELETE);
 	RETURN(kernelObjects.Destroy<EventFlag>(uid));
 }
 
@@ -161,22 +176,18 @@ void sceKernelSetEventFlag()
 	EventFlag *e = kernelObjects.Get<EventFlag>(id, error);
 	if (e)
 	{
-		bool wokeThreads = false;
-
 		e->nef.currentPattern |= bitsToSet;
 
-retry:
-		for (size_t i = 0; i < e->waitingThreads.size(); i++)
+		// Every waiter wants different bits, so all of them need a look. Clearing waiters can
+		// take the bits away from the ones behind them.
+		SceUID threadID = __KernelWaitQueueFirst(e->waitingThreads);
+		while (threadID != 0 && e->nef.currentPattern != 0)
 		{
-			EventFlagTh *t = &e->waitingThreads[i];
-			if (__KernelEventFlagMatches(&e->nef.currentPattern, t->bits, t->wait, t->outAddr))
-			{
-				__KernelResumeThread(t->tid);
-				wokeThreads = true;
-				e->nef.numWaitThreads--;
-				e->waitingThreads.erase(e->waitingThreads.begin() + i);
-				goto retry;
-			}
+			SceUID next = __KernelWaitQueueNext(threadID);
+			const WaitRequest *request = __KernelGetWaitRequest(threadID);
+			if (__KernelEventFlagMatches(&e->nef.currentPattern, request->value, request->mode, request->addr))
+				__KernelResumeThreadFromWait(threadID, 0);
+			threadID = next;
 		}
 		RETURN(0);
 	}
@@ -186,36 +197,31 @@ retry:
 	}
 }
 
-//int sceKernelWaitEventFlag(SceUID evid, u32 bits, u32 wait, u32 *outBits, SceUInt *timeout);
-void sceKernelWaitEventFlag()
+void __KernelWaitEventFlag(SceUID id, u32 bits, u32 wait, u32 outBitsPtr, u32 timeoutPtr, const char *funcName, bool processCallbacks)
 {
-	SceUID id = PARAM(0);
-	u32 bits = PARAM(1);
-	u32 wait = PARAM(2);
-	u32 outBitsPtr = PARAM(3);
-	u32 timeoutPtr = PARAM(4);
-
-	DEBUG_LOG(HLE,"sceKernelWaitEventFlag(%i, %08x, %i, %08x, %08x)", id, bits, wait, outBitsPtr, timeoutPtr);
+	DEBUG_LOG(HLE,"%s(%i, %08x, %i, %08x, %08x)", funcName, id, bits, wait, outBitsPtr, timeoutPtr);
 
 	u32 error;
 	EventFlag *e = kernelObjects.Get<EventFlag>(id, error);
 	if (e)
 	{
-		EventFlagTh th;
+		if (bits == 0)
+		{
+			RETURN(SCE_KERNEL_ERROR_EVF_ILPAT);
+			return;
+		}
+		if (!(e->nef.attr & PSP_EVENT_WAITMULTIPLE) && e->waitingThreads.count != 0)
+		{
+			RETURN(SCE_KERNEL_ERROR_EVF_MULTI);
+			return;
+		}
+
 		if (!__KernelEventFlagMatches(&e->nef.currentPattern, bits, wait, outBitsPtr))
 		{
 			// No match - must wait.
-			e->nef.numWaitThreads++;
-			th.tid = __KernelGetCurThread();
-			th.bits = bits;
-			th.wait = wait;
-			th.outAddr = outBitsPtr;
-			e->waitingThreads.push_back(th);
-			u32 timeout;
-			if (Memory::IsValidAddress(timeoutPtr))
-				timeout = Memory::Read_U32(timeoutPtr);
-
-			__KernelWaitCurThread(WAITTYPE_EVENTFLAG, id, 0, 0, false);
+			WaitRequest request = {bits, wait, outBitsPtr, 0};
+			__KernelWaitCurThreadOnQueue(e->waitingThreads, WAITTYPE_EVENTFLAG, id, request, timeoutPtr, processCallbacks);
+			return;
 		}
 		RETURN(0);
 	}
@@ -225,43 +231,16 @@ void sceKernelWaitEventFlag()
 	}
 }
 
+//int sceKernelWaitEventFlag(SceUID evid, u32 bits, u32 wait, u32 *outBits, SceUInt *timeout);
+void sceKernelWaitEventFlag()
+{
+	__KernelWaitEventFlag(PARAM(0), PARAM(1), PARAM(2), PARAM(3), PARAM(4), "sceKernelWaitEventFlag", false);
+}
+
 //int sceKernelWaitEventFlagCB(SceUID evid, u32 bits, u32 wait, u32 *outBits, SceUInt *timeout);
 void sceKernelWaitEventFlagCB()
 {
-	SceUID id = PARAM(0);
-	u32 bits = PARAM(1);
-	u32 wait = PARAM(2);
-	u32 outBitsPtr = PARAM(3);
-	u32 timeoutPtr = PARAM(4);
-
-	DEBUG_LOG(HLE,"sceKernelWaitEventFlagCB(%i, %08x, %i, %08x, %08x)", id, bits, wait, outBitsPtr, timeoutPtr);
-
-	u32 error;
-	EventFlag *e = kernelObjects.Get<EventFlag>(id, error);
-	if (e)
-	{
-		EventFlagTh th;
-		if (!__KernelEventFlagMatches(&e->nef.currentPattern, bits, wait, outBitsPtr))
-		{
-			// No match - must wait.
-			e->nef.numWaitThreads++;
-			th.tid = __KernelGetCurThread();
-			th.bits = bits;
-			th.wait = wait;
-			th.outAddr = outBitsPtr;
-			e->waitingThreads.push_back(th);
-			u32 timeout;
-			if (Memory::IsValidAddress(timeoutPtr))
-				timeout = Memory::Read_U32(timeoutPtr);
-
-			__KernelWaitCurThread(WAITTYPE_EVENTFLAG, id, 0, 0, true);
-		}
-		RETURN(0);
-	}
-	else
-	{
-		RETURN(error);
-	}
+	__KernelWaitEventFlag(PARAM(0), PARAM(1), PARAM(2), PARAM(3), PARAM(4), "sceKernelWaitEventFlagCB", true);
 }
 
 //int sceKernelPollEventFlag(int evid, u32 bits, u32 wait, u32 *outBits);
@@ -308,6 +287,7 @@ void sceKernelReferEventFlagStatus()
 	EventFlag *e = kernelObjects.Get<EventFlag>(id, error);
 	if (e)
 	{
+		e->nef.numWaitThreads = e->waitingThreads.count;
 		Memory::WriteStruct(statusAddr, &e->nef);
 		RETURN(0);
 	}
@@ -317,9 +297,26 @@ void sceKernelReferEventFlagStatus()
 	}
 }
 
-// never seen this one
+//int sceKernelCancelEventFlag(SceUID evid, u32 newPattern, int *numWaitThreads);
 void sceKernelCancelEventFlag()
 {
-	ERROR_LOG(HLE,"UNIMPL: sceKernelCancelEventFlag()");
-	RETURN(0);
+	SceUID id = PARAM(0);
+	u32 newPattern = PARAM(1);
+	u32 numWaitThreadsPtr = PARAM(2);
+
+	DEBUG_LOG(HLE,"sceKernelCancelEventFlag(%i, %08x, %08x)", id, newPattern, numWaitThreadsPtr);
+	u32 error;
+	EventFlag *e = kernelObjects.Get<EventFlag>(id, error);
+	if (e)
+	{
+		if (Memory::IsValidAddress(numWaitThreadsPtr))
+			Memory::Write_U32(e->waitingThreads.count, numWaitThreadsPtr);
+		e->nef.currentPattern = newPattern;
+		__KernelResumeAllFromWait(e->waitingThreads, SCE_KERNEL_ERROR_WAIT_CANCEL);
+		RETURN(0);
+	}
+	else
+	{
+		RETURN(error);
+	}
 }
@@ -26,3 +26,5 @@ void sceKernelWaitEventFlagCB();
 void sceKernelPollEventFlag();
 void sceKernelCancelEventFlag();
 void sceKernelReferEventFlagStatus();
+
+KernelObject *__KernelEventFlagObject();
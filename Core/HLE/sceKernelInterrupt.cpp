@@ -19,6 +19,8 @@
 #include <list>
 #include <map>
 
+#include "ChunkFile.h"
+
 #include "HLE.h"
 #include "../MIPS/MIPS.h"
 
@@ -195,6 +197,25 @@ public:
 		}
 	}
 
+	void DoState(PointerWrap &p)
+	{
+		int n = (int)subIntrHandlers.size();
+		p.Do(n);
+		if (p.GetMode() == PointerWrap::MODE_READ)
+			subIntrHandlers.clear();
+		std::map<int, SubIntrHandler>::iterator iter = subIntrHandlers.begin();
+		for (int i = 0; i < n; i++)
+		{
+			int subIntrNum = p.GetMode() == PointerWrap::MODE_READ ? 0 : iter->first;
+			p.Do(subIntrNum);
+			SubIntrHandler &handler = p.GetMode() == PointerWrap::MODE_READ ? subIntrHandlers[subIntrNum] : (iter++)->second;
+			p.Do(handler.enabled);
+			p.Do(handler.number);
+			p.Do(handler.handlerAddress);
+			p.Do(handler.handlerArg);
+		}
+	}
+
 private:
 	std::map<int, SubIntrHandler> subIntrHandlers;
 };
@@ -226,6 +247,39 @@ public:
 InterruptState intState;
 IntrHandler intrHandlers[PSP_NUMBER_INTERRUPTS];
 
+void __InterruptsDoState(PointerWrap &p)
+{
+	p.Do(interruptsEnabled);
+	p.Do(inInterrupt);
+	p.Do(intState.insideInterrupt);
+	p.Do(intState.savedCpu);
+	for (int i = 0; i < PSP_NUMBER_INTERRUPTS; i++)
+		intrHandlers[i].DoState(p);
+
+	// Pending interrupts point into the handler maps, so they're stored as the numbers to look up.
+	std::vector<std::pair<int, int> > pending;
+	for (std::list<AllegrexInterruptHandler *>::iterator iter = pendingInterrupts.begin(); iter != pendingInterrupts.end(); ++iter)
+	{
+		SubIntrHandler *handler = static_cast<SubIntrHandler *>(*iter);
+		for (int i = 0; i < PSP_NUMBER_INTERRUPTS; i++)
+		{
+			if (intrHandlers[i].has(handler->number) && &intrHandlers[i].get(handler->number) == handler)
+				pending.push_back(std::make_pair(i, handler->number));
+		}
+	}
+	p.Do(pending);
+	if (p.GetMode() == PointerWrap::MODE_READ)
+	{
+		pendingInterrupts.clear();
+		for (size_t i = 0; i < pending.size(); i++)
+		{
+			if (intrHandlers[pending[i].first].has(pending[i].second))
+				pendingInterrupts.push_back(&intrHandlers[pending[i].first].get(pending[i].second));
+		}
+	}
+	p.DoMarker("sceKernelInterrupt");
+}
+
 // http://forums.ps2dev.org/viewtopic.php?t=5687
 
 // http://www.google.se/url?sa=t&rct=j&q=&esrc=s&source=web&cd=7&ved=0CFYQFjAG&url=http%3A%2F%2Fdev.psnpt.com%2Fredmine%2Fprojects%2Fuofw%2Frepository%2Frevisions%2F65%2Fraw%2Ftrunk%2Finclude%2Finterruptman.h&ei=J4pCUKvyK4nl4QSu-YC4Cg&usg=AFQjCNFxJcgzQnv6dK7aiQlht_BM9grfQQ&sig2=GGk5QUEWI6qouYDoyE07YQ
@@ -369,15 +423,19 @@ void QueryIntrHandlerInfo()
 	RETURN(0);
 }
 
-void sceKernelMemset()
+u32 sceKernelMemset(u32 addr, u32 fillc, u32 n)
 {
-	u32 addr = PARAM(0);
-	u8 c = PARAM(1) & 0xff;
-	u32 n = PARAM(2);
+	u8 c = fillc & 0xff;
 	DEBUG_LOG(HLE, "sceKernelMemset(ptr = %08x, c = %02x, n = %08x)", addr, c, n);
-	for (size_t i = 0; i < n; i++)
-		Memory::Write_U8((u8)c, addr + i);
-	RETURN(addr); /* TODO: verify it should return this */
+	Memory::Memset(addr, c, n);
+	return addr; /* TODO: verify it should return this */
+}
+
+u32 sce_paf_private_memcpy(u32 dst, u32 src, u32 size)
+{
+	DEBUG_LOG(HLE, "sce_paf_private_memcpy(dst = %08x, src = %08x, size = %08x)", dst, src, size);
+	Memory::MemcpyGuestToGuest(dst, src, size);
+	return dst;
 }
 
 const HLEFunction Kernel_Library[] = 
@@ -387,12 +445,12 @@ const HLEFunction Kernel_Library[] =
 	{0x3b84732d,WrapV_U<sceKernelCpuResumeIntrWithSync>, "sceKernelCpuResumeIntrWithSync"},
 	{0x47a0b729,sceKernelIsCpuIntrSuspended, "sceKernelIsCpuIntrSuspended"}, //flags
 	{0xb55249d2,sceKernelIsCpuIntrEnable, "sceKernelIsCpuIntrEnable"}, 
-	{0xa089eca4,sceKernelMemset, "sceKernelMemset"}, 
+	{0xa089eca4,WrapU_UUU<sceKernelMemset>, "sceKernelMemset"}, 
 	{0xbea46419,0, "sceKernelLockLwMutex"}, 
 	{0x15b6446b,0, "sceKernelUnlockLwMutex"}, 
 	{0x293b45b8,0, "sceKernelGetThreadId"}, 
-	{0x1839852A,0,"sce_paf_private_memcpy"},
-	{0xA089ECA4,0,"sce_paf_private_memset"},
+	{0x1839852A,WrapU_UUU<sce_paf_private_memcpy>,"sce_paf_private_memcpy"},
+	{0xA089ECA4,WrapU_UUU<sceKernelMemset>,"sce_paf_private_memset"},
 };
 
 void Register_Kernel_Library()
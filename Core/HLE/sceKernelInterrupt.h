@@ -54,8 +54,11 @@ enum PSPGeSubInterrupts {
   PSP_GE_SUBINTR_SIGNAL = 15
 };
 
+class PointerWrap;
+
 bool __IsInInterrupt();
 void __InterruptsInit();
+void __InterruptsDoState(PointerWrap &p);
 void __InterruptsShutdown();
 void __TriggerInterrupt(PSPInterrupt intno);
 
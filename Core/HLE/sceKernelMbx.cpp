@@ -15,10 +15,20 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <cstddef>
+
+#include "ChunkFile.h"
+
 #include "sceKernel.h"
+#include "sceKernelThread.h"
 #include "sceKernelMbx.h"
 #include "HLE.h"
 
+#define PSP_MBX_ATTR_FIFO 0
+#define PSP_MBX_ATTR_PRIORITY 0x100
+#define PSP_MBX_ATTR_MSG_FIFO 0
+#define PSP_MBX_ATTR_MSG_PRIORITY 0x400
+
 struct NativeMbxPacket
 {
 	u32 next;
@@ -45,11 +55,57 @@ struct Mbx : public KernelObject
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_UNKNOWN_MBXID; }
 	int GetIDType() const { return SCE_KERNEL_TMID_Mbox; }
 
+	WaitQueue *GetWaitQueue(int index) { return index == 0 ? &receiveWaitingThreads : 0; }
+
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(nmb);
+		p.Do(receiveWaitingThreads);
+		p.DoMarker("Mbx");
+	}
+
 	NativeMbx nmb;
 
-	std::vector<SceUID> receiveWaitingThreads;
+	WaitQueue receiveWaitingThreads;
 };
 
+KernelObject *__KernelMbxObject()
+{
+	return new Mbx;
+}
+
+// Queues a packet, after all others or after those with the same or higher priority.
+void __KernelMbxAddPacket(Mbx *m, u32 packetAddr)
+{
+	u8 priority = Memory::Read_U8(packetAddr + offsetof(NativeMbxPacket, priority));
+	bool byPriority = (m->nmb.attr & PSP_MBX_ATTR_MSG_PRIORITY) != 0;
+
+	u32 prev = 0;
+	u32 next = m->nmb.packetListHead;
+	while (next != 0)
+	{
+		if (byPriority && Memory::Read_U8(next + offsetof(NativeMbxPacket, priority)) > priority)
+			break;
+		prev = next;
+		next = Memory::Read_U32(next);
+	}
+
+	Memory::Write_U32(next, packetAddr);
+	if (prev)
+		Memory::Write_U32(packetAddr, prev);
+	else
+		m->nmb.packetListHead = packetAddr;
+	m->nmb.numMessages++;
+}
+
+u32 __KernelMbxTakePacket(Mbx *m)
+{
+	u32 packetAddr = m->nmb.packetListHead;
+	m->nmb.packetListHead = Memory::Read_U32(packetAddr);
+	m->nmb.numMessages--;
+	return packetAddr;
+}
+
 void sceKernelCreateMbx()
 {
 	const char *name = Memory::GetCharPointer(PARAM(0));
@@ -58,7 +114,7 @@ void sceKernelCreateMbx()
 	int size = PARAM(3);
 	int opt = PARAM(4);
 
-	ERROR_LOG(HLE, "sceKernelCreateMbx(%s, %i, %08x, %i, %08x)", name, memoryPartition, attr, size, opt);
+	DEBUG_LOG(HLE, "sceKernelCreateMbx(%s, %i, %08x, %i, %08x)", name, memoryPartition, attr, size, opt);
 
 	Mbx *m = new Mbx();
 	SceUID id = kernelObjects.Create(m);
@@ -69,6 +125,7 @@ void sceKernelCreateMbx()
 	m->nmb.numWaitThreads = 0;
 	m->nmb.numMessages = 0;
 	m->nmb.packetListHead = 0;
+	__KernelInitWaitQueue(m->receiveWaitingThreads, (attr & PSP_MBX_ATTR_PRIORITY) != 0);
 
 	RETURN(id);
 }
@@ -76,7 +133,11 @@ void sceKernelCreateMbx()
 void sceKernelDeleteMbx()
 {
 	SceUInt uid = PARAM(0);
-	ERROR_LOG(HLE, "sceKernelDeleteMbx(%i)", uid);
+	DEBUG_LOG(HLE, "sceKernelDeleteMbx(%i)", uid);
+	u32 error;
+	Mbx *m = kernelObjects.Get<Mbx>(uid, error);
+	if (m)
+		__KernelResumeAllFromWait(m->receiveWaitingThreads, SCE_KERNEL_ERROR_WAIT_DELETE);
 	RETURN(kernelObjects.Destroy<Mbx>(uid));
 }
 
@@ -85,28 +146,63 @@ void sceKernelSendMbx()
 	SceUInt uid = PARAM(0);
 	u32 packetAddr = PARAM(1);
 
-	ERROR_LOG(HLE, "UNIMPL sceKernelSendMbx(%i, %08x)", uid, packetAddr);
+	DEBUG_LOG(HLE, "sceKernelSendMbx(%i, %08x)", uid, packetAddr);
+	u32 error;
+	Mbx *m = kernelObjects.Get<Mbx>(uid, error);
+	if (!m)
+	{
+		RETURN(error);
+		return;
+	}
+	if (!Memory::IsValidAddress(packetAddr))
+	{
+		RETURN(SCE_KERNEL_ERROR_ILLEGAL_ADDR);
+		return;
+	}
+
+	// Hand it straight to a waiting thread if there is one.
+	SceUID threadID = __KernelWaitQueueFirst(m->receiveWaitingThreads);
+	if (threadID != 0)
+	{
+		Memory::Write_U32(packetAddr, __KernelGetWaitRequest(threadID)->addr);
+		__KernelResumeThreadFromWait(threadID, 0);
+	}
+	else
+		__KernelMbxAddPacket(m, packetAddr);
 	RETURN(0);
 }
 
-void sceKernelReceiveMbx()
+void __KernelReceiveMbx(SceUInt uid, u32 packetAddrPtr, u32 timeoutPtr, const char *funcName, bool processCallbacks)
 {
-	SceUInt uid = PARAM(0);
-	u32 packetAddrPtr = PARAM(1);
-	u32 timeoutPtr = PARAM(2);
+	DEBUG_LOG(HLE, "%s(%i, %08x, %08x)", funcName, uid, packetAddrPtr, timeoutPtr);
+	u32 error;
+	Mbx *m = kernelObjects.Get<Mbx>(uid, error);
+	if (!m)
+	{
+		RETURN(error);
+		return;
+	}
 
-	ERROR_LOG(HLE, "UNIMPL sceKernelReceiveMbx(%i, %08x, %08x)", uid, packetAddrPtr, timeoutPtr);
-	RETURN(0);
+	if (m->nmb.numMessages > 0)
+	{
+		Memory::Write_U32(__KernelMbxTakePacket(m), packetAddrPtr);
+		RETURN(0);
+	}
+	else
+	{
+		WaitRequest request = {0, 0, packetAddrPtr, 0};
+		__KernelWaitCurThreadOnQueue(m->receiveWaitingThreads, WAITTYPE_MBX, uid, request, timeoutPtr, processCallbacks);
+	}
 }
 
-void sceKernelReceiveMbxCB()
+void sceKernelReceiveMbx()
 {
-	SceUInt uid = PARAM(0);
-	u32 packetAddrPtr = PARAM(1);
-	u32 timeoutPtr = PARAM(2);
+	__KernelReceiveMbx(PARAM(0), PARAM(1), PARAM(2), "sceKernelReceiveMbx", false);
+}
 
-	ERROR_LOG(HLE, "UNIMPL sceKernelReceiveMbxCB(%i, %08x, %08x)", uid, packetAddrPtr, timeoutPtr);
-	RETURN(0);
+void sceKernelReceiveMbxCB()
+{
+	__KernelReceiveMbx(PARAM(0), PARAM(1), PARAM(2), "sceKernelReceiveMbxCB", true);
 }
 
 void sceKernelPollMbx()
@@ -114,16 +210,41 @@ void sceKernelPollMbx()
 	SceUInt uid = PARAM(0);
 	u32 packetAddrPtr = PARAM(1);
 
-	ERROR_LOG(HLE, "UNIMPL sceKernelPollMbx(%i, %08x)", uid, packetAddrPtr);
-	RETURN(0);
+	DEBUG_LOG(HLE, "sceKernelPollMbx(%i, %08x)", uid, packetAddrPtr);
+	u32 error;
+	Mbx *m = kernelObjects.Get<Mbx>(uid, error);
+	if (!m)
+	{
+		RETURN(error);
+		return;
+	}
+
+	if (m->nmb.numMessages > 0)
+	{
+		Memory::Write_U32(__KernelMbxTakePacket(m), packetAddrPtr);
+		RETURN(0);
+	}
+	else
+		RETURN(SCE_KERNEL_ERROR_MBOX_NOMSG);
 }
 
 void sceKernelCancelReceiveMbx()
 {
 	SceUInt uid = PARAM(0);
-	int numWaitingThreadsAddr = PARAM(1);
+	u32 numWaitingThreadsAddr = PARAM(1);
+
+	DEBUG_LOG(HLE, "sceKernelCancelReceiveMbx(%i, %08x)", uid, numWaitingThreadsAddr);
+	u32 error;
+	Mbx *m = kernelObjects.Get<Mbx>(uid, error);
+	if (!m)
+	{
+		RETURN(error);
+		return;
+	}
 
-	ERROR_LOG(HLE, "UNIMPL sceKernelCancelReceiveMbx(%i, %i)", uid, numWaitingThreadsAddr);
+	if (Memory::IsValidAddress(numWaitingThreadsAddr))
+		Memory::Write_U32(m->receiveWaitingThreads.count, numWaitingThreadsAddr);
+	__KernelResumeAllFromWait(m->receiveWaitingThreads, SCE_KERNEL_ERROR_WAIT_CANCEL);
 	RETURN(0);
 }
 
@@ -142,11 +263,12 @@ void sceKernelReferMbxStatus()
 	SceUInt uid = PARAM(0);
 	u32 mbxStatusAddr = PARAM(1);
 
-	ERROR_LOG(HLE, "sceKernelReferMbxStatus(%i, %08x)", uid, mbxStatusAddr);
+	DEBUG_LOG(HLE, "sceKernelReferMbxStatus(%i, %08x)", uid, mbxStatusAddr);
 	u32 error;
 	Mbx *mp = kernelObjects.Get<Mbx>(uid, error);
 	if (mp)
 	{
+		mp->nmb.numWaitThreads = mp->receiveWaitingThreads.count;
 		Memory::WriteStruct(mbxStatusAddr, &mp->nmb);
 		RETURN(0);
 	}
@@ -24,4 +24,6 @@ void sceKernelReceiveMbx();
 void sceKernelReceiveMbxCB();
 void sceKernelPollMbx();
 void sceKernelCancelReceiveMbx();
-void sceKernelReferMbxStatus();
\ No newline at end of file
+void sceKernelReferMbxStatus();
+
+KernelObject *__KernelMbxObject();
@@ -15,6 +15,8 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include "ChunkFile.h"
+
 #include "HLE.h"
 #include "../System.h"
 #include "../MIPS/MIPS.h"
@@ -52,6 +54,26 @@ struct FPL : KernelObject
 	const char *GetTypeName() {return "FPL";}
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_UNKNOWN_FPLID; }
 	int GetIDType() const { return SCE_KERNEL_TMID_Fpl; }
+
+	FPL() : freeBlocks(0) {}
+	~FPL()
+	{
+		delete [] freeBlocks;
+	}
+
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(nf);
+		if (p.GetMode() == PointerWrap::MODE_READ)
+		{
+			delete [] freeBlocks;
+			freeBlocks = new bool[nf.numBlocks];
+		}
+		p.DoArray(freeBlocks, nf.numBlocks);
+		p.Do(address);
+		p.DoMarker("FPL");
+	}
+
 	NativeFPL nf;
 	bool *freeBlocks;
 	u32 address;
@@ -74,6 +96,16 @@ struct VPL : KernelObject
 	const char *GetTypeName() {return "VPL";}
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_UNKNOWN_VPLID; }
 	int GetIDType() const { return SCE_KERNEL_TMID_Vpl; }
+
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(nv);
+		p.Do(size);
+		p.Do(address);
+		alloc.DoState(p);
+		p.DoMarker("VPL");
+	}
+
 	SceKernelVplInfo nv;
 	u32 size;
 	bool *freeBlocks;
@@ -88,6 +120,23 @@ void __KernelMemoryInit()
 	INFO_LOG(HLE, "Kernel and user memory pools initialized");
 }
 
+void __KernelMemoryDoState(PointerWrap &p)
+{
+	kernelMemory.DoState(p);
+	userMemory.DoState(p);
+	p.DoMarker("sceKernelMemory");
+}
+
+KernelObject *__KernelFPLObject()
+{
+	return new FPL;
+}
+
+KernelObject *__KernelVPLObject()
+{
+	return new VPL;
+}
+
 void __KernelMemoryShutdown()
 {
 	INFO_LOG(HLE,"Shutting down user memory pool: ");
@@ -280,8 +329,10 @@ public:
 		sprintf(ptr, "MemPart: %08x - %08x	size: %08x", address, address + sz, sz);
 	}
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_UNKNOWN_MPPID; }	/// ????
-	int GetIDType() const { return 0; }
+	int GetIDType() const { return PPSSPP_KERNEL_TMID_PMB; }
 
+	// For loading states only.
+	PartitionMemoryBlock() : alloc(0), address((u32)-1) {}
 	PartitionMemoryBlock(BlockAllocator *_alloc, u32 size, bool fromEnd)
 	{
 		alloc = _alloc;
@@ -290,7 +341,20 @@ public:
 	}
 	~PartitionMemoryBlock()
 	{
-		alloc->Free(address);
+		if (alloc)
+			alloc->Free(address);
+	}
+
+	virtual void DoState(PointerWrap &p)
+	{
+		// The allocator is one of the two globals, stored as which one.
+		int allocIndex = alloc == &kernelMemory ? 1 : 0;
+		p.Do(allocIndex);
+		if (p.GetMode() == PointerWrap::MODE_READ)
+			alloc = allocIndex == 1 ? &kernelMemory : &userMemory;
+		p.Do(address);
+		p.Do(name);
+		p.DoMarker("PMB");
 	}
 	bool IsValid() {return address != (u32)-1;}
 	BlockAllocator *alloc;
@@ -298,6 +362,11 @@ public:
 	char name[32];
 };
 
+KernelObject *__KernelMemoryPMBObject()
+{
+	return new PartitionMemoryBlock;
+}
+
 
 void sceKernelMaxFreeMemSize() 
 {
@@ -19,6 +19,8 @@
 
 #include "../Util/BlockAllocator.h"
 
+class KernelObject;
+
 
 //todo: "real" memory block allocator, 
 // have elf loader grab its memory block first to avoid overwriting,
@@ -29,7 +31,11 @@ extern BlockAllocator userMemory;
 extern BlockAllocator kernelMemory;
 
 void __KernelMemoryInit();
+void __KernelMemoryDoState(PointerWrap &p);
 void __KernelMemoryShutdown();
+KernelObject *__KernelMemoryPMBObject();
+KernelObject *__KernelFPLObject();
+KernelObject *__KernelVPLObject();
 
 void sceKernelCreateVpl();
 void sceKernelDeleteVpl();
@@ -15,7 +15,9 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
-#include <fstream>
+#include "base/timeutil.h"
+#include "ChunkFile.h"
+#include "FileUtil.h"
 #include "HLE.h"
 
 #include "../Host.h"
@@ -53,7 +55,26 @@ struct Module : public KernelObject
 			entry_addr);
 	}
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_UNKNOWN_MODULE; }
-	int GetIDType() const { return 0; }
+	int GetIDType() const { return PPSSPP_KERNEL_TMID_Module; }
+
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(size);
+		p.Do(nsegment);
+		p.Do(reserved);
+		p.Do(segmentaddr);
+		p.Do(segmentsize);
+		p.Do(entry_addr);
+		p.Do(gp_value);
+		p.Do(text_addr);
+		p.Do(text_size);
+		p.Do(data_size);
+		p.Do(bss_size);
+		p.Do(attribute);
+		p.Do(version);
+		p.Do(name);
+		p.DoMarker("Module");
+	}
 
 	SceSize size;
 	char nsegment;
@@ -110,8 +131,27 @@ static SceUID mainModuleID;	// hack
 // STATE END
 //////////////////////////////////////////////////////////////////////////
 
-Module *__KernelLoadELFFromPtr(const u8 *ptr, u32 loadAddress, SceUID &id, std::string *error_string)
+void __KernelModuleDoState(PointerWrap &p)
+{
+	p.Do(numLoadedModules);
+	p.Do(mainModuleID);
+	p.DoMarker("sceKernelModule");
+}
+
+KernelObject *__KernelModuleObject()
 {
+	return new Module;
+}
+
+Module *__KernelLoadELFFromPtr(const u8 *ptr, size_t size, u32 loadAddress, SceUID &id, std::string *error_string)
+{
+	if (size < sizeof(Elf32_Ehdr))
+	{
+		ERROR_LOG(HLE, "Executable too small (%i bytes)", (int)size);
+		*error_string = "File corrupt or encrypted?";
+		return 0;
+	}
+
 	Module *m = new Module;
 	SceUID uid = kernelObjects.Create(m);
 
@@ -139,7 +179,7 @@ Module *__KernelLoadELFFromPtr(const u8 *ptr, u32 loadAddress, SceUID &id, std::
 		return 0;
 	}
 	// Open ELF reader
-	ElfReader reader((void*)ptr);
+	ElfReader reader((void*)ptr, size);
 
 	if (!reader.LoadInto(loadAddress))
 	{
@@ -262,6 +302,7 @@ Module *__KernelLoadELFFromPtr(const u8 *ptr, u32 loadAddress, SceUID &id, std::
 
 	PspLibStubEntry *entry = (PspLibStubEntry *)Memory::GetPointer(modinfo->libstub);
 
+	double importStart = real_time_now();
 	int numSyms=0;
 	for (int m=0; m<numModules; m++)
 	{
@@ -274,97 +315,82 @@ Module *__KernelLoadELFFromPtr(const u8 *ptr, u32 loadAddress, SceUID &id, std::
 		for (int i=0; i<entry[m].numFuncs; i++)
 		{
 			u32 addrToWriteSyscall = entry[m].firstSymAddr+i*8;
-			DEBUG_LOG(LOADER,"%s : %08x",GetFuncName(modulename, nidDataPtr[i]), addrToWriteSyscall);
+			const char *funcName = GetFuncName(modulename, nidDataPtr[i]);
+			DEBUG_LOG(LOADER,"%s : %08x",funcName, addrToWriteSyscall);
 			//write a syscall here
 			WriteSyscall(modulename, nidDataPtr[i], addrToWriteSyscall);
 			if (!dontadd)
 			{
 				char temp[256];
-				sprintf(temp,"zz_%s", GetFuncName(modulename, nidDataPtr[i]));
+				sprintf(temp,"zz_%s", funcName);
 				symbolMap.AddSymbol(temp, addrToWriteSyscall, 8, ST_FUNCTION);
 			}
 			numSyms++;
 		}
 		DEBUG_LOG(LOADER,"-------------------------------------------------------------");
 	}
+	INFO_LOG(LOADER, "Resolved %i imports from %i modules in %0.2f ms", numSyms, numModules, (real_time_now() - importStart) * 1000.0);
 
 	m->entry_addr = reader.GetEntryPoint();
 
 	return m;
 }
 
-bool __KernelLoadPBP(const char *filename, std::string *error_string)
+// A PBP is a header followed by the files it contains, back to back.
+enum
 {
-	static const char *FileNames[] =
-	{
-		"PARAM.SFO", "ICON0.PNG", "ICON1.PMF", "UNKNOWN.PNG",
-		"PIC1.PNG", "SND0.AT3", "UNKNOWN.PSP", "UNKNOWN.PSAR"
-	};
-
-	std::ifstream in(filename, std::ios::binary);
+	PBP_PARAM_SFO,
+	PBP_ICON0_PNG,
+	PBP_ICON1_PMF,
+	PBP_PIC0_PNG,
+	PBP_PIC1_PNG,
+	PBP_SND0_AT3,
+	PBP_DATA_PSP,
+	PBP_DATA_PSAR,
+	PBP_NUM_FILES,
+};
 
-	char temp[4];
-	in.read(temp,4);
+struct PBPHeader
+{
+	char magic[4];
+	u32 version;
+	u32 offsets[PBP_NUM_FILES];
+};
 
-	if (memcmp(temp,"\0PBP",4) != 0)
-	{
-		//This is not a valid file!
-		ERROR_LOG(LOADER,"%s is not a valid homebrew PSP1.0 PBP",filename);
-		*error_string = "Not a valid homebrew PBP";
+// Finds DATA.PSP, the executable, in a PBP. It runs up to DATA.PSAR, or the end of the file.
+static bool __KernelGetPBPExecutable(const PBPHeader &header, size_t fileSize, u32 &offset, u32 &size)
+{
+	offset = header.offsets[PBP_DATA_PSP];
+	u32 end = header.offsets[PBP_DATA_PSAR];
+	if (end < offset || end > fileSize)
+		end = (u32)fileSize;
+	if (offset >= end)
 		return false;
-	}
-
-	u32 version, offset0, offsets[16];
-	int numfiles;
-
-	in.read((char*)&version,4);
-
-	in.read((char*)&offset0,4);
-	numfiles = (offset0 - 8) / 4;
-	offsets[0] = offset0;
-	for (int i = 1; i < numfiles; i++)
-		in.read((char*)&offsets[i], 4);
-
-	// The 6th is always the executable?
-	in.seekg(offsets[5]);
-	//in.read((char*)&id,4);
-	{
-		u8 *temp = new u8[1024*1024*8];
-		in.read((char*)temp, 1024*1024*8);
-		SceUID id;
-		Module *m = __KernelLoadELFFromPtr(temp, PSP_GetDefaultLoadAddress(), id, error_string);
-		if (!m)
-			return false;
-		mipsr4k.pc = m->entry_addr;
-		delete [] temp;
-	}
-	in.close();
+	size = end - offset;
 	return true;
 }
 
-
-Module *__KernelLoadModule(u8 *fileptr, SceUID &id, SceKernelLMOption *options, std::string *error_string)
+static Module *__KernelLoadModule(const u8 *fileptr, size_t size, SceUID &id, SceKernelLMOption *options, std::string *error_string)
 {
 	Module *m = 0;
 	// Check for PBP
-	if (memcmp(fileptr, "\0PBP", 4) == 0)
+	if (size >= sizeof(PBPHeader) && memcmp(fileptr, "\0PBP", 4) == 0)
 	{
 		// PBP!
-		u32 version;
-		memcpy(&version, fileptr + 4, 4);
-		u32 offset0, offsets[16];
-		int numfiles;
-
-		memcpy(&offset0, fileptr + 8, 4);
-		numfiles = (offset0 - 8)/4;
-		offsets[0] = offset0;
-		for (int i = 1; i < numfiles; i++)
-			memcpy(&offsets[i], fileptr + 12 + 4*i, 4);
-		m = __KernelLoadELFFromPtr(fileptr + offsets[5], PSP_GetDefaultLoadAddress(), id, error_string);
+		PBPHeader header;
+		memcpy(&header, fileptr, sizeof(header));
+		u32 offset, execSize;
+		if (!__KernelGetPBPExecutable(header, size, offset, execSize))
+		{
+			ERROR_LOG(LOADER, "PBP has no executable");
+			*error_string = "Not a valid homebrew PBP";
+			return 0;
+		}
+		m = __KernelLoadELFFromPtr(fileptr + offset, execSize, PSP_GetDefaultLoadAddress(), id, error_string);
 	}
 	else
 	{
-		m = __KernelLoadELFFromPtr(fileptr, PSP_GetDefaultLoadAddress(), id, error_string);
+		m = __KernelLoadELFFromPtr(fileptr, size, PSP_GetDefaultLoadAddress(), id, error_string);
 	}
 
 	return m;
@@ -392,6 +418,25 @@ u32 __KernelGetModuleGP(SceUID module)
 	}
 }
 
+// Sets up the main thread for a loaded executable. argp is what the game sees as argv[0].
+static void __KernelStartExec(Module *m, const char *argp)
+{
+	mipsr4k.pc = m->entry_addr;
+
+	INFO_LOG(LOADER, "Module entry: %08x", mipsr4k.pc);
+
+	SceKernelSMOption option;
+	option.size = sizeof(SceKernelSMOption);
+	option.attribute = PSP_THREAD_ATTR_USER;
+	option.mpidstack = 2;
+	option.priority = 0x20;
+	option.stacksize = 0x40000;	// crazy? but seems to be the truth
+
+	__KernelStartModule(m, (u32)strlen(argp), argp, &option);
+
+	__KernelStartIdleThreads();
+}
+
 bool __KernelLoadExec(const char *filename, SceKernelLoadExecParam *param, std::string *error_string)
 {
 	// Wipe kernel here, loadexec should reset the entire system
@@ -406,36 +451,62 @@ bool __KernelLoadExec(const char *filename, SceKernelLoadExecParam *param, std::
 	}
 	u32 handle = pspFileSystem.OpenFile(filename, FILEACCESS_READ);
 
-	u8 *temp = new u8[(int)size];
+	// For a PBP, only read the executable, not the icons and sounds around it.
+	PBPHeader header;
+	u32 offset = 0;
+	u32 execSize = (u32)size;
+	if (size >= (s64)sizeof(PBPHeader) && pspFileSystem.ReadFile(handle, (u8 *)&header, sizeof(header)) == sizeof(header) &&
+		memcmp(header.magic, "\0PBP", 4) == 0)
+	{
+		if (!__KernelGetPBPExecutable(header, (size_t)size, offset, execSize))
+		{
+			ERROR_LOG(LOADER, "PBP has no executable: %s", filename);
+			*error_string = "Not a valid homebrew PBP";
+			pspFileSystem.CloseFile(handle);
+			return false;
+		}
+	}
+	pspFileSystem.SeekFile(handle, (s32)offset, FILEMOVE_BEGIN);
 
-	pspFileSystem.ReadFile(handle, temp, (size_t)size);
+	u8 *temp = new u8[execSize];
+	size_t readSize = pspFileSystem.ReadFile(handle, temp, execSize);
+	pspFileSystem.CloseFile(handle);
 
 	SceUID moduleID;
-	Module *m = __KernelLoadModule(temp, moduleID, 0, error_string);
+	Module *m = __KernelLoadELFFromPtr(temp, readSize, PSP_GetDefaultLoadAddress(), moduleID, error_string);
+	delete [] temp;
 
 	if (!m) {
 		ERROR_LOG(LOADER, "Failed to load module %s", filename);
 		return false;
 	}
 
-	mipsr4k.pc = m->entry_addr;
-
-	INFO_LOG(LOADER, "Module entry: %08x", mipsr4k.pc);
-
-	delete [] temp;
+	__KernelStartExec(m, filename);
+	return true;
+}
 
-	pspFileSystem.CloseFile(handle);
+bool __KernelLoadExecFromHost(const std::string &hostFilename, const char *filename, std::string *error_string)
+{
+	__KernelInit();
 
-	SceKernelSMOption option;
-	option.size = sizeof(SceKernelSMOption);
-	option.attribute = PSP_THREAD_ATTR_USER;
-	option.mpidstack = 2;
-	option.priority = 0x20;
-	option.stacksize = 0x40000;	// crazy? but seems to be the truth
+	// Segments get copied straight out of the mapping, and only the pages of the executable
+	// itself are ever read in.
+	File::MappedFile file;
+	if (!file.Open(hostFilename))
+	{
+		ERROR_LOG(LOADER, "Could not map %s", hostFilename.c_str());
+		*error_string = "Error reading file";
+		return false;
+	}
 
-	__KernelStartModule(m, (u32)strlen(filename), filename, &option);
+	SceUID moduleID;
+	Module *m = __KernelLoadModule(file.GetData(), file.GetSize(), moduleID, 0, error_string);
+	if (!m) {
+		ERROR_LOG(LOADER, "Failed to load module %s", hostFilename.c_str());
+		return false;
+	}
 
-	__KernelStartIdleThreads();
+	__KernelStartExec(m, filename);
 	return true;
 }
 
@@ -20,8 +20,12 @@
 #include "sceKernel.h"
 #include "HLE.h"
 
-bool __KernelLoadPBP(const char *filename, std::string *error_string);
 u32 __KernelGetModuleGP(SceUID module);
+void __KernelModuleDoState(PointerWrap &p);
+KernelObject *__KernelModuleObject();
 bool __KernelLoadExec(const char *filename, SceKernelLoadExecParam *param, std::string *error_string);
+// Boots an ELF or PBP straight from a host file, without going through the PSP file system.
+// filename is the name the game gets to see.
+bool __KernelLoadExecFromHost(const std::string &hostFilename, const char *filename, std::string *error_string);
 
 void Register_ModuleMgrForUser();
@@ -15,10 +15,24 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <algorithm>
+
+#include "ChunkFile.h"
+
 #include "HLE.h"
 #include "sceKernel.h"
+#include "sceKernelThread.h"
 #include "sceKernelMsgPipe.h"
 
+#define PSP_MPP_ATTR_SEND_FIFO 0
+#define PSP_MPP_ATTR_SEND_PRIORITY 0x100
+#define PSP_MPP_ATTR_RECEIVE_FIFO 0
+#define PSP_MPP_ATTR_RECEIVE_PRIORITY 0x1000
+
+// Transfer everything or nothing, or as much as possible but at least a byte.
+#define PSP_MPP_WAIT_MODE_COMPLETE 0
+#define PSP_MPP_WAIT_MODE_PARTIAL 1
+
 struct NativeMsgPipe
 {
 	SceSize size;
@@ -37,15 +51,126 @@ struct MsgPipe : public KernelObject
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_UNKNOWN_MPPID; }
 	int GetIDType() const { return SCE_KERNEL_TMID_Mpipe; }
 
+	MsgPipe() : buffer(0) {}
+	~MsgPipe()
+	{
+		delete [] buffer;
+	}
+
+	WaitQueue *GetWaitQueue(int index)
+	{
+		if (index == 0)
+			return &sendWaitingThreads;
+		else if (index == 1)
+			return &receiveWaitingThreads;
+		return 0;
+	}
+	void RecheckWaitingThreads();
+
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(nmp);
+		p.Do(sendWaitingThreads);
+		p.Do(receiveWaitingThreads);
+		if (p.GetMode() == PointerWrap::MODE_READ)
+		{
+			delete [] buffer;
+			buffer = new u8[nmp.bufSize];
+		}
+		p.DoArray(buffer, nmp.bufSize);
+		p.Do(readPos);
+		p.DoMarker("MsgPipe");
+	}
+
 	NativeMsgPipe nmp;
 
-	std::vector<SceUID> sendWaitingThreads;
-	std::vector<SceUID> receiveWaitingThreads;
+	WaitQueue sendWaitingThreads;
+	WaitQueue receiveWaitingThreads;
 
 	// Ring buffer
 	u8 *buffer;
+	int readPos;
 };
 
+KernelObject *__KernelMsgPipeObject()
+{
+	return new MsgPipe;
+}
+
+// Copies into the ring buffer if the mode allows. Returns the bytes copied, or -1 if it has to wait.
+int __KernelMsgPipeWrite(MsgPipe *m, u32 addr, u32 size, int waitMode)
+{
+	u32 count = std::min(size, (u32)m->nmp.freeSize);
+	if (waitMode == PSP_MPP_WAIT_MODE_COMPLETE ? count < size : (count == 0 && size != 0))
+		return -1;
+	if (count == 0)
+		return 0;
+
+	int writePos = (m->readPos + m->nmp.bufSize - m->nmp.freeSize) % m->nmp.bufSize;
+	u32 firstPart = std::min(count, (u32)(m->nmp.bufSize - writePos));
+	Memory::Memcpy(m->buffer + writePos, addr, firstPart);
+	Memory::Memcpy(m->buffer, addr + firstPart, count - firstPart);
+	m->nmp.freeSize -= count;
+	return (int)count;
+}
+
+int __KernelMsgPipeRead(MsgPipe *m, u32 addr, u32 size, int waitMode)
+{
+	u32 count = std::min(size, (u32)(m->nmp.bufSize - m->nmp.freeSize));
+	if (waitMode == PSP_MPP_WAIT_MODE_COMPLETE ? count < size : (count == 0 && size != 0))
+		return -1;
+	if (count == 0)
+		return 0;
+
+	u32 firstPart = std::min(count, (u32)(m->nmp.bufSize - m->readPos));
+	Memory::Memcpy(addr, m->buffer + m->readPos, firstPart);
+	Memory::Memcpy(addr + firstPart, m->buffer, count - firstPart);
+	m->readPos = (m->readPos + count) % m->nmp.bufSize;
+	m->nmp.freeSize += count;
+	return (int)count;
+}
+
+// Serves waiting threads, in queue order, until neither side can make progress.
+void __KernelMsgPipeWakeThreads(MsgPipe *m)
+{
+	bool progress = true;
+	while (progress)
+	{
+		progress = false;
+
+		SceUID threadID;
+		while ((threadID = __KernelWaitQueueFirst(m->receiveWaitingThreads)) != 0)
+		{
+			const WaitRequest *request = __KernelGetWaitRequest(threadID);
+			int count = __KernelMsgPipeRead(m, request->addr, request->value, request->mode);
+			if (count < 0)
+				break;
+			if (Memory::IsValidAddress(request->addr2))
+				Memory::Write_U32(count, request->addr2);
+			__KernelResumeThreadFromWait(threadID, 0);
+			progress = true;
+		}
+
+		while ((threadID = __KernelWaitQueueFirst(m->sendWaitingThreads)) != 0)
+		{
+			const WaitRequest *request = __KernelGetWaitRequest(threadID);
+			int count = __KernelMsgPipeWrite(m, request->addr, request->value, request->mode);
+			if (count < 0)
+				break;
+			if (Memory::IsValidAddress(request->addr2))
+				Memory::Write_U32(count, request->addr2);
+			__KernelResumeThreadFromWait(threadID, 0);
+			progress = true;
+		}
+	}
+}
+
+// A big send or receive at the head of a queue may have been holding up smaller ones.
+void MsgPipe::RecheckWaitingThreads()
+{
+	__KernelMsgPipeWakeThreads(this);
+}
+
 void sceKernelCreateMsgPipe()
 {
 	const char *name = Memory::GetCharPointer(PARAM(0));
@@ -57,6 +182,8 @@ void sceKernelCreateMsgPipe()
 	MsgPipe *m = new MsgPipe();
 	SceUID id = kernelObjects.Create(m);
 
+	DEBUG_LOG(HLE, "%i=sceKernelCreateMsgPipe(%s, %i, %08x, %i, %08x)", id, name, memoryPartition, attr, size, opt);
+
 	m->nmp.size = sizeof(NativeMsgPipe);
 	strncpy(m->nmp.name, name, sizeof(m->nmp.name));
 	m->nmp.attr = attr;
@@ -64,8 +191,11 @@ void sceKernelCreateMsgPipe()
 	m->nmp.freeSize = size;
 	m->nmp.numSendWaitThreads = 0;
 	m->nmp.numReceiveWaitThreads = 0;
+	__KernelInitWaitQueue(m->sendWaitingThreads, (attr & PSP_MPP_ATTR_SEND_PRIORITY) != 0);
+	__KernelInitWaitQueue(m->receiveWaitingThreads, (attr & PSP_MPP_ATTR_RECEIVE_PRIORITY) != 0);
 
 	m->buffer = new u8[size];
+	m->readPos = 0;
 	RETURN(id);
 }
 
@@ -77,96 +207,137 @@ void sceKernelDeleteMsgPipe()
 	if (!p)
 	{
 		ERROR_LOG(HLE, "sceKernelDeleteMsgPipe(%i) - ERROR %08x", uid, error);
+		RETURN(error);
 		return;
 	}
-	delete [] p->buffer;
-	ERROR_LOG(HLE, "sceKernelDeleteMsgPipe(%i)", uid);
+	__KernelResumeAllFromWait(p->sendWaitingThreads, SCE_KERNEL_ERROR_WAIT_DELETE);
+	__KernelResumeAllFromWait(p->receiveWaitingThreads, SCE_KERNEL_ERROR_WAIT_DELETE);
+	DEBUG_LOG(HLE, "sceKernelDeleteMsgPipe(%i)", uid);
 	RETURN(kernelObjects.Destroy<MsgPipe>(uid));
 }
 
-void sceKernelSendMsgPipe()
+// Pipes without a buffer hand data straight from sender to receiver. That's not emulated, so
+// they're refused rather than left to block forever.
+void __KernelSendMsgPipe(SceUInt uid, u32 sendBufAddr, u32 sendSize, int waitMode, u32 resultAddr, u32 timeoutPtr, const char *funcName, bool poll, bool processCallbacks)
 {
-	SceUInt uid = PARAM(0);
-	u32 sendBufAddr = PARAM(1);
-	u32 sendSize = PARAM(2);
-	int waitMode = PARAM(3);
-	u32 resultAddr = PARAM(4);
-	u32 timeoutPtr = PARAM(5);
+	DEBUG_LOG(HLE, "%s(%i, %08x, %i, %i, %08x, %08x)", funcName, uid, sendBufAddr, sendSize, waitMode, resultAddr, timeoutPtr);
+	u32 error;
+	MsgPipe *m = kernelObjects.Get<MsgPipe>(uid, error);
+	if (!m)
+	{
+		RETURN(error);
+		return;
+	}
+	if (sendSize > (u32)m->nmp.bufSize)
+	{
+		RETURN(SCE_KERNEL_ERROR_ILLEGAL_SIZE);
+		return;
+	}
 
-	ERROR_LOG(HLE, "UNIMPL sceKernelSendMsgPipe(%i, %08x, %i, %i, %08x, %08x)", uid, sendBufAddr, sendSize, waitMode, resultAddr, timeoutPtr);
-	RETURN(0);
+	// Don't jump the queue.
+	int count = m->sendWaitingThreads.count == 0 ? __KernelMsgPipeWrite(m, sendBufAddr, sendSize, waitMode) : -1;
+	if (count >= 0)
+	{
+		if (Memory::IsValidAddress(resultAddr))
+			Memory::Write_U32(count, resultAddr);
+		__KernelMsgPipeWakeThreads(m);
+		RETURN(0);
+	}
+	else if (poll)
+		RETURN(SCE_KERNEL_ERROR_MPP_FULL);
+	else
+	{
+		WaitRequest request = {sendSize, (u32)waitMode, sendBufAddr, resultAddr};
+		__KernelWaitCurThreadOnQueue(m->sendWaitingThreads, WAITTYPE_MSGPIPE, uid, request, timeoutPtr, processCallbacks);
+	}
 }
 
-void sceKernelSendMsgPipeCB()
+void sceKernelSendMsgPipe()
 {
-	SceUInt uid = PARAM(0);
-	u32 sendBufAddr = PARAM(1);
-	u32 sendSize = PARAM(2);
-	int waitMode = PARAM(3);
-	u32 resultAddr = PARAM(4);
-	u32 timeoutPtr = PARAM(5);
+	__KernelSendMsgPipe(PARAM(0), PARAM(1), PARAM(2), PARAM(3), PARAM(4), PARAM(5), "sceKernelSendMsgPipe", false, false);
+}
 
-	ERROR_LOG(HLE, "UNIMPL sceKernelSendMsgPipeCB(%i, %08x, %i, %i, %08x, %08x)", uid, sendBufAddr, sendSize, waitMode, resultAddr, timeoutPtr);
-	RETURN(0);
+void sceKernelSendMsgPipeCB()
+{
+	__KernelSendMsgPipe(PARAM(0), PARAM(1), PARAM(2), PARAM(3), PARAM(4), PARAM(5), "sceKernelSendMsgPipeCB", false, true);
 }
 
 void sceKernelTrySendMsgPipe()
 {
-	SceUInt uid = PARAM(0);
-	u32 sendBufAddr = PARAM(1);
-	u32 sendSize = PARAM(2);
-	int waitMode = PARAM(3);
-	u32 resultAddr = PARAM(4);
+	__KernelSendMsgPipe(PARAM(0), PARAM(1), PARAM(2), PARAM(3), PARAM(4), 0, "sceKernelTrySendMsgPipe", true, false);
+}
 
-	ERROR_LOG(HLE, "UNIMPL sceKernelTrySendMsgPipe(%i, %08x, %i, %i, %08x)", uid, sendBufAddr, sendSize, waitMode, resultAddr);
-	RETURN(0);
+void __KernelReceiveMsgPipe(SceUInt uid, u32 receiveBufAddr, u32 receiveSize, int waitMode, u32 resultAddr, u32 timeoutPtr, const char *funcName, bool poll, bool processCallbacks)
+{
+	DEBUG_LOG(HLE, "%s(%i, %08x, %i, %i, %08x, %08x)", funcName, uid, receiveBufAddr, receiveSize, waitMode, resultAddr, timeoutPtr);
+	u32 error;
+	MsgPipe *m = kernelObjects.Get<MsgPipe>(uid, error);
+	if (!m)
+	{
+		RETURN(error);
+		return;
+	}
+	if (receiveSize > (u32)m->nmp.bufSize)
+	{
+		RETURN(SCE_KERNEL_ERROR_ILLEGAL_SIZE);
+		return;
+	}
+
+	int count = m->receiveWaitingThreads.count == 0 ? __KernelMsgPipeRead(m, receiveBufAddr, receiveSize, waitMode) : -1;
+	if (count >= 0)
+	{
+		if (Memory::IsValidAddress(resultAddr))
+			Memory::Write_U32(count, resultAddr);
+		__KernelMsgPipeWakeThreads(m);
+		RETURN(0);
+	}
+	else if (poll)
+		RETURN(SCE_KERNEL_ERROR_MPP_EMPTY);
+	else
+	{
+		WaitRequest request = {receiveSize, (u32)waitMode, receiveBufAddr, resultAddr};
+		__KernelWaitCurThreadOnQueue(m->receiveWaitingThreads, WAITTYPE_MSGPIPE, uid, request, timeoutPtr, processCallbacks);
+	}
 }
 
 void sceKernelReceiveMsgPipe()
 {
-	SceUInt uid = PARAM(0);
-	u32 receiveBufAddr = PARAM(1);
-	u32 receiveSize = PARAM(2);
-	int waitMode = PARAM(3);
-	u32 resultAddr = PARAM(4);
-	u32 timeoutPtr = PARAM(5);
-
-	ERROR_LOG(HLE, "UNIMPL sceKernelReceiveMsgPipe(%i, %08x, %i, %i, %08x, %08x)", uid, receiveBufAddr, receiveSize, waitMode, resultAddr, timeoutPtr);
-	RETURN(0);
+	__KernelReceiveMsgPipe(PARAM(0), PARAM(1), PARAM(2), PARAM(3), PARAM(4), PARAM(5), "sceKernelReceiveMsgPipe", false, false);
 }
 
 void sceKernelReceiveMsgPipeCB()
 {
-	SceUInt uid = PARAM(0);
-	u32 receiveBufAddr = PARAM(1);
-	u32 receiveSize = PARAM(2);
-	int waitMode = PARAM(3);
-	u32 resultAddr = PARAM(4);
-	u32 timeoutPtr = PARAM(5);
-
-	ERROR_LOG(HLE, "UNIMPL sceKernelReceiveMsgPipeCB(%i, %08x, %i, %i, %08x, %08x)", uid, receiveBufAddr, receiveSize, waitMode, resultAddr, timeoutPtr);
-	RETURN(0);
+	__KernelReceiveMsgPipe(PARAM(0), PARAM(1), PARAM(2), PARAM(3), PARAM(4), PARAM(5), "sceKernelReceiveMsgPipeCB", false, true);
 }
 
 void sceKernelTryReceiveMsgPipe()
 {
-	SceUInt uid = PARAM(0);
-	u32 receiveBufAddr = PARAM(1);
-	u32 receiveSize = PARAM(2);
-	int waitMode = PARAM(3);
-	u32 resultAddr = PARAM(4);
-
-	ERROR_LOG(HLE, "UNIMPL sceKernelTryReceiveMsgPipe(%i, %08x, %i, %i, %08x)", uid, receiveBufAddr, receiveSize, waitMode, resultAddr);
-	RETURN(0);
+	__KernelReceiveMsgPipe(PARAM(0), PARAM(1), PARAM(2), PARAM(3), PARAM(4), 0, "sceKernelTryReceiveMsgPipe", true, false);
 }
 
 void sceKernelCancelMsgPipe()
 {
 	SceUInt uid = PARAM(0);
-	u32 numSendThreads = PARAM(1);
-	u32 numReceiveThreads = PARAM(2);
+	u32 numSendThreadsAddr = PARAM(1);
+	u32 numReceiveThreadsAddr = PARAM(2);
+
+	DEBUG_LOG(HLE, "sceKernelCancelMsgPipe(%i, %08x, %08x)", uid, numSendThreadsAddr, numReceiveThreadsAddr);
+	u32 error;
+	MsgPipe *m = kernelObjects.Get<MsgPipe>(uid, error);
+	if (!m)
+	{
+		RETURN(error);
+		return;
+	}
 
-	ERROR_LOG(HLE, "UNIMPL sceKernelCancelMsgPipe(%i, %i, %i)", uid, numSendThreads, numReceiveThreads);
+	if (Memory::IsValidAddress(numSendThreadsAddr))
+		Memory::Write_U32(m->sendWaitingThreads.count, numSendThreadsAddr);
+	if (Memory::IsValidAddress(numReceiveThreadsAddr))
+		Memory::Write_U32(m->receiveWaitingThreads.count, numReceiveThreadsAddr);
+	__KernelResumeAllFromWait(m->sendWaitingThreads, SCE_KERNEL_ERROR_WAIT_CANCEL);
+	__KernelResumeAllFromWait(m->receiveWaitingThreads, SCE_KERNEL_ERROR_WAIT_CANCEL);
+	m->nmp.freeSize = m->nmp.bufSize;
+	m->readPos = 0;
 	RETURN(0);
 }
 
@@ -180,6 +351,8 @@ void sceKernelReferMsgPipeStatus()
 	MsgPipe *mp = kernelObjects.Get<MsgPipe>(uid, error);
 	if (mp)
 	{
+		mp->nmp.numSendWaitThreads = mp->sendWaitingThreads.count;
+		mp->nmp.numReceiveWaitThreads = mp->receiveWaitingThreads.count;
 		Memory::WriteStruct(msgPipeStatusAddr, &mp->nmp);
 		RETURN(0);
 	}
@@ -17,6 +17,8 @@
 
 // UNFINISHED
 
+#include "ChunkFile.h"
+
 #include "HLE.h"
 #include "../MIPS/MIPS.h"
 #include "sceKernel.h"
@@ -48,8 +50,17 @@ struct Mutex : public KernelObject
 	const char *GetTypeName() {return "Mutex";}
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_UNKNOWN_SEMID; }	// Not sure?
 	int GetIDType() const { return SCE_KERNEL_TMID_Mutex; }
+	WaitQueue *GetWaitQueue(int index) { return index == 0 ? &waitingThreads : 0; }
+
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(nm);
+		p.Do(waitingThreads);
+		p.DoMarker("Mutex");
+	}
+
 	NativeMutex nm;
-	std::vector<SceUID> waitingThreads;
+	WaitQueue waitingThreads;
 };
 
 struct LWMutex : public KernelObject
@@ -58,10 +69,28 @@ struct LWMutex : public KernelObject
 	const char *GetTypeName() {return "LWMutex";}
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_UNKNOWN_SEMID; }	// Not sure?
 	int GetIDType() const { return SCE_KERNEL_TMID_LwMutex; }
+
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(nm);
+		p.Do(waitingThreads);
+		p.DoMarker("LWMutex");
+	}
+
 	NativeMutex nm;
 	std::vector<SceUID> waitingThreads;
 };
 
+KernelObject *__KernelMutexObject()
+{
+	return new Mutex;
+}
+
+KernelObject *__KernelLwMutexObject()
+{
+	return new LWMutex;
+}
+
 u32 sceKernelCreateMutex(const char *name, u32 attr, u32 options)
 {
 	DEBUG_LOG(HLE,"sceKernelCreateMutex(%s, %08x, %08x)", name, attr, options);
@@ -73,6 +102,7 @@ u32 sceKernelCreateMutex(const char *name, u32 attr, u32 options)
 	mutex->nm.attr = attr;
 	mutex->nm.lockLevel = 0;
 	mutex->nm.lockThread = -1;
+	__KernelInitWaitQueue(mutex->waitingThreads, (attr & PSP_MUTEX_ATTR_PRIORITY) != 0);
 
 	strncpy(mutex->nm.name, name, 32);
 	return id;
@@ -85,51 +115,81 @@ u32 sceKernelDeleteMutex(u32 id)
 	Mutex *mutex = kernelObjects.Get<Mutex>(id, error);
 	if (!mutex)
 		return PSP_MUTEX_ERROR_NO_SUCH_MUTEX;
+	__KernelResumeAllFromWait(mutex->waitingThreads, SCE_KERNEL_ERROR_WAIT_DELETE);
 	kernelObjects.Destroy<Mutex>(id);
 	return 0;
 }
 
-u32 sceKernelLockMutex(u32 id, u32 count, u32 timeoutPtr)
+// Not wrapped: when it blocks, the return value belongs to the thread that's switched to.
+void __KernelLockMutex(SceUID id, int count, u32 timeoutPtr, const char *funcName, bool processCallbacks)
 {
-	DEBUG_LOG(HLE,"sceKernelLockMutex(%i, %i, %08x)", id, count, timeoutPtr);
+	DEBUG_LOG(HLE,"%s(%i, %i, %08x)", funcName, id, count, timeoutPtr);
 	u32 error;
 	Mutex *mutex = kernelObjects.Get<Mutex>(id, error);
 	if (!mutex)
-		return PSP_MUTEX_ERROR_NO_SUCH_MUTEX;
+	{
+		RETURN(PSP_MUTEX_ERROR_NO_SUCH_MUTEX);
+		return;
+	}
+	if (count <= 0)
+	{
+		RETURN(SCE_KERNEL_ERROR_ILLEGAL_COUNT);
+		return;
+	}
+
 	if (mutex->nm.lockLevel == 0)
 	{
 		mutex->nm.lockLevel += count;
 		mutex->nm.lockThread = __KernelGetCurThread();
 		// Nobody had it locked - no need to block
+		RETURN(0);
 	}
 	else if ((mutex->nm.attr & PSP_MUTEX_ATTR_ALLOW_RECURSIVE) && mutex->nm.lockThread == __KernelGetCurThread())
 	{
 		// Recursive mutex, let's just increase the lock count and keep going
 		mutex->nm.lockLevel += count;
+		RETURN(0);
 	}
 	else
 	{
-		// Yeah, we need to block. Somehow.
+		// The unlocking thread hands the mutex over, see sceKernelUnlockMutex.
+		WaitRequest request = {(u32)count, 0, 0, 0};
+		__KernelWaitCurThreadOnQueue(mutex->waitingThreads, WAITTYPE_MUTEX, id, request, timeoutPtr, processCallbacks);
 	}
-	return 0;
 }
 
-u32 sceKernelLockMutexCB(u32 id, u32 count, u32 timeoutPtr)
+void sceKernelLockMutex()
 {
-	DEBUG_LOG(HLE,"UNIMPL sceKernelLockMutexCB(%i, %i, %08x)", id, count, timeoutPtr);
-	return 0;
+	__KernelLockMutex(PARAM(0), PARAM(1), PARAM(2), "sceKernelLockMutex", false);
+}
+
+void sceKernelLockMutexCB()
+{
+	__KernelLockMutex(PARAM(0), PARAM(1), PARAM(2), "sceKernelLockMutexCB", true);
 }
 
 u32 sceKernelUnlockMutex(u32 id, u32 count)
 {
-	DEBUG_LOG(HLE,"UNFINISHED sceKernelUnlockMutex(%i, %i)", id, count);
+	DEBUG_LOG(HLE,"sceKernelUnlockMutex(%i, %i)", id, count);
 	u32 error;
 	Mutex *mutex = kernelObjects.Get<Mutex>(id, error);
 	if (!mutex)
 		return PSP_MUTEX_ERROR_NO_SUCH_MUTEX;
-	if (mutex->nm.lockLevel == 0)
+	if (mutex->nm.lockLevel == 0 || (int)count > mutex->nm.lockLevel)
 		return PSP_MUTEX_ERROR_NOT_LOCKED;
 	mutex->nm.lockLevel -= count;
-	// TODO....
+
+	if (mutex->nm.lockLevel == 0)
+	{
+		SceUID threadID = __KernelWaitQueueFirst(mutex->waitingThreads);
+		if (threadID != 0)
+		{
+			mutex->nm.lockLevel = (int)__KernelGetWaitRequest(threadID)->value;
+			mutex->nm.lockThread = threadID;
+			__KernelResumeThreadFromWait(threadID, 0);
+		}
+		else
+			mutex->nm.lockThread = -1;
+	}
 	return 0;
 }
@@ -20,11 +20,14 @@
 // TODO
 u32 sceKernelCreateMutex(const char *name, u32 attr, u32 options);
 u32 sceKernelDeleteMutex(u32 id);
-u32 sceKernelLockMutex(u32 id, u32 count, u32 timeoutPtr);
-u32 sceKernelLockMutexCB(u32 id, u32 count, u32 timeoutPtr);
+void sceKernelLockMutex();
+void sceKernelLockMutexCB();
 u32 sceKernelUnlockMutex(u32 id, u32 count);
 
 /*
 void sceKernelCreateLwMutex();
 void sceKernelDeleteLwMutex();
 */
+
+KernelObject *__KernelMutexObject();
+KernelObject *__KernelLwMutexObject();
@@ -15,6 +15,8 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include "ChunkFile.h"
+
 #include "HLE.h"
 #include "../MIPS/MIPS.h"
 
@@ -45,6 +47,9 @@ struct NativeSemaphore
 };
 
 
+#define PSP_SEMA_ATTR_FIFO 0
+#define PSP_SEMA_ATTR_PRIORITY 0x100
+
 struct Semaphore : public KernelObject 
 {
 	const char *GetName() {return ns.name;}
@@ -53,15 +58,75 @@ struct Semaphore : public KernelObject
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_UNKNOWN_SEMID; }
 	int GetIDType() const { return SCE_KERNEL_TMID_Semaphore; }
 
+	WaitQueue *GetWaitQueue(int index) { return index == 0 ? &waitingThreads : 0; }
+	void RecheckWaitingThreads();
+
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(ns);
+		p.Do(waitingThreads);
+		p.DoMarker("Semaphore");
+	}
+
 	NativeSemaphore ns;
-	std::vector<SceUID> waitingThreads;
+	WaitQueue waitingThreads;
 };
 
+KernelObject *__KernelSemaphoreObject()
+{
+	return new Semaphore;
+}
+
+// Wakes waiting threads in order for as long as the count covers what they want.
+void __KernelSemaWakeThreads(Semaphore *s)
+{
+	SceUID threadID;
+	while ((threadID = __KernelWaitQueueFirst(s->waitingThreads)) != 0)
+	{
+		int wantedCount = (int)__KernelGetWaitRequest(threadID)->value;
+		if (wantedCount > s->ns.currentCount)
+			break;
+
+		s->ns.currentCount -= wantedCount;
+		__KernelResumeThreadFromWait(threadID, 0);
+	}
+}
+
+// A thread that wanted more than the count may have been blocking smaller requests behind it.
+void Semaphore::RecheckWaitingThreads()
+{
+	__KernelSemaWakeThreads(this);
+}
+
+//int sceKernelCancelSema(SceUID semaid, int newCount, int *numWaitThreads);
 void sceKernelCancelSema()
 {
 	SceUID id = PARAM(0);
-	ERROR_LOG(HLE,"UNIMPL sceKernelCancelSema(%i)", id);
-	RETURN(0);
+	int newCount = PARAM(1);
+	u32 numWaitThreadsPtr = PARAM(2);
+
+	u32 error;
+	Semaphore *s = kernelObjects.Get<Semaphore>(id, error);
+	if (s)
+	{
+		DEBUG_LOG(HLE,"sceKernelCancelSema(%i, %i, %08x)", id, newCount, numWaitThreadsPtr);
+		if (newCount > s->ns.maxCount)
+		{
+			RETURN(SCE_KERNEL_ERROR_ILLEGAL_COUNT);
+			return;
+		}
+
+		if (Memory::IsValidAddress(numWaitThreadsPtr))
+			Memory::Write_U32(s->waitingThreads.count, numWaitThreadsPtr);
+		s->ns.currentCount = newCount < 0 ? s->ns.initCount : newCount;
+		__KernelResumeAllFromWait(s->waitingThreads, SCE_KERNEL_ERROR_WAIT_CANCEL);
+		RETURN(0);
+	}
+	else
+	{
+		ERROR_LOG(HLE, "sceKernelCancelSema : Trying to cancel invalid semaphore %i", id);
+		RETURN(error);
+	}
 }
 
 //SceUID sceKernelCreateSema(const char *name, SceUInt attr, int initVal, int maxVal, SceKernelSemaOptParam *option);
@@ -78,6 +143,7 @@ void sceKernelCreateSema()
 	s->ns.currentCount = s->ns.initCount;
 	s->ns.maxCount = PARAM(3);
 	s->ns.numWaitThreads = 0;
+	__KernelInitWaitQueue(s->waitingThreads, (s->ns.attr & PSP_SEMA_ATTR_PRIORITY) != 0);
 
 	DEBUG_LOG(HLE,"%i=sceKernelCreateSema(%s, %08x, %i, %i, %08x)", id, s->ns.name, s->ns.attr, s->ns.initCount, s->ns.maxCount, PARAM(4));
 
@@ -89,6 +155,10 @@ void sceKernelDeleteSema()
 {
 	SceUID id = PARAM(0);
 	DEBUG_LOG(HLE,"sceKernelDeleteSema(%i)", id);
+	u32 error;
+	Semaphore *s = kernelObjects.Get<Semaphore>(id, error);
+	if (s)
+		__KernelResumeAllFromWait(s->waitingThreads, SCE_KERNEL_ERROR_WAIT_DELETE);
 	RETURN(kernelObjects.Destroy<Semaphore>(id));
 }
 
@@ -100,9 +170,10 @@ void sceKernelReferSemaStatus()
 	if (s)
 	{
 		DEBUG_LOG(HLE,"sceKernelReferSemaStatus(%i, %08x)", id, PARAM(1));
+		s->ns.numWaitThreads = s->waitingThreads.count;
 		NativeSemaphore *outptr = (NativeSemaphore*)Memory::GetPointer(PARAM(1));
 		int szToCopy = outptr->size - 4;
-		memcpy((char*)outptr + 4, (char*)s + 4, szToCopy);
+		memcpy((char*)outptr + 4, (char*)&s->ns + 4, szToCopy);
 		RETURN(0);
 	}
 	else
@@ -115,45 +186,26 @@ void sceKernelReferSemaStatus()
 //int sceKernelSignalSema(SceUID semaid, int signal);
 void sceKernelSignalSema()
 {
-	//TODO: check that this thing really works :)
 	SceUID id = PARAM(0);
-	u32 signal = PARAM(1);
+	int signal = PARAM(1);
 	u32 error;
 	Semaphore *s = kernelObjects.Get<Semaphore>(id, error);
 	if (s)
 	{
 		int oldval = s->ns.currentCount;
+		if (oldval + signal > s->ns.maxCount)
+		{
+			DEBUG_LOG(HLE,"sceKernelSignalSema(%i, %i) - overflow (%i, max %i)", id, signal, oldval, s->ns.maxCount);
+			RETURN(SCE_KERNEL_ERROR_SEMA_OVF);
+			return;
+		}
 
 		s->ns.currentCount += signal;
 		DEBUG_LOG(HLE,"sceKernelSignalSema(%i, %i) (old: %i, new: %i)", id, signal, oldval, s->ns.currentCount);
-			
-		bool wokeThreads = false;
-retry:
-		//TODO: check for threads to wake up - wake them
-		std::vector<SceUID>::iterator iter;
-		for (iter = s->waitingThreads.begin(); iter!=s->waitingThreads.end(); s++)
-		{
-			SceUID id = *iter;
-			int wVal = (int)__KernelGetWaitValue(id, error);
-			if (wVal <= s->ns.currentCount)
-			{
-				__KernelResumeThread(id);
-				s->ns.currentCount -= wVal;
-				wokeThreads = true;
-				s->waitingThreads.erase(iter);
-				goto retry;
-			}
-			else
-			{
-				break;
-			}
-		}
-		//pop the thread that were released from waiting
 
-		// I don't think we should reschedule here
-		//if (wokeThreads)
-		//	__KernelReSchedule("semaphore signalled");
+		__KernelSemaWakeThreads(s);
 
+		// I don't think we should reschedule here
 		RETURN(0);
 	}
 	else
@@ -163,68 +215,48 @@ retry:
 	}
 }
 
-//int sceKernelWaitSema(SceUID semaid, int signal, SceUInt *timeout);
-void sceKernelWaitSema()
+void __KernelWaitSema(SceUID id, int wantedCount, u32 timeoutPtr, const char *funcName, bool processCallbacks)
 {
-	SceUID id = PARAM(0);
-	int wantedCount = PARAM(1);
-	u32 timeoutPtr = PARAM(2);
-		
 	u32 error;
 	Semaphore *s = kernelObjects.Get<Semaphore>(id, error);
 	if (s)
 	{
-		DEBUG_LOG(HLE,"sceKernelWaitSema(%i, %i, %i)", id, wantedCount, timeoutPtr);
-		if (s->ns.currentCount >= wantedCount) //TODO fix
+		DEBUG_LOG(HLE,"%s(%i, %i, %08x)", funcName, id, wantedCount, timeoutPtr);
+		if (wantedCount > s->ns.maxCount || wantedCount <= 0)
+		{
+			RETURN(SCE_KERNEL_ERROR_ILLEGAL_COUNT);
+			return;
+		}
+
+		// Don't jump the queue.
+		if (s->ns.currentCount >= wantedCount && s->waitingThreads.count == 0)
 		{
 			s->ns.currentCount -= wantedCount;
 			RETURN(0);
 		}
 		else
 		{
-			s->waitingThreads.push_back(__KernelGetCurThread());
-			__KernelWaitCurThread(WAITTYPE_SEMA, id, wantedCount, 0, false);
-			return;
+			WaitRequest request = {(u32)wantedCount, 0, 0, 0};
+			__KernelWaitCurThreadOnQueue(s->waitingThreads, WAITTYPE_SEMA, id, request, timeoutPtr, processCallbacks);
 		}
 	}
 	else
 	{
-		ERROR_LOG(HLE, "sceKernelWaitSema : Trying to wait for invalid semaphore %i", id);
+		ERROR_LOG(HLE, "%s : Trying to wait for invalid semaphore %i", funcName, id);
 		RETURN(error);
 	}
+}
+
+//int sceKernelWaitSema(SceUID semaid, int signal, SceUInt *timeout);
+void sceKernelWaitSema()
+{
+	__KernelWaitSema(PARAM(0), PARAM(1), PARAM(2), "sceKernelWaitSema", false);
 } 
 
 //int sceKernelWaitSemaCB(SceUID semaid, int signal, SceUInt *timeout);
 void sceKernelWaitSemaCB()
 {
-	SceUID id = PARAM(0);
-	int wantedCount = PARAM(1);
-	int timeout = PARAM(2);
-	DEBUG_LOG(HLE,"sceKernelWaitSemaCB(%i, %i, %i)", id, wantedCount, timeout);
-	u32 error;
-	Semaphore *s = kernelObjects.Get<Semaphore>(id, error);
-	if (s)
-	{
-		DEBUG_LOG(HLE,"CurrentCount: %i, Signal: %i", s->ns.currentCount, wantedCount);
-		if (s->ns.currentCount >= wantedCount) //TODO fix
-		{
-			DEBUG_LOG(HLE,"Subtracting");
-			s->ns.currentCount -= wantedCount;
-		}
-		else
-		{
-			s->waitingThreads.push_back(__KernelGetCurThread());
-			__KernelWaitCurThread(WAITTYPE_SEMA, id, wantedCount, 0, true);
-			return;
-		}
-		DEBUG_LOG(HLE,"After: CurrentCount: %i, Signal: %i", s->ns.currentCount, wantedCount);
-		RETURN(0);
-	}
-	else
-	{
-		ERROR_LOG(HLE,"sceKernelWaitSemaCB - Bad semaphore");
-		RETURN(error);
-	}
+	__KernelWaitSema(PARAM(0), PARAM(1), PARAM(2), "sceKernelWaitSemaCB", true);
 }
 
 // Should be same as WaitSema but without the wait, instead returning SCE_KERNEL_ERROR_SEMA_ZERO
@@ -238,7 +270,11 @@ void sceKernelPollSema()
 	if (s)
 	{
 		DEBUG_LOG(HLE,"sceKernelPollSema(%i, %i)", id, wantedCount);
-		if (s->ns.currentCount >= wantedCount) //TODO fix
+		if (wantedCount <= 0)
+		{
+			RETURN(SCE_KERNEL_ERROR_ILLEGAL_COUNT);
+		}
+		else if (s->ns.currentCount >= wantedCount && s->waitingThreads.count == 0)
 		{
 			s->ns.currentCount -= wantedCount;
 			RETURN(0);
@@ -254,4 +290,3 @@ void sceKernelPollSema()
 		RETURN(error);
 	}
 }
-
@@ -25,3 +25,5 @@ void sceKernelReferSemaStatus();
 void sceKernelSignalSema();
 void sceKernelWaitSema();
 void sceKernelWaitSemaCB();
+
+KernelObject *__KernelSemaphoreObject();
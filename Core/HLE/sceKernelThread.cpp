@@ -15,6 +15,8 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include "ChunkFile.h"
+
 #include "HLE.h"
 #include "HLETables.h"
 #include "../MIPS/MIPSInt.h"
@@ -77,6 +79,7 @@ const char *waitTypeStrings[] =
   "Umd",
   "Vblank",
   "Mutex",
+  "MsgPipe",
 };
 
 struct SceKernelSysClock {
@@ -168,9 +171,50 @@ public:
 		userMemory.Free(stackBlock);
 	}
 
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(nt);
+		p.Do(waitValue);
+		p.Do(waitRequest);
+
+		// The queue is stored as its index on the object being waited on, the pointer is fixed up
+		// in __KernelThreadingDoState once all objects are back.
+		loadedWaitQueue = -1;
+		if (p.GetMode() != PointerWrap::MODE_READ && waitQueue && kernelObjects.IsValid(nt.waitID))
+		{
+			KernelObject *owner = kernelObjects[nt.waitID];
+			for (int i = 0; i < 2; i++)
+			{
+				if (owner->GetWaitQueue(i) == waitQueue)
+					loadedWaitQueue = i;
+			}
+		}
+		p.Do(loadedWaitQueue);
+		if (p.GetMode() == PointerWrap::MODE_READ)
+			waitQueue = 0;
+		p.Do(waitPrev);
+		p.Do(waitNext);
+		p.Do(waitTimeoutPtr);
+		p.Do(sleeping);
+		p.Do(isProcessingCallbacks);
+		p.Do(context);
+		p.Do(callbacks);
+		p.Do(stackBlock);
+		p.DoMarker("Thread");
+	}
+
 	NativeThread nt;
 
 	u32 waitValue;
+	WaitRequest waitRequest;
+	// The queue this thread is on while waiting on a sync object, and its neighbours there.
+	WaitQueue *waitQueue;
+	SceUID waitPrev;
+	SceUID waitNext;
+	// Where the time left goes, if the wait has a timeout.
+	u32 waitTimeoutPtr;
+	// Only used while loading a state, see DoState.
+	int loadedWaitQueue;
 	bool sleeping;
 
 	bool isProcessingCallbacks;
@@ -198,6 +242,7 @@ std::vector<Thread *> threadqueue; //Change to SceUID
 SceUID threadIdleID[2];
 
 int eventScheduledWakeup;
+int eventWaitTimeout;
 
 // This seems nasty
 SceUID curModule;
@@ -217,6 +262,7 @@ u32 __KernelInterruptReturnAddress()
 }
 
 void hleScheduledWakeup(u64 userdata, int cyclesLate);
+void hleWaitTimeout(u64 userdata, int cyclesLate);
 
 void __KernelThreadingInit()
 {
@@ -244,6 +290,7 @@ void __KernelThreadingInit()
   WriteSyscall("FakeSysCalls", NID_INTERRUPTRETURN, intReturnHackAddr);
 
 	eventScheduledWakeup = CoreTiming::RegisterEvent("ScheduledWakeup", &hleScheduledWakeup);
+	eventWaitTimeout = CoreTiming::RegisterEvent("WaitTimeout", &hleWaitTimeout);
 
   // Create the two idle threads, as well. With the absolute minimal possible priority.
   // Zero stack size. Hm, if callbacks are ever to run on these threads, that's not a good idea.
@@ -288,6 +335,46 @@ void __KernelThreadingShutdown()
 	threadqueue.clear();
 }
 
+void __KernelThreadingDoState(PointerWrap &p)
+{
+	p.Do(idleThreadHackAddr);
+	p.Do(threadReturnHackAddr);
+	p.Do(cbReturnHackAddr);
+	p.Do(intReturnHackAddr);
+	p.DoArray(threadIdleID, 2);
+	p.Do(curModule);
+
+	// Threads are kept by uid, the objects themselves are saved with the rest of the kernel objects.
+	SceUID currentID = currentThread ? currentThread->GetUID() : 0;
+	p.Do(currentID);
+	std::vector<SceUID> queueIDs;
+	for (size_t i = 0; i < threadqueue.size(); i++)
+		queueIDs.push_back(threadqueue[i]->GetUID());
+	p.Do(queueIDs);
+
+	if (p.GetMode() == PointerWrap::MODE_READ)
+	{
+		u32 error;
+		currentThread = currentID ? kernelObjects.Get<Thread>(currentID, error) : 0;
+		threadqueue.clear();
+		for (size_t i = 0; i < queueIDs.size(); i++)
+		{
+			Thread *t = kernelObjects.Get<Thread>(queueIDs[i], error);
+			if (!t)
+				continue;
+			threadqueue.push_back(t);
+			if (t->loadedWaitQueue >= 0 && kernelObjects.IsValid(t->nt.waitID))
+				t->waitQueue = kernelObjects[t->nt.waitID]->GetWaitQueue(t->loadedWaitQueue);
+		}
+	}
+	p.DoMarker("sceKernelThread");
+}
+
+KernelObject *__KernelThreadObject()
+{
+	return new Thread;
+}
+
 u32 __KernelGetWaitValue(SceUID threadID, u32 &error)
 {
 	Thread *t = kernelObjects.Get<Thread>(threadID, error);
@@ -383,6 +470,8 @@ void sceKernelGetThreadmanIdType()
   int type;
   if (kernelObjects.GetIDType(uid, &type))
   {
+    if (type >= PPSSPP_KERNEL_TMID_Module)
+      type = 0;
     RETURN(type);
     DEBUG_LOG(HLE, "%i=sceKernelGetThreadmanIdType(%i)", type, uid);
   }
@@ -443,6 +532,53 @@ void __KernelLoadContext(ThreadContext *ctx)
   // currentMIPS->fcr31 = ctx->fcr31;
 }
 
+static void __KernelUnlinkFromWaitQueue(Thread *t)
+{
+	WaitQueue *queue = t->waitQueue;
+	if (!queue)
+		return;
+
+	u32 error;
+	if (t->waitPrev)
+		kernelObjects.Get<Thread>(t->waitPrev, error)->waitNext = t->waitNext;
+	else
+		queue->first = t->waitNext;
+	if (t->waitNext)
+		kernelObjects.Get<Thread>(t->waitNext, error)->waitPrev = t->waitPrev;
+	else
+		queue->last = t->waitPrev;
+	queue->count--;
+
+	t->waitQueue = 0;
+	t->waitPrev = 0;
+	t->waitNext = 0;
+}
+
+// Undoes the bookkeeping of a wait that's ending, whatever ended it. leftEarly is for waits the
+// object itself didn't end, so that it can look at the threads queued behind this one again.
+static void __KernelClearWait(Thread *t, bool leftEarly = false)
+{
+	bool wasQueued = t->waitQueue != 0;
+	__KernelUnlinkFromWaitQueue(t);
+	if (t->waitTimeoutPtr)
+	{
+		s64 cyclesLeft = CoreTiming::UnscheduleEvent(eventWaitTimeout, t->GetUID());
+		if (cyclesLeft >= 0)
+			Memory::Write_U32((u32)cyclesToUs(cyclesLeft), t->waitTimeoutPtr);
+		t->waitTimeoutPtr = 0;
+	}
+	if (leftEarly && wasQueued && kernelObjects.IsValid(t->nt.waitID))
+		kernelObjects[t->nt.waitID]->RecheckWaitingThreads();
+}
+
+static void __KernelSetThreadReturn(Thread *t, u32 value)
+{
+	if (t == currentThread)
+		currentMIPS->r[MIPS_REG_V0] = value;
+	else
+		t->context.r[MIPS_REG_V0] = value;
+}
+
 // DANGEROUS
 // Only run when you can safely accept a context switch
 // Triggers a waitable event, that is, it wakes up all threads that waits for it
@@ -459,6 +595,7 @@ bool __KernelTriggerWait(WaitType type, int id, bool dontSwitch)
 			if (t->nt.waitType == type && t->nt.waitID == id)
 			{
 				// This threads is waiting for the triggered object
+				__KernelClearWait(t);
 				t->nt.status &= ~THREADSTATUS_WAIT;
 				if (t->nt.status == 0)
         {
@@ -488,6 +625,7 @@ u32 __KernelResumeThread(SceUID threadID)
   Thread *t = kernelObjects.Get<Thread>(threadID, error);
   if (t)
   {
+    __KernelClearWait(t);
     t->nt.status &= ~THREADSTATUS_WAIT;
     if (!(t->nt.status & (THREADSTATUS_SUSPEND | THREADSTATUS_WAIT)))
       t->nt.status |= THREADSTATUS_READY;
@@ -501,7 +639,7 @@ u32 __KernelResumeThread(SceUID threadID)
 }
 
 // makes the current thread wait for an event
-void __KernelWaitCurThread(WaitType type, SceUID waitID, u32 waitValue, int timeout, bool processCallbacks)
+void __KernelWaitCurThread(WaitType type, SceUID waitID, u32 waitValue, u32 timeoutPtr, bool processCallbacks)
 {
 	currentThread->nt.status = THREADSTATUS_WAIT;
 	currentThread->nt.waitID = waitID;
@@ -509,10 +647,12 @@ void __KernelWaitCurThread(WaitType type, SceUID waitID, u32 waitValue, int time
 	currentThread->nt.numReleases++;
 	currentThread->waitValue = waitValue;
 	currentThread->isProcessingCallbacks = processCallbacks;
-  if (timeout)
-  {
-    // TODO:
-  }
+	if (Memory::IsValidAddress(timeoutPtr))
+	{
+		u32 timeoutUs = Memory::Read_U32(timeoutPtr);
+		currentThread->waitTimeoutPtr = timeoutPtr;
+		CoreTiming::ScheduleEvent(usToCycles((u64)timeoutUs), eventWaitTimeout, currentThread->GetUID());
+	}
 
 	RETURN(0); //pretend all went OK
 
@@ -523,6 +663,108 @@ void __KernelWaitCurThread(WaitType type, SceUID waitID, u32 waitValue, int time
 	// TODO: Remove thread from Ready queue?
 }
 
+void __KernelInitWaitQueue(WaitQueue &queue, bool priorityOrder)
+{
+	queue.first = 0;
+	queue.last = 0;
+	queue.count = 0;
+	queue.priorityOrder = priorityOrder;
+}
+
+void __KernelWaitCurThreadOnQueue(WaitQueue &queue, WaitType type, SceUID waitID, const WaitRequest &request, u32 timeoutPtr, bool processCallbacks)
+{
+	Thread *t = currentThread;
+	u32 error;
+
+	// Lower numbers are higher priorities. Equal priorities stay in arrival order.
+	SceUID next = 0;
+	if (queue.priorityOrder)
+	{
+		for (next = queue.first; next != 0; )
+		{
+			Thread *other = kernelObjects.Get<Thread>(next, error);
+			if (other->nt.currentPriority > t->nt.currentPriority)
+				break;
+			next = other->waitNext;
+		}
+	}
+
+	t->waitQueue = &queue;
+	t->waitNext = next;
+	t->waitPrev = next ? kernelObjects.Get<Thread>(next, error)->waitPrev : queue.last;
+	if (t->waitPrev)
+		kernelObjects.Get<Thread>(t->waitPrev, error)->waitNext = t->GetUID();
+	else
+		queue.first = t->GetUID();
+	if (next)
+		kernelObjects.Get<Thread>(next, error)->waitPrev = t->GetUID();
+	else
+		queue.last = t->GetUID();
+	queue.count++;
+
+	t->waitRequest = request;
+	__KernelWaitCurThread(type, waitID, request.value, timeoutPtr, processCallbacks);
+}
+
+SceUID __KernelWaitQueueFirst(const WaitQueue &queue)
+{
+	return queue.first;
+}
+
+SceUID __KernelWaitQueueNext(SceUID threadID)
+{
+	u32 error;
+	Thread *t = kernelObjects.Get<Thread>(threadID, error);
+	return t ? t->waitNext : 0;
+}
+
+const WaitRequest *__KernelGetWaitRequest(SceUID threadID)
+{
+	u32 error;
+	Thread *t = kernelObjects.Get<Thread>(threadID, error);
+	return t ? &t->waitRequest : 0;
+}
+
+void __KernelResumeThreadFromWait(SceUID threadID, u32 returnValue)
+{
+	u32 error;
+	Thread *t = kernelObjects.Get<Thread>(threadID, error);
+	if (!t)
+	{
+		ERROR_LOG(HLE, "__KernelResumeThreadFromWait(%d): bad thread: %08x", threadID, error);
+		return;
+	}
+
+	__KernelResumeThread(threadID);
+	__KernelSetThreadReturn(t, returnValue);
+}
+
+int __KernelResumeAllFromWait(WaitQueue &queue, u32 returnValue)
+{
+	int count = 0;
+	while (queue.first != 0)
+	{
+		__KernelResumeThreadFromWait(queue.first, returnValue);
+		count++;
+	}
+	return count;
+}
+
+void hleWaitTimeout(u64 userdata, int cyclesLate)
+{
+	SceUID threadID = (SceUID)userdata;
+	u32 error;
+	Thread *t = kernelObjects.Get<Thread>(threadID, error);
+	if (!t || !(t->nt.status & THREADSTATUS_WAIT))
+		return;
+
+	// The event is gone already, nothing to cancel.
+	Memory::Write_U32(0, t->waitTimeoutPtr);
+	t->waitTimeoutPtr = 0;
+	__KernelClearWait(t, true);
+	__KernelResumeThreadFromWait(threadID, SCE_KERNEL_ERROR_WAIT_TIMEOUT);
+}
+
 void hleScheduledWakeup(u64 userdata, int cyclesLate)
 {
 	SceUID threadID = (SceUID)userdata;
@@ -531,11 +773,12 @@ void hleScheduledWakeup(u64 userdata, int cyclesLate)
 
 void __KernelScheduleWakeup(SceUID threadID, int usFromNow)
 {
-	CoreTiming::ScheduleEvent(usToCycles(usFromNow), eventScheduledWakeup, threadID);
+	CoreTiming::ScheduleEvent(usToCycles((u64)(u32)usFromNow), eventScheduledWakeup, threadID);
 }
 
 void __KernelRemoveFromThreadQueue(Thread *t)
 {
+  __KernelClearWait(t, true);
   for (int i = 0; i < threadqueue.size(); i++)
   {
     if (threadqueue[i] == t)
@@ -687,6 +930,11 @@ Thread *__KernelCreateThread(SceUID &id, SceUID moduleID, const char *name, u32
 	t->nt.waitType = WAITTYPE_NONE;
 	t->nt.waitID = 0;
 	t->waitValue = 0;
+	memset(&t->waitRequest, 0, sizeof(t->waitRequest));
+	t->waitQueue = 0;
+	t->waitPrev = 0;
+	t->waitNext = 0;
+	t->waitTimeoutPtr = 0;
 	t->nt.exitStatus = 0;
 	t->nt.numInterruptPreempts = 0;
 	t->nt.numReleases = 0;
@@ -65,6 +65,27 @@ enum WaitType //probably not the real values
 	WAITTYPE_UMD = 11,           // this is fake, should be replaced with 1 eventflag    ( ?? )
 	WAITTYPE_VBLANK = 12,           // fake
   WAITTYPE_MUTEX = 13,
+	WAITTYPE_MSGPIPE = 14,
+};
+
+// Threads waiting on a sync object (semaphore, mutex, event flag...), in wake order. The links
+// live in the threads, which can only wait on one thing at a time. Threads are queued in arrival
+// order, or by priority when the object was created with the priority attribute.
+struct WaitQueue
+{
+	SceUID first;
+	SceUID last;
+	int count;
+	bool priorityOrder;
+};
+
+// What a waiting thread asked the object for. Only the object's own code interprets it.
+struct WaitRequest
+{
+	u32 value;  // Count, bits, size...
+	u32 mode;
+	u32 addr;   // Where the result goes.
+	u32 addr2;
 };
 
 
@@ -89,7 +110,9 @@ struct ThreadContext
 // Internal API, used by implementations of kernel functions
 
 void __KernelThreadingInit();
+void __KernelThreadingDoState(PointerWrap &p);
 void __KernelThreadingShutdown();
+KernelObject *__KernelThreadObject();
 
 void __KernelScheduleWakeup(int usFromNow, int threadnumber);
 SceUID __KernelGetCurThread();
@@ -102,7 +125,21 @@ bool __KernelTriggerWait(WaitType type, int id, bool dontSwitch = false);
 u32 __KernelResumeThread(SceUID threadID);  // can return an error value
 
 u32 __KernelGetWaitValue(SceUID threadID, u32 &error);
-void __KernelWaitCurThread(WaitType type, SceUID waitId, u32 waitValue, int timeout, bool processCallbacks);
+// If timeoutPtr is a valid address, it holds the timeout in microseconds. The wait then ends with
+// SCE_KERNEL_ERROR_WAIT_TIMEOUT when it runs out, and the time left is written back when woken.
+void __KernelWaitCurThread(WaitType type, SceUID waitId, u32 waitValue, u32 timeoutPtr, bool processCallbacks);
+
+void __KernelInitWaitQueue(WaitQueue &queue, bool priorityOrder);
+// Like __KernelWaitCurThread, but also queues the current thread on the object.
+void __KernelWaitCurThreadOnQueue(WaitQueue &queue, WaitType type, SceUID waitID, const WaitRequest &request, u32 timeoutPtr, bool processCallbacks);
+// Walk a queue in wake order. Both return 0 at the end.
+SceUID __KernelWaitQueueFirst(const WaitQueue &queue);
+SceUID __KernelWaitQueueNext(SceUID threadID);
+const WaitRequest *__KernelGetWaitRequest(SceUID threadID);
+// Ends a thread's wait, dequeuing it and canceling its timeout. returnValue is what the waiting call returns.
+void __KernelResumeThreadFromWait(SceUID threadID, u32 returnValue);
+// Ends every wait on the queue, for deleting or canceling the object. Returns how many threads were woken.
+int __KernelResumeAllFromWait(WaitQueue &queue, u32 returnValue);
 void __KernelReSchedule(const char *reason = "no reason");
 void __KernelNotifyCallback(SceUID threadID, SceUID cbid, u32 arg);
 
@@ -15,6 +15,8 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include "ChunkFile.h"
+
 #include "sceKernel.h"
 #include "sceKernelVTimer.h"
 #include "HLE.h"
@@ -30,6 +32,18 @@ struct VTimer : public KernelObject
 	static u32 GetMissingErrorCode() { return SCE_KERNEL_ERROR_UNKNOWN_VTID; }
 	int GetIDType() const { return SCE_KERNEL_TMID_VTimer; }
 
+	virtual void DoState(PointerWrap &p)
+	{
+		p.Do(size);
+		p.Do(name);
+		p.Do(startTime);
+		p.Do(running);
+		p.Do(handler);
+		p.Do(handlerTime);
+		p.Do(argument);
+		p.DoMarker("VTimer");
+	}
+
 	SceSize 	size;
 	char 		name[KERNELOBJECT_MAX_NAME_LENGTH+1];
 	u64 startTime;
@@ -39,6 +53,11 @@ struct VTimer : public KernelObject
 	u32 argument;
 };
 
+KernelObject *__KernelVTimerObject()
+{
+	return new VTimer;
+}
+
 void sceKernelCreateVTimer()
 {
 	DEBUG_LOG(HLE,"sceKernelCreateVTimer");
@@ -21,404 +21,478 @@
 // JPCSP is, as it often is, a pretty good reference although I didn't actually use it much yet:
 // http://code.google.com/p/jpcsp/source/browse/trunk/src/jpcsp/HLE/modules150/sceSasCore.java
 
+#include <algorithm>
+#include <cstring>
+#include <map>
+
 #include "base/basictypes.h"
+#include "ChunkFile.h"
 
 #include "HLE.h"
 #include "../MIPS/MIPS.h"
+#include "../MemMap.h"
 
 #include "sceSas.h"
+#include "__sceSas.h"
 #include "sceKernel.h"
 
-static const double f[5][2] = 
-{ { 0.0, 0.0 },
-{	 60.0 / 64.0,	0.0 },
-{	115.0 / 64.0, -52.0 / 64.0 },
-{	 98.0 / 64.0, -55.0 / 64.0 },
-{	122.0 / 64.0, -60.0 / 64.0 } };
-
-// VAG is a Sony ADPCM audio compression format, which goes all the way back to the PSX.
-// It compresses 28 16-bit samples into a block of 16 bytes.
-// TODO: Get rid of the doubles, making sure it does not impact sound quality.
-// Doubles are pretty fast on Android devices these days though.
-class VagDecoder
-{
-public:
-	void Start(u8 *data)
-	{
-		data_ = data;
-		curSample = 28;
-		s_1 = 0.0;	// per block?
-		s_2 = 0.0;
-	}
-
-	int GetSample()
-	{
-		if (end_)
-			return 0;
-		if (curSample == 28)
-			Decode();
-		if (end_)
-			return 0;
-		return samples[curSample++];
-	}
-
-	bool Decode();
-	bool End() const { return end_; }
-
-	u8 GetByte() {
-		return *data_++;
-	}
-
-private:
-	double samples[28];
-	int curSample;
-
-	u8 *data_;
-
-	// rolling state. start at 0, should probably reset to 0 on loops?
-	double s_1;
-	double s_2;
-
-	bool end_;
+enum
+{
+	ERROR_SAS_INVALID_GRAIN = 0x80420001,
+	ERROR_SAS_INVALID_MAX_VOICES = 0x80420002,
+	ERROR_SAS_INVALID_OUTPUT_MODE = 0x80420003,
+	ERROR_SAS_INVALID_SAMPLE_RATE = 0x80420004,
+	ERROR_SAS_INVALID_ADDRESS = 0x80420005,
+	ERROR_SAS_INVALID_VOICE = 0x80420010,
+	ERROR_SAS_INVALID_ADSR_CURVE_MODE = 0x80420013,
+	ERROR_SAS_INVALID_PARAMETER = 0x80420014,
+	ERROR_SAS_NOT_INIT = 0x80420100,
 };
 
-bool VagDecoder::Decode()
+// Each sceSasInit gets its own instance, keyed by the core pointer the game passes to every
+// function. Sas mixes into guest memory when the game asks, and the game outputs that through
+// sceAudio, which is paced by CoreTiming. So this is deterministic as it is.
+typedef std::map<u32, SasInstance *> SasInstanceMap;
+static SasInstanceMap sasInstances;
+
+static SasInstance *GetSasInstance(u32 core)
 {
-	int predict_nr = GetByte();
-	int shift_factor = predict_nr & 0xf;
-	predict_nr >>= 4;
-	int flags = GetByte();
-	if (flags == 7)
-	{
-		end_ = true;
-		return false;
-	}
-	for (int i = 0; i < 28; i += 2) 
+	SasInstanceMap::iterator iter = sasInstances.find(core);
+	if (iter == sasInstances.end())
 	{
-		int d = GetByte();
-		int s = (d & 0xf) << 12;
-		if (s & 0x8000)
-			s |= 0xffff0000;
-		samples[i] = (double)(s >> shift_factor);
-		s = (d & 0xf0) << 8;
-		if (s & 0x8000)
-			s |= 0xffff0000;
-		samples[i + 1] = (double)(s >> shift_factor);
+		ERROR_LOG(HLE, "sceSas: core %08x not initialized", core);
+		return 0;
 	}
-	for (int i = 0; i < 28; i++)
+	return iter->second;
+}
+
+// Looks up the instance and checks the voice number, returning the error code if either is bad.
+static u32 GetSasVoice(u32 core, int voiceNum, SasInstance *&sas)
+{
+	sas = GetSasInstance(core);
+	if (!sas)
+		return ERROR_SAS_NOT_INIT;
+	if (voiceNum < 0 || voiceNum >= sas->maxVoices)
 	{
-		samples[i] = samples[i] + s_1 * f[predict_nr][0] + s_2 * f[predict_nr][1];
-		s_2 = s_1;
-		s_1 = samples[i];
+		ERROR_LOG(HLE, "sceSas: bad voice %i on core %08x", voiceNum, core);
+		return ERROR_SAS_INVALID_VOICE;
 	}
-	curSample = 0;
-	return true;
+	return 0;
 }
 
-// A SAS voice.
-// TODO: Look into pre-decoding the VAG samples on SetVoice instead of decoding them on the fly.
-// It's not very likely that games encode VAG dynamically.
-struct Voice
-{
-	u32 vagAddr;
-	int samplePos;
-	int size;
-	int loop;
-	int volumeLeft;
-	int volumeRight;
-	int volumeLeftSend;	// volume to "Send" (audio-lingo) to the effects processing engine, like reverb
-	int volumeRightSend;
-	int pitch;
-	bool endFlag;
-	bool playing;
-
-	VagDecoder vag;
-};
-
-class SasInstance
+static void DeleteSasInstances()
 {
-public:
-	enum { NUM_VOICES = 32 };
-	Voice voices[NUM_VOICES];
-	int grainSize;
-	int maxVoices;
-	int sampleRate;
-
-	void mix(u32 outAddr);
-};
-
-// TODO - allow more than one, associating each with one Core pointer (passed in to all the functions)
-// No known games use more than one instance of Sas though.
-SasInstance sas;	
+	for (SasInstanceMap::iterator iter = sasInstances.begin(); iter != sasInstances.end(); ++iter)
+		delete iter->second;
+	sasInstances.clear();
+}
 
-// TODO: Make deterministic, by adding staging buffers that we pump out on a fixed CoreTiming-scheduled interval.
+void __SasInit()
+{
+}
 
-void SasInstance::mix(u32 outAddr)
+void __SasDoState(PointerWrap &p)
 {
-	s16 *out = (s16 *)Memory::GetPointer(outAddr);
-	// Don't need to memset, done by the caller.
-	for (int v = 0; v < NUM_VOICES; v++)	 // sas.maxVoices?
+	int count = (int)sasInstances.size();
+	p.Do(count);
+	if (p.GetMode() == PointerWrap::MODE_READ)
 	{
-		Voice &voice = sas.voices[v];
-
-		if (voice.playing)
+		DeleteSasInstances();
+		for (int i = 0; i < count; i++)
+		{
+			u32 core;
+			int grainSize, maxVoices, outputMode, sampleRate;
+			p.Do(core);
+			p.Do(grainSize);
+			p.Do(maxVoices);
+			p.Do(outputMode);
+			p.Do(sampleRate);
+			SasInstance *sas = new SasInstance(grainSize, maxVoices, outputMode, sampleRate);
+			sas->DoState(p);
+			sasInstances[core] = sas;
+		}
+	}
+	else
+	{
+		for (SasInstanceMap::iterator iter = sasInstances.begin(); iter != sasInstances.end(); ++iter)
 		{
-			for (int i = 0; i < grainSize; i++)
-			{
-				int sample = voice.vag.GetSample();
-				voice.samplePos++;
-				if (voice.samplePos >= voice.size || voice.vag.End())
-				{
-					voice.playing = false;
-					break;
-				}
-				int l = sample; int r = sample; //* (voice.volumeLeft >> 16), r = sample * (voice.volumeRight >> 16);
-
-				// TODO: should mix into a temporary 32-bit buffer and then clip down
-				out[i * 2] += l;
-				out[i * 2 + 1] += r;
-			}
+			u32 core = iter->first;
+			SasInstance *sas = iter->second;
+			p.Do(core);
+			p.Do(sas->grainSize);
+			p.Do(sas->maxVoices);
+			p.Do(sas->outputMode);
+			p.Do(sas->sampleRate);
+			sas->DoState(p);
 		}
 	}
+	p.DoMarker("sceSas");
 }
 
-u32 sceSasInit(u32 core, u32 grainSize, u32 maxVoices, u32 unknown, u32 sampleRate)
+void __SasShutdown()
 {
-	DEBUG_LOG(HLE,"0=sceSasInit()");
-	memset(&sas, 0, sizeof(sas));
-	sas.grainSize = grainSize;
-	sas.maxVoices = maxVoices;
-	sas.sampleRate = sampleRate;
-	for (int i = 0; i < 32; i++) {
-		sas.voices[i].playing = false;
-	}
+	DeleteSasInstances();
+	__SasClearVagCache();
+}
+
+u32 sceSasInit(u32 core, u32 grainSize, u32 maxVoices, u32 outputMode, u32 sampleRate)
+{
+	DEBUG_LOG(HLE,"0=sceSasInit(%08x, %i, %i, %i, %i)", core, grainSize, maxVoices, outputMode, sampleRate);
+	if (!Memory::IsValidAddress(core) || (core & 0x3F) != 0)
+		return ERROR_SAS_INVALID_ADDRESS;
+	if (grainSize < 0x40 || grainSize > SasInstance::MAX_GRAIN || (grainSize & 0x1F) != 0)
+		return ERROR_SAS_INVALID_GRAIN;
+	if (maxVoices == 0 || maxVoices > SasInstance::NUM_VOICES)
+		return ERROR_SAS_INVALID_MAX_VOICES;
+	if (outputMode > 1)
+		return ERROR_SAS_INVALID_OUTPUT_MODE;
+	if (sampleRate != 44100)
+		return ERROR_SAS_INVALID_SAMPLE_RATE;
+
+	SasInstanceMap::iterator iter = sasInstances.find(core);
+	if (iter != sasInstances.end())
+		delete iter->second;
+	sasInstances[core] = new SasInstance(grainSize, maxVoices, outputMode, sampleRate);
 	return 0;
 }
 
-u32 sceSasGetEndFlag()
+u32 sceSasGetEndFlag(u32 core)
 {
-	u32 endFlag = 0;
-	for (int i = 0; i < sas.maxVoices; i++) {
-		if (!sas.voices[i].playing)
-			endFlag |= 1 << i;
-	}
-	DEBUG_LOG(HLE,"%08x=sceSasGetEndFlag()", endFlag);
+	SasInstance *sas = GetSasInstance(core);
+	if (!sas)
+		return ERROR_SAS_NOT_INIT;
+	u32 endFlag = sas->GetEndFlags();
+	DEBUG_LOG(HLE,"%08x=sceSasGetEndFlag(%08x)", endFlag, core);
 	return endFlag;
 }
 
 // Runs the mixer
-void _sceSasCore()
+u32 _sceSasCore(u32 core, u32 outAddr)
 {
-	u32 outAddr = PARAM(1);
-	DEBUG_LOG(HLE,"0=sceSasCore(, %08x)	(grain: %i samples)", outAddr, sas.grainSize);
-	memset(Memory::GetPointer(outAddr), 0, sas.grainSize * 2 * 2);
-	sas.mix(outAddr);
-	RETURN(0);
+	SasInstance *sas = GetSasInstance(core);
+	if (!sas)
+		return ERROR_SAS_NOT_INIT;
+	DEBUG_LOG(HLE,"0=sceSasCore(%08x, %08x)	(grain: %i samples)", core, outAddr, sas->grainSize);
+	if (!Memory::IsValidAddress(outAddr) || !Memory::IsValidAddress(outAddr + sas->grainSize * 4 - 1))
+		return ERROR_SAS_INVALID_ADDRESS;
+	sas->Mix((s16 *)Memory::GetPointer(outAddr));
+	return 0;
 }
 
-// Another way of running the mixer, what was the difference again?
-void _sceSasCoreWithMix()
+// Same, but what's already in the buffer is mixed in too, at the given volume.
+u32 _sceSasCoreWithMix(u32 core, u32 inOutAddr, u32 leftVolume, u32 rightVolume)
 {
-	u32 outAddr = PARAM(1);
-	DEBUG_LOG(HLE,"0=sceSasCoreWithMix(, %08x)", outAddr);
-	sas.mix(outAddr);
-	RETURN(0);
+	SasInstance *sas = GetSasInstance(core);
+	if (!sas)
+		return ERROR_SAS_NOT_INIT;
+	DEBUG_LOG(HLE,"0=sceSasCoreWithMix(%08x, %08x, %i, %i)", core, inOutAddr, leftVolume, rightVolume);
+	if (!Memory::IsValidAddress(inOutAddr) || !Memory::IsValidAddress(inOutAddr + sas->grainSize * 4 - 1))
+		return ERROR_SAS_INVALID_ADDRESS;
+	s16 *inOut = (s16 *)Memory::GetPointer(inOutAddr);
+	sas->Mix(inOut, inOut, leftVolume, rightVolume);
+	return 0;
 }
 
-void sceSasSetVoice()
+u32 sceSasSetVoice(u32 core, int voiceNum, u32 vagAddr, int size, int loop)
 {
-	u32 core = PARAM(0);
-	int voiceNum = PARAM(1);
-	u32 vagAddr = PARAM(2);
-	int size = PARAM(3);
-	int loop = PARAM(4);
 	DEBUG_LOG(HLE,"0=sceSasSetVoice(core=%08x, voicenum=%i, vag=%08x, size=%i, loop=%i)", 
 		core, voiceNum, vagAddr, size, loop);
+	SasInstance *sas;
+	u32 error = GetSasVoice(core, voiceNum, sas);
+	if (error)
+		return error;
+	if (size <= 0 || (size & 0xF) != 0 || !Memory::IsValidAddress(vagAddr))
+		return ERROR_SAS_INVALID_PARAMETER;
 
 	//Real VAG header is 0x30 bytes behind the vagAddr
-	Voice &v = sas.voices[voiceNum];
+	// Doesn't interrupt a playing voice, the new data is used from the next key on or loop.
+	SasVoice &v = sas->voices[voiceNum];
 	v.vagAddr = vagAddr;
 	v.size = size;
 	v.loop = loop;
-	v.playing = false;
-	RETURN(0);
+	return 0;
 }
 
-void sceSasSetVolume()
+u32 sceSasSetVolume(u32 core, int voiceNum, int l, int r, int el, int er)
 {
-	u32 core = PARAM(0);
-	int voiceNum = PARAM(1);
-	int l = PARAM(2);
-	int r = PARAM(3);
-	int el = PARAM(4);
-	int er = PARAM(5);
-	DEBUG_LOG(HLE,"UNIMPL 0=sceSasSetVolume(core=%08x, voicenum=%i, l=%i, r=%i, el=%i, er=%i", core, voiceNum, l, r, el, er);
-	Voice &v = sas.voices[voiceNum];
+	DEBUG_LOG(HLE,"0=sceSasSetVolume(core=%08x, voicenum=%i, l=%i, r=%i, el=%i, er=%i", core, voiceNum, l, r, el, er);
+	SasInstance *sas;
+	u32 error = GetSasVoice(core, voiceNum, sas);
+	if (error)
+		return error;
+	SasVoice &v = sas->voices[voiceNum];
 	v.volumeLeft = l;
 	v.volumeRight = r;
-	RETURN(0);
+	v.volumeLeftSend = el;
+	v.volumeRightSend = er;
+	return 0;
 }
 
-void sceSasSetPitch()
+u32 sceSasSetPitch(u32 core, int voiceNum, int pitch)
 {
-	u32 core = PARAM(0);
-	int voiceNum = PARAM(1);
-	int pitch = PARAM(2);
-	Voice &v = sas.voices[voiceNum];
-	v.pitch = pitch;
-	DEBUG_LOG(HLE,"UNIMPL 0=sceSasSetPitch(core=%08x, voicenum=%i, pitch=%i)", core, voiceNum, pitch);
-	RETURN(0);
+	DEBUG_LOG(HLE,"0=sceSasSetPitch(core=%08x, voicenum=%i, pitch=%i)", core, voiceNum, pitch);
+	SasInstance *sas;
+	u32 error = GetSasVoice(core, voiceNum, sas);
+	if (error)
+		return error;
+	// Up to 4x the original rate.
+	sas->voices[voiceNum].pitch = std::max(0, std::min(pitch, PSP_SAS_PITCH_BASE * 4));
+	return 0;
 }
 
-void sceSasSetKeyOn()
+u32 sceSasSetKeyOn(u32 core, int voiceNum)
 {
-	u32 core = PARAM(0);
-	int voiceNum = PARAM(1);
-	DEBUG_LOG(HLE,"0=sceSasSetKeyOff(core=%08x, voicenum=%i)", core, voiceNum);
-	Voice &v = sas.voices[voiceNum];
-	v.vag.Start(Memory::GetPointer(v.vagAddr));
-	v.playing = true;
-	RETURN(0);
+	DEBUG_LOG(HLE,"0=sceSasSetKeyOn(core=%08x, voicenum=%i)", core, voiceNum);
+	SasInstance *sas;
+	u32 error = GetSasVoice(core, voiceNum, sas);
+	if (error)
+		return error;
+	SasVoice &v = sas->voices[voiceNum];
+	sas->KeyOn(voiceNum, __SasAcquireVag(v.vagAddr, v.size));
+	return 0;
 }
 
-// TODO: We really need ADSR work: 
 // sceSasSetKeyOff can be used to start sounds, that just sound during the Release phase!
-void sceSasSetKeyOff()
+// Here that just ends up a no-op, since the voice isn't playing.
+u32 sceSasSetKeyOff(u32 core, int voiceNum)
 {
-	u32 core = PARAM(0);
-	int voiceNum = PARAM(1);
 	DEBUG_LOG(HLE,"0=sceSasSetKeyOff(core=%08x, voicenum=%i)", core, voiceNum);
-	Voice &v = sas.voices[voiceNum];
-	v.playing = false;	// not right! Should directly enter Release envelope stage instead!
-	RETURN(0);
+	SasInstance *sas;
+	u32 error = GetSasVoice(core, voiceNum, sas);
+	if (error)
+		return error;
+	sas->KeyOff(voiceNum);
+	return 0;
 }
 
-void sceSasSetADSR()
+u32 sceSasSetPause(u32 core, u32 voiceBits, int pause)
 {
-	u32 core = PARAM(0);
-	int voiceNum = PARAM(1);
-	int flag = PARAM(2);
-	int a = PARAM(3);
-	int d = PARAM(4);
-	int s = PARAM(5);
-	int r = PARAM(6); //??
-	DEBUG_LOG(HLE,"UNIMPL 0=sceSasSetADSR(core=%08x, voicenum=%i, flag=%i, a=%08x, d=%08x, s=%08x, r=%08x)", 
+	DEBUG_LOG(HLE,"0=sceSasSetPause(core=%08x, voicebits=%08x, pause=%i)", core, voiceBits, pause);
+	SasInstance *sas = GetSasInstance(core);
+	if (!sas)
+		return ERROR_SAS_NOT_INIT;
+	for (int i = 0; i < sas->maxVoices; i++)
+	{
+		if (voiceBits & (1 << i))
+			sas->voices[i].paused = pause != 0;
+	}
+	return 0;
+}
+
+u32 sceSasGetPauseFlag(u32 core)
+{
+	SasInstance *sas = GetSasInstance(core);
+	if (!sas)
+		return ERROR_SAS_NOT_INIT;
+	u32 pauseFlag = 0;
+	for (int i = 0; i < sas->maxVoices; i++)
+	{
+		if (sas->voices[i].paused)
+			pauseFlag |= 1 << i;
+	}
+	DEBUG_LOG(HLE,"%08x=sceSasGetPauseFlag(%08x)", pauseFlag, core);
+	return pauseFlag;
+}
+
+u32 sceSasSetADSR(u32 core, int voiceNum, int flag, int a, int d, int s, int r)
+{
+	DEBUG_LOG(HLE,"0=sceSasSetADSR(core=%08x, voicenum=%i, flag=%i, a=%08x, d=%08x, s=%08x, r=%08x)", 
 		core, voiceNum, flag, a,d,s,r);
-	RETURN(0);
+	SasInstance *sas;
+	u32 error = GetSasVoice(core, voiceNum, sas);
+	if (error)
+		return error;
+	if (((flag & PSP_SAS_ADSR_ATTACK) && a < 0) || ((flag & PSP_SAS_ADSR_DECAY) && d < 0) ||
+		((flag & PSP_SAS_ADSR_SUSTAIN) && s < 0) || ((flag & PSP_SAS_ADSR_RELEASE) && r < 0))
+		return ERROR_SAS_INVALID_PARAMETER;
+
+	SasEnvelope &envelope = sas->voices[voiceNum].envelope;
+	if (flag & PSP_SAS_ADSR_ATTACK)
+		envelope.attackRate = a;
+	if (flag & PSP_SAS_ADSR_DECAY)
+		envelope.decayRate = d;
+	if (flag & PSP_SAS_ADSR_SUSTAIN)
+		envelope.sustainRate = s;
+	if (flag & PSP_SAS_ADSR_RELEASE)
+		envelope.releaseRate = r;
+	return 0;
 }
 
-void sceSasSetADSRMode()
+u32 sceSasSetADSRMode(u32 core, int voiceNum, int flag, int a, int d, int s, int r)
 {
-	u32 core = PARAM(0);
-	int voiceNum = PARAM(1);
-	int flag = PARAM(2);
-	int a = PARAM(3);
-	int d = PARAM(4);
-	int s = PARAM(5);
-	int r = PARAM(6); //??
-	DEBUG_LOG(HLE,"UNIMPL 0=sceSasSetADSRMode(core=%08x, voicenum=%i, flag=%i, a=%08x, d=%08x, s=%08x, r=%08x)", 
+	DEBUG_LOG(HLE,"0=sceSasSetADSRMode(core=%08x, voicenum=%i, flag=%i, a=%08x, d=%08x, s=%08x, r=%08x)", 
 		core, voiceNum, flag, a,d,s,r);
-	RETURN(0);
+	SasInstance *sas;
+	u32 error = GetSasVoice(core, voiceNum, sas);
+	if (error)
+		return error;
+	const int modes[4] = { a, d, s, r };
+	for (int i = 0; i < 4; i++)
+	{
+		if ((flag & (1 << i)) && (modes[i] < 0 || modes[i] > PSP_SAS_ADSR_CURVE_MODE_DIRECT))
+			return ERROR_SAS_INVALID_ADSR_CURVE_MODE;
+	}
+
+	SasEnvelope &envelope = sas->voices[voiceNum].envelope;
+	if (flag & PSP_SAS_ADSR_ATTACK)
+		envelope.attackType = a;
+	if (flag & PSP_SAS_ADSR_DECAY)
+		envelope.decayType = d;
+	if (flag & PSP_SAS_ADSR_SUSTAIN)
+		envelope.sustainType = s;
+	if (flag & PSP_SAS_ADSR_RELEASE)
+		envelope.releaseType = r;
+	return 0;
+}
+
+u32 sceSasSetSL(u32 core, int voiceNum, int level)
+{
+	DEBUG_LOG(HLE,"0=sceSasSetSL(core=%08x, voicenum=%i, level=%08x)", core, voiceNum, level);
+	SasInstance *sas;
+	u32 error = GetSasVoice(core, voiceNum, sas);
+	if (error)
+		return error;
+	sas->voices[voiceNum].envelope.sustainLevel = std::max(0, std::min(level, (int)PSP_SAS_ENVELOPE_HEIGHT_MAX));
+	return 0;
 }
 
 // http://code.google.com/p/jpcsp/source/browse/trunk/src/jpcsp/HLE/modules150/sceSasCore.java
 
 u32 sceSasSetSimpleADSR(u32 core, u32 voiceNum, u32 ADSREnv1, u32 ADSREnv2)
 {
-	DEBUG_LOG(HLE,"UNIMPL 0=sasSetSimpleADSR(%08x, %i, %08x, %08x)", core, voiceNum, ADSREnv1, ADSREnv2);
-	ADSREnv1 &= 0xFFFF;
-	ADSREnv2 &= 0xFFFF;
-	//....
+	DEBUG_LOG(HLE,"0=sasSetSimpleADSR(%08x, %i, %08x, %08x)", core, voiceNum, ADSREnv1, ADSREnv2);
+	SasInstance *sas;
+	u32 error = GetSasVoice(core, voiceNum, sas);
+	if (error)
+		return error;
+	sas->voices[voiceNum].envelope.SetSimple(ADSREnv1, ADSREnv2);
 	return 0;
 }
 
 u32 sceSasGetEnvelopeHeight(u32 core, u32 voiceNum)
 {
-	// Spam reduction
-	if (voiceNum == 17)
-	{
-		DEBUG_LOG(HLE,"UNIMPL 0=sceSasGetEnvelopeHeight(core=%08x, voicenum=%i)", core, voiceNum);
-	}
-	Voice &v = sas.voices[voiceNum];
+	SasInstance *sas;
+	u32 error = GetSasVoice(core, voiceNum, sas);
+	if (error)
+		return error;
+	return (u32)sas->voices[voiceNum].envelope.height;
+}
+
+u32 sceSasGetAllEnvelopeHeights(u32 core, u32 heightsAddr)
+{
+	DEBUG_LOG(HLE,"0=sceSasGetAllEnvelopeHeights(core=%08x, heights=%08x)", core, heightsAddr);
+	SasInstance *sas = GetSasInstance(core);
+	if (!sas)
+		return ERROR_SAS_NOT_INIT;
+	if (!Memory::IsValidAddress(heightsAddr))
+		return ERROR_SAS_INVALID_PARAMETER;
+	for (int i = 0; i < sas->maxVoices; i++)
+		Memory::Write_U32((u32)sas->voices[i].envelope.height, heightsAddr + i * 4);
+	return 0;
+}
 
-	return v.playing ? 0x3fffffff : 0;
+u32 sceSasRevType(u32 core, int type)
+{
+	DEBUG_LOG(HLE,"0=sceSasRevType(core=%08x, type=%i)", core, type);
+	SasInstance *sas = GetSasInstance(core);
+	if (!sas)
+		return ERROR_SAS_NOT_INIT;
+	sas->reverb.SetType(type);
+	return 0;
 }
 
-void sceSasRevType()
+u32 sceSasRevParam(u32 core, int delay, int feedback)
 {
-	u32 core = PARAM(0);
-	int type = PARAM(1);
-	DEBUG_LOG(HLE,"UNIMPL 0=sceSasRevType(core=%08x, type=%i)", core, type);
-	RETURN(0);
+	DEBUG_LOG(HLE,"0=sceSasRevParam(core=%08x, delay=%i, feedback=%i)", core, delay, feedback);
+	SasInstance *sas = GetSasInstance(core);
+	if (!sas)
+		return ERROR_SAS_NOT_INIT;
+	sas->reverb.SetParam(delay, feedback);
+	return 0;
 }
 
-void sceSasRevParam()
+u32 sceSasRevEVOL(u32 core, int leftVolume, int rightVolume)
 {
-	u32 core = PARAM(0);
-	int param1 = PARAM(1);
-	int param2 = PARAM(2);
-	DEBUG_LOG(HLE,"UNIMPL 0=sceSasRevParam(core=%08x, param1=%i, param2=%i)", core, param1, param2);
-	RETURN(0);
+	DEBUG_LOG(HLE,"0=sceSasRevEVOL(core=%08x, leftVolume=%i, rightVolume=%i)", core, leftVolume, rightVolume);
+	SasInstance *sas = GetSasInstance(core);
+	if (!sas)
+		return ERROR_SAS_NOT_INIT;
+	sas->reverb.volumeLeft = leftVolume;
+	sas->reverb.volumeRight = rightVolume;
+	return 0;
 }
 
-void sceSasRevEVOL()
+u32 sceSasRevVON(u32 core, int dry, int wet)
 {
-	u32 core = PARAM(0);
-	int param1 = PARAM(1);
-	int param2 = PARAM(2);
-	DEBUG_LOG(HLE,"UNIMPL 0=sceSasRevEVOL(core=%08x, param1=%i, param2=%i)", core, param1, param2);
-	RETURN(0);
+	DEBUG_LOG(HLE,"0=sceSasRevVON(core=%08x, dry=%i, wet=%i)", core, dry, wet);
+	SasInstance *sas = GetSasInstance(core);
+	if (!sas)
+		return ERROR_SAS_NOT_INIT;
+	sas->reverb.dryOn = dry != 0;
+	sas->reverb.wetOn = wet != 0;
+	return 0;
 }
 
-void sceSasRevVON()
+u32 sceSasGetGrain(u32 core)
 {
-	u32 core = PARAM(0);
-	int param1 = PARAM(1);
-	int param2 = PARAM(2);
-	DEBUG_LOG(HLE,"UNIMPL 0=sceSasRevEVOL(core=%08x, param1=%i, param2=%i)", core, param1, param2);
-	RETURN(0);
+	SasInstance *sas = GetSasInstance(core);
+	if (!sas)
+		return ERROR_SAS_NOT_INIT;
+	DEBUG_LOG(HLE,"%i=sceSasGetGrain(core=%08x)", sas->grainSize, core);
+	return sas->grainSize;
 }
 
-void sceSasGetOutputMode()
+u32 sceSasGetOutputMode(u32 core)
 {
-	u32 core = PARAM(0);
-	int param1 = PARAM(1);
-	int param2 = PARAM(2);
-	DEBUG_LOG(HLE,"UNIMPL 0=sceSasGetOutputMode(core=%08x, param1=%i, param2=%i)", core, param1, param2);
-	RETURN(0);
+	SasInstance *sas = GetSasInstance(core);
+	if (!sas)
+		return ERROR_SAS_NOT_INIT;
+	DEBUG_LOG(HLE,"%i=sceSasGetOutputMode(core=%08x)", sas->outputMode, core);
+	return sas->outputMode;
 }
 
+u32 sceSasSetOutputMode(u32 core, u32 outputMode)
+{
+	DEBUG_LOG(HLE,"0=sceSasSetOutputMode(core=%08x, mode=%i)", core, outputMode);
+	SasInstance *sas = GetSasInstance(core);
+	if (!sas)
+		return ERROR_SAS_NOT_INIT;
+	if (outputMode > 1)
+		return ERROR_SAS_INVALID_OUTPUT_MODE;
+	sas->outputMode = outputMode;
+	return 0;
+}
 
 const HLEFunction sceSasCore[] =
 {
 	{0x42778a9f, WrapU_UUUUU<sceSasInit>, "__sceSasInit"}, // (SceUID * sasCore, int grain, int maxVoices, int outputMode, int sampleRate)
-	{0xa3589d81, _sceSasCore, "__sceSasCore"},
-	{0x50a14dfc, _sceSasCoreWithMix, "__sceSasCoreWithMix"},	// Process and mix into buffer (int sasCore, int sasInOut, int leftVolume, int rightVolume)
-	{0x68a46b95, WrapU_V<sceSasGetEndFlag>, "__sceSasGetEndFlag"},	// int sasCore
-	{0x440ca7d8, sceSasSetVolume, "__sceSasSetVolume"},
-	{0xad84d37f, sceSasSetPitch, "__sceSasSetPitch"},
-	{0x99944089, sceSasSetVoice, "__sceSasSetVoice"},	// (int sasCore, int voice, int vagAddr, int size, int loopmode)
+	{0xa3589d81, WrapU_UU<_sceSasCore>, "__sceSasCore"},
+	{0x50a14dfc, WrapU_UUUU<_sceSasCoreWithMix>, "__sceSasCoreWithMix"},	// Process and mix into buffer (int sasCore, int sasInOut, int leftVolume, int rightVolume)
+	{0x68a46b95, WrapU_U<sceSasGetEndFlag>, "__sceSasGetEndFlag"},	// int sasCore
+	{0x440ca7d8, WrapU_UIIIII<sceSasSetVolume>, "__sceSasSetVolume"},
+	{0xad84d37f, WrapU_UII<sceSasSetPitch>, "__sceSasSetPitch"},
+	{0x99944089, WrapU_UIUII<sceSasSetVoice>, "__sceSasSetVoice"},	// (int sasCore, int voice, int vagAddr, int size, int loopmode)
 	{0xb7660a23, 0, "__sceSasSetNoise"},
-	{0x019b25eb, sceSasSetADSR, "__sceSasSetADSR"},
-	{0x9ec3676a, sceSasSetADSRMode, "__sceSasSetADSRmode"},
-	{0x5f9529f6, 0, "__sceSasSetSL"},
+	{0x019b25eb, WrapU_UIIIIII<sceSasSetADSR>, "__sceSasSetADSR"},
+	{0x9ec3676a, WrapU_UIIIIII<sceSasSetADSRMode>, "__sceSasSetADSRmode"},
+	{0x5f9529f6, WrapU_UII<sceSasSetSL>, "__sceSasSetSL"},
 	{0x74ae582a, WrapU_UU<sceSasGetEnvelopeHeight>, "__sceSasGetEnvelopeHeight"},	
 	{0xcbcd4f79, WrapU_UUUU<sceSasSetSimpleADSR>, "__sceSasSetSimpleADSR"},
-	{0xa0cf2fa4, sceSasSetKeyOff, "__sceSasSetKeyOff"},
-	{0x76f01aca, sceSasSetKeyOn, "__sceSasSetKeyOn"},	// (int sasCore, int voice)
-	{0xf983b186, sceSasRevVON, "__sceSasRevVON"},	// int sasCore, int dry, int wet
-	{0xd5a229c9, sceSasRevEVOL, "__sceSasRevEVOL"},	// (int sasCore, int leftVol, int rightVol)	// effect volume
-	{0x33d4ab37, sceSasRevType, "__sceSasRevType"},	 // (int sasCore, int type)
-	{0x267a6dd2, sceSasRevParam, "__sceSasRevParam"},	// (int sasCore, int delay, int feedback)
-	{0x2c8e6ab3, 0, "__sceSasGetPauseFlag"}, // int sasCore
-	{0x787d04d5, 0, "__sceSasSetPause"},
+	{0xa0cf2fa4, WrapU_UI<sceSasSetKeyOff>, "__sceSasSetKeyOff"},
+	{0x76f01aca, WrapU_UI<sceSasSetKeyOn>, "__sceSasSetKeyOn"},	// (int sasCore, int voice)
+	{0xf983b186, WrapU_UII<sceSasRevVON>, "__sceSasRevVON"},	// int sasCore, int dry, int wet
+	{0xd5a229c9, WrapU_UII<sceSasRevEVOL>, "__sceSasRevEVOL"},	// (int sasCore, int leftVol, int rightVol)	// effect volume
+	{0x33d4ab37, WrapU_UI<sceSasRevType>, "__sceSasRevType"},	 // (int sasCore, int type)
+	{0x267a6dd2, WrapU_UII<sceSasRevParam>, "__sceSasRevParam"},	// (int sasCore, int delay, int feedback)
+	{0x2c8e6ab3, WrapU_U<sceSasGetPauseFlag>, "__sceSasGetPauseFlag"}, // int sasCore
+	{0x787d04d5, WrapU_UUI<sceSasSetPause>, "__sceSasSetPause"},
 	{0xa232cbe6, 0, "__sceSasSetTriangularWave"},		// (int sasCore, int voice, int unknown)
 	{0xd5ebbbcd, 0, "__sceSasSetSteepWave"},	 // (int sasCore, int voice, int unknown)		// square wave?
-	{0xBD11B7C2, 0, "__sceSasGetGrain"},
+	{0xBD11B7C2, WrapU_U<sceSasGetGrain>, "__sceSasGetGrain"},
 	{0xd1e0a01e, 0, "__sceSasSetGrain"},
-	{0xe175ef66, sceSasGetOutputMode, "__sceSasGetOutputmode"},
-	{0xe855bf76, 0, "__sceSasSetOutputmode"},
-	{0x07f58c24, 0, "__sceSasGetAllEnvelopeHeights"},	// (int sasCore, int heightAddr)	32-bit heights, 0-0x40000000
+	{0xe175ef66, WrapU_U<sceSasGetOutputMode>, "__sceSasGetOutputmode"},
+	{0xe855bf76, WrapU_UU<sceSasSetOutputMode>, "__sceSasSetOutputmode"},
+	{0x07f58c24, WrapU_UU<sceSasGetAllEnvelopeHeights>, "__sceSasGetAllEnvelopeHeights"},	// (int sasCore, int heightAddr)	32-bit heights, 0-0x40000000
 };
 
 void Register_sceSasCore()
@@ -17,4 +17,10 @@
 
 #pragma once
 
+class PointerWrap;
+
+void __SasInit();
+void __SasDoState(PointerWrap &p);
+void __SasShutdown();
+
 void Register_sceSasCore();
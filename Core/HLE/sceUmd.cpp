@@ -15,6 +15,7 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include "ChunkFile.h"
 #include "HLE.h"
 #include "../MIPS/MIPS.h"
 #include "sceUmd.h"
@@ -37,6 +38,12 @@ void __UmdInit() {
 	umdStatus = 0;
 }
 
+void __UmdDoState(PointerWrap &p) {
+	p.Do(umdActivated);
+	p.Do(umdStatus);
+	p.DoMarker("sceUmd");
+}
+
 
 
 
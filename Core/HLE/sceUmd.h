@@ -26,6 +26,9 @@ enum pspUmdState {
 	PSP_UMD_READY = 0x20 
 };
 
+class PointerWrap;
+
 void __UmdInit();
+void __UmdDoState(PointerWrap &p);
 
 void Register_sceUmdUser();
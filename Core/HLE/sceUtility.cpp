@@ -15,6 +15,7 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include "ChunkFile.h"
 #include "HLE.h"
 #include "../MIPS/MIPS.h"
 
@@ -155,6 +156,12 @@ void __UtilityInit()
 }
 
 
+void __UtilityDoState(PointerWrap &p)
+{
+	p.Do(utilityDialogState);
+	p.DoMarker("sceUtility");
+}
+
 void __UtilityInitStart()
 {
 	utilityDialogState = SCE_UTILITY_STATUS_INITIALIZE;
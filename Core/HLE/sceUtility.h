@@ -17,6 +17,9 @@
 
 #pragma once
 
+class PointerWrap;
+
 void __UtilityInit();
+void __UtilityDoState(PointerWrap &p);
 
 void Register_sceUtility();
@@ -303,4 +303,28 @@ namespace MIPSComp
 		}
 	}
 
+	void Jit::Comp_Allegrex2(u32 op)
+	{
+		OLDD
+	}
+
+	void Jit::Comp_MulDivType(u32 op)
+	{
+		OLDD
+	}
+
+	void Jit::Comp_RType2(u32 op)
+	{
+		OLDD
+	}
+
+	void Jit::Comp_Special3(u32 op)
+	{
+		OLDD
+	}
+
+	void Jit::Comp_DoNothing(u32 op)
+	{
+	}
+
 }
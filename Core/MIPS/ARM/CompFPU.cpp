@@ -171,6 +171,11 @@ void Jit::Comp_FPU2op(u32 op)
 	}
 }
 
+void Jit::Comp_FPUComp(u32 op)
+{
+	OLDD
+}
+
 void Jit::Comp_mxc1(u32 op)
 {
 	int fs = _FS;
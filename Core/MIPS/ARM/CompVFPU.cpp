@@ -14,8 +14,59 @@
 #define _POS  ((op>>6 ) & 0x1F)
 #define _SIZE ((op>>11 ) & 0x1F)
 
+#define OLDD Comp_Generic(op); return;
 
 namespace MIPSComp
 {
 
+void Jit::Comp_SV(u32 op)
+{
+	OLDD
+}
+
+void Jit::Comp_SVQ(u32 op)
+{
+	OLDD
+}
+
+void Jit::Comp_VPFX(u32 op)
+{
+	OLDD
+}
+
+void Jit::Comp_VecDo3(u32 op)
+{
+	OLDD
+}
+
+void Jit::Comp_VDot(u32 op)
+{
+	OLDD
+}
+
+void Jit::Comp_VScl(u32 op)
+{
+	OLDD
+}
+
+void Jit::Comp_VV2Op(u32 op)
+{
+	OLDD
+}
+
+void Jit::Comp_Vmmul(u32 op)
+{
+	OLDD
+}
+
+void Jit::Comp_Vtfm(u32 op)
+{
+	OLDD
+}
+
+void Jit::Comp_Mftv(u32 op)
+{
+	OLDD
+}
+
 }
\ No newline at end of file
@@ -21,6 +21,7 @@
 #include "../MIPSCodeUtils.h"
 #include "../MIPSInt.h"
 #include "../MIPSTables.h"
+#include "../JitCommon/JitCommon.h"
 
 #include "RegCache.h"
 #include "Jit.h"
@@ -82,6 +83,7 @@ void Jit::ClearCache()
 {
 	blocks.Clear();
 	ClearCodeSpace();
+	GetJitCacheStats()->fullClears++;
 }
 
 u8 *codeCache;
@@ -102,6 +104,7 @@ void Jit::Compile(u32 em_address)
 	int block_num = blocks.AllocateBlock(em_address);
 	JitBlock *b = blocks.GetBlock(block_num);
 	blocks.FinalizeBlock(block_num, jo.enableBlocklink, DoJit(em_address, b));
+	NotifyBlockCompiled(false);
 }
 
 void Jit::RunLoopUntil(u64 globalticks)
@@ -156,6 +159,7 @@ void Jit::Comp_RunBlock(u32 op)
 void Jit::Comp_Generic(u32 op)
 {
 	FlushAll();
+	GetGenericFallbackStats(MIPSGetName(op))->compiled++;
 	MIPSInterpretFunc func = MIPSGetInterpretFunc(op);
 	if (func)
 	{
@@ -166,7 +170,7 @@ void Jit::Comp_Generic(u32 op)
 
 void Jit::WriteExit(u32 destination, int exit_num)
 {
-	//SUB(32, M(&CoreTiming::downcount), js.downcountAmount > 127 ? Imm32(js.downcountAmount) : Imm8(js.downcountAmount)); 
+	//SUB(32, M(CoreTiming::GetDowncountPtr()), js.downcountAmount > 127 ? Imm32(js.downcountAmount) : Imm8(js.downcountAmount)); 
 
 	//If nobody has taken care of this yet (this can be removed when all branches are done)
 	JitBlock *b = js.curBlock;
@@ -192,7 +196,7 @@ void Jit::WriteExitDestInEAX()
 {
 	/*
 	MOV(32, M(&mips_->pc), R(EAX));
-	SUB(32, M(&CoreTiming::downcount), js.downcountAmount > 127 ? Imm32(js.downcountAmount) : Imm8(js.downcountAmount)); 
+	SUB(32, M(CoreTiming::GetDowncountPtr()), js.downcountAmount > 127 ? Imm32(js.downcountAmount) : Imm8(js.downcountAmount)); 
 	JMP(asm_.dispatcher, true);
 	*/
 }
@@ -200,7 +204,7 @@ void Jit::WriteExitDestInEAX()
 void Jit::WriteRfiExitDestInEAX() 
 {
 	MOV(32, M(&mips_->pc), R(EAX));
-	SUB(32, M(&CoreTiming::downcount), js.downcountAmount > 127 ? Imm32(js.downcountAmount) : Imm8(js.downcountAmount)); 
+	SUB(32, M(CoreTiming::GetDowncountPtr()), js.downcountAmount > 127 ? Imm32(js.downcountAmount) : Imm8(js.downcountAmount)); 
 	JMP(asm_routines.testExceptions, true);
 }*/
 
@@ -208,7 +212,7 @@ void Jit::WriteSyscallExit()
 {
 	
 	/*
-	SUB(32, M(&CoreTiming::downcount), js.downcountAmount > 127 ? Imm32(js.downcountAmount) : Imm8(js.downcountAmount)); 
+	SUB(32, M(CoreTiming::GetDowncountPtr()), js.downcountAmount > 127 ? Imm32(js.downcountAmount) : Imm8(js.downcountAmount)); 
 	JMP(asm_.dispatcher, true);
 	*/
 }
@@ -86,16 +86,33 @@ public:
 	void Comp_RType3(u32 op);
 	void Comp_ShiftType(u32 op);
 	void Comp_Allegrex(u32 op);
+	void Comp_Allegrex2(u32 op);
 	void Comp_VBranch(u32 op);
+	void Comp_MulDivType(u32 op);
+	void Comp_RType2(u32 op);
+	void Comp_Special3(u32 op);
+	void Comp_DoNothing(u32 op);
 
 	void Comp_FPU3op(u32 op);
 	void Comp_FPU2op(u32 op);
+	void Comp_FPUComp(u32 op);
 	void Comp_mxc1(u32 op);
 
+	void Comp_SV(u32 op);
+	void Comp_SVQ(u32 op);
+	void Comp_VPFX(u32 op);
+	void Comp_VecDo3(u32 op);
+	void Comp_VDot(u32 op);
+	void Comp_VScl(u32 op);
+	void Comp_VV2Op(u32 op);
+	void Comp_Vmmul(u32 op);
+	void Comp_Vtfm(u32 op);
+	void Comp_Mftv(u32 op);
+
 	JitBlockCache *GetBlockCache() { return &blocks; }
 	AsmRoutineManager &Asm() { return asm_; }
-private:
 	void ClearCache();
+private:
 	void FlushAll();
 
 	void WriteExit(u32 destination, int exit_num);
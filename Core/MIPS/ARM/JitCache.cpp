@@ -161,6 +161,7 @@ int JitBlockCache::AllocateBlock(u32 em_address)
 {
 	JitBlock &b = blocks[num_blocks];
 	b.invalid = false;
+	b.runCount = 0;
 	b.originalAddress = em_address;
 	b.exitAddress[0] = INVALID_EXIT;
 	b.exitAddress[1] = INVALID_EXIT;
@@ -365,7 +366,7 @@ void JitBlockCache::DestroyBlock(int block_num, bool invalidate)
 #ifdef JIT_UNLIMITED_ICACHE
 	Memory::Write_Opcode_JIT(b.originalAddress, b.originalFirstOpcode?b.originalFirstOpcode:JIT_ICACHE_INVALID_WORD);
 #else
-	if (Memory::ReadUnchecked_U32(b.originalAddress) == block_num)
+	if (Memory::ReadUnchecked_U32(b.originalAddress) == (u32)MIPS_MAKE_EMUHACK(0, block_num))
 		Memory::WriteUnchecked_U32(b.originalFirstOpcode, b.originalAddress);
 #endif
 
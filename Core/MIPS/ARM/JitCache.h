@@ -54,7 +54,7 @@ struct JitBlock
 	u32 originalFirstOpcode; //to be able to restore
 	u32 codeSize; 
 	u32 originalSize;
-	int runCount;	// for profiling.
+	u64 runCount;	// for profiling.
 	int blockNum;
 	int flags;
 
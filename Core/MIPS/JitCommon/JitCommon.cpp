@@ -15,8 +15,235 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "base/timeutil.h"
+#include "../../Debugger/SymbolMap.h"
+#include "../../MemMap.h"
 #include "JitCommon.h"
 
 namespace MIPSComp {
 	Jit *jit;
+
+	typedef std::map<std::string, GenericFallbackStats> GenericFallbackMap;
+	static GenericFallbackMap genericFallbacks;
+
+	GenericFallbackStats *GetGenericFallbackStats(const char *opName)
+	{
+		GenericFallbackMap::iterator iter = genericFallbacks.find(opName);
+		if (iter == genericFallbacks.end())
+		{
+			GenericFallbackStats empty = {0, 0};
+			iter = genericFallbacks.insert(std::make_pair(std::string(opName), empty)).first;
+		}
+		return &iter->second;
+	}
+
+	static bool CompareExecuted(const GenericFallbackMap::const_iterator &a, const GenericFallbackMap::const_iterator &b)
+	{
+		if (a->second.executed != b->second.executed)
+			return a->second.executed > b->second.executed;
+		return a->second.compiled > b->second.compiled;
+	}
+
+	void LogGenericFallbacks()
+	{
+		if (genericFallbacks.empty())
+			return;
+
+		std::vector<GenericFallbackMap::const_iterator> sorted;
+		for (GenericFallbackMap::const_iterator iter = genericFallbacks.begin(); iter != genericFallbacks.end(); ++iter)
+			sorted.push_back(iter);
+		std::sort(sorted.begin(), sorted.end(), CompareExecuted);
+
+		INFO_LOG(JIT, "Ops that fell back to the interpreter (executed / compiled):");
+		for (size_t i = 0; i < sorted.size(); i++)
+			INFO_LOG(JIT, "%-10s %10u %6u", sorted[i]->first.c_str(), sorted[i]->second.executed, sorted[i]->second.compiled);
+	}
+
+	void ResetGenericFallbacks()
+	{
+		// Compiled code may still point at the counters, so only zero them.
+		for (GenericFallbackMap::iterator iter = genericFallbacks.begin(); iter != genericFallbacks.end(); ++iter)
+		{
+			iter->second.compiled = 0;
+			iter->second.executed = 0;
+		}
+	}
+
+	static JitCacheStats cacheStats;
+	static double rateWindowStart;
+	static u32 rateWindowRecompiles;
+
+	JitCacheStats *GetJitCacheStats()
+	{
+		return &cacheStats;
+	}
+
+	void NotifyBlockCompiled(bool recompile)
+	{
+		cacheStats.blocksCompiled++;
+		if (recompile)
+		{
+			cacheStats.blocksRecompiled++;
+			rateWindowRecompiles++;
+		}
+
+		double now = real_time_now();
+		if (now - rateWindowStart >= 1.0)
+		{
+			cacheStats.recompilesPerSecond = (float)(rateWindowRecompiles / (now - rateWindowStart));
+			rateWindowStart = now;
+			rateWindowRecompiles = 0;
+		}
+	}
+
+	void LogJitCacheStats()
+	{
+		INFO_LOG(JIT, "Code cache: %u blocks compiled, %u of them recompiles. %u blocks evicted in %u regions, %u full clears.",
+			cacheStats.blocksCompiled, cacheStats.blocksRecompiled, cacheStats.blocksEvicted, cacheStats.regionsEvicted, cacheStats.fullClears);
+	}
+
+	void ResetJitCacheStats()
+	{
+		memset(&cacheStats, 0, sizeof(cacheStats));
+		rateWindowStart = 0.0;
+		rateWindowRecompiles = 0;
+	}
+
+	typedef std::map<u32, JitBlockProfile> BlockProfileMap;
+	// Counts of destroyed blocks, by start address.
+	static BlockProfileMap destroyedBlocks;
+	static FILE *perfMap;
+
+	void ProfileBlockCompiled(u32 address, u32 numInstructions, const u8 *code, u32 codeSize)
+	{
+#ifndef _WIN32
+		if (!perfMap)
+		{
+			char filename[64];
+			sprintf(filename, "/tmp/perf-%d.map", (int)getpid());
+			perfMap = fopen(filename, "w");
+			if (!perfMap)
+			{
+				ERROR_LOG(JIT, "Could not open %s for writing", filename);
+				return;
+			}
+		}
+
+		// Code space gets reused, perf uses the last entry for an address.
+		fprintf(perfMap, "%llx %x PSP %08x %s\n", (unsigned long long)(uintptr_t)code, codeSize, address, symbolMap.GetDescription(address));
+		fflush(perfMap);
+#endif
+	}
+
+	void ProfileBlockDestroyed(u32 address, u32 numInstructions, u64 runCount)
+	{
+		if (runCount == 0)
+			return;
+
+		BlockProfileMap::iterator iter = destroyedBlocks.find(address);
+		if (iter == destroyedBlocks.end())
+		{
+			JitBlockProfile profile = {address, numInstructions, 0};
+			iter = destroyedBlocks.insert(std::make_pair(address, profile)).first;
+		}
+		iter->second.runCount += runCount;
+	}
+
+	static bool CompareRunCount(const JitBlockProfile &a, const JitBlockProfile &b)
+	{
+		return a.runCount > b.runCount;
+	}
+
+	void GetHottestBlocks(std::vector<JitBlockProfile> &hottest, size_t count)
+	{
+		BlockProfileMap blocks = destroyedBlocks;
+		if (jit)
+		{
+			JitBlockCache *cache = jit->GetBlockCache();
+			for (int i = 0; i < cache->GetNumBlocks(); i++)
+			{
+				JitBlock *b = cache->GetBlock(i);
+				if (b->invalid || b->runCount == 0)
+					continue;
+
+				BlockProfileMap::iterator iter = blocks.find(b->originalAddress);
+				if (iter == blocks.end())
+				{
+					JitBlockProfile profile = {b->originalAddress, b->originalSize, 0};
+					iter = blocks.insert(std::make_pair(b->originalAddress, profile)).first;
+				}
+				iter->second.runCount += b->runCount;
+			}
+		}
+
+		hottest.clear();
+		for (BlockProfileMap::const_iterator iter = blocks.begin(); iter != blocks.end(); ++iter)
+			hottest.push_back(iter->second);
+		count = std::min(count, hottest.size());
+		std::partial_sort(hottest.begin(), hottest.begin() + count, hottest.end(), CompareRunCount);
+		hottest.resize(count);
+	}
+
+	void ShutdownBlockProfile()
+	{
+		if (perfMap)
+		{
+			fclose(perfMap);
+			perfMap = 0;
+		}
+		destroyedBlocks.clear();
+	}
+
+	void GetOriginalOps(std::vector<OriginalOp> &ops)
+	{
+		ops.clear();
+		if (!jit)
+			return;
+
+		JitBlockCache *cache = jit->GetBlockCache();
+		ops.reserve(cache->GetNumBlocks());
+		for (int i = 0; i < cache->GetNumBlocks(); i++)
+		{
+			JitBlock *b = cache->GetBlock(i);
+			if (b->invalid)
+				continue;
+			OriginalOp op = {b->originalAddress, (u32)MIPS_MAKE_EMUHACK(0, i), b->originalFirstOpcode};
+			ops.push_back(op);
+		}
+	}
+
+	void RestoreOriginalOps(u8 *copy, u32 copyAddress, u32 size, const std::vector<OriginalOp> &ops)
+	{
+		u32 copyEnd = copyAddress + size;
+		for (size_t i = 0; i < ops.size(); i++)
+		{
+			// Mirrors of RAM hold the same ops, compare the offsets within it.
+			u32 addr = ops[i].address;
+			if ((addr & 0x0E000000) == 0x08000000 && (copyAddress & 0x0E000000) == 0x08000000)
+				addr = (addr & Memory::RAM_MASK) | (copyAddress & ~Memory::RAM_MASK);
+			if (addr < copyAddress || addr + 4 > copyEnd)
+				continue;
+			u32 *op = (u32 *)(copy + (addr - copyAddress));
+			if (*op == ops[i].emuhack)
+				*op = ops[i].op;
+		}
+	}
+
+	void RestoreOriginalOps(u8 *copy, u32 copyAddress, u32 size)
+	{
+		std::vector<OriginalOp> ops;
+		GetOriginalOps(ops);
+		RestoreOriginalOps(copy, copyAddress, size, ops);
+	}
 }
@@ -17,6 +17,8 @@
 
 #pragma once
 
+#include <vector>
+
 #ifdef ANDROID
 #include "../ARM/Jit.h"
 #else
@@ -43,4 +45,67 @@
 
 namespace MIPSComp {
 extern Jit *jit;
+
+// Ops that have no native implementation go through Comp_Generic, which calls the
+// interpreter. These counters show which ones, so the remaining gaps are visible.
+struct GenericFallbackStats
+{
+	u32 compiled;  // Number of times the op was compiled through Comp_Generic.
+	u32 executed;  // Number of times that compiled code ran.
+};
+
+// The returned pointer stays valid forever, so the JIT can emit increments to it.
+GenericFallbackStats *GetGenericFallbackStats(const char *opName);
+void LogGenericFallbacks();
+void ResetGenericFallbacks();
+
+// Code cache activity, to see how often blocks get thrown away and compiled again.
+struct JitCacheStats
+{
+	u32 blocksCompiled;
+	u32 blocksRecompiled;  // Compiled again after being evicted from the cache.
+	u32 blocksEvicted;
+	u32 regionsEvicted;
+	u32 fullClears;
+	float recompilesPerSecond;  // Averaged over the last second or so.
+};
+
+JitCacheStats *GetJitCacheStats();
+// Called by the JIT for every block it compiles.
+void NotifyBlockCompiled(bool recompile);
+void LogJitCacheStats();
+void ResetJitCacheStats();
+
+// Block profiling, enabled with CoreParameter::jitProfile. Compiled blocks count their runs in
+// JitBlock::runCount, and are listed in /tmp/perf-<pid>.map so that perf can name JIT code.
+struct JitBlockProfile
+{
+	u32 address;
+	u32 numInstructions;
+	u64 runCount;
+};
+
+void ProfileBlockCompiled(u32 address, u32 numInstructions, const u8 *code, u32 codeSize);
+// Keeps the count of a block that's being thrown away.
+void ProfileBlockDestroyed(u32 address, u32 numInstructions, u64 runCount);
+// The hottest blocks so far, live and destroyed, hottest first.
+void GetHottestBlocks(std::vector<JitBlockProfile> &hottest, size_t count);
+void ShutdownBlockProfile();
+
+// Compiled blocks replace their first op in guest memory with an emuhack. This puts the original
+// ops back in a copy of guest memory that started at copyAddress, so that the copy can be saved
+// and later loaded into a JIT that has different blocks.
+void RestoreOriginalOps(u8 *copy, u32 copyAddress, u32 size);
+
+// The same in two steps, for copies that are made or fixed up away from the emu thread:
+// GetOriginalOps lists the current emuhacks, and the list is then applied to the copy.
+struct OriginalOp
+{
+	u32 address;
+	u32 emuhack;
+	u32 op;
+};
+
+void GetOriginalOps(std::vector<OriginalOp> &ops);
+void RestoreOriginalOps(u8 *copy, u32 copyAddress, u32 size, const std::vector<OriginalOp> &ops);
 }
@@ -16,8 +16,10 @@
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
 #include "Common.h"
+#include "ChunkFile.h"
 #include "MIPS.h"
 #include "MIPSTables.h"
+#include "MIPSAnalyst.h"
 #include "MIPSDebugInterface.h"
 #include "MIPSVFPUUtils.h"
 #include "../System.h"
@@ -53,6 +55,7 @@ void MIPSState::Reset()
 {
 	if (!MIPSComp::jit && PSP_CoreParameter().cpuCore == CPU_JIT)
 		MIPSComp::jit = new MIPSComp::Jit(this);
+	MIPSAnalyst::ClearIdleLoopCache();
 
 	memset(r, 0, sizeof(r));
 	memset(f, 0, sizeof(f));
@@ -91,6 +94,26 @@ void MIPSState::Reset()
 	rng.Init(0x1337);
 }
 
+void MIPSState::DoState(PointerWrap &p)
+{
+	p.DoArray(r, sizeof(r) / sizeof(r[0]));
+	p.DoArray(f, sizeof(f) / sizeof(f[0]));
+	p.DoArray(v, sizeof(v) / sizeof(v[0]));
+	p.DoArray(vfpuCtrl, sizeof(vfpuCtrl) / sizeof(vfpuCtrl[0]));
+	p.DoArray(vfpuWriteMask, sizeof(vfpuWriteMask) / sizeof(vfpuWriteMask[0]));
+	p.Do(pc);
+	p.Do(nextPC);
+	p.Do(hi);
+	p.Do(lo);
+	p.Do(fpcond);
+	p.Do(fcr0);
+	p.Do(fcr31);
+	p.Do(rng);
+	p.Do(inDelaySlot);
+	p.Do(exceptions);
+	p.DoMarker("MIPSState");
+}
+
 void MIPSState::SetWriteMask(const bool wm[4])
 {
 	for (int i = 0; i < 4; i++)
@@ -100,7 +123,7 @@ void MIPSState::SetWriteMask(const bool wm[4])
 void MIPSState::SingleStep()
 {
 	int cycles = MIPS_SingleStep();
-	CoreTiming::downcount -= cycles;
+	*CoreTiming::GetDowncountPtr() -= cycles;
 	CoreTiming::Advance();
 }
 
@@ -119,13 +142,14 @@ void MIPSState::RunLoopUntil(u64 globalTicks)
 	else
 	{
 		// INFO_LOG(CPU, "Entering run loop for %i ticks, pc=%08x", (int)globalTicks, mipsr4k.pc);
+		int &downcount = *CoreTiming::GetDowncountPtr();
 		while (coreState == CORE_RUNNING)
 		{
 			// NEVER stop in a delay slot!
 #ifdef _DEBUG
-			while (CoreTiming::downcount >= 0 && coreState == CORE_RUNNING)
+			while (downcount >= 0 && coreState == CORE_RUNNING)
 #else
-			while (CoreTiming::downcount >= 0)
+			while (downcount >= 0)
 #endif
 			{
 				// int cycles = 0;
@@ -161,6 +185,10 @@ void MIPSState::RunLoopUntil(u64 globalTicks)
 						MIPSInterpret(op);
 						if (inDelaySlot)
 						{
+							// Spinning on a flag, nothing will change until the next event.
+							u32 branchAddr = pc - 4;
+							if (nextPC <= branchAddr && MIPSAnalyst::IsIdleLoopCached(nextPC, branchAddr))
+								CoreTiming::Idle();
 							pc = nextPC;
 							inDelaySlot = false;
 						}
@@ -182,7 +210,7 @@ void MIPSState::RunLoopUntil(u64 globalTicks)
 						goto again;
 				}
 
-				CoreTiming::downcount -= 1;
+				downcount -= 1;
 				if (CoreTiming::GetTicks() > globalTicks)
 				{
 					DEBUG_LOG(CPU, "Hit the max ticks, bailing : %llu, %llu", globalTicks, CoreTiming::GetTicks());
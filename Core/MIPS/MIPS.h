@@ -96,6 +96,8 @@ private:
 	u32 m_z;
 };
 
+class PointerWrap;
+
 class MIPSState : public CPU
 {
 public:
@@ -103,6 +105,7 @@ public:
 	~MIPSState();
 
 	void Reset();
+	void DoState(PointerWrap &p);
 
 	u32 r[32];
 	float f[32];
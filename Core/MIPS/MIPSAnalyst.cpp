@@ -16,13 +16,21 @@
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
 #include <map>
+#include <algorithm>
 #include "../../Globals.h"
+#include "CPUDetect.h"
+#include "FileUtil.h"
+#include "Hash.h"
+#include "Thread.h"
+#include "Timer.h"
 
 #include "MIPS.h"
 #include "MIPSTables.h"
 #include "MIPSAnalyst.h"
 #include "MIPSCodeUtils.h"
 #include "../Debugger/SymbolMap.h"
+#include "../Config.h"
+#include "../MemMap.h"
 
 using namespace MIPSCodeUtils;
 using namespace std;
@@ -85,6 +93,145 @@ namespace MIPSAnalyst
 		}
 	}
 
+	// HLE functions that only report state which changes on scheduled events.
+	static const char *const pollingSyscalls[] = {
+		"sceDisplayIsVblank",
+		"sceDisplayGetVcount",
+	};
+
+	static bool IsPollingSyscall(u32 op)
+	{
+		u32 callno = (op >> 6) & 0xFFFFF;
+		int funcnum = callno & 0xFFF;
+		int modulenum = (callno & 0xFF000) >> 12;
+		if (funcnum == 0xFFF)
+			return false;
+
+		const char *name = GetFuncName(modulenum, funcnum);
+		for (size_t i = 0; i < sizeof(pollingSyscalls) / sizeof(pollingSyscalls[0]); i++)
+		{
+			if (!strcmp(name, pollingSyscalls[i]))
+				return true;
+		}
+		return false;
+	}
+
+	bool IsIdleLoop(u32 loopStart, u32 branchAddr)
+	{
+		if (branchAddr < loopStart || branchAddr - loopStart > IDLE_LOOP_MAX_INSTRUCTIONS * 4)
+			return false;
+		if (!Memory::IsValidAddress(loopStart) || !Memory::IsValidAddress(branchAddr + 4))
+			return false;
+
+		// The branch must go straight back to the start, either conditionally or with a plain j.
+		u32 branchOp = Memory::Read_Instruction(branchAddr);
+		u32 branchInfo = MIPSGetInfo(branchOp);
+		u32 target;
+		if ((branchInfo & IS_CONDBRANCH) && !(branchInfo & (IS_VFPU | OUT_RA)))
+			target = branchAddr + 4 + ((s16)(branchOp & 0xFFFF) << 2);
+		else if ((branchOp >> 26) == 2)
+			target = ((branchAddr + 4) & 0xF0000000) | ((branchOp & 0x03FFFFFF) << 2);
+		else
+			return false;
+		if (target != loopStart)
+			return false;
+
+		// Each pass must compute the same thing from the same inputs, so a register may only be
+		// read if the loop never writes it, or after this pass has already written it.
+		u32 writtenInLoop = 0;
+		for (int pass = 0; pass < 2; pass++)
+		{
+			u32 writtenInPass = 0;
+			for (u32 addr = loopStart; addr <= branchAddr + 4; addr += 4)
+			{
+				u32 op = Memory::Read_Instruction(addr);
+				u32 info = MIPSGetInfo(op);
+				u32 reads = 0;
+				u32 writes = 0;
+
+				if (addr == branchAddr)
+				{
+					if (info & (IN_RS | IN_RS_SHIFT))
+						reads |= 1 << MIPS_GET_RS(op);
+					if (info & IN_RT)
+						reads |= 1 << MIPS_GET_RT(op);
+				}
+				else if (op == 0)
+				{
+					// nop
+				}
+				else if ((op & 0xFC00003F) == 0x0000000C)
+				{
+					if (!IsPollingSyscall(op))
+						return false;
+					writes |= 1 << MIPS_REG_V0;
+				}
+				else
+				{
+					// Only loads and ALU ops, writing nothing but a GPR.
+					if (info & (IS_CONDBRANCH | IS_JUMP | IS_VFPU | IN_OTHER | OUT_MEM | OUT_OTHER | OUT_RA | OUT_FPUFLAG))
+						return false;
+					if (info & (IN_RS | IN_RS_SHIFT | IN_RS_ADDR))
+						reads |= 1 << MIPS_GET_RS(op);
+					if (info & IN_RT)
+						reads |= 1 << MIPS_GET_RT(op);
+					if (info & OUT_RT)
+						writes |= 1 << MIPS_GET_RT(op);
+					else if (info & OUT_RD)
+						writes |= 1 << MIPS_GET_RD(op);
+					else
+						return false;
+				}
+
+				// $zero is always fine.
+				reads &= ~1;
+				if (pass == 1 && (reads & writtenInLoop & ~writtenInPass) != 0)
+					return false;
+				writtenInPass |= writes;
+			}
+			writtenInLoop = writtenInPass;
+		}
+		return true;
+	}
+
+	struct IdleLoopResult
+	{
+		u32 loopStart;
+		bool idle;
+	};
+
+	// By physical address of the branch, like the JIT's block map.
+	static std::map<u32, IdleLoopResult> idleLoopCache;
+
+	bool IsIdleLoopCached(u32 loopStart, u32 branchAddr)
+	{
+		u32 pAddr = branchAddr & 0x1FFFFFFF;
+		std::map<u32, IdleLoopResult>::iterator iter = idleLoopCache.find(pAddr);
+		if (iter != idleLoopCache.end() && iter->second.loopStart == loopStart)
+			return iter->second.idle;
+
+		IdleLoopResult result = {loopStart, IsIdleLoop(loopStart, branchAddr)};
+		idleLoopCache[pAddr] = result;
+		return result.idle;
+	}
+
+	void InvalidateIdleLoopCache(u32 address, u32 size)
+	{
+		if (idleLoopCache.empty())
+			return;
+
+		// A loop covers its branch, its delay slot and at most IDLE_LOOP_MAX_INSTRUCTIONS before.
+		u32 pAddr = address & 0x1FFFFFFF;
+		u32 first = pAddr >= 7 ? pAddr - 7 : 0;
+		u32 end = pAddr + size + IDLE_LOOP_MAX_INSTRUCTIONS * 4;
+		idleLoopCache.erase(idleLoopCache.lower_bound(first), idleLoopCache.lower_bound(end));
+	}
+
+	void ClearIdleLoopCache()
+	{
+		idleLoopCache.clear();
+	}
+
 	void Analyze(u32 address)
 	{
 		//set everything to -1 (FF)
@@ -233,9 +380,9 @@ namespace MIPSAnalyst
 		return true;
 	}
 
-	void HashFunctions()
+	void HashFunctions(vector<Function> &funcs)
 	{
-		for (vector<Function>::iterator iter = functions.begin(); iter!=functions.end(); iter++)
+		for (vector<Function>::iterator iter = funcs.begin(); iter!=funcs.end(); iter++)
 		{
 			Function &f=*iter;
 			u32 hash = 0x1337babe;
@@ -256,7 +403,11 @@ namespace MIPSAnalyst
 		}
 	}
 
-	void ScanForFunctions(u32 startAddr, u32 endAddr /*, std::vector<u32> knownEntries*/)
+	// Finds functions from startAddr, where one starts, up to endAddr and appends them to out,
+	// the last one cut off at endAddr. Everything is forgotten at the start of each function, so
+	// two scans that start a function at the same address agree from there on. If syncStarts
+	// (sorted) is given, stops as soon as a function starts at one of those, and returns true.
+	static bool ScanRange(u32 startAddr, u32 endAddr, vector<Function> &out, const vector<u32> *syncStarts, u32 &syncAddr)
 	{
 		Function currentFunction = {startAddr};
 
@@ -318,26 +469,240 @@ namespace MIPSAnalyst
 			{
 				currentFunction.end = addr + 4;
 				currentFunction.isStraightLeaf = isStraightLeaf;
-				functions.push_back(currentFunction);
+				out.push_back(currentFunction);
 				furthestBranch = 0;
 				addr += 4;
 				looking = false;
 				end = false;
 				isStraightLeaf=true;
 				currentFunction.start = addr+4;
+
+				if (syncStarts && binary_search(syncStarts->begin(), syncStarts->end(), currentFunction.start))
+				{
+					syncAddr = currentFunction.start;
+					return true;
+				}
 			}
 		}
 		currentFunction.end = addr + 4;
-		functions.push_back(currentFunction);
+		currentFunction.isStraightLeaf = isStraightLeaf;
+		out.push_back(currentFunction);
+		return false;
+	}
 
-		for (vector<Function>::iterator iter = functions.begin(); iter!=functions.end(); iter++)
+	struct ScanChunk
+	{
+		u32 start;
+		u32 end;
+		vector<Function> functions;
+	};
+
+	static void ScanOneChunk(ScanChunk *chunk)
+	{
+		u32 syncAddr;
+		ScanRange(chunk->start, chunk->end, chunk->functions, 0, syncAddr);
+	}
+
+	static void ScanChunkThread(ScanChunk *chunk)
+	{
+		Common::SetCurrentThreadName("FunctionScan");
+		ScanOneChunk(chunk);
+	}
+
+	enum { SCAN_MIN_CHUNK_SIZE = 0x10000 };
+
+	// Each chunk is scanned on its own thread as if a function started there, which gets the
+	// first few wrong if it really started in the middle of one. To stitch them together, the
+	// real scan picks up where the previous chunk's cut off function started and goes on until
+	// it starts a function where a later chunk did too. Everything that chunk found from there
+	// is right, so the result is exactly what a single scan would give.
+	static void ScanParallel(u32 startAddr, u32 endAddr, vector<Function> &out)
+	{
+		u32 numChunks = std::min((u32)cpu_info.num_cores, (endAddr - startAddr) / SCAN_MIN_CHUNK_SIZE);
+		u32 syncAddr;
+		if (numChunks <= 1)
+		{
+			ScanRange(startAddr, endAddr, out, 0, syncAddr);
+			return;
+		}
+
+		vector<ScanChunk> chunks(numChunks);
+		u32 chunkSize = ((endAddr - startAddr) / numChunks) & ~3;
+		for (u32 i = 0; i < numChunks; i++)
+		{
+			chunks[i].start = startAddr + i * chunkSize;
+			chunks[i].end = i == numChunks - 1 ? endAddr : chunks[i].start + chunkSize - 4;
+		}
+
+		// No symbols get added until the scan is done, the threads only read them.
+		symbolMap.UpdateIndex();
+		vector<std::thread *> workers;
+		for (u32 i = 1; i < numChunks; i++)
+			workers.push_back(new std::thread(ScanChunkThread, &chunks[i]));
+		ScanOneChunk(&chunks[0]);
+		for (size_t i = 0; i < workers.size(); i++)
+		{
+			workers[i]->join();
+			delete workers[i];
+		}
+
+		u32 c = 0;
+		size_t first = 0;
+		while (true)
+		{
+			const vector<Function> &found = chunks[c].functions;
+			if (c == numChunks - 1)
+			{
+				out.insert(out.end(), found.begin() + first, found.end());
+				break;
+			}
+			out.insert(out.end(), found.begin() + first, found.end() - 1);
+
+			vector<u32> syncStarts;
+			for (u32 i = c + 1; i < numChunks; i++)
+			{
+				for (size_t j = 0; j < chunks[i].functions.size(); j++)
+					syncStarts.push_back(chunks[i].functions[j].start);
+			}
+			sort(syncStarts.begin(), syncStarts.end());
+
+			if (!ScanRange(found.back().start, endAddr, out, &syncStarts, syncAddr))
+				break;
+
+			// Find the first later chunk that started a function there.
+			bool synced = false;
+			for (c = c + 1; c < numChunks && !synced; c++)
+			{
+				const vector<Function> &later = chunks[c].functions;
+				for (first = 0; first < later.size(); first++)
+				{
+					if (later[first].start == syncAddr)
+					{
+						synced = true;
+						break;
+					}
+				}
+			}
+			c--;
+		}
+	}
+
+	struct FunctionCacheHeader
+	{
+		char magic[4];
+		u32 version;
+		u32 textSize;
+		u32 count;
+	};
+
+	// Relative to the start of the text, so the same code loaded elsewhere still matches.
+	struct FunctionCacheEntry
+	{
+		u32 start;
+		u32 end;
+		u32 hash;
+		u32 isStraightLeaf;
+	};
+
+	static const u32 FUNCTION_CACHE_VERSION = 1;
+
+	static std::string FunctionCacheFilename(u32 startAddr, u32 endAddr)
+	{
+		if (g_Config.functionCacheDirectory.empty() || !Memory::IsValidAddress(startAddr) || !Memory::IsValidAddress(endAddr - 1))
+			return "";
+
+		u64 hash = GetMurmurHash3(Memory::GetPointer(startAddr), endAddr - startAddr, 0);
+		char temp[64];
+		sprintf(temp, "/%016llx.funcs", (unsigned long long)hash);
+		return g_Config.functionCacheDirectory + temp;
+	}
+
+	static bool LoadFunctionCache(const std::string &filename, u32 startAddr, u32 endAddr, vector<Function> &out)
+	{
+		File::IOFile file(filename, "rb");
+		FunctionCacheHeader header;
+		if (!file.IsOpen() || !file.ReadArray(&header, 1))
+			return false;
+		if (memcmp(header.magic, "PFNC", 4) != 0 || header.version != FUNCTION_CACHE_VERSION || header.textSize != endAddr - startAddr)
+			return false;
+		if (header.count > header.textSize / 4 + 1)
+			return false;
+
+		vector<FunctionCacheEntry> entries(header.count);
+		if (header.count == 0 || !file.ReadArray(&entries[0], entries.size()))
+			return false;
+
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			Function f = {startAddr + entries[i].start};
+			f.end = startAddr + entries[i].end;
+			f.hash = entries[i].hash;
+			f.hasHash = true;
+			f.isStraightLeaf = entries[i].isStraightLeaf != 0;
+			out.push_back(f);
+		}
+		return true;
+	}
+
+	static void SaveFunctionCache(const std::string &filename, u32 startAddr, u32 endAddr, const vector<Function> &found)
+	{
+		File::CreateFullPath(g_Config.functionCacheDirectory + "/");
+		File::IOFile file(filename, "wb");
+		if (!file.IsOpen())
+		{
+			WARN_LOG(CPU, "Could not write function cache %s", filename.c_str());
+			return;
+		}
+
+		FunctionCacheHeader header;
+		memcpy(header.magic, "PFNC", 4);
+		header.version = FUNCTION_CACHE_VERSION;
+		header.textSize = endAddr - startAddr;
+		header.count = (u32)found.size();
+
+		vector<FunctionCacheEntry> entries(found.size());
+		for (size_t i = 0; i < found.size(); i++)
+		{
+			entries[i].start = found[i].start - startAddr;
+			entries[i].end = found[i].end - startAddr;
+			entries[i].hash = found[i].hash;
+			entries[i].isStraightLeaf = found[i].isStraightLeaf ? 1 : 0;
+		}
+		file.WriteArray(&header, 1);
+		file.WriteArray(&entries[0], entries.size());
+	}
+
+	void ScanForFunctions(u32 startAddr, u32 endAddr /*, std::vector<u32> knownEntries*/)
+	{
+		u32 startMs = Common::Timer::GetTimeMs();
+
+		// The scan skips over known functions, so the result only depends on the code when there
+		// are none. That's the case at module load, where the symbols were just reset.
+		std::string cacheFilename;
+		if (symbolMap.GetNumSymbols() == 0 && endAddr > startAddr)
+			cacheFilename = FunctionCacheFilename(startAddr, endAddr);
+
+		vector<Function> found;
+		bool cached = !cacheFilename.empty() && LoadFunctionCache(cacheFilename, startAddr, endAddr, found);
+		if (!cached)
+		{
+			found.clear();
+			ScanParallel(startAddr, endAddr, found);
+			HashFunctions(found);
+			if (!cacheFilename.empty())
+				SaveFunctionCache(cacheFilename, startAddr, endAddr, found);
+		}
+
+		for (vector<Function>::iterator iter = found.begin(); iter!=found.end(); iter++)
 		{
 			(*iter).size = ((*iter).end-(*iter).start+4);
 			char temp[256];
 			sprintf(temp,"z_un_%08x",(*iter).start);
-			symbolMap.AddSymbol(std::string(temp).c_str(), (*iter).start,(*iter).end-(*iter).start+4,ST_FUNCTION);
+			symbolMap.AddSymbol(temp, (*iter).start,(*iter).end-(*iter).start+4,ST_FUNCTION);
 		}
-		HashFunctions();
+		functions.insert(functions.end(), found.begin(), found.end());
+
+		INFO_LOG(CPU, "%s %i functions in %08x-%08x in %i ms", cached ? "Loaded" : "Found", (int)found.size(), startAddr, endAddr, (int)(Common::Timer::GetTimeMs() - startMs));
 	}
 
 	struct HashMapFunc
@@ -375,7 +740,7 @@ namespace MIPSAnalyst
 
 	void LoadHashMap(const char *filename)
 	{
-		HashFunctions();
+		HashFunctions(functions);
 		UpdateHashToFunctionMap();
 
 		FILE *file = fopen(filename, "rb");
@@ -58,5 +58,17 @@ namespace MIPSAnalyst
 	bool ReadsFromReg(u32 op, u32 reg);
 	bool IsDelaySlotNice(u32 branch, u32 delayslot);
 
+	enum { IDLE_LOOP_MAX_INSTRUCTIONS = 8 };
+
+	// Whether the code from loopStart to the branch at branchAddr (and its delay slot) is a loop
+	// that just polls memory or a known HLE function without changing anything, so that nothing
+	// but a scheduled event can make it exit. Running it again is pointless until then.
+	bool IsIdleLoop(u32 loopStart, u32 branchAddr);
+	// Same, remembering the answer per branch, for the interpreter which asks on every taken
+	// backward branch. Writes that invalidate code also have to invalidate this.
+	bool IsIdleLoopCached(u32 loopStart, u32 branchAddr);
+	void InvalidateIdleLoopCache(u32 address, u32 size);
+	void ClearIdleLoopCache();
+
 
 }	// namespace MIPSAnalyst
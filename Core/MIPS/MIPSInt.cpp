@@ -640,6 +640,9 @@ namespace MIPSInt
 
 		switch (op & 0x3ff)
 		{
+		case 0xA0: //wsbh
+			R(rd) = ((R(rt) & 0xFF00FF00) >> 8) | ((R(rt) & 0x00FF00FF) << 8);
+			break;
 		case 0xE0: //wsbw
 			R(rd) = _byteswap_ulong(R(rt));
 			break;
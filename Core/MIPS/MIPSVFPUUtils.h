@@ -57,6 +57,10 @@ void WriteMatrix(const float *rs, MatrixSize size, int reg);
 void WriteVector(const float *rs, VectorSize N, int reg);
 void ReadVector(float *rd, VectorSize N, int reg);
 
+// Indices into MIPSState::v of the elements ReadVector/ReadMatrix would read, in the same order.
+void GetVectorRegs(u8 regs[4], VectorSize N, int vectorReg);
+void GetMatrixRegs(u8 regs[16], MatrixSize N, int matrixReg);
+
 VectorSize GetVecSize(u32 op);
 MatrixSize GetMtxSize(u32 op);
 VectorSize GetHalfVectorSize(VectorSize sz);
@@ -148,24 +148,57 @@ namespace MIPSComp
 
 		switch (op & 63)
 		{
-		//case 10: if (!R(rt)) R(rd) = R(rs); break; //movz
-		//case 11: if (R(rt)) R(rd) = R(rs); break; //movn
+		case 10: //if (!R(rt)) R(rd) = R(rs); break; //movz
+		case 11: //if (R(rt)) R(rd) = R(rs); break; //movn
+			{
+				bool movz = (op & 63) == 10;
+				if (gpr.R(rt).IsImm())
+				{
+					// The condition is known, this is either a plain move or nothing.
+					if ((gpr.R(rt).GetImmValue() == 0) != movz || rd == rs)
+						break;
+					if (gpr.R(rs).IsImm())
+					{
+						gpr.SetImmediate32(rd, gpr.R(rs).GetImmValue());
+						break;
+					}
+					gpr.Lock(rd, rs);
+					gpr.BindToRegister(rd, false, true);
+					MOV(32, gpr.R(rd), gpr.R(rs));
+					gpr.UnlockAll();
+					break;
+				}
+
+				gpr.Lock(rd, rs, rt);
+				gpr.BindToRegister(rd, true, true);
+				// CMOV can't take an immediate.
+				OpArg src = gpr.R(rs);
+				if (src.IsImm())
+				{
+					MOV(32, R(EAX), src);
+					src = R(EAX);
+				}
+				CMP(32, gpr.R(rt), Imm32(0));
+				CMOVcc(32, gpr.RX(rd), src, movz ? CC_Z : CC_NZ);
+				gpr.UnlockAll();
+			}
+			break;
 
 		// case 32: //R(rd) = R(rs) + R(rt);		break; //add
 		case 33: //R(rd) = R(rs) + R(rt);		break; //addu
 			CompTriArith(op, &XEmitter::ADD);
 			break;
-		case 134: //R(rd) = R(rs) - R(rt);		break; //sub
-		case 135:
+		case 34: //R(rd) = R(rs) - R(rt);		break; //sub
+		case 35:
 			CompTriArith(op, &XEmitter::SUB);
 			break;
-		case 136: //R(rd) = R(rs) & R(rt);		break; //and
+		case 36: //R(rd) = R(rs) & R(rt);		break; //and
 			CompTriArith(op, &XEmitter::AND);
 			break;
-		case 137: //R(rd) = R(rs) | R(rt);		break; //or
+		case 37: //R(rd) = R(rs) | R(rt);		break; //or
 			CompTriArith(op, &XEmitter::OR);
 			break;
-		case 138: //R(rd) = R(rs) ^ R(rt);		break; //xor
+		case 38: //R(rd) = R(rs) ^ R(rt);		break; //xor
 			CompTriArith(op, &XEmitter::XOR);
 			break;
 
@@ -175,30 +208,30 @@ namespace MIPSComp
 			break;
 
 		case 42: //R(rd) = (int)R(rs) < (int)R(rt); break; //slt
-			gpr.Lock(rt, rs);
-			gpr.BindToRegister(rs, true, true);
+		case 43: //R(rd) = R(rs) < R(rt);		break; //sltu
+			gpr.Lock(rd, rs, rt);
+			gpr.BindToRegister(rs, true, false);
 			XOR(32, R(EAX), R(EAX));
 			CMP(32, gpr.R(rs), gpr.R(rt));
-			SETcc(CC_L, R(EAX));
+			SETcc((op & 63) == 42 ? CC_L : CC_B, R(EAX));
+			gpr.BindToRegister(rd, rd == rs || rd == rt, true);
 			MOV(32, gpr.R(rd), R(EAX));
 			gpr.UnlockAll();
 			break;
 
-		case 43: //R(rd) = R(rs) < R(rt);		break; //sltu
+		case 44: //R(rd) = (R(rs) > R(rt)) ? R(rs) : R(rt); break; //max
+		case 45: //R(rd) = (R(rs) < R(rt)) ? R(rs) : R(rt); break; //min
 			gpr.Lock(rd, rs, rt);
-			gpr.BindToRegister(rs, true, true);
-			XOR(32, R(EAX), R(EAX));
-			CMP(32, gpr.R(rs), gpr.R(rt));
-			SETcc(CC_B, R(EAX));
+			// CMOV can't take an immediate.
+			gpr.KillImmediate(rt, true, false);
+			MOV(32, R(EAX), gpr.R(rs));
+			CMP(32, R(EAX), gpr.R(rt));
+			CMOVcc(32, EAX, gpr.R(rt), (op & 63) == 44 ? CC_L : CC_G);
+			gpr.BindToRegister(rd, rd == rs || rd == rt, true);
 			MOV(32, gpr.R(rd), R(EAX));
 			gpr.UnlockAll();
 			break;
 
-		// case 44: R(rd) = (R(rs) > R(rt)) ? R(rs) : R(rt); break; //max
-		// CMP(a,b); CMOVLT(a,b)
-
-		// case 45: R(rd) = (R(rs) < R(rt)) ? R(rs) : R(rt); break; //min
-		// CMP(a,b); CMOVGT(a,b)
 		default:
 			Comp_Generic(op);
 			break;
@@ -244,11 +277,25 @@ namespace MIPSComp
 		switch (op & 0x3f)
 		{
 		case 0: CompShiftImm(op, &XEmitter::SHL); break;
-		case 2: CompShiftImm(op, &XEmitter::SHR); break;	// srl
+		case 2:
+			if (_RS == 0)
+				CompShiftImm(op, &XEmitter::SHR);	// srl
+			else if (_RS == 1)
+				CompShiftImm(op, &XEmitter::ROR);	// rotr
+			else
+				Comp_Generic(op);
+			break;
 		case 3: CompShiftImm(op, &XEmitter::SAR); break;	// sra
 
 		case 4: CompShiftVar(op, &XEmitter::SHL); break;	// R(rd) = R(rt) << R(rs);				break; //sllv
-		case 6: CompShiftVar(op, &XEmitter::SHR); break;	// R(rd) = R(rt) >> R(rs);				break; //srlv
+		case 6:
+			if (_SA == 0)
+				CompShiftVar(op, &XEmitter::SHR);	// R(rd) = R(rt) >> R(rs);				break; //srlv
+			else if (_SA == 1)
+				CompShiftVar(op, &XEmitter::ROR);	// rotrv
+			else
+				Comp_Generic(op);
+			break;
 		case 7: CompShiftVar(op, &XEmitter::SAR); break;	// R(rd) = ((s32)R(rt)) >> R(rs); break; //srav
 
 		default:
@@ -283,10 +330,271 @@ namespace MIPSComp
 			break;
 
 		case 20: //bitrev
+			gpr.FlushLockX(EDX);
+			gpr.Lock(rd, rt);
+			MOV(32, R(EAX), gpr.R(rt));
+			// Swap adjacent bits, then pairs, then nibbles. BSWAP takes care of the bytes.
+			{
+				static const u32 masks[3] = {0x55555555, 0x33333333, 0x0F0F0F0F};
+				for (int i = 0; i < 3; i++)
+				{
+					MOV(32, R(EDX), R(EAX));
+					SHR(32, R(EDX), Imm8(1 << i));
+					AND(32, R(EDX), Imm32(masks[i]));
+					AND(32, R(EAX), Imm32(masks[i]));
+					SHL(32, R(EAX), Imm8(1 << i));
+					OR(32, R(EAX), R(EDX));
+				}
+			}
+			BSWAP(32, EAX);
+			gpr.BindToRegister(rd, rd == rt, true);
+			MOV(32, gpr.R(rd), R(EAX));
+			gpr.UnlockAll();
+			gpr.UnlockAllX();
+			break;
+
 		default:
 			Comp_Generic(op);
 			return;
 		}
 	}
 
+	void Jit::Comp_Allegrex2(u32 op)
+	{
+		int rt = _RT;
+		int rd = _RD;
+		switch (op & 0x3ff)
+		{
+		case 0xA0: //wsbh
+		case 0xE0: //wsbw
+			gpr.Lock(rd, rt);
+			gpr.BindToRegister(rd, rd == rt, true);
+			if (rd != rt)
+				MOV(32, gpr.R(rd), gpr.R(rt));
+			BSWAP(32, gpr.RX(rd));
+			// Swapping the halves back leaves the bytes swapped within each half.
+			if ((op & 0x3ff) == 0xA0)
+				ROL(32, gpr.R(rd), Imm8(16));
+			gpr.UnlockAll();
+			break;
+
+		default:
+			Comp_Generic(op);
+			return;
+		}
+	}
+
+	void Jit::Comp_RType2(u32 op)
+	{
+		int rs = _RS;
+		int rd = _RD;
+		switch (op & 63)
+		{
+		case 22: //clz
+		case 23: //clo
+			{
+				gpr.Lock(rd, rs);
+				MOV(32, R(EAX), gpr.R(rs));
+				if ((op & 63) == 23)
+					NOT(32, R(EAX));
+				// BSR gives the index of the top set bit, and sets Z if there is none.
+				BSR(32, EAX, R(EAX));
+				FixupBranch notFound = J_CC(CC_Z);
+				XOR(32, R(EAX), Imm32(31));
+				FixupBranch done = J();
+				SetJumpTarget(notFound);
+				MOV(32, R(EAX), Imm32(32));
+				SetJumpTarget(done);
+				gpr.BindToRegister(rd, rd == rs, true);
+				MOV(32, gpr.R(rd), R(EAX));
+				gpr.UnlockAll();
+			}
+			break;
+
+		default:
+			Comp_Generic(op);
+			return;
+		}
+	}
+
+	void Jit::Comp_Special3(u32 op)
+	{
+		int rs = _RS;
+		int rt = _RT;
+		int pos = _POS;
+
+		switch (op & 0x3f)
+		{
+		case 0x0: //ext
+			{
+				int size = _SIZE + 1;
+				u32 mask = size >= 32 ? 0xFFFFFFFF : (1U << size) - 1;
+				if (gpr.R(rs).IsImm())
+				{
+					gpr.SetImmediate32(rt, (gpr.R(rs).GetImmValue() >> pos) & mask);
+					break;
+				}
+
+				gpr.Lock(rs, rt);
+				gpr.BindToRegister(rt, rs == rt, true);
+				if (rs != rt)
+					MOV(32, gpr.R(rt), gpr.R(rs));
+				if (pos != 0)
+					SHR(32, gpr.R(rt), Imm8(pos));
+				if (mask != 0xFFFFFFFF)
+					AND(32, gpr.R(rt), Imm32(mask));
+				gpr.UnlockAll();
+			}
+			break;
+
+		case 0x4: //ins
+			{
+				int size = (_SIZE + 1) - pos;
+				if (size <= 0)
+				{
+					Comp_Generic(op);
+					return;
+				}
+				u32 sourcemask = size >= 32 ? 0xFFFFFFFF : (1U << size) - 1;
+				u32 destmask = sourcemask << pos;
+				if (gpr.R(rs).IsImm() && gpr.R(rt).IsImm())
+				{
+					u32 result = (gpr.R(rt).GetImmValue() & ~destmask) | ((gpr.R(rs).GetImmValue() & sourcemask) << pos);
+					gpr.SetImmediate32(rt, result);
+					break;
+				}
+
+				gpr.Lock(rs, rt);
+				MOV(32, R(EAX), gpr.R(rs));
+				AND(32, R(EAX), Imm32(sourcemask));
+				if (pos != 0)
+					SHL(32, R(EAX), Imm8(pos));
+				gpr.BindToRegister(rt, true, true);
+				AND(32, gpr.R(rt), Imm32(~destmask));
+				OR(32, gpr.R(rt), R(EAX));
+				gpr.UnlockAll();
+			}
+			break;
+
+		default:
+			Comp_Generic(op);
+			return;
+		}
+	}
+
+	void Jit::Comp_MulDivType(u32 op)
+	{
+		int rt = _RT;
+		int rs = _RS;
+		int rd = _RD;
+
+		switch (op & 63)
+		{
+		case 16: // R(rd) = HI; //mfhi
+		case 18: // R(rd) = LO; //mflo
+			gpr.Lock(rd);
+			gpr.BindToRegister(rd, false, true);
+			MOV(32, gpr.R(rd), M((op & 63) == 16 ? &mips_->hi : &mips_->lo));
+			gpr.UnlockAll();
+			break;
+
+		case 17: // HI = R(rs); //mthi
+		case 19: // LO = R(rs); //mtlo
+			MOV(32, R(EAX), gpr.R(rs));
+			MOV(32, M((op & 63) == 17 ? &mips_->hi : &mips_->lo), R(EAX));
+			break;
+
+		case 24: //mult
+		case 25: //multu
+		case 28: //madd
+		case 29: //maddu
+			{
+				bool isSigned = (op & 63) == 24 || (op & 63) == 28;
+				bool accumulate = (op & 63) == 28 || (op & 63) == 29;
+				// The one operand forms give the full 64-bit result in EDX:EAX.
+				gpr.FlushLockX(EDX);
+				gpr.Lock(rs, rt);
+				gpr.KillImmediate(rt, true, false);
+				MOV(32, R(EAX), gpr.R(rs));
+				if (isSigned)
+					IMUL(32, gpr.R(rt));
+				else
+					MUL(32, gpr.R(rt));
+				if (accumulate)
+				{
+					ADD(32, M(&mips_->lo), R(EAX));
+					ADC(32, M(&mips_->hi), R(EDX));
+				}
+				else
+				{
+					MOV(32, M(&mips_->lo), R(EAX));
+					MOV(32, M(&mips_->hi), R(EDX));
+				}
+				gpr.UnlockAll();
+				gpr.UnlockAllX();
+			}
+			break;
+
+		case 26: //div
+		case 27: //divu
+			{
+				bool isSigned = (op & 63) == 26;
+				gpr.FlushLockX(EDX);
+				gpr.Lock(rs, rt);
+				gpr.KillImmediate(rt, true, false);
+				MOV(32, R(EAX), gpr.R(rs));
+
+				// Division by zero leaves zero in both, like the interpreter.
+				CMP(32, gpr.R(rt), Imm32(0));
+				FixupBranch notZero = J_CC(CC_NZ);
+				MOV(32, M(&mips_->lo), Imm32(0));
+				MOV(32, M(&mips_->hi), Imm32(0));
+				FixupBranch doneZero = J();
+				SetJumpTarget(notZero);
+
+				FixupBranch doneOverflow;
+				if (isSigned)
+				{
+					// 0x80000000 / -1 would fault on x86. The result is 0x80000000, remainder 0.
+					FixupBranch notOverflow1, notOverflow2;
+					CMP(32, gpr.R(rt), Imm32(0xFFFFFFFF));
+					notOverflow1 = J_CC(CC_NZ);
+					CMP(32, R(EAX), Imm32(0x80000000));
+					notOverflow2 = J_CC(CC_NZ);
+					MOV(32, M(&mips_->lo), R(EAX));
+					MOV(32, M(&mips_->hi), Imm32(0));
+					doneOverflow = J();
+					SetJumpTarget(notOverflow1);
+					SetJumpTarget(notOverflow2);
+
+					CDQ();
+					IDIV(32, gpr.R(rt));
+				}
+				else
+				{
+					XOR(32, R(EDX), R(EDX));
+					DIV(32, gpr.R(rt));
+				}
+				MOV(32, M(&mips_->lo), R(EAX));
+				MOV(32, M(&mips_->hi), R(EDX));
+
+				SetJumpTarget(doneZero);
+				if (isSigned)
+					SetJumpTarget(doneOverflow);
+				gpr.UnlockAll();
+				gpr.UnlockAllX();
+			}
+			break;
+
+		default:
+			Comp_Generic(op);
+			return;
+		}
+	}
+
+	void Jit::Comp_DoNothing(u32 op)
+	{
+		// cache and sync don't do anything we emulate.
+	}
+
 }
@@ -170,6 +170,7 @@ void Jit::Comp_FPU2op(u32 op)
 		return;
 
 	case 13: //FsI(fd) = F(fs)>=0 ? (int)floorf(F(fs)) : (int)ceilf(F(fs)); break;//trunc.w.s
+	case 36: //FsI(fd) = (int)	F(fs);			 break; //cvt.w.s
 		fpr.Lock(fs, fd);
 		fpr.StoreFromRegister(fd);
 		CVTTSS2SI(EAX, fpr.R(fs));
@@ -177,16 +178,57 @@ void Jit::Comp_FPU2op(u32 op)
 		fpr.UnlockAll();
 		break;
 
+	case 32: //F(fd)	= (float)FsI(fs);			break; //cvt.s.w
+		fpr.Lock(fs, fd);
+		MOVSS(XMM0, fpr.R(fs));
+		CVTDQ2PS(XMM0, R(XMM0));
+		fpr.BindToRegister(fd, fd == fs, true);
+		MOVSS(fpr.RX(fd), R(XMM0));
+		fpr.UnlockAll();
+		break;
+
 	case 14: //FsI(fd) = (int)ceilf (F(fs)); break; //ceil.w.s
 	case 15: //FsI(fd) = (int)floorf(F(fs)); break; //floor.w.s
-	case 32: //F(fd)	= (float)FsI(fs);			break; //cvt.s.w
-	case 36: //FsI(fd) = (int)	F(fs);			 break; //cvt.w.s
 	default:
 		Comp_Generic(op);
 		return;
 	}
 }
 
+void Jit::Comp_FPUComp(u32 op)
+{
+	int fs = _FS;
+	int ft = _FT;
+
+	// CMPSS predicates are ordered, so NaNs compare false like in the interpreter.
+	u8 compare;
+	switch (op & 0xf)
+	{
+	case 2: //eq
+		compare = 0;
+		break;
+	case 12: //lt
+	case 13: //nge
+		compare = 1;
+		break;
+	case 14: //le
+	case 15: //ngt
+		compare = 2;
+		break;
+	default:
+		Comp_Generic(op);
+		return;
+	}
+
+	fpr.Lock(fs, ft);
+	MOVSS(XMM0, fpr.R(fs));
+	CMPSS(XMM0, fpr.R(ft), compare);
+	MOVD_xmm(R(EAX), XMM0);
+	AND(32, R(EAX), Imm32(1));
+	MOV(32, M((void *)&mips_->fpcond), R(EAX));
+	fpr.UnlockAll();
+}
+
 void Jit::Comp_mxc1(u32 op)
 {
 	int fs = _FS;
@@ -35,98 +35,164 @@
 
 namespace MIPSComp
 {
-	void Jit::Comp_ITypeMem(u32 op)
+	OpArg Jit::GuestMemoryOp(int offset)
+	{
+#ifdef _M_IX86
+		AND(32, R(EAX), Imm32(Memory::MEMVIEW32_MASK));
+		return MDisp(EAX, (u32)Memory::base + offset);
+#else
+		return MComplex(RBX, EAX, SCALE_1, offset);
+#endif
+	}
+
+	void Jit::CompITypeMemRead(u32 op, int bits, bool signExtend)
 	{
-		// OLDD
 		int offset = (signed short)(op&0xFFFF);
 		int rt = _RT;
 		int rs = _RS;
-		int o = op>>26;
-		switch (o)
-		{
-		case 37: //R(rt) = ReadMem16(addr); break; //lhu
-		case 36: //R(rt) = ReadMem8 (addr); break; //lbu
-			Comp_Generic(op);
-			return;
 
-		case 35: //R(rt) = ReadMem32(addr); break; //lw
+		gpr.Lock(rt, rs);
+		gpr.BindToRegister(rt, rt == rs, true);
+		MOV(32, R(EAX), gpr.R(rs));
+		OpArg src = GuestMemoryOp(offset);
+		if (bits == 32)
+			MOV(32, gpr.R(rt), src);
+		else if (signExtend)
+			MOVSX(32, bits, gpr.RX(rt), src);
+		else
+			MOVZX(32, bits, gpr.RX(rt), src);
+		gpr.UnlockAll();
+	}
+
+	void Jit::CompITypeMemWrite(u32 op, int bits)
+	{
+		int offset = (signed short)(op&0xFFFF);
+		int rt = _RT;
+		int rs = _RS;
+
+		if (bits == 32)
+		{
 			gpr.Lock(rt, rs);
-			gpr.BindToRegister(rt, rt == rs, true);
-#ifdef _M_IX86
-			MOV(32, R(EAX), gpr.R(rs));
-			AND(32, R(EAX), Imm32(Memory::MEMVIEW32_MASK));
-			MOV(32, gpr.R(rt), MDisp(EAX, (u32)Memory::base + offset));
-#else
+			gpr.BindToRegister(rt, true, false);
 			MOV(32, R(EAX), gpr.R(rs));
-			MOV(32, gpr.R(rt), MComplex(RBX, EAX, SCALE_1, offset));
-#endif
+			MOV(32, GuestMemoryOp(offset), gpr.R(rt));
 			gpr.UnlockAll();
-			break;
-
-		case 132: //R(rt) = (u32)(s32)(s8) ReadMem8 (addr); break; //lb
-		case 133: //R(rt) = (u32)(s32)(s16)ReadMem16(addr); break; //lh
-		case 136: //R(rt) = ReadMem8 (addr); break; //lbu
-		case 140: //WriteMem8 (addr, R(rt)); break; //sb
-			
-		case 40:
-		case 41: //WriteMem16(addr, R(rt)); break; //sh
-			Comp_Generic(op);
 			return;
+		}
 
-		case 43: //WriteMem32(addr, R(rt)); break; //sw
-			{
-				gpr.Lock(rt, rs);
-				gpr.BindToRegister(rt, true, false);
-#ifdef _M_IX86
-				MOV(32, R(EAX), gpr.R(rs));
-				AND(32, R(EAX), Imm32(Memory::MEMVIEW32_MASK));
-				MOV(32, MDisp(EAX, (u32)Memory::base + offset), gpr.R(rt));
-#else
-				MOV(32, R(EAX), gpr.R(rs));
-				MOV(32, MComplex(RBX, EAX, SCALE_1, offset), gpr.R(rt));
-#endif
-				gpr.UnlockAll();
-			}
-			break;
+		// Not every register has a low byte on x86-32, so go through EDX for the small stores.
+		gpr.FlushLockX(EDX);
+		gpr.Lock(rt, rs);
+		MOV(32, R(EDX), gpr.R(rt));
+		MOV(32, R(EAX), gpr.R(rs));
+		MOV(bits, GuestMemoryOp(offset), R(EDX));
+		gpr.UnlockAll();
+		gpr.UnlockAllX();
+	}
+
+	void Jit::CompITypeMemUnaligned(u32 op)
+	{
+		int offset = (signed short)(op&0xFFFF);
+		int rt = _RT;
+		int rs = _RS;
+		int o = op>>26;
+
+		gpr.FlushLockX(ECX, EDX);
+		gpr.Lock(rt, rs);
 
-		case 134: //lwl
-			{
-				Crash();
-				//u32 shift = (addr & 3) << 3;
-				//u32 mem = ReadMem32(addr & 0xfffffffc);
-				//R(rt) = ( u32(R(rt)) & (0x00ffffff >> shift) ) | ( mem << (24 - shift) );
-			}
+		// ECX = shift = (addr & 3) * 8, EAX = addr & ~3.
+		MOV(32, R(EAX), gpr.R(rs));
+		if (offset != 0)
+			ADD(32, R(EAX), Imm32((u32)offset));
+		MOV(32, R(ECX), R(EAX));
+		AND(32, R(ECX), Imm32(3));
+		SHL(32, R(ECX), Imm8(3));
+		AND(32, R(EAX), Imm32(0xFFFFFFFC));
+		OpArg mem = GuestMemoryOp(0);
+
+		switch (o)
+		{
+		case 34: //lwl
+			// R(rt) = (R(rt) & (0x00ffffff >> shift)) | (mem << (24 - shift));
+			MOV(32, R(EAX), mem);
+			gpr.BindToRegister(rt, true, true);
+			MOV(32, R(EDX), Imm32(0x00ffffff));
+			SHR(32, R(EDX), R(ECX));
+			AND(32, gpr.R(rt), R(EDX));
+			NEG(32, R(ECX));
+			ADD(32, R(ECX), Imm32(24));
+			SHL(32, R(EAX), R(ECX));
+			OR(32, gpr.R(rt), R(EAX));
 			break;
 
-		case 138: //lwr
-			{
-				Crash();
-				//u32 shift = (addr & 3) << 3;
-				//u32 mem = ReadMem32(addr & 0xfffffffc);
+		case 38: //lwr
+			// R(rt) = (R(rt) & (0xffffff00 << (24 - shift))) | (mem >> shift);
+			MOV(32, R(EAX), mem);
+			gpr.BindToRegister(rt, true, true);
+			SHR(32, R(EAX), R(ECX));
+			NEG(32, R(ECX));
+			ADD(32, R(ECX), Imm32(24));
+			MOV(32, R(EDX), Imm32(0xffffff00));
+			SHL(32, R(EDX), R(ECX));
+			AND(32, gpr.R(rt), R(EDX));
+			OR(32, gpr.R(rt), R(EAX));
+			break;
 
-				//R(rt) = ( u32(rt) & (0xffffff00 << (24 - shift)) ) | ( mem	>> shift );
-			}
+		// The stores merge into memory in place: first mask off the bytes being replaced,
+		// then OR in the shifted register.
+		case 42: //swl
+			// mem = (R(rt) >> (24 - shift)) | (mem & (0xffffff00 << shift));
+			MOV(32, R(EDX), Imm32(0xffffff00));
+			SHL(32, R(EDX), R(ECX));
+			AND(32, mem, R(EDX));
+			NEG(32, R(ECX));
+			ADD(32, R(ECX), Imm32(24));
+			MOV(32, R(EDX), gpr.R(rt));
+			SHR(32, R(EDX), R(ECX));
+			OR(32, mem, R(EDX));
 			break;
 
-		case 142: //swl
-			{
-				Crash();
-				//u32 shift = (addr & 3) << 3;
-				//u32 mem = ReadMem32(addr & 0xfffffffc);
-				//WriteMem32((addr & 0xfffffffc),	( ( u32(R(rt)) >>	(24 - shift) ) ) |
-				//	(	mem & (0xffffff00 << shift) ));
-			}
+		case 46: //swr
+			// mem = (R(rt) << shift) | (mem & (0x00ffffff >> (24 - shift)));
+			NEG(32, R(ECX));
+			ADD(32, R(ECX), Imm32(24));
+			MOV(32, R(EDX), Imm32(0x00ffffff));
+			SHR(32, R(EDX), R(ECX));
+			AND(32, mem, R(EDX));
+			NEG(32, R(ECX));
+			ADD(32, R(ECX), Imm32(24));
+			MOV(32, R(EDX), gpr.R(rt));
+			SHL(32, R(EDX), R(ECX));
+			OR(32, mem, R(EDX));
 			break;
-		case 146: //swr
-			{
-				Crash();
-				//	u32 shift = (addr & 3) << 3;
-			//	u32 mem = ReadMem32(addr & 0xfffffffc);
-//
-//				WriteMem32((addr & 0xfffffffc), ( ( u32(R(rt)) << shift ) |
-//					(mem	& (0x00ffffff >> (24 - shift)) ) ) );
-			}
+		}
+
+		gpr.UnlockAll();
+		gpr.UnlockAllX();
+	}
+
+	void Jit::Comp_ITypeMem(u32 op)
+	{
+		// OLDD
+		switch (op >> 26)
+		{
+		case 32: CompITypeMemRead(op, 8, true); break; //lb
+		case 33: CompITypeMemRead(op, 16, true); break; //lh
+		case 35: CompITypeMemRead(op, 32, false); break; //lw
+		case 36: CompITypeMemRead(op, 8, false); break; //lbu
+		case 37: CompITypeMemRead(op, 16, false); break; //lhu
+
+		case 40: CompITypeMemWrite(op, 8); break; //sb
+		case 41: CompITypeMemWrite(op, 16); break; //sh
+		case 43: CompITypeMemWrite(op, 32); break; //sw
+
+		case 34: //lwl
+		case 38: //lwr
+		case 42: //swl
+		case 46: //swr
+			CompITypeMemUnaligned(op);
 			break;
+
 		default:
 			Comp_Generic(op);
 			return ;
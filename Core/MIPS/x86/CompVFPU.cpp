@@ -17,6 +17,8 @@
 
 #include "../../MemMap.h"
 #include "../MIPSAnalyst.h"
+#include "../MIPSTables.h"
+#include "../MIPSVFPUUtils.h"
 
 #include "Jit.h"
 #include "RegCache.h"
@@ -35,4 +37,593 @@
 namespace MIPSComp
 {
 
+static const float GC_ALIGNED16(vfpuConstants[8]) = {0.f, 1.f, 2.f, 0.5f, 3.f, 1.f/3.f, 0.25f, 1.f/6.f};
+static const float GC_ALIGNED16(vfpuOne[4]) = {1.0f, 1.0f, 1.0f, 1.0f};
+static const float GC_ALIGNED16(vfpuZero[4]) = {0.0f, 0.0f, 0.0f, 0.0f};
+static const float GC_ALIGNED16(vfpuMinusOne[4]) = {-1.0f, -1.0f, -1.0f, -1.0f};
+static const u32 GC_ALIGNED16(vfpuSignBits[4]) = {0x80000000, 0x80000000, 0x80000000, 0x80000000};
+static const u32 GC_ALIGNED16(vfpuNoSignMask[4]) = {0x7FFFFFFF, 0x7FFFFFFF, 0x7FFFFFFF, 0x7FFFFFFF};
+
+// The VFPU registers live in fpr after the 32 FPU registers.
+static inline int VFPR(int vreg)
+{
+	return 32 + vreg;
+}
+
+static void GetVectorFPRs(u8 regs[4], VectorSize sz, int vectorReg)
+{
+	GetVectorRegs(regs, sz, vectorReg);
+	for (int i = 0; i < GetNumVectorElements(sz); i++)
+		regs[i] = VFPR(regs[i]);
+}
+
+static void GetMatrixFPRs(u8 regs[16], MatrixSize sz, int matrixReg)
+{
+	GetMatrixRegs(regs, sz, matrixReg);
+	int n = GetMatrixSide(sz);
+	for (int i = 0; i < n; i++)
+	{
+		for (int j = 0; j < n; j++)
+			regs[j * 4 + i] = VFPR(regs[j * 4 + i]);
+	}
+}
+
+// A swizzle past the end of the vector makes the interpreter read garbage, leave those to it.
+static bool IsPrefixWithinSize(u32 prefix, VectorSize sz)
+{
+	int n = GetNumVectorElements(sz);
+	for (int i = 0; i < n; i++)
+	{
+		int regnum = (prefix >> (i * 2)) & 3;
+		int constants = (prefix >> (12 + i)) & 1;
+		if (!constants && regnum >= n)
+			return false;
+	}
+	return true;
+}
+
+static bool MatricesOverlap(const u8 *a, const u8 *b, int n)
+{
+	for (int i = 0; i < n; i++)
+	{
+		for (int j = 0; j < n; j++)
+		{
+			for (int k = 0; k < n; k++)
+			{
+				for (int l = 0; l < n; l++)
+				{
+					if (a[i * 4 + j] == b[k * 4 + l])
+						return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+void Jit::FlushPrefixV()
+{
+	if ((js.prefixSFlag & JitState::PREFIX_DIRTY) != 0)
+	{
+		MOV(32, M((void *)&mips_->vfpuCtrl[VFPU_CTRL_SPREFIX]), Imm32(js.prefixS));
+		js.prefixSFlag = JitState::PREFIX_KNOWN;
+	}
+	if ((js.prefixTFlag & JitState::PREFIX_DIRTY) != 0)
+	{
+		MOV(32, M((void *)&mips_->vfpuCtrl[VFPU_CTRL_TPREFIX]), Imm32(js.prefixT));
+		js.prefixTFlag = JitState::PREFIX_KNOWN;
+	}
+	if ((js.prefixDFlag & JitState::PREFIX_DIRTY) != 0)
+	{
+		MOV(32, M((void *)&mips_->vfpuCtrl[VFPU_CTRL_DPREFIX]), Imm32(js.prefixD));
+		js.prefixDFlag = JitState::PREFIX_KNOWN;
+	}
+}
+
+// Native VFPU ops need the prefixes at compile time. When we don't know them (start of block,
+// after an interpreted VFPU op), compile the op assuming the defaults, which is by far the
+// common case, and check that at runtime, interpreting the op if it doesn't hold.
+// Returns true if the op has been compiled.
+bool Jit::CompPrefixGuard(u32 op)
+{
+	if (js.HasKnownPrefixes())
+		return false;
+
+	FlushAll();
+
+	FixupBranch notDefault[3];
+	int numChecks = 0;
+	if (js.prefixSFlag == JitState::PREFIX_UNKNOWN)
+	{
+		CMP(32, M((void *)&mips_->vfpuCtrl[VFPU_CTRL_SPREFIX]), Imm32(0xE4));
+		notDefault[numChecks++] = J_CC(CC_NE, true);
+		js.prefixS = 0xE4;
+		js.prefixSFlag = JitState::PREFIX_KNOWN;
+	}
+	if (js.prefixTFlag == JitState::PREFIX_UNKNOWN)
+	{
+		CMP(32, M((void *)&mips_->vfpuCtrl[VFPU_CTRL_TPREFIX]), Imm32(0xE4));
+		notDefault[numChecks++] = J_CC(CC_NE, true);
+		js.prefixT = 0xE4;
+		js.prefixTFlag = JitState::PREFIX_KNOWN;
+	}
+	if (js.prefixDFlag == JitState::PREFIX_UNKNOWN)
+	{
+		CMP(32, M((void *)&mips_->vfpuCtrl[VFPU_CTRL_DPREFIX]), Imm32(0));
+		notDefault[numChecks++] = J_CC(CC_NE, true);
+		js.prefixD = 0;
+		js.prefixDFlag = JitState::PREFIX_KNOWN;
+	}
+
+	MIPSCompileOp(op);
+	FlushAll();
+	FixupBranch done = J(true);
+
+	for (int i = 0; i < numChecks; i++)
+		SetJumpTarget(notDefault[i]);
+	MOV(32, M(&mips_->pc), Imm32(js.compilerPC));
+	ABI_CallFunctionC((void *)MIPSGetInterpretFunc(op), op);
+	SetJumpTarget(done);
+
+	// Either way, the op ate the prefixes.
+	js.prefixS = 0xE4;
+	js.prefixT = 0xE4;
+	js.prefixD = 0;
+	js.prefixSFlag = JitState::PREFIX_KNOWN;
+	js.prefixTFlag = JitState::PREFIX_KNOWN;
+	js.prefixDFlag = JitState::PREFIX_KNOWN;
+	return true;
+}
+
+// Loads one lane of an S or T operand into xr, swizzled, abs'd, negated or replaced by
+// a constant according to the prefix.
+void Jit::ApplyPrefixST(X64Reg xr, const u8 *vregs, u32 prefix, int lane)
+{
+	int regnum = (prefix >> (lane * 2)) & 3;
+	int abs    = (prefix >> (8 + lane)) & 1;
+	int negate = (prefix >> (16 + lane)) & 1;
+	int constants = (prefix >> (12 + lane)) & 1;
+
+	if (!constants)
+	{
+		MOVSS(xr, fpr.R(vregs[regnum]));
+		if (abs)
+			ANDPS(xr, M((void *)vfpuNoSignMask));
+	}
+	else
+		MOVSS(xr, M((void *)&vfpuConstants[regnum + (abs << 2)]));
+
+	if (negate)
+		XORPS(xr, M((void *)vfpuSignBits));
+}
+
+void Jit::ApplyPrefixD(X64Reg xr, int lane)
+{
+	SaturateLane(xr, (js.prefixD >> (lane * 2)) & 3);
+}
+
+// sat is encoded like in the D prefix: 1 clamps to [0, 1], 3 to [-1, 1].
+// Clobbers XMM1. The operand order makes NaNs pass through, like the interpreter's compares.
+void Jit::SaturateLane(X64Reg xr, int sat)
+{
+	if (sat != 1 && sat != 3)
+		return;
+
+	MOVSS(XMM1, M((void *)(sat == 1 ? vfpuZero : vfpuMinusOne)));
+	MAXSS(XMM1, R(xr));
+	MOVSS(xr, M((void *)vfpuOne));
+	MINSS(xr, R(XMM1));
+}
+
+// Grabs and locks xmm registers to compute results in, so that all inputs can be read
+// before the first output is written. Release with StoreVectorLanes.
+void Jit::AllocTempXRegs(X64Reg *xregs, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		xregs[i] = fpr.GetFreeXReg();
+		fpr.LockX(xregs[i]);
+	}
+}
+
+void Jit::StoreVectorLanes(const u8 *vregs, const X64Reg *xregs, int count, bool useWriteMask)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (useWriteMask && ((js.prefixD >> (8 + i)) & 1) != 0)
+			continue;
+		fpr.BindToRegister(vregs[i], false, true);
+		MOVSS(fpr.RX(vregs[i]), R(xregs[i]));
+	}
+	fpr.UnlockAllX();
+}
+
+void Jit::Comp_SV(u32 op)
+{
+	s32 imm = (signed short)(op & 0xFFFC);
+	int vt = VFPR(((op >> 16) & 0x1f) | ((op & 3) << 5));
+	int rs = _RS;
+
+	switch (op >> 26)
+	{
+	case 50: //lv.s  // VI(vt) = Memory::Read_U32(addr);
+		gpr.Lock(rs);
+		fpr.Lock(vt);
+		fpr.BindToRegister(vt, false, true);
+		MOV(32, R(EAX), gpr.R(rs));
+		MOVSS(fpr.RX(vt), GuestMemoryOp(imm));
+		gpr.UnlockAll();
+		fpr.UnlockAll();
+		break;
+
+	case 58: //sv.s   // Memory::Write_U32(VI(vt), addr);
+		gpr.Lock(rs);
+		fpr.Lock(vt);
+		fpr.BindToRegister(vt, true, false);
+		MOV(32, R(EAX), gpr.R(rs));
+		MOVSS(GuestMemoryOp(imm), fpr.RX(vt));
+		gpr.UnlockAll();
+		fpr.UnlockAll();
+		break;
+
+	default:
+		Comp_Generic(op);
+		break;
+	}
+}
+
+void Jit::Comp_SVQ(u32 op)
+{
+	int imm = (signed short)(op & 0xFFFC);
+	int vt = (((op >> 16) & 0x1f)) | ((op & 1) << 5);
+	int rs = _RS;
+
+	u8 vregs[4];
+	GetVectorFPRs(vregs, V_Quad, vt);
+
+	switch (op >> 26)
+	{
+	case 54: //lv.q
+		gpr.Lock(rs);
+		fpr.Lock(vregs[0], vregs[1], vregs[2], vregs[3]);
+		for (int i = 0; i < 4; i++)
+			fpr.BindToRegister(vregs[i], false, true);
+		MOV(32, R(EAX), gpr.R(rs));
+		for (int i = 0; i < 4; i++)
+			MOVSS(fpr.RX(vregs[i]), GuestMemoryOp(imm + i * 4));
+		gpr.UnlockAll();
+		fpr.UnlockAll();
+		break;
+
+	case 62: //sv.q
+		gpr.Lock(rs);
+		fpr.Lock(vregs[0], vregs[1], vregs[2], vregs[3]);
+		for (int i = 0; i < 4; i++)
+			fpr.BindToRegister(vregs[i], true, false);
+		MOV(32, R(EAX), gpr.R(rs));
+		for (int i = 0; i < 4; i++)
+			MOVSS(GuestMemoryOp(imm + i * 4), fpr.RX(vregs[i]));
+		gpr.UnlockAll();
+		fpr.UnlockAll();
+		break;
+
+	// lvl.q/lvr.q/svl.q/svr.q
+	default:
+		Comp_Generic(op);
+		break;
+	}
+}
+
+void Jit::Comp_VPFX(u32 op)
+{
+	int data = op & 0xFFFFF;
+	int regnum = (op >> 24) & 3;
+	switch (regnum)
+	{
+	case 0:  // S
+		js.prefixS = data;
+		js.prefixSFlag = JitState::PREFIX_KNOWN_DIRTY;
+		break;
+	case 1:  // T
+		js.prefixT = data;
+		js.prefixTFlag = JitState::PREFIX_KNOWN_DIRTY;
+		break;
+	case 2:  // D
+		js.prefixD = data;
+		js.prefixDFlag = JitState::PREFIX_KNOWN_DIRTY;
+		break;
+	default:
+		Comp_Generic(op);
+		break;
+	}
+}
+
+void Jit::Comp_VecDo3(u32 op)
+{
+	if (CompPrefixGuard(op))
+		return;
+
+	void (XEmitter::*xmmop)(X64Reg, OpArg) = NULL;
+	switch (op >> 26)
+	{
+	case 24: //VFPU0
+		switch ((op >> 23) & 7)
+		{
+		case 0: xmmop = &XEmitter::ADDSS; break; //vadd
+		case 1: xmmop = &XEmitter::SUBSS; break; //vsub
+		case 7: xmmop = &XEmitter::DIVSS; break; //vdiv
+		}
+		break;
+	case 25: //VFPU1
+		if (((op >> 23) & 7) == 0)
+			xmmop = &XEmitter::MULSS; //vmul
+		break;
+	}
+
+	VectorSize sz = GetVecSize(op);
+	if (!xmmop || !IsPrefixWithinSize(js.prefixS, sz) || !IsPrefixWithinSize(js.prefixT, sz))
+	{
+		Comp_Generic(op);
+		return;
+	}
+
+	int n = GetNumVectorElements(sz);
+	u8 sregs[4], tregs[4], dregs[4];
+	GetVectorFPRs(sregs, sz, _VS);
+	GetVectorFPRs(tregs, sz, _VT);
+	GetVectorFPRs(dregs, sz, _VD);
+
+	X64Reg tempxregs[4];
+	AllocTempXRegs(tempxregs, n);
+	for (int i = 0; i < n; i++)
+	{
+		ApplyPrefixST(tempxregs[i], sregs, js.prefixS, i);
+		ApplyPrefixST(XMM0, tregs, js.prefixT, i);
+		(this->*xmmop)(tempxregs[i], R(XMM0));
+		ApplyPrefixD(tempxregs[i], i);
+	}
+	StoreVectorLanes(dregs, tempxregs, n, true);
+
+	js.EatPrefix();
+}
+
+void Jit::Comp_VDot(u32 op)
+{
+	if (CompPrefixGuard(op))
+		return;
+
+	VectorSize sz = GetVecSize(op);
+	if (!IsPrefixWithinSize(js.prefixS, sz) || !IsPrefixWithinSize(js.prefixT, sz))
+	{
+		Comp_Generic(op);
+		return;
+	}
+
+	int n = GetNumVectorElements(sz);
+	u8 sregs[4], tregs[4];
+	GetVectorFPRs(sregs, sz, _VS);
+	GetVectorFPRs(tregs, sz, _VT);
+	// The result goes straight to V(vd), not through the vector mapping or the write mask.
+	u8 dreg = VFPR(_VD);
+
+	// Sum in the same order as the interpreter, starting from +0.0f.
+	X64Reg sum;
+	AllocTempXRegs(&sum, 1);
+	XORPS(sum, R(sum));
+	for (int i = 0; i < n; i++)
+	{
+		ApplyPrefixST(XMM0, sregs, js.prefixS, i);
+		ApplyPrefixST(XMM1, tregs, js.prefixT, i);
+		MULSS(XMM0, R(XMM1));
+		ADDSS(sum, R(XMM0));
+	}
+	ApplyPrefixD(sum, 0);
+	StoreVectorLanes(&dreg, &sum, 1, false);
+
+	js.EatPrefix();
+}
+
+void Jit::Comp_VScl(u32 op)
+{
+	if (CompPrefixGuard(op))
+		return;
+
+	VectorSize sz = GetVecSize(op);
+	if (!IsPrefixWithinSize(js.prefixS, sz))
+	{
+		Comp_Generic(op);
+		return;
+	}
+
+	int n = GetNumVectorElements(sz);
+	u8 sregs[4], dregs[4];
+	GetVectorFPRs(sregs, sz, _VS);
+	GetVectorFPRs(dregs, sz, _VD);
+	// The scale is V(vt) as is, the T prefix doesn't apply.
+	int treg = VFPR(_VT);
+
+	X64Reg tempxregs[4];
+	AllocTempXRegs(tempxregs, n);
+	for (int i = 0; i < n; i++)
+	{
+		ApplyPrefixST(tempxregs[i], sregs, js.prefixS, i);
+		MULSS(tempxregs[i], fpr.R(treg));
+		ApplyPrefixD(tempxregs[i], i);
+	}
+	StoreVectorLanes(dregs, tempxregs, n, true);
+
+	js.EatPrefix();
+}
+
+void Jit::Comp_VV2Op(u32 op)
+{
+	int optype = (op >> 16) & 0x1f;
+	switch (optype)
+	{
+	case 0: //vmov
+	case 1: //vabs
+	case 2: //vneg
+	case 4: //vsat0
+	case 5: //vsat1
+		break;
+	default:
+		Comp_Generic(op);
+		return;
+	}
+
+	if (CompPrefixGuard(op))
+		return;
+
+	VectorSize sz = GetVecSize(op);
+	if (!IsPrefixWithinSize(js.prefixS, sz))
+	{
+		Comp_Generic(op);
+		return;
+	}
+
+	int n = GetNumVectorElements(sz);
+	u8 sregs[4], dregs[4];
+	GetVectorFPRs(sregs, sz, _VS);
+	GetVectorFPRs(dregs, sz, _VD);
+
+	X64Reg tempxregs[4];
+	AllocTempXRegs(tempxregs, n);
+	for (int i = 0; i < n; i++)
+	{
+		ApplyPrefixST(tempxregs[i], sregs, js.prefixS, i);
+		switch (optype)
+		{
+		case 1:
+			ANDPS(tempxregs[i], M((void *)vfpuNoSignMask));
+			break;
+		case 2:
+			XORPS(tempxregs[i], M((void *)vfpuSignBits));
+			break;
+		case 4:
+			SaturateLane(tempxregs[i], 1);
+			break;
+		case 5:
+			SaturateLane(tempxregs[i], 3);
+			break;
+		}
+		ApplyPrefixD(tempxregs[i], i);
+	}
+	StoreVectorLanes(dregs, tempxregs, n, true);
+
+	js.EatPrefix();
+}
+
+void Jit::Comp_Vmmul(u32 op)
+{
+	MatrixSize sz = GetMtxSize(op);
+	int n = GetMatrixSide(sz);
+
+	u8 sregs[16], tregs[16], dregs[16];
+	GetMatrixFPRs(sregs, sz, _VS);
+	GetMatrixFPRs(tregs, sz, _VT);
+	GetMatrixFPRs(dregs, sz, _VD);
+
+	// Every output depends on a whole row and column, so an in place multiply would need
+	// all sixteen results kept around. Not worth it.
+	if (MatricesOverlap(dregs, sregs, n) || MatricesOverlap(dregs, tregs, n))
+	{
+		Comp_Generic(op);
+		return;
+	}
+
+	// Prefixes are ignored, but still eaten. No need to know them.
+	for (int a = 0; a < n; a++)
+	{
+		for (int b = 0; b < n; b++)
+		{
+			XORPS(XMM0, R(XMM0));
+			for (int c = 0; c < n; c++)
+			{
+				MOVSS(XMM1, fpr.R(sregs[b * 4 + c]));
+				MULSS(XMM1, fpr.R(tregs[a * 4 + c]));
+				ADDSS(XMM0, R(XMM1));
+			}
+			fpr.BindToRegister(dregs[a * 4 + b], false, true);
+			MOVSS(fpr.RX(dregs[a * 4 + b]), R(XMM0));
+		}
+	}
+
+	js.EatPrefix();
+}
+
+void Jit::Comp_Vtfm(u32 op)
+{
+	int ins = (op >> 23) & 7;
+	VectorSize sz = GetVecSize(op);
+	MatrixSize msz = GetMtxSize(op);
+	int n = GetNumVectorElements(sz);
+
+	bool homogenous = false;
+	if (n == ins)
+	{
+		n++;
+		sz = (VectorSize)((int)(sz) + 1);
+		msz = (MatrixSize)((int)(msz) + 1);
+		homogenous = true;
+	}
+	// Let the interpreter deal with the invalid encodings.
+	if ((!homogenous && n != ins + 1) || n > 4 || msz > M_4x4)
+	{
+		Comp_Generic(op);
+		return;
+	}
+
+	u8 sregs[16], tregs[4], dregs[4];
+	GetMatrixFPRs(sregs, msz, _VS);
+	GetVectorFPRs(tregs, sz, _VT);
+	GetVectorFPRs(dregs, sz, _VD);
+
+	// The output is often the input vector, so compute everything before writing.
+	X64Reg tempxregs[4];
+	AllocTempXRegs(tempxregs, n);
+	for (int i = 0; i < n; i++)
+	{
+		XORPS(tempxregs[i], R(tempxregs[i]));
+		for (int k = 0; k < n; k++)
+		{
+			MOVSS(XMM0, fpr.R(sregs[i * 4 + k]));
+			if (!homogenous || k != n - 1)
+				MULSS(XMM0, fpr.R(tregs[k]));
+			ADDSS(tempxregs[i], R(XMM0));
+		}
+	}
+	StoreVectorLanes(dregs, tempxregs, n, false);
+
+	js.EatPrefix();
+}
+
+void Jit::Comp_Mftv(u32 op)
+{
+	int vd = VFPR(_VD);
+	int rt = _RT;
+
+	switch ((op >> 21) & 0x1f)
+	{
+	case 3: //mfv  // R(rt) = VI(vd);
+		fpr.StoreFromRegister(vd);
+		gpr.Lock(rt);
+		gpr.BindToRegister(rt, false, true);
+		MOV(32, gpr.R(rt), fpr.R(vd));
+		gpr.UnlockAll();
+		break;
+
+	case 7: //mtv  // VI(vd) = R(rt);
+		gpr.StoreFromRegister(rt);
+		fpr.Lock(vd);
+		fpr.BindToRegister(vd, false, true);
+		MOVSS(fpr.RX(vd), gpr.R(rt));
+		fpr.UnlockAll();
+		break;
+
+	default:
+		Comp_Generic(op);
+		break;
+	}
+}
+
 }
\ No newline at end of file
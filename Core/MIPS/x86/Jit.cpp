@@ -17,10 +17,14 @@
 
 #include "../../Core.h"
 #include "../../CoreTiming.h"
+#include "../../System.h"
 #include "../MIPS.h"
+#include "../MIPSAnalyst.h"
 #include "../MIPSCodeUtils.h"
 #include "../MIPSInt.h"
+#include "../MIPSIntVFPU.h"
 #include "../MIPSTables.h"
+#include "../JitCommon/JitCommon.h"
 
 #include "RegCache.h"
 #include "Jit.h"
@@ -31,7 +35,7 @@ extern u32 *pspmainram;
 namespace MIPSComp
 {
 
-Jit::Jit(MIPSState *mips) : blocks(mips), mips_(mips)
+Jit::Jit(MIPSState *mips) : blocks(mips), codeRegion(0), mips_(mips)
 {
 	blocks.Init();
 	asm_.Init(mips, this);
@@ -44,12 +48,31 @@ void Jit::FlushAll()
 {
 	gpr.Flush(FLUSH_ALL);
 	fpr.Flush(FLUSH_ALL);
+	FlushPrefixV();
 }
 
 void Jit::ClearCache()
 {
 	blocks.Clear();
 	ClearCodeSpace();
+	codeRegion = 0;
+	GetJitCacheStats()->fullClears++;
+}
+
+void Jit::EvictNextCodeRegion()
+{
+	size_t codeRegionSize = region_size / NUM_CODE_REGIONS;
+	codeRegion = (codeRegion + 1) % NUM_CODE_REGIONS;
+	u8 *start = region + codeRegion * codeRegionSize;
+
+	int evicted = blocks.EvictBlocksInCodeRange(start, start + codeRegionSize);
+	memset(start, 0xCC, codeRegionSize);
+	SetCodePtr(start);
+
+	JitCacheStats *stats = GetJitCacheStats();
+	stats->blocksEvicted += evicted;
+	stats->regionsEvicted++;
+	INFO_LOG(JIT, "Evicted %d blocks from code region %d, %u recompiles so far (%.1f/s)", evicted, codeRegion, stats->blocksRecompiled, stats->recompilesPerSecond);
 }
 
 u8 *codeCache;
@@ -62,14 +85,21 @@ void Jit::CompileAt(u32 addr)
 
 void Jit::Compile(u32 em_address)
 {
-	if (GetSpaceLeft() < 0x10000 || blocks.IsFull())
+	u8 *codeRegionEnd = region + (codeRegion + 1) * (region_size / NUM_CODE_REGIONS);
+	if (GetCodePtr() + 0x10000 > codeRegionEnd || blocks.IsFull())
 	{
-		ClearCache();
+		EvictNextCodeRegion();
+		// Can only happen if the blocks are tiny, but then there's nothing better to do.
+		if (blocks.IsFull())
+			ClearCache();
 	}
 
 	int block_num = blocks.AllocateBlock(em_address);
 	JitBlock *b = blocks.GetBlock(block_num);
 	blocks.FinalizeBlock(block_num, jo.enableBlocklink, DoJit(em_address, b));
+	NotifyBlockCompiled(blocks.ForgetEvicted(em_address));
+	if (PSP_CoreParameter().jitProfile)
+		ProfileBlockCompiled(em_address, b->originalSize, b->normalEntry, b->codeSize);
 }
 
 void Jit::RunLoopUntil(u64 globalticks)
@@ -86,8 +116,13 @@ const u8 *Jit::DoJit(u32 em_address, JitBlock *b)
 	js.curBlock = b;
 	js.compiling = true;
 	js.inDelaySlot = false;
+	js.PrefixUnknown();
 
 	b->normalEntry = GetCodePtr();
+	b->checkedEntry = b->normalEntry;
+
+	if (PSP_CoreParameter().jitProfile)
+		IncrementCounter64(&b->runCount);
 
 	// TODO: this needs work
 	MIPSAnalyst::AnalysisResults analysis; // = MIPSAnalyst::Analyze(em_address);
@@ -123,17 +158,58 @@ void Jit::Comp_RunBlock(u32 op)
 void Jit::Comp_Generic(u32 op)
 {
 	FlushAll();
+	GenericFallbackStats *stats = GetGenericFallbackStats(MIPSGetName(op));
+	stats->compiled++;
 	MIPSInterpretFunc func = MIPSGetInterpretFunc(op);
 	if (func)
 	{
+		IncrementCounter32(&stats->executed);
 		MOV(32, M(&mips_->pc), Imm32(js.compilerPC));
 		ABI_CallFunctionC((void *)func, op);
 	}
+
+	// Interpreted VFPU ops may set or eat the prefixes, except for the plain loads and stores.
+	if ((MIPSGetInfo(op) & IS_VFPU) != 0 && func != MIPSInt::Int_SV && func != MIPSInt::Int_SVQ && func != MIPSInt::Int_Vflush)
+		js.PrefixUnknown();
+}
+
+void Jit::IncrementCounter32(void *counter)
+{
+	// The counters live on the heap, which may be out of RIP relative reach of the code space.
+#ifdef _M_X64
+	MOV(64, R(RAX), ImmPtr(counter));
+	ADD(32, MatR(RAX), Imm8(1));
+#else
+	ADD(32, M(counter), Imm8(1));
+#endif
+}
+
+void Jit::IncrementCounter64(u64 *counter)
+{
+#ifdef _M_X64
+	MOV(64, R(RAX), ImmPtr(counter));
+	ADD(64, MatR(RAX), Imm8(1));
+#else
+	ADD(32, M(counter), Imm8(1));
+	ADC(32, M((u32 *)counter + 1), Imm8(0));
+#endif
 }
 
 void Jit::WriteExit(u32 destination, int exit_num)
 {
-	SUB(32, M(&CoreTiming::downcount), js.downcountAmount > 127 ? Imm32(js.downcountAmount) : Imm8(js.downcountAmount));
+	// Spinning on a flag, nothing will change until the next event. Skip straight to it.
+	bool idleLoop = destination <= js.compilerPC && MIPSAnalyst::IsIdleLoop(destination, js.compilerPC);
+	if (idleLoop)
+	{
+		DEBUG_LOG(JIT, "Idle loop at %08x-%08x", destination, js.compilerPC);
+		ABI_CallFunctionC((void *)&CoreTiming::Idle, 0);
+	}
+
+	SUB(32, M(CoreTiming::GetDowncountPtr()), js.downcountAmount > 127 ? Imm32(js.downcountAmount) : Imm8(js.downcountAmount));
+
+	// pc is set even when linking, so that the exit only needs its JMP pointed back at the
+	// dispatcher when the destination block goes away.
+	MOV(32, M(&mips_->pc), Imm32(destination));
 
 	//If nobody has taken care of this yet (this can be removed when all branches are done)
 	JitBlock *b = js.curBlock;
@@ -142,7 +218,7 @@ void Jit::WriteExit(u32 destination, int exit_num)
 
 	// Link opportunity!
 	int block = blocks.GetBlockNumberFromStartAddress(destination);
-	if (jo.enableBlocklink)
+	if (jo.enableBlocklink && !idleLoop)
 	{
 		if (block >= 0 && jo.enableBlocklink)
 		{
@@ -153,7 +229,6 @@ void Jit::WriteExit(u32 destination, int exit_num)
 		}
 	}
 	// No blocklinking.
-	MOV(32, M(&mips_->pc), Imm32(destination));
 	JMP(asm_.dispatcher, true);
 }
 
@@ -161,13 +236,13 @@ void Jit::WriteExitDestInEAX()
 {
 	// TODO: Some wasted potential, dispatcher will alwa
 	MOV(32, M(&mips_->pc), R(EAX));
-	SUB(32, M(&CoreTiming::downcount), js.downcountAmount > 127 ? Imm32(js.downcountAmount) : Imm8(js.downcountAmount));
+	SUB(32, M(CoreTiming::GetDowncountPtr()), js.downcountAmount > 127 ? Imm32(js.downcountAmount) : Imm8(js.downcountAmount));
 	JMP(asm_.dispatcher, true);
 }
 
 void Jit::WriteSyscallExit()
 {
-	SUB(32, M(&CoreTiming::downcount), js.downcountAmount > 127 ? Imm32(js.downcountAmount) : Imm8(js.downcountAmount));
+	SUB(32, M(CoreTiming::GetDowncountPtr()), js.downcountAmount > 127 ? Imm32(js.downcountAmount) : Imm8(js.downcountAmount));
 	JMP(asm_.dispatcher, true);
 }
 
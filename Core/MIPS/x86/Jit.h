@@ -27,6 +27,7 @@
 #include "x64Emitter.h"
 #include "JitCache.h"
 #include "RegCache.h"
+#include "../MIPSVFPUUtils.h"
 
 namespace MIPSComp
 {
@@ -50,6 +51,53 @@ struct JitState
 	int downcountAmount;
 	bool compiling;	// TODO: get rid of this in favor of using analysis results to determine end of block
 	JitBlock *curBlock;
+
+	// VFPU prefixes are tracked at compile time so that native VFPU ops can apply them
+	// statically. Known values are only written back to vfpuCtrl on flush.
+	enum PrefixState
+	{
+		PREFIX_UNKNOWN = 0x00,
+		PREFIX_KNOWN = 0x01,
+		PREFIX_DIRTY = 0x10,
+		PREFIX_KNOWN_DIRTY = 0x11,
+	};
+
+	u32 prefixS;
+	u32 prefixT;
+	u32 prefixD;
+	PrefixState prefixSFlag;
+	PrefixState prefixTFlag;
+	PrefixState prefixDFlag;
+
+	bool HasKnownPrefixes() const
+	{
+		return (prefixSFlag & prefixTFlag & prefixDFlag & PREFIX_KNOWN) != 0;
+	}
+	void PrefixUnknown()
+	{
+		prefixSFlag = PREFIX_UNKNOWN;
+		prefixTFlag = PREFIX_UNKNOWN;
+		prefixDFlag = PREFIX_UNKNOWN;
+	}
+	// Every VFPU op that applies prefixes resets them to the defaults afterwards.
+	void EatPrefix()
+	{
+		if ((prefixSFlag & PREFIX_KNOWN) == 0 || prefixS != 0xE4)
+		{
+			prefixSFlag = PREFIX_KNOWN_DIRTY;
+			prefixS = 0xE4;
+		}
+		if ((prefixTFlag & PREFIX_KNOWN) == 0 || prefixT != 0xE4)
+		{
+			prefixTFlag = PREFIX_KNOWN_DIRTY;
+			prefixT = 0xE4;
+		}
+		if ((prefixDFlag & PREFIX_KNOWN) == 0 || prefixD != 0x0)
+		{
+			prefixDFlag = PREFIX_KNOWN_DIRTY;
+			prefixD = 0x0;
+		}
+	}
 };
 
 class Jit : public Gen::XCodeBlock
@@ -85,18 +133,42 @@ public:
 	void Comp_RType3(u32 op);
 	void Comp_ShiftType(u32 op);
 	void Comp_Allegrex(u32 op);
+	void Comp_Allegrex2(u32 op);
 	void Comp_VBranch(u32 op);
+	void Comp_MulDivType(u32 op);
+	void Comp_RType2(u32 op);
+	void Comp_Special3(u32 op);
+	void Comp_DoNothing(u32 op);
 
 	void Comp_FPU3op(u32 op);
 	void Comp_FPU2op(u32 op);
+	void Comp_FPUComp(u32 op);
 	void Comp_mxc1(u32 op);
 
+	void Comp_SV(u32 op);
+	void Comp_SVQ(u32 op);
+	void Comp_VPFX(u32 op);
+	void Comp_VecDo3(u32 op);
+	void Comp_VDot(u32 op);
+	void Comp_VScl(u32 op);
+	void Comp_VV2Op(u32 op);
+	void Comp_Vmmul(u32 op);
+	void Comp_Vtfm(u32 op);
+	void Comp_Mftv(u32 op);
+
 	JitBlockCache *GetBlockCache() { return &blocks; }
 	AsmRoutineManager &Asm() { return asm_; }
-private:
 	void ClearCache();
+private:
+	void EvictNextCodeRegion();
 	void FlushAll();
+	void FlushPrefixV();
 
+	// Emits a 32-bit increment of a counter anywhere in host memory, such as the generic fallback
+	// counts. Clobbers EAX.
+	void IncrementCounter32(void *counter);
+	// Same for counters that may run past 32 bits, like the block run counts. Clobbers EAX.
+	void IncrementCounter64(u64 *counter);
 	void WriteExit(u32 destination, int exit_num);
 	void WriteExitDestInEAX();
 //	void WriteRfiExitDestInEAX();
@@ -113,9 +185,22 @@ private:
 	void CompTriArith(u32 op, void (XEmitter::*arith)(int, const OpArg &, const OpArg &));
 	void CompShiftImm(u32 op, void (XEmitter::*shift)(int, OpArg, OpArg));
 	void CompShiftVar(u32 op, void (XEmitter::*shift)(int, OpArg, OpArg));
+	void CompITypeMemRead(u32 op, int bits, bool signExtend);
+	void CompITypeMemWrite(u32 op, int bits);
+	void CompITypeMemUnaligned(u32 op);
+	// Converts the guest address in EAX into an operand addressing host memory.
+	OpArg GuestMemoryOp(int offset);
 
 	void CompFPTriArith(u32 op, void (XEmitter::*arith)(X64Reg reg, OpArg), bool orderMatters);
 
+	// VFPU helpers.
+	bool CompPrefixGuard(u32 op);
+	void ApplyPrefixST(X64Reg xr, const u8 *vregs, u32 prefix, int lane);
+	void ApplyPrefixD(X64Reg xr, int lane);
+	void SaturateLane(X64Reg xr, int sat);
+	void AllocTempXRegs(X64Reg *xregs, int count);
+	void StoreVectorLanes(const u8 *vregs, const X64Reg *xregs, int count, bool useWriteMask);
+
 	JitBlockCache blocks;
 	JitOptions jo;
 	JitState js;
@@ -125,6 +210,11 @@ private:
 
 	AsmRoutineManager asm_;
 
+	// The code space is used as a ring of regions. When the current one fills up, the blocks
+	// in the next one are evicted and it's reused, instead of throwing away everything.
+	enum { NUM_CODE_REGIONS = 8 };
+	int codeRegion;
+
 	MIPSState *mips_;
 };
 
@@ -70,7 +70,7 @@ bool JitBlock::ContainsAddress(u32 em_address)
 
 bool JitBlockCache::IsFull() const 
 {
-	return GetNumBlocks() >= MAX_NUM_BLOCKS - 1;
+	return GetNumBlocks() >= MAX_NUM_BLOCKS - 1 && freeBlockNums.empty();
 }
 
 void JitBlockCache::Init()
@@ -92,6 +92,8 @@ void JitBlockCache::Shutdown()
 	blocks = 0;
 	blockCodePointers = 0;
 	num_blocks = 0;
+	freeBlockNums.clear();
+	evictedAddresses.clear();
 #if defined USE_OPROFILE && USE_OPROFILE
 	op_close_agent(agent);
 #endif
@@ -113,10 +115,13 @@ void JitBlockCache::Clear()
 {
 	for (int i = 0; i < num_blocks; i++)
 	{
+		if (!blocks[i].invalid)
+			evictedAddresses.insert(blocks[i].originalAddress);
 		DestroyBlock(i, false);
 	}
 	links_to.clear();
 	block_map.clear();
+	freeBlockNums.clear();
 	num_blocks = 0;
 	memset(blockCodePointers, 0, sizeof(u8*)*MAX_NUM_BLOCKS);
 }
@@ -162,8 +167,20 @@ bool JitBlockCache::RangeIntersect(int s1, int e1, int s2, int e2) const
 
 int JitBlockCache::AllocateBlock(u32 em_address)
 {
-	JitBlock &b = blocks[num_blocks];
+	int block_num;
+	if (!freeBlockNums.empty())
+	{
+		block_num = freeBlockNums.back();
+		freeBlockNums.pop_back();
+	}
+	else
+		block_num = num_blocks++; //commit the current block
+
+	JitBlock &b = blocks[block_num];
 	b.invalid = false;
+	b.checkedEntry = 0;
+	b.normalEntry = 0;
+	b.runCount = 0;
 	b.originalAddress = em_address;
 	b.exitAddress[0] = INVALID_EXIT;
 	b.exitAddress[1] = INVALID_EXIT;
@@ -171,9 +188,8 @@ int JitBlockCache::AllocateBlock(u32 em_address)
 	b.exitPtrs[1] = 0;
 	b.linkStatus[0] = false;
 	b.linkStatus[1] = false;
-	b.blockNum = num_blocks;
-	num_blocks++; //commit the current block
-	return num_blocks - 1;
+	b.blockNum = block_num;
+	return block_num;
 }
 
 void JitBlockCache::FinalizeBlock(int block_num, bool block_link, const u8 *code_ptr)
@@ -240,7 +256,7 @@ int JitBlockCache::GetBlockNumberFromStartAddress(u32 addr)
 	int bl = (inst & MIPS_EMUHACK_VALUE_MASK);
 	if (bl >= num_blocks)
 		return -1;
-	if (blocks[bl].originalAddress != addr)
+	if (blocks[bl].originalAddress != addr || blocks[bl].invalid)
 		return -1;		
 	return bl;
 }
@@ -347,8 +363,13 @@ void JitBlockCache::UnlinkBlock(int i)
 		JitBlock &sourceBlock = blocks[iter2->second];
 		for (int e = 0; e < 2; e++)
 		{
-			if (sourceBlock.exitAddress[e] == b.originalAddress)
+			if (sourceBlock.exitAddress[e] == b.originalAddress && sourceBlock.linkStatus[e])
+			{
+				// The exit has already set pc, so just send it to the dispatcher instead.
+				XEmitter emit(sourceBlock.exitPtrs[e]);
+				emit.JMP(MIPSComp::jit->Asm().dispatcher, true);
 				sourceBlock.linkStatus[e] = false;
+			}
 		}
 	}
 }
@@ -368,15 +389,20 @@ void JitBlockCache::DestroyBlock(int block_num, bool invalidate)
 		return;
 	}
 	b.invalid = true;
+	MIPSComp::ProfileBlockDestroyed(b.originalAddress, b.originalSize, b.runCount);
 #ifdef JIT_UNLIMITED_ICACHE
 	Memory::Write_Opcode_JIT(b.originalAddress, b.originalFirstOpcode?b.originalFirstOpcode:JIT_ICACHE_INVALID_WORD);
 #else
-	if (Memory::ReadUnchecked_U32(b.originalAddress) == (u32)block_num)
+	if (Memory::ReadUnchecked_U32(b.originalAddress) == (u32)MIPS_MAKE_EMUHACK(0, block_num))
 		Memory::WriteUnchecked_U32(b.originalFirstOpcode, b.originalAddress);
 #endif
 
 	UnlinkBlock(block_num);
 
+	// Not compiled yet.
+	if (!b.checkedEntry)
+		return;
+
 	// Send anyone who tries to run this block back to the dispatcher.
 	// Not entirely ideal, but .. pretty good.
 	// Spurious entrances from previously linked blocks can only come through checkedEntry
@@ -410,3 +436,60 @@ void JitBlockCache::InvalidateICache(u32 address, const u32 length)
 		block_map.erase(it1, it2);
 	}
 }
+
+void JitBlockCache::RemoveBlock(int i)
+{
+	JitBlock &b = blocks[i];
+	DestroyBlock(i, false);
+
+	u32 pAddr = b.originalAddress & 0x1FFFFFFF;
+	std::map<pair<u32,u32>, u32>::iterator mapIter = block_map.find(std::make_pair(pAddr + 4 * b.originalSize - 1, pAddr));
+	if (mapIter != block_map.end() && mapIter->second == (u32)i)
+		block_map.erase(mapIter);
+
+	for (int e = 0; e < 2; e++)
+	{
+		if (b.exitAddress[e] == INVALID_EXIT)
+			continue;
+		pair<multimap<u32, int>::iterator, multimap<u32, int>::iterator> ppp = links_to.equal_range(b.exitAddress[e]);
+		for (multimap<u32, int>::iterator iter = ppp.first; iter != ppp.second; )
+		{
+			if (iter->second == i)
+				links_to.erase(iter++);
+			else
+				++iter;
+		}
+	}
+
+	blockCodePointers[i] = 0;
+	b.checkedEntry = 0;
+	b.normalEntry = 0;
+	freeBlockNums.push_back(i);
+}
+
+int JitBlockCache::EvictBlocksInCodeRange(const u8 *start, const u8 *end)
+{
+	int evicted = 0;
+	for (int i = 0; i < num_blocks; i++)
+	{
+		JitBlock &b = blocks[i];
+		if (b.normalEntry < start || b.normalEntry >= end)
+			continue;
+
+		// Destroying the block unlinks every exit that jumps into it, so nothing outside the
+		// range can reach its code anymore.  Blocks that were already invalidated are removed
+		// too, since their own exits are still in links_to and would be patched later.
+		if (!b.invalid)
+		{
+			evictedAddresses.insert(b.originalAddress);
+			evicted++;
+		}
+		RemoveBlock(i);
+	}
+	return evicted;
+}
+
+bool JitBlockCache::ForgetEvicted(u32 em_address)
+{
+	return evictedAddresses.erase(em_address) != 0;
+}
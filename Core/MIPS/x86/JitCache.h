@@ -18,6 +18,7 @@
 #pragma once
 
 #include <map>
+#include <set>
 #include <vector>
 #include <string>
 
@@ -54,7 +55,7 @@ struct JitBlock
 	u32 originalFirstOpcode; //to be able to restore
 	u32 codeSize; 
 	u32 originalSize;
-	int runCount;	// for profiling.
+	u64 runCount;	// for profiling.
 	int blockNum;
 	int flags;
 
@@ -85,6 +86,10 @@ class JitBlockCache
 	int num_blocks;
 	std::multimap<u32, int> links_to;
 	std::map<std::pair<u32,u32>, u32> block_map; // (end_addr, start_addr) -> number
+	// Numbers of evicted blocks, reused before growing num_blocks.
+	std::vector<int> freeBlockNums;
+	// Start addresses of evicted blocks that haven't been compiled again yet.
+	std::set<u32> evictedAddresses;
 
 	int MAX_NUM_BLOCKS;
 
@@ -92,6 +97,8 @@ class JitBlockCache
 	void LinkBlockExits(int i);
 	void LinkBlock(int i);
 	void UnlinkBlock(int i);
+	// Destroys the block and forgets everything about it, so that its number can be reused.
+	void RemoveBlock(int i);
 
 public:
 	JitBlockCache(MIPSState *mips_) :
@@ -130,6 +137,13 @@ public:
 	void InvalidateICache(u32 address, const u32 length);
 	void DestroyBlock(int block_num, bool invalidate);
 
+	// Removes all blocks whose code starts in [start, end), so that the code space can be reused.
+	// Exits elsewhere linked into the range are pointed back at the dispatcher. Returns the number
+	// of valid blocks removed.
+	int EvictBlocksInCodeRange(const u8 *start, const u8 *end);
+	// Returns true if a block starting at em_address was evicted since it was last compiled.
+	bool ForgetEvicted(u32 em_address);
+
 	std::string GetCompiledDisassembly(int block_num);
 
 	// Not currently used
@@ -38,7 +38,7 @@ static const int allocationOrder[] =
 #endif
 };
 
-RegCache::RegCache() : emit(0), mips(0) {
+RegCache::RegCache(int numRegs_) : emit(0), numRegs(numRegs_), mips(0) {
 	memset(locks, 0, sizeof(locks));
 	memset(xlocks, 0, sizeof(xlocks));
 	memset(saved_locks, 0, sizeof(saved_locks));
@@ -58,7 +58,7 @@ void RegCache::Start(MIPSState *mips, MIPSAnalyst::AnalysisResults &stats)
 		xregs[i].dirty = false;
 		xlocks[i] = false;
 	}
-	for (int i = 0; i < 32; i++)
+	for (int i = 0; i < numRegs; i++)
 	{
 		regs[i].location = GetDefaultLocation(i);
 		regs[i].away = false;
@@ -109,7 +109,7 @@ bool RegCache::IsFreeX(int xreg) const
 
 void RegCache::UnlockAll()
 {
-	for (int i = 0; i < 32; i++)
+	for (int i = 0; i < numRegs; i++)
 		locks[i] = false;
 }
 
@@ -179,7 +179,7 @@ void RegCache::FlushR(X64Reg reg)
 
 int RegCache::SanityCheck() const
 {
-	for (int i = 0; i < 32; i++) {
+	for (int i = 0; i < numRegs; i++) {
 		if (regs[i].away) {
 			if (regs[i].location.IsSimpleReg()) {
 				Gen::X64Reg simple = regs[i].location.GetSimpleReg();
@@ -253,7 +253,10 @@ OpArg GPRRegCache::GetDefaultLocation(int reg) const
 
 OpArg FPURegCache::GetDefaultLocation(int reg) const
 {
-	return M(&mips->f[reg]);
+	if (reg < 32)
+		return M(&mips->f[reg]);
+	else
+		return M(&mips->v[reg - 32]);
 }
 
 void RegCache::KillImmediate(int preg, bool doLoad, bool makeDirty)
@@ -385,7 +388,7 @@ void RegCache::Flush(FlushMode mode)
 		if (xlocks[i])
 			PanicAlert("Someone forgot to unlock X64 reg %i.", i);
 	}
-	for (int i = 0; i < 32; i++)
+	for (int i = 0; i < numRegs; i++)
 	{
 		if (locks[i])
 		{
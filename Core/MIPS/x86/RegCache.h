@@ -54,28 +54,33 @@ typedef int PReg;
 #define NUMXREGS 8
 #endif
 
+// The FPU cache also holds the 128 VFPU registers, v[i] is cached as register 32 + i.
+#define NUM_MIPS_FPRS (32 + 128)
+
 class RegCache
 {
 private:
-	bool locks[32];
-	bool saved_locks[32];
+	bool locks[NUM_MIPS_FPRS];
+	bool saved_locks[NUM_MIPS_FPRS];
 	bool saved_xlocks[NUMXREGS];
 
 protected:
 	bool xlocks[NUMXREGS];
-	MIPSCachedReg regs[32];
+	MIPSCachedReg regs[NUM_MIPS_FPRS];
 	X64CachedReg xregs[NUMXREGS];
 
-	MIPSCachedReg saved_regs[32];
+	MIPSCachedReg saved_regs[NUM_MIPS_FPRS];
 	X64CachedReg saved_xregs[NUMXREGS];
 
 	virtual const int *GetAllocationOrder(int &count) = 0;
 	
 	XEmitter *emit;
+	// Number of MIPS registers this cache handles.
+	int numRegs;
 
 public:
   MIPSState *mips;
-	RegCache();
+	RegCache(int numRegs_);
 
 	virtual ~RegCache() {}
 	virtual void Start(MIPSState *mips, MIPSAnalyst::AnalysisResults &stats) = 0;
@@ -130,6 +135,7 @@ public:
 class GPRRegCache : public RegCache
 {
 public:
+	GPRRegCache() : RegCache(32) {}
 	void Start(MIPSState *mips, MIPSAnalyst::AnalysisResults &stats);
 	void BindToRegister(int preg, bool doLoad = true, bool makeDirty = true);
 	void StoreFromRegister(int preg);
@@ -142,6 +148,7 @@ public:
 class FPURegCache : public RegCache
 {
 public:
+	FPURegCache() : RegCache(NUM_MIPS_FPRS) {}
 	void Start(MIPSState *mips, MIPSAnalyst::AnalysisResults &stats);
 	void BindToRegister(int preg, bool doLoad = true, bool makeDirty = true);
 	void StoreFromRegister(int preg);
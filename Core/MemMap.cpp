@@ -18,15 +18,28 @@
 #include "Common.h"
 #include "MemoryUtil.h"
 #include "MemArena.h"
+#include "Atomic.h"
 #include "ChunkFile.h"
 
 #include "Memmap.h"
 #include "Core.h"
 #include "MIPS/MIPS.h"
+#include "MIPS/MIPSAnalyst.h"
 #include "MIPS/JitCommon/JitCommon.h"
 #include "HLE/HLE.h"
+#include "HLE/__sceSas.h"
 #include "CPU.h"
 #include "Debugger/SymbolMap.h"
+#include "../GPU/GPUInterface.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <signal.h>
+#include <unistd.h>
+#endif
 
 namespace Memory
 {
@@ -82,7 +95,11 @@ void Init()
 
 void DoState(PointerWrap &p)
 {
+	// Saved RAM must not contain the JIT's emuhacks, a later load won't have the same blocks.
+	u8 *ramCopy = *p.GetPPtr();
 	p.DoArray(m_pRAM, RAM_SIZE);
+	if (p.GetMode() == PointerWrap::MODE_WRITE)
+		MIPSComp::RestoreOriginalOps(ramCopy, PSP_GetKernelMemoryBase(), RAM_SIZE);
 	p.DoMarker("RAM");
 	p.DoArray(m_pVRAM, VRAM_SIZE);
 	p.DoMarker("VRAM");
@@ -90,8 +107,361 @@ void DoState(PointerWrap &p)
 	p.DoMarker("ScratchPad");
 }
 
+// Every view of a region, some may be the same on 32-bit.
+struct DirtyRegion
+{
+	u8 **views[4];
+	u32 size;
+	int firstPage;
+};
+
+static const DirtyRegion dirtyRegions[] =
+{
+	{{&m_pRAM, &m_pPhysicalRAM, &m_pUncachedRAM, &m_pKernelRAM}, RAM_SIZE, 0},
+	{{&m_pVRAM, &m_pPhysicalVRAM, &m_pUncachedVRAM, NULL}, VRAM_SIZE, RAM_SIZE >> DIRTY_PAGE_SHIFT},
+	{{&m_pScratchPad, &m_pPhysicalScratchPad, NULL, NULL}, SCRATCHPAD_SIZE, (RAM_SIZE + VRAM_SIZE) >> DIRTY_PAGE_SHIFT},
+};
+
+static const int numDirtyRegions = sizeof(dirtyRegions) / sizeof(DirtyRegion);
+
+static u8 dirtyPages[DIRTY_PAGE_COUNT];
+static volatile bool dirtyTracking = false;
+static bool faultHandlerInstalled = false;
+
+enum
+{
+	COW_PENDING,
+	COW_COPYING,
+	COW_COPIED,
+};
+
+static volatile u32 cowState[DIRTY_PAGE_COUNT];
+static u8 *cowDest = NULL;
+static volatile bool cowActive = false;
+
+static bool IsDuplicateView(const DirtyRegion &r, int v)
+{
+	for (int i = 0; i < v; i++)
+	{
+		if (r.views[i] && *r.views[i] == *r.views[v])
+			return true;
+	}
+	return false;
+}
+
+static void ProtectPages(int first, int count, bool protect)
+{
+	for (int i = 0; i < numDirtyRegions; i++)
+	{
+		const DirtyRegion &r = dirtyRegions[i];
+		int regionPages = r.size >> DIRTY_PAGE_SHIFT;
+		int start = std::max(first, r.firstPage);
+		int end = std::min(first + count, r.firstPage + regionPages);
+		if (start >= end)
+			continue;
+
+		size_t offset = (size_t)(start - r.firstPage) << DIRTY_PAGE_SHIFT;
+		size_t size = (size_t)(end - start) << DIRTY_PAGE_SHIFT;
+		for (int v = 0; v < 4; v++)
+		{
+			if (!r.views[v] || !*r.views[v] || IsDuplicateView(r, v))
+				continue;
+			if (protect)
+				WriteProtectMemory(*r.views[v] + offset, size, false);
+			else
+				UnWriteProtectMemory(*r.views[v] + offset, size, false);
+		}
+	}
+}
+
+// A page stays protected while either dirty tracking or a copy on write snapshot wants it.
+static bool WantsProtection(int page)
+{
+	if (dirtyTracking && !dirtyPages[page])
+		return true;
+	return cowActive && cowState[page] != COW_COPIED;
+}
+
+static void UpdateProtection()
+{
+	int page = 0;
+	while (page < DIRTY_PAGE_COUNT)
+	{
+		int first = page;
+		bool protect = WantsProtection(page);
+		while (page < DIRTY_PAGE_COUNT && WantsProtection(page) == protect)
+			page++;
+		ProtectPages(first, page - first, protect);
+	}
+}
+
+// Can be called from any thread. Whoever gets to a page first copies it, the other waits.
+static void CopyOnWritePage(int page)
+{
+	if (Common::AtomicCompareAndSwap(cowState[page], COW_PENDING, COW_COPYING))
+	{
+		memcpy(cowDest + ((size_t)page << DIRTY_PAGE_SHIFT), GetDirtyPagePointer(page), DIRTY_PAGE_SIZE);
+		Common::AtomicStoreRelease(cowState[page], COW_COPIED);
+	}
+	else
+	{
+		// Copying a page takes no time at all, not worth sleeping for.
+		while (Common::AtomicLoadAcquire(cowState[page]) != COW_COPIED)
+			continue;
+	}
+}
+
+// Called from the fault handler. Returns true if the address is in a tracked page, which is now
+// writable so the write can be retried.
+static bool HandleDirtyFault(const u8 *addr)
+{
+	if (!dirtyTracking && !cowActive)
+		return false;
+
+	for (int i = 0; i < numDirtyRegions; i++)
+	{
+		const DirtyRegion &r = dirtyRegions[i];
+		for (int v = 0; v < 4; v++)
+		{
+			const u8 *view = r.views[v] ? *r.views[v] : NULL;
+			if (!view || addr < view || addr >= view + r.size)
+				continue;
+
+			// Another thread may have just faulted on the same page, that's fine.
+			int page = r.firstPage + (int)((addr - view) >> DIRTY_PAGE_SHIFT);
+			if (cowActive)
+				CopyOnWritePage(page);
+			if (dirtyTracking)
+				dirtyPages[page] = 1;
+			ProtectPages(page, 1, false);
+			return true;
+		}
+	}
+	return false;
+}
+
+#ifdef _WIN32
+
+static LONG NTAPI DirtyExceptionHandler(PEXCEPTION_POINTERS info)
+{
+	const EXCEPTION_RECORD *record = info->ExceptionRecord;
+	// ExceptionInformation[0] is 1 for writes, [1] is the address.
+	if (record->ExceptionCode == EXCEPTION_ACCESS_VIOLATION && record->ExceptionInformation[0] == 1)
+	{
+		if (HandleDirtyFault((const u8 *)record->ExceptionInformation[1]))
+			return EXCEPTION_CONTINUE_EXECUTION;
+	}
+	return EXCEPTION_CONTINUE_SEARCH;
+}
+
+static bool InstallFaultHandler()
+{
+	return AddVectoredExceptionHandler(1, DirtyExceptionHandler) != NULL;
+}
+
+#else
+
+static struct sigaction prevSegvAction;
+static struct sigaction prevBusAction;
+
+static void DirtyFaultHandler(int sig, siginfo_t *info, void *context)
+{
+	if (HandleDirtyFault((const u8 *)info->si_addr))
+		return;
+
+	// Not ours, pass it on.
+	struct sigaction &prev = sig == SIGBUS ? prevBusAction : prevSegvAction;
+	if (prev.sa_flags & SA_SIGINFO)
+		prev.sa_sigaction(sig, info, context);
+	else if (prev.sa_handler == SIG_DFL)
+		sigaction(sig, &prev, NULL);  // The fault happens again on return, and takes the default.
+	else if (prev.sa_handler != SIG_IGN)
+		prev.sa_handler(sig);
+}
+
+static bool InstallFaultHandler()
+{
+	// The protection has to line up with our pages.
+	if (sysconf(_SC_PAGESIZE) > DIRTY_PAGE_SIZE)
+		return false;
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_sigaction = &DirtyFaultHandler;
+	action.sa_flags = SA_SIGINFO;
+	sigemptyset(&action.sa_mask);
+	if (sigaction(SIGSEGV, &action, &prevSegvAction) != 0)
+		return false;
+	// Some systems (OS X) report write protection faults as SIGBUS.
+	sigaction(SIGBUS, &action, &prevBusAction);
+	return true;
+}
+
+#endif
+
+static bool EnsureFaultHandler()
+{
+	if (!faultHandlerInstalled)
+	{
+		if (!InstallFaultHandler())
+		{
+			WARN_LOG(MEMMAP, "Can't trap memory writes on this host, no dirty page tracking");
+			return false;
+		}
+		faultHandlerInstalled = true;
+	}
+	return true;
+}
+
+bool EnableDirtyTracking()
+{
+	if (dirtyTracking)
+		return true;
+	if (!EnsureFaultHandler())
+		return false;
+
+	memset(dirtyPages, 0, sizeof(dirtyPages));
+	dirtyTracking = true;
+	ProtectPages(0, DIRTY_PAGE_COUNT, true);
+	return true;
+}
+
+void DisableDirtyTracking()
+{
+	if (!dirtyTracking)
+		return;
+	dirtyTracking = false;
+	UpdateProtection();
+}
+
+bool IsDirtyTrackingEnabled()
+{
+	return dirtyTracking;
+}
+
+const u8 *GetDirtyPages()
+{
+	return dirtyPages;
+}
+
+void ResetDirtyPages()
+{
+	if (!dirtyTracking)
+		return;
+
+	// Protect runs of dirty pages at once, writes tend to be clustered.
+	int page = 0;
+	while (page < DIRTY_PAGE_COUNT)
+	{
+		if (!dirtyPages[page])
+		{
+			page++;
+			continue;
+		}
+		int first = page;
+		while (page < DIRTY_PAGE_COUNT && dirtyPages[page])
+			dirtyPages[page++] = 0;
+		ProtectPages(first, page - first, true);
+	}
+}
+
+static int GetDirtyPage(u32 address)
+{
+	if ((address & 0x0E000000) == 0x08000000)
+		return (address & RAM_MASK) >> DIRTY_PAGE_SHIFT;
+	else if ((address & 0x0F000000) == 0x04000000)
+		return dirtyRegions[1].firstPage + ((address & VRAM_MASK) >> DIRTY_PAGE_SHIFT);
+	else if ((address & 0xFFFFC000) == 0x00010000)
+		return dirtyRegions[2].firstPage + ((address & SCRATCHPAD_MASK) >> DIRTY_PAGE_SHIFT);
+	else
+		return -1;
+}
+
+void MarkDirty(u32 address, u32 size)
+{
+	if ((!dirtyTracking && !cowActive) || size == 0)
+		return;
+
+	u32 addr = address;
+	u32 left = size;
+	while (left > 0)
+	{
+		u32 chunk = std::min(ContiguousSize(addr), left);
+		int first = GetDirtyPage(addr);
+		if (chunk == 0 || first < 0)
+			break;
+		int last = GetDirtyPage(addr + chunk - 1);
+		if (cowActive)
+		{
+			for (int page = first; page <= last; page++)
+				CopyOnWritePage(page);
+		}
+		ProtectPages(first, last - first + 1, false);
+		if (dirtyTracking)
+			memset(dirtyPages + first, 1, last - first + 1);
+		addr += chunk;
+		left -= chunk;
+	}
+}
+
+u8 *GetDirtyPagePointer(int page)
+{
+	for (int i = numDirtyRegions - 1; i >= 0; i--)
+	{
+		if (page >= dirtyRegions[i].firstPage)
+			return *dirtyRegions[i].views[0] + ((size_t)(page - dirtyRegions[i].firstPage) << DIRTY_PAGE_SHIFT);
+	}
+	return NULL;
+}
+
+bool BeginCopyOnWrite(u8 *dest)
+{
+	if (cowActive || !EnsureFaultHandler())
+		return false;
+
+	cowDest = dest;
+	for (int i = 0; i < DIRTY_PAGE_COUNT; i++)
+		cowState[i] = COW_PENDING;
+
+	// Pages that dirty tracking already let go of are writable, so they can't wait.
+	if (dirtyTracking)
+	{
+		for (int i = 0; i < DIRTY_PAGE_COUNT; i++)
+		{
+			if (dirtyPages[i])
+				CopyOnWritePage(i);
+		}
+	}
+
+	cowActive = true;
+	if (!dirtyTracking)
+		ProtectPages(0, DIRTY_PAGE_COUNT, true);
+	return true;
+}
+
+void CopyOnWriteRemaining()
+{
+	for (int i = 0; i < DIRTY_PAGE_COUNT; i++)
+	{
+		if (cowState[i] != COW_COPIED)
+			CopyOnWritePage(i);
+	}
+}
+
+void EndCopyOnWrite()
+{
+	if (!cowActive)
+		return;
+	CopyOnWriteRemaining();
+	cowActive = false;
+	cowDest = NULL;
+	UpdateProtection();
+}
+
 void Shutdown()
 {
+	EndCopyOnWrite();
+	DisableDirtyTracking();
 	u32 flags = 0;
 	MemoryMap_Shutdown(views, num_views, flags, &g_arena);
 	g_arena.ReleaseSpace();
@@ -139,23 +509,164 @@ void Write_Opcode_JIT(const u32 _Address, const u32 _Value)
 	Memory::WriteUnchecked_U32(_Value, _Address);
 }
 
-void Memset(const u32 _Address, const u8 _iValue, const u32 _iLength)
-{	
-	u8 *ptr = GetPointer(_Address);
-	if (ptr != NULL)
+// How many bytes from address onwards are contiguous in host memory. Mirrors wrap around,
+// so a range may need to be split at the end of each one. 0 if the address is invalid.
+u32 ContiguousSize(const u32 address)
+{
+	if ((address & 0x0E000000) == 0x08000000)
+		return RAM_SIZE - (address & RAM_MASK);
+	else if ((address & 0x0F000000) == 0x04000000)
+		return VRAM_SIZE - (address & VRAM_MASK);
+	else if ((address & 0xFFFFC000) == 0x00010000)
+		return SCRATCHPAD_SIZE - (address & SCRATCHPAD_MASK);
+	else
+		return 0;
+}
+
+bool IsValidRange(const u32 address, const u32 size)
+{
+	u32 addr = address;
+	u32 left = size;
+	while (left > 0)
+	{
+		u32 chunk = ContiguousSize(addr);
+		if (chunk == 0)
+			return false;
+		if (chunk >= left)
+			break;
+		addr += chunk;
+		left -= chunk;
+	}
+	return true;
+}
+
+// Nothing runs code out of VRAM, so writes there can skip the JIT.
+static bool MayHoldCode(const u32 address, const u32 size)
+{
+	if (size == 0)
+		return false;
+	return (address & 0x0F000000) != 0x04000000 || ContiguousSize(address) < size;
+}
+
+void NotifyMemoryWritten(const u32 address, const u32 size)
+{
+	if (MayHoldCode(address, size))
 	{
-		memset(ptr,_iValue,_iLength);
+		if (MIPSComp::jit)
+			MIPSComp::jit->GetBlockCache()->InvalidateICache(address, size);
+		MIPSAnalyst::InvalidateIdleLoopCache(address, size);
 	}
-	else
+	if (gpu)
+		gpu->InvalidateCache(address, size);
+	__SasInvalidateVagCache(address, size);
+}
+
+bool Memset(const u32 _Address, const u8 _iValue, const u32 _iLength)
+{
+	if (!IsValidRange(_Address, _iLength))
+	{
+		ERROR_LOG(MEMMAP, "Memset: Invalid range %08x, %08x bytes", _Address, _iLength);
+		return false;
+	}
+	NotifyMemoryWritten(_Address, _iLength);
+
+	u32 addr = _Address;
+	u32 left = _iLength;
+	while (left > 0)
+	{
+		u32 chunk = std::min(ContiguousSize(addr), left);
+		memset(GetPointer(addr), _iValue, chunk);
+		addr += chunk;
+		left -= chunk;
+	}
+	return true;
+}
+
+bool Memcpy(const u32 to_address, const void *from_data, const u32 len)
+{
+	if (!IsValidRange(to_address, len))
+	{
+		ERROR_LOG(MEMMAP, "Memcpy: Invalid destination range %08x, %08x bytes", to_address, len);
+		return false;
+	}
+	NotifyMemoryWritten(to_address, len);
+
+	const u8 *from = (const u8 *)from_data;
+	u32 addr = to_address;
+	u32 left = len;
+	while (left > 0)
+	{
+		u32 chunk = std::min(ContiguousSize(addr), left);
+		memcpy(GetPointer(addr), from, chunk);
+		from += chunk;
+		addr += chunk;
+		left -= chunk;
+	}
+	return true;
+}
+
+bool Memcpy(void *to_data, const u32 from_address, const u32 len)
+{
+	if (!IsValidRange(from_address, len))
+	{
+		ERROR_LOG(MEMMAP, "Memcpy: Invalid source range %08x, %08x bytes", from_address, len);
+		return false;
+	}
+
+	u8 *to = (u8 *)to_data;
+	u32 addr = from_address;
+	u32 left = len;
+	while (left > 0)
 	{
-		for (size_t i = 0; i < _iLength; i++)
-			Write_U8(_iValue, _Address + i);
+		u32 chunk = std::min(ContiguousSize(addr), left);
+		memcpy(to, GetPointer(addr), chunk);
+		to += chunk;
+		addr += chunk;
+		left -= chunk;
 	}
+	return true;
 }
 
-void Memcpy(const u32 address, const void *data, const u32 len)
+bool MemcpyGuestToGuest(const u32 to_address, const u32 from_address, const u32 len)
 {
-	memcpy(GetPointer(address), data, len);
+	if (!IsValidRange(to_address, len) || !IsValidRange(from_address, len))
+	{
+		ERROR_LOG(MEMMAP, "MemcpyGuestToGuest: Invalid range %08x -> %08x, %08x bytes", from_address, to_address, len);
+		return false;
+	}
+	// Compiled blocks replace their first instruction in memory, those get fixed up in the copy
+	// below. When that can't be done word by word, the source blocks have to go.
+	bool overlap = to_address < from_address + len && from_address < to_address + len;
+	bool fixupCode = MIPSComp::jit && MayHoldCode(from_address, len);
+	if (fixupCode && (overlap || ((to_address ^ from_address) & 3) != 0))
+	{
+		MIPSComp::jit->GetBlockCache()->InvalidateICache(from_address, len);
+		fixupCode = false;
+	}
+	NotifyMemoryWritten(to_address, len);
+
+	u32 to = to_address, from = from_address;
+	u32 left = len;
+	while (left > 0)
+	{
+		u32 chunk = std::min(std::min(ContiguousSize(to), ContiguousSize(from)), left);
+		memmove(GetPointer(to), GetPointer(from), chunk);
+		to += chunk;
+		from += chunk;
+		left -= chunk;
+	}
+
+	if (fixupCode)
+	{
+		// Only whole words can be block starts.
+		u32 start = (to_address + 3) & ~3;
+		for (u32 addr = start; addr + 4 <= to_address + len; addr += 4)
+		{
+			if (MIPS_IS_EMUHACK(ReadUnchecked_U32(addr)))
+				WriteUnchecked_U32(Read_Instruction(from_address + (addr - to_address)), addr);
+		}
+	}
+	return true;
 }
 
 void GetString(std::string& _string, const u32 em_address)
@@ -111,6 +111,38 @@ void Init();
 void Shutdown();
 void DoState(PointerWrap &p);
 
+// Dirty page tracking, for incremental savestates. While enabled, RAM, VRAM and the scratchpad
+// are write protected in every view, and the first write to a page marks it dirty and lifts the
+// protection for that page. Pages are numbered over RAM, then VRAM, then the scratchpad.
+enum
+{
+	DIRTY_PAGE_SHIFT = 12,
+	DIRTY_PAGE_SIZE = 1 << DIRTY_PAGE_SHIFT,
+	DIRTY_PAGE_COUNT = (RAM_SIZE + VRAM_SIZE + SCRATCHPAD_SIZE) >> DIRTY_PAGE_SHIFT,
+};
+
+// Returns false if the host can't trap writes, callers then have to treat all pages as dirty.
+bool EnableDirtyTracking();
+void DisableDirtyTracking();
+bool IsDirtyTrackingEnabled();
+// One flag per page, set if it was written since the last reset.
+const u8 *GetDirtyPages();
+// Clears the flags and protects the dirty pages again.
+void ResetDirtyPages();
+// The OS doesn't go through the fault handler when it writes to memory, a read() into a
+// protected page just fails. Host code that has the OS write into PSP memory calls this first.
+void MarkDirty(u32 address, u32 size);
+u8 *GetDirtyPagePointer(int page);
+
+// Copy on write snapshots of RAM, VRAM and the scratchpad, in dirty page order, into dest, which
+// must have room for DIRTY_PAGE_COUNT pages. Pages are copied when they're first written, or by
+// CopyOnWriteRemaining, which can run on any thread while emulation goes on. Returns false if the
+// host can't trap writes.
+bool BeginCopyOnWrite(u8 *dest);
+void CopyOnWriteRemaining();
+// Emu thread only. Finishes the copy if needed.
+void EndCopyOnWrite();
+
 void Clear();
 bool AreMemoryBreakpointsActivated();
 
@@ -205,8 +237,24 @@ inline const char* GetCharPointer(const u32 address) {
   return (const char *)GetPointer(address);
 }
 
-void Memset(const u32 _Address, const u8 _Data, const u32 _iLength);
-void Memcpy(const u32 _Address, const void *_Data, const u32 _iLength);
+// Returns true if [address, address + size) is entirely valid PSP memory.
+bool IsValidRange(const u32 address, const u32 size);
+// Bytes from address to the end of the mirror it's in, which are contiguous on the host too.
+// 0 if the address is invalid.
+u32 ContiguousSize(const u32 address);
+
+// Bulk memory operations. The whole range is validated up front, if any of it is invalid
+// nothing is written and false is returned. Ranges may cross mirror boundaries, they are split
+// up as needed. Anything that caches guest memory (the JIT, the texture cache) is told about
+// the written range.
+bool Memset(const u32 _Address, const u8 _Data, const u32 _iLength);
+bool Memcpy(const u32 to_address, const void *from_data, const u32 len);
+bool Memcpy(void *to_data, const u32 from_address, const u32 len);
+// Handles overlapping ranges, like memmove.
+bool MemcpyGuestToGuest(const u32 to_address, const u32 from_address, const u32 len);
+
+// Tells the JIT and the GPU that the CPU has written to a range behind their backs.
+void NotifyMemoryWritten(const u32 address, const u32 size);
 
 template<class T>
 void ReadStruct(u32 address, T *ptr)
@@ -49,7 +49,7 @@ u8 *GetPointer(const u32 address)
 	}
 	else if ((address & 0xFFFF0000) == 0x00010000)
 	{
-		return m_pScratchPad + (address & VRAM_MASK);
+		return m_pScratchPad + (address & SCRATCHPAD_MASK);
 	}
 	else
 	{
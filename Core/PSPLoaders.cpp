@@ -83,5 +83,5 @@ bool Load_PSP_ELF_PBP(const char *filename, std::string *error_string)
 	pspFileSystem.Mount("umd0:/", fs);
 
 	std::string finalName = "umd0:/" + file + extension;
-	return __KernelLoadExec(finalName.c_str(), 0, error_string);
+	return __KernelLoadExecFromHost(full_path, finalName.c_str(), error_string);
 }
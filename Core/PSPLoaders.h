@@ -21,5 +21,10 @@
 
 #include "MemMap.h"
 
+class BlockDevice;
+
+// A CSO or plain ISO block device, by extension.
+BlockDevice *constructBlockDevice(const char *filename);
+
 bool Load_PSP_ISO(const char *filename, std::string *error_string);
 bool Load_PSP_ELF_PBP(const char *filename, std::string *error_string);
@@ -0,0 +1,765 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <deque>
+#include <vector>
+
+#include "zlib.h"
+
+#include "Atomic.h"
+#include "ChunkFile.h"
+#include "FileUtil.h"
+#include "StdMutex.h"
+#include "Thread.h"
+
+#include "SaveState.h"
+#include "Config.h"
+#include "Core.h"
+#include "CoreTiming.h"
+#include "MemMap.h"
+#include "System.h"
+#include "MIPS/MIPS.h"
+#include "MIPS/MIPSAnalyst.h"
+#include "MIPS/JitCommon/JitCommon.h"
+#include "HLE/sceKernel.h"
+#include "../GPU/GPUState.h"
+#include "../GPU/GPUInterface.h"
+
+namespace SaveState
+{
+
+// Bump this whenever anything saved changes layout.
+static const int REVISION = 1;
+
+// The oldest rewind snapshots are dropped beyond this.
+static const size_t MAX_SNAPSHOTS = 60;
+
+enum OperationType
+{
+	SAVESTATE_SAVE,
+	SAVESTATE_LOAD,
+	SAVESTATE_REWIND,
+};
+
+struct Operation
+{
+	Operation(OperationType t, const std::string &f, Callback cb, void *data)
+		: type(t), filename(f), callback(cb), cbUserData(data)
+	{
+	}
+
+	OperationType type;
+	std::string filename;
+	Callback callback;
+	void *cbUserData;
+};
+
+typedef void (*DoSectionFunc)(PointerWrap &p);
+
+static void DoCpuSection(PointerWrap &p)
+{
+	CoreTiming::DoState(p);
+	currentMIPS->DoState(p);
+	p.DoMarker("CPU");
+}
+
+static void DoKernelSection(PointerWrap &p)
+{
+	__KernelDoState(p);
+	p.DoMarker("Kernel");
+}
+
+static void DoGpuSection(PointerWrap &p)
+{
+	p.Do(gstate);
+	if (gpu)
+		gpu->DoState(p);
+	p.DoMarker("GPU");
+}
+
+// Everything in a state, in order. Rewind snapshots leave out memory, it's handled by pages.
+class StateWrapper
+{
+public:
+	StateWrapper(bool _includeMemory) : includeMemory(_includeMemory), failed(false) {}
+
+	void DoState(PointerWrap &p)
+	{
+		// Loading into a different kind of GPU would mean recreating it, not worth it.
+		bool loading = p.GetMode() == PointerWrap::MODE_READ;
+		int gpuCore = PSP_CoreParameter().gpuCore;
+		p.Do(gpuCore);
+		if (loading && gpuCore != PSP_CoreParameter().gpuCore)
+		{
+			ERROR_LOG(COMMON, "Savestate is for a different GPU backend (%i)", gpuCore);
+			failed = true;
+			return;
+		}
+
+		DoCpuSection(p);
+		if (includeMemory)
+			Memory::DoState(p);
+		DoKernelSection(p);
+		DoGpuSection(p);
+
+		// Anything that goes wrong while loading switches the mode to measure.
+		if (loading && p.GetMode() != PointerWrap::MODE_READ)
+			failed = true;
+	}
+
+	bool includeMemory;
+	bool failed;
+};
+
+// State files are split into sections that are compressed separately, and listed in an index
+// after the header so that each can be found without reading the others. Memory sections are
+// raw, the others are PointerWrap data.
+enum Section
+{
+	SECTION_CPU,
+	SECTION_RAM,
+	SECTION_VRAM,
+	SECTION_SCRATCHPAD,
+	SECTION_KERNEL,
+	SECTION_GPU,
+
+	SECTION_COUNT,
+};
+
+struct SectionInfo
+{
+	char id[4];
+	DoSectionFunc func;
+	// Memory sections only, in dirty page numbering.
+	int firstPage;
+	u32 size;
+};
+
+// Also the order they're loaded in.
+static const SectionInfo sectionInfo[SECTION_COUNT] =
+{
+	{{'C', 'P', 'U', ' '}, &DoCpuSection, 0, 0},
+	{{'R', 'A', 'M', ' '}, NULL, 0, Memory::RAM_SIZE},
+	{{'V', 'R', 'A', 'M'}, NULL, Memory::RAM_SIZE >> Memory::DIRTY_PAGE_SHIFT, Memory::VRAM_SIZE},
+	{{'S', 'C', 'R', 'P'}, NULL, (Memory::RAM_SIZE + Memory::VRAM_SIZE) >> Memory::DIRTY_PAGE_SHIFT, Memory::SCRATCHPAD_SIZE},
+	{{'K', 'E', 'R', 'N'}, &DoKernelSection, 0, 0},
+	{{'G', 'P', 'U', ' '}, &DoGpuSection, 0, 0},
+};
+
+static const char STATE_MAGIC[8] = {'P', 'P', 'S', 'S', 'T', 'A', 'T', 'E'};
+// Of the container, REVISION covers what's in the sections.
+static const u32 STATE_FORMAT_VERSION = 1;
+static const u32 MAX_SECTIONS = 64;
+
+struct StateFileHeader
+{
+	char magic[8];
+	u32 version;
+	u32 revision;
+	s32 gpuCore;
+	u32 numSections;
+};
+
+struct StateSectionHeader
+{
+	char id[4];
+	u32 size;
+	u32 compressedSize;
+	// adler32 of the uncompressed data.
+	u32 checksum;
+	// From the start of the file.
+	u64 offset;
+};
+
+// Files are written on a thread of their own. Memory is grabbed copy on write, so the emu
+// thread only serializes the small sections and goes on with the next frame.
+struct SaveJob
+{
+	SaveJob(const Operation &op) : filename(op.filename), callback(op.callback), cbUserData(op.cbUserData),
+		memory(NULL), copyOnWrite(false), thread(NULL), done(0), result(false)
+	{
+	}
+
+	std::string filename;
+	Callback callback;
+	void *cbUserData;
+
+	s32 gpuCore;
+	// The PointerWrap sections, the memory ones come from memory.
+	std::vector<u8> sections[SECTION_COUNT];
+	// RAM, VRAM and the scratchpad, in dirty page order.
+	u8 *memory;
+	bool copyOnWrite;
+	std::vector<MIPSComp::OriginalOp> originalOps;
+
+	std::thread *thread;
+	volatile u32 done;
+	bool result;
+};
+
+struct Snapshot
+{
+	// Everything but memory.
+	std::vector<u8> state;
+	// The pages written between the previous snapshot and this one, as they were at the previous.
+	std::vector<int> undoPages;
+	std::vector<u8> undoData;
+};
+
+static std::recursive_mutex mutex;
+static std::vector<Operation> pending;
+
+static SaveJob *saveJob = NULL;
+
+static std::deque<Snapshot *> snapshots;
+// Memory as of the latest snapshot, with the JIT's emuhacks taken out.
+static std::vector<u8> shadow;
+static int framesSinceSnapshot = 0;
+static bool snapshotDue = false;
+
+static void Enqueue(const Operation &op)
+{
+	std::lock_guard<std::recursive_mutex> guard(mutex);
+	pending.push_back(op);
+}
+
+void Save(const std::string &filename, Callback callback, void *cbUserData)
+{
+	Enqueue(Operation(SAVESTATE_SAVE, filename, callback, cbUserData));
+}
+
+void Load(const std::string &filename, Callback callback, void *cbUserData)
+{
+	Enqueue(Operation(SAVESTATE_LOAD, filename, callback, cbUserData));
+}
+
+void Rewind(Callback callback, void *cbUserData)
+{
+	Enqueue(Operation(SAVESTATE_REWIND, "", callback, cbUserData));
+}
+
+static void SaveToRam(std::vector<u8> &data, bool includeMemory)
+{
+	StateWrapper state(includeMemory);
+	u8 *ptr = 0;
+	PointerWrap p(&ptr, PointerWrap::MODE_MEASURE);
+	state.DoState(p);
+	data.resize((size_t)ptr);
+
+	ptr = &data[0];
+	p.SetMode(PointerWrap::MODE_WRITE);
+	state.DoState(p);
+}
+
+static bool LoadFromRam(std::vector<u8> &data, bool includeMemory)
+{
+	StateWrapper state(includeMemory);
+	u8 *ptr = &data[0];
+	PointerWrap p(&ptr, PointerWrap::MODE_READ);
+	state.DoState(p);
+	return !state.failed;
+}
+
+// Compiled blocks have emuhacks in memory and the old state baked in. Clearing the cache puts
+// the original ops back, so this has to happen before memory is loaded.
+static void PrepareLoad()
+{
+	if (MIPSComp::jit)
+		MIPSComp::jit->ClearCache();
+	MIPSAnalyst::ClearIdleLoopCache();
+}
+
+static void FinishLoad()
+{
+	ReapplyGfxState();
+}
+
+static void SaveSection(DoSectionFunc func, std::vector<u8> &data)
+{
+	u8 *ptr = 0;
+	PointerWrap p(&ptr, PointerWrap::MODE_MEASURE);
+	func(p);
+	data.resize((size_t)ptr);
+
+	ptr = &data[0];
+	p.SetMode(PointerWrap::MODE_WRITE);
+	func(p);
+}
+
+static void GetSectionData(const SaveJob *job, int section, const u8 *&data, u32 &size)
+{
+	const SectionInfo &info = sectionInfo[section];
+	if (info.func)
+	{
+		data = &job->sections[section][0];
+		size = (u32)job->sections[section].size();
+	}
+	else
+	{
+		data = job->memory + ((size_t)info.firstPage << Memory::DIRTY_PAGE_SHIFT);
+		size = info.size;
+	}
+}
+
+// Streams the section through deflate into the file, buffer holds the output in between.
+static bool WriteSection(File::IOFile &file, const u8 *data, u32 size, std::vector<u8> &buffer, StateSectionHeader &header)
+{
+	header.size = size;
+	header.checksum = adler32(adler32(0L, Z_NULL, 0), data, size);
+	header.offset = file.Tell();
+
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	// Speed over size, it's running alongside the game.
+	if (deflateInit(&stream, Z_BEST_SPEED) != Z_OK)
+		return false;
+
+	stream.next_in = (Bytef *)data;
+	stream.avail_in = size;
+	int ret;
+	do
+	{
+		stream.next_out = &buffer[0];
+		stream.avail_out = (uInt)buffer.size();
+		ret = deflate(&stream, Z_FINISH);
+		if (!file.WriteBytes(&buffer[0], buffer.size() - stream.avail_out))
+			ret = Z_ERRNO;
+	}
+	while (ret == Z_OK);
+	deflateEnd(&stream);
+
+	header.compressedSize = (u32)(file.Tell() - header.offset);
+	return ret == Z_STREAM_END;
+}
+
+static bool WriteStateFile(SaveJob *job)
+{
+	// Write to the side, so that a failed save doesn't take the old state with it.
+	std::string tempFilename = job->filename + ".tmp";
+	{
+		File::IOFile file(tempFilename, "wb");
+		if (!file)
+			return false;
+
+		StateFileHeader header;
+		memcpy(header.magic, STATE_MAGIC, sizeof(header.magic));
+		header.version = STATE_FORMAT_VERSION;
+		header.revision = REVISION;
+		header.gpuCore = job->gpuCore;
+		header.numSections = SECTION_COUNT;
+
+		// The index is written again at the end, once the offsets are known.
+		StateSectionHeader index[SECTION_COUNT];
+		memset(index, 0, sizeof(index));
+		if (!file.WriteArray(&header, 1) || !file.WriteArray(index, SECTION_COUNT))
+			return false;
+
+		std::vector<u8> buffer(256 * 1024);
+		for (int i = 0; i < SECTION_COUNT; i++)
+		{
+			memcpy(index[i].id, sectionInfo[i].id, sizeof(index[i].id));
+			const u8 *data;
+			u32 size;
+			GetSectionData(job, i, data, size);
+			if (!WriteSection(file, data, size, buffer, index[i]))
+				return false;
+		}
+
+		if (!file.Seek(sizeof(header), SEEK_SET) || !file.WriteArray(index, SECTION_COUNT))
+			return false;
+	}
+
+	File::Delete(job->filename);
+	return File::Rename(tempFilename, job->filename);
+}
+
+static void SaveThread(SaveJob *job)
+{
+	Common::SetCurrentThreadName("Savestate writer");
+
+	if (job->copyOnWrite)
+		Memory::CopyOnWriteRemaining();
+	MIPSComp::RestoreOriginalOps(job->memory, PSP_GetKernelMemoryBase(), Memory::RAM_SIZE, job->originalOps);
+
+	job->result = WriteStateFile(job);
+	Common::AtomicStoreRelease(job->done, 1);
+}
+
+// Waits for the save in progress, if any, and reports how it went.
+static void FinishSave()
+{
+	if (!saveJob)
+		return;
+
+	SaveJob *job = saveJob;
+	saveJob = NULL;
+	job->thread->join();
+	delete job->thread;
+	if (job->copyOnWrite)
+		Memory::EndCopyOnWrite();
+
+	if (job->result)
+	{
+		INFO_LOG(COMMON, "Saved state to %s", job->filename.c_str());
+	}
+	else
+	{
+		ERROR_LOG(COMMON, "Failed to save state to %s", job->filename.c_str());
+	}
+	if (job->callback)
+		job->callback(job->result, job->cbUserData);
+
+	delete [] job->memory;
+	delete job;
+}
+
+static void StartSave(const Operation &op)
+{
+	// One at a time.
+	FinishSave();
+
+	SaveJob *job = new SaveJob(op);
+	job->gpuCore = PSP_CoreParameter().gpuCore;
+	for (int i = 0; i < SECTION_COUNT; i++)
+	{
+		if (sectionInfo[i].func)
+			SaveSection(sectionInfo[i].func, job->sections[i]);
+	}
+
+	// Not touched until needed, so that only the pages actually copied cost anything here.
+	job->memory = new u8[(size_t)Memory::DIRTY_PAGE_COUNT << Memory::DIRTY_PAGE_SHIFT];
+	MIPSComp::GetOriginalOps(job->originalOps);
+	job->copyOnWrite = Memory::BeginCopyOnWrite(job->memory);
+	if (!job->copyOnWrite)
+	{
+		for (int i = 0; i < Memory::DIRTY_PAGE_COUNT; i++)
+			memcpy(job->memory + ((size_t)i << Memory::DIRTY_PAGE_SHIFT), Memory::GetDirtyPagePointer(i), Memory::DIRTY_PAGE_SIZE);
+	}
+
+	job->thread = new std::thread(SaveThread, job);
+	saveJob = job;
+}
+
+static bool ReadSection(File::IOFile &file, const StateSectionHeader &header, u8 *dest)
+{
+	std::vector<u8> compressed(header.compressedSize);
+	if (compressed.empty() || !file.Seek(header.offset, SEEK_SET) || !file.ReadBytes(&compressed[0], compressed.size()))
+		return false;
+
+	uLongf destLen = header.size;
+	if (uncompress(dest, &destLen, &compressed[0], header.compressedSize) != Z_OK || destLen != header.size)
+		return false;
+	return adler32(adler32(0L, Z_NULL, 0), dest, header.size) == header.checksum;
+}
+
+static bool LoadSection(File::IOFile &file, int section, const StateSectionHeader &header)
+{
+	const SectionInfo &info = sectionInfo[section];
+
+	// Memory goes straight where it belongs.
+	if (!info.func)
+		return header.size == info.size && ReadSection(file, header, Memory::GetDirtyPagePointer(info.firstPage));
+
+	std::vector<u8> data(header.size);
+	if (data.empty() || !ReadSection(file, header, &data[0]))
+		return false;
+
+	u8 *ptr = &data[0];
+	PointerWrap p(&ptr, PointerWrap::MODE_READ);
+	info.func(p);
+	return p.GetMode() == PointerWrap::MODE_READ && ptr == &data[0] + data.size();
+}
+
+static bool LoadFile(const std::string &filename)
+{
+	File::IOFile file(filename, "rb");
+	StateFileHeader header;
+	if (!file || !file.ReadArray(&header, 1) || memcmp(header.magic, STATE_MAGIC, sizeof(header.magic)) != 0)
+	{
+		ERROR_LOG(COMMON, "%s is not a savestate", filename.c_str());
+		return false;
+	}
+	if (header.version != STATE_FORMAT_VERSION || header.revision != REVISION)
+	{
+		ERROR_LOG(COMMON, "Savestate %s is from another version (%i/%i)", filename.c_str(), header.version, header.revision);
+		return false;
+	}
+	if (header.gpuCore != PSP_CoreParameter().gpuCore)
+	{
+		ERROR_LOG(COMMON, "Savestate is for a different GPU backend (%i)", header.gpuCore);
+		return false;
+	}
+
+	std::vector<StateSectionHeader> index(header.numSections);
+	if (header.numSections == 0 || header.numSections > MAX_SECTIONS || !file.ReadArray(&index[0], index.size()))
+	{
+		ERROR_LOG(COMMON, "Savestate %s has a bad index", filename.c_str());
+		return false;
+	}
+
+	const StateSectionHeader *sections[SECTION_COUNT];
+	for (int i = 0; i < SECTION_COUNT; i++)
+	{
+		sections[i] = NULL;
+		for (size_t j = 0; j < index.size(); j++)
+		{
+			if (memcmp(index[j].id, sectionInfo[i].id, sizeof(index[j].id)) == 0)
+				sections[i] = &index[j];
+		}
+		if (!sections[i])
+		{
+			ERROR_LOG(COMMON, "Savestate %s has no %.4s section", filename.c_str(), sectionInfo[i].id);
+			return false;
+		}
+	}
+
+	// A state that turns out to be bad halfway through leaves a mess, so keep the current one.
+	std::vector<u8> backup;
+	SaveToRam(backup, true);
+
+	PrepareLoad();
+	bool result = true;
+	for (int i = 0; i < SECTION_COUNT && result; i++)
+	{
+		result = LoadSection(file, i, *sections[i]);
+		if (!result)
+			ERROR_LOG(COMMON, "Savestate %s: bad %.4s section, going back to where we were", filename.c_str(), sectionInfo[i].id);
+	}
+	if (!result)
+	{
+		PrepareLoad();
+		LoadFromRam(backup, true);
+	}
+	FinishLoad();
+	return result;
+}
+
+static void ClearSnapshots()
+{
+	for (size_t i = 0; i < snapshots.size(); i++)
+		delete snapshots[i];
+	snapshots.clear();
+	std::vector<u8>().swap(shadow);
+	framesSinceSnapshot = 0;
+	Memory::DisableDirtyTracking();
+}
+
+static u8 *GetShadowPage(int page)
+{
+	return &shadow[(size_t)page << Memory::DIRTY_PAGE_SHIFT];
+}
+
+static void GetDirtyPageList(std::vector<int> &pages)
+{
+	pages.clear();
+	if (Memory::IsDirtyTrackingEnabled())
+	{
+		const u8 *dirty = Memory::GetDirtyPages();
+		for (int i = 0; i < Memory::DIRTY_PAGE_COUNT; i++)
+		{
+			if (dirty[i])
+				pages.push_back(i);
+		}
+	}
+	else
+	{
+		// No way to trap writes here, compare instead. Much slower, but still cheaper than a
+		// full copy for every snapshot.
+		for (int i = 0; i < Memory::DIRTY_PAGE_COUNT; i++)
+		{
+			if (memcmp(Memory::GetDirtyPagePointer(i), GetShadowPage(i), Memory::DIRTY_PAGE_SIZE) != 0)
+				pages.push_back(i);
+		}
+	}
+}
+
+// The page no longer matches the shadow copy.
+static void MarkPageDirty(int page)
+{
+	u32 offset = (u32)page << Memory::DIRTY_PAGE_SHIFT;
+	u32 address;
+	if (offset < Memory::RAM_SIZE)
+		address = PSP_GetKernelMemoryBase() + offset;
+	else if (offset < Memory::RAM_SIZE + Memory::VRAM_SIZE)
+		address = PSP_GetVidMemBase() + offset - Memory::RAM_SIZE;
+	else
+		address = 0x00010000 + offset - Memory::RAM_SIZE - Memory::VRAM_SIZE;
+	Memory::MarkDirty(address, Memory::DIRTY_PAGE_SIZE);
+}
+
+static void TakeSnapshot()
+{
+	Snapshot *snap = new Snapshot;
+	if (snapshots.empty())
+	{
+		shadow.resize((size_t)Memory::DIRTY_PAGE_COUNT << Memory::DIRTY_PAGE_SHIFT);
+		for (int i = 0; i < Memory::DIRTY_PAGE_COUNT; i++)
+			memcpy(GetShadowPage(i), Memory::GetDirtyPagePointer(i), Memory::DIRTY_PAGE_SIZE);
+		Memory::EnableDirtyTracking();
+	}
+	else
+	{
+		GetDirtyPageList(snap->undoPages);
+		snap->undoData.resize(snap->undoPages.size() << Memory::DIRTY_PAGE_SHIFT);
+		for (size_t i = 0; i < snap->undoPages.size(); i++)
+		{
+			int page = snap->undoPages[i];
+			memcpy(&snap->undoData[i << Memory::DIRTY_PAGE_SHIFT], GetShadowPage(page), Memory::DIRTY_PAGE_SIZE);
+			memcpy(GetShadowPage(page), Memory::GetDirtyPagePointer(page), Memory::DIRTY_PAGE_SIZE);
+		}
+	}
+	MIPSComp::RestoreOriginalOps(&shadow[0], PSP_GetKernelMemoryBase(), Memory::RAM_SIZE);
+	Memory::ResetDirtyPages();
+
+	SaveToRam(snap->state, false);
+	snapshots.push_back(snap);
+
+	if (snapshots.size() > MAX_SNAPSHOTS)
+	{
+		delete snapshots.front();
+		snapshots.pop_front();
+		// Nothing to go back to from the new oldest one.
+		std::vector<int>().swap(snapshots.front()->undoPages);
+		std::vector<u8>().swap(snapshots.front()->undoData);
+	}
+	framesSinceSnapshot = 0;
+}
+
+static bool RewindToSnapshot()
+{
+	if (snapshots.empty())
+		return false;
+
+	PrepareLoad();
+
+	// Back to the latest snapshot: only the pages written since differ from the shadow copy.
+	std::vector<int> dirty;
+	GetDirtyPageList(dirty);
+	for (size_t i = 0; i < dirty.size(); i++)
+		memcpy(Memory::GetDirtyPagePointer(dirty[i]), GetShadowPage(dirty[i]), Memory::DIRTY_PAGE_SIZE);
+	Memory::ResetDirtyPages();
+
+	Snapshot *snap = snapshots.back();
+	bool result = LoadFromRam(snap->state, false);
+	if (!result)
+		ERROR_LOG(COMMON, "Failed to load rewind snapshot");
+
+	// Step the shadow copy back to the snapshot before, so that the next rewind goes further.
+	// The oldest one stays, there's nothing before it.
+	if (snapshots.size() > 1)
+	{
+		for (size_t i = 0; i < snap->undoPages.size(); i++)
+		{
+			int page = snap->undoPages[i];
+			memcpy(GetShadowPage(page), &snap->undoData[i << Memory::DIRTY_PAGE_SHIFT], Memory::DIRTY_PAGE_SIZE);
+			MarkPageDirty(page);
+		}
+		delete snap;
+		snapshots.pop_back();
+	}
+
+	framesSinceSnapshot = 0;
+	FinishLoad();
+	return result;
+}
+
+bool NextFrame()
+{
+	if (g_Config.iRewindSnapshotInterval > 0 && ++framesSinceSnapshot >= g_Config.iRewindSnapshotInterval)
+		snapshotDue = true;
+	else if (g_Config.iRewindSnapshotInterval <= 0 && !snapshots.empty())
+		snapshotDue = true;  // To drop them.
+
+	if (saveJob && Common::AtomicLoadAcquire(saveJob->done))
+		return true;
+
+	std::lock_guard<std::recursive_mutex> guard(mutex);
+	return snapshotDue || !pending.empty();
+}
+
+void Process()
+{
+	if (saveJob && Common::AtomicLoadAcquire(saveJob->done))
+		FinishSave();
+
+	std::vector<Operation> operations;
+	{
+		std::lock_guard<std::recursive_mutex> guard(mutex);
+		operations.swap(pending);
+	}
+
+	bool stateChanged = false;
+	for (size_t i = 0; i < operations.size(); i++)
+	{
+		const Operation &op = operations[i];
+		bool result = false;
+		switch (op.type)
+		{
+		case SAVESTATE_SAVE:
+			// Finishes in the background, the callback is called from FinishSave.
+			INFO_LOG(COMMON, "Saving state to %s", op.filename.c_str());
+			StartSave(op);
+			continue;
+
+		case SAVESTATE_LOAD:
+			INFO_LOG(COMMON, "Loading state from %s", op.filename.c_str());
+			result = LoadFile(op.filename);
+			if (result)
+			{
+				// The snapshots are of a different timeline now.
+				ClearSnapshots();
+				stateChanged = true;
+			}
+			else
+				ERROR_LOG(COMMON, "Failed to load state from %s", op.filename.c_str());
+			break;
+
+		case SAVESTATE_REWIND:
+			result = RewindToSnapshot();
+			stateChanged = result;
+			break;
+		}
+
+		if (op.callback)
+			op.callback(result, op.cbUserData);
+	}
+
+	if (snapshotDue)
+	{
+		snapshotDue = false;
+		if (g_Config.iRewindSnapshotInterval <= 0)
+			ClearSnapshots();
+		else if (!stateChanged)
+			TakeSnapshot();
+	}
+
+	if (coreState == CORE_NEXTFRAME)
+		coreState = CORE_RUNNING;
+}
+
+void Shutdown()
+{
+	{
+		std::lock_guard<std::recursive_mutex> guard(mutex);
+		pending.clear();
+	}
+	FinishSave();
+	ClearSnapshots();
+	snapshotDue = false;
+}
+
+}  // namespace SaveState
@@ -0,0 +1,65 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <string>
+
+#include "../Globals.h"
+
+// Savestates and rewind.
+//
+// A state is everything: CoreTiming, the CPU, memory, the kernel and HLE modules and the GPU.
+// States can only be taken between frames, so all requests are queued and carried out by
+// Process() on the emu thread. At each vblank the core stops with CORE_NEXTFRAME if there's
+// anything to do, and the run loop calls Process() before going on.
+//
+// State files are made of separately zlib compressed sections (CPU, RAM, VRAM, scratchpad,
+// kernel, GPU) with an index up front. Saving only serializes the small sections on the emu
+// thread. Memory is snapshotted copy on write and compressed and written on another thread,
+// while the game goes on.
+//
+// Rewind snapshots are incremental. The first one copies all of memory into a shadow copy, and
+// write protects it (see Memory::EnableDirtyTracking). Each later snapshot only copies the pages
+// written since, keeping their old contents so that earlier snapshots can be restored as well.
+// Everything else is small and saved in full every time.
+
+namespace SaveState
+{
+
+typedef void (*Callback)(bool status, void *cbUserData);
+
+// Queue a save or load of a state file. The callback, if any, is called from the emu thread,
+// for saves once the file has been written.
+void Save(const std::string &filename, Callback callback = 0, void *cbUserData = 0);
+void Load(const std::string &filename, Callback callback = 0, void *cbUserData = 0);
+
+// Go back to the last rewind snapshot. Repeated calls go further back, as far as there are
+// snapshots. Snapshots are taken every g_Config.iRewindSnapshotInterval frames, 0 disables them.
+void Rewind(Callback callback = 0, void *cbUserData = 0);
+
+// Called at each vblank on the emu thread. Returns true if Process() needs to run before the
+// next frame.
+bool NextFrame();
+
+// Carries out queued requests and takes rewind snapshots. Emu thread only, between frames.
+void Process();
+
+// Drops the rewind snapshots and stops dirty page tracking.
+void Shutdown();
+
+}  // namespace SaveState
@@ -19,17 +19,16 @@
 
 #include "MIPS/MIPS.h"
 
-#ifdef ANDROID
-#include "MIPS/ARM/Jit.h"
-#else
-#include "MIPS/x86/Jit.h"
-#endif
+#include "MIPS/JitCommon/JitCommon.h"
 
 #include "System.h"
+#include "SaveState.h"
 // Bad dependency
 #include "GPU/GLES/Framebuffer.h"
 #include "GPU/GLES/TextureCache.h"
 #include "GPU/GLES/ShaderManager.h"
+#include "GPU/GLES/DisplayListInterpreter.h"
+#include "GPU/Software/SoftGpu.h"
 
 #include "PSPMixer.h"
 #include "HLE/HLE.h"
@@ -80,7 +79,21 @@ bool PSP_Init(const CoreParameter &coreParam, std::string *error_string)
 		return false;
 	}
 
-	if (coreParameter.gpuCore != GPU_NULL)
+	switch (coreParameter.gpuCore)
+	{
+	case GPU_GLES:
+		gpu = new GLES_GPU();
+		break;
+	case GPU_SOFTWARE:
+		gpu = new SoftGPU();
+		break;
+	default:
+		gpu = 0;
+		break;
+	}
+
+	// The software renderer still needs GL to show its output, but not when running headless.
+	if (coreParameter.gpuCore != GPU_NULL && !coreParameter.headLess)
 	{
 		DisplayDrawer_Init();
 	}
@@ -116,10 +129,21 @@ void PSP_Shutdown()
 	}
 	__KernelShutdown();
 	HLEShutdown();
-	if (coreParameter.gpuCore != GPU_NULL)
+	if (coreParameter.cpuCore == CPU_JIT)
+	{
+		MIPSComp::LogGenericFallbacks();
+		MIPSComp::ResetGenericFallbacks();
+		MIPSComp::LogJitCacheStats();
+		MIPSComp::ResetJitCacheStats();
+		MIPSComp::ShutdownBlockProfile();
+	}
+	if (coreParameter.gpuCore != GPU_NULL && !coreParameter.headLess)
 	{
 		DisplayDrawer_Shutdown();
 	}
+	delete gpu;
+	gpu = 0;
+	SaveState::Shutdown();
 	Memory::Shutdown() ;
 	currentCPU = 0;
 }
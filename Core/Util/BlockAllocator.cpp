@@ -1,8 +1,7 @@
 #include "BlockAllocator.h"
+#include "ChunkFile.h"
 
-// Slow freaking thing but works (eventually) :)
-
-BlockAllocator::BlockAllocator()
+BlockAllocator::BlockAllocator() : totalFree(0)
 {
 	blocks.clear();
 }
@@ -16,74 +15,139 @@ void BlockAllocator::Init(u32 _rangeStart, u32 _rangeSize)
 {
 	Shutdown();
 	//Initial block, covering everything
-	blocks.push_back(Block(_rangeStart, _rangeSize, false));
+	Block b(_rangeStart, _rangeSize, false);
+	InsertBlock(b);
+	AddFree(b);
 }
 
 
 void BlockAllocator::Shutdown()
 {
 	blocks.clear();
+	for (int i = 0; i < NUM_SIZE_CLASSES; i++)
+		freeLists[i].clear();
+	totalFree = 0;
 }
 
-u32 BlockAllocator::Alloc(u32 &size, bool fromEnd, const char *tag)
+int BlockAllocator::SizeClass(u32 size)
 {
-	//upalign size
-	size = (size+15) & ~15;
+	int sizeClass = 0;
+	while (size >>= 1)
+		sizeClass++;
+	return sizeClass;
+}
+
+void BlockAllocator::AddFree(const Block &b)
+{
+	freeLists[SizeClass(b.size)].insert(std::make_pair(b.start, b.size));
+	totalFree += b.size;
+}
+
+void BlockAllocator::RemoveFree(const Block &b)
+{
+	freeLists[SizeClass(b.size)].erase(b.start);
+	totalFree -= b.size;
+}
+
+BlockAllocator::BlockMap::iterator BlockAllocator::InsertBlock(const Block &b)
+{
+	return blocks.insert(std::make_pair(b.start, b)).first;
+}
+
+BlockAllocator::BlockMap::iterator BlockAllocator::FindFreeBlock(u32 size, bool fromEnd)
+{
+	int sizeClass = SizeClass(size);
+	bool found = false;
+	u32 best = 0;
+
+	// Everything in a larger class fits, so only the lowest (highest) address of each matters.
+	for (int i = sizeClass + 1; i < NUM_SIZE_CLASSES; i++)
+	{
+		const FreeList &list = freeLists[i];
+		if (list.empty())
+			continue;
+		u32 candidate = fromEnd ? list.rbegin()->first : list.begin()->first;
+		if (!found || (fromEnd ? candidate > best : candidate < best))
+		{
+			best = candidate;
+			found = true;
+		}
+	}
 
+	// Blocks in the requested size's own class may be too small, walk them in address order,
+	// but only as far as the best candidate found so far.
+	const FreeList &list = freeLists[sizeClass];
 	if (!fromEnd)
 	{
-		//Allocate from start of mem
-		for (std::list<Block>::iterator iter = blocks.begin(); iter != blocks.end(); iter++)
+		for (FreeList::const_iterator iter = list.begin(); iter != list.end() && (!found || iter->first < best); ++iter)
 		{
-			BlockAllocator::Block &b = *iter;
-			if (b.taken == false && b.size >= size)
+			if (iter->second >= size)
 			{
-				if (b.size == size)
-				{
-					b.taken = true;
-					b.SetTag(tag);
-					return b.start;
-				}
-				else
-				{
-					blocks.insert(++iter, Block(b.start+size, b.size-size, false));
-					b.taken = true;
-					b.size = size;
-					b.SetTag(tag);
-					return b.start;
-				}
-				//Got one!
+				best = iter->first;
+				found = true;
+				break;
 			}
 		}
 	}
 	else
 	{
-		for (std::list<Block>::reverse_iterator iter = blocks.rbegin(); iter != blocks.rend(); ++iter)
+		for (FreeList::const_reverse_iterator iter = list.rbegin(); iter != list.rend() && (!found || iter->first > best); ++iter)
 		{
-			std::list<Block>::reverse_iterator hey = iter;
-			BlockAllocator::Block &b = *((++hey).base()); //yes, confusing syntax. reverse_iterators are confusing
-			if (b.taken == false && b.size >= size)
+			if (iter->second >= size)
 			{
-				if (b.size == size)
-				{
-					b.taken = true;
-					b.SetTag(tag);
-					return b.start;
-				}
-				else
-				{
-					blocks.insert(hey.base(), Block(b.start, b.size-size, false));
-					b.taken = true;
-					b.start += b.size-size;
-					b.size = size;
-					b.SetTag(tag);
-					return b.start;
-				}
-				//Got one!
+				best = iter->first;
+				found = true;
+				break;
 			}
 		}
 	}
 
+	if (!found)
+		return blocks.end();
+	return blocks.find(best);
+}
+
+u32 BlockAllocator::Alloc(u32 &size, bool fromEnd, const char *tag)
+{
+	//upalign size
+	size = (size+15) & ~15;
+	// A zero sized block would share its start address with the next one.
+	if (size == 0)
+		size = 16;
+
+	BlockMap::iterator iter = FindFreeBlock(size, fromEnd);
+	if (iter != blocks.end())
+	{
+		Block &b = iter->second;
+		RemoveFree(b);
+		if (b.size == size)
+		{
+			b.taken = true;
+			b.SetTag(tag);
+			return b.start;
+		}
+		else if (!fromEnd)
+		{
+			Block rest(b.start + size, b.size - size, false);
+			InsertBlock(rest);
+			AddFree(rest);
+			b.taken = true;
+			b.size = size;
+			b.SetTag(tag);
+			return b.start;
+		}
+		else
+		{
+			// Take the end of the block, the start stays free.
+			Block taken(b.start + b.size - size, size, true);
+			taken.SetTag(tag);
+			b = Block(b.start, b.size - size, false);
+			AddFree(b);
+			InsertBlock(taken);
+			return taken.start;
+		}
+	}
+
 	//Out of memory :(
 	ListBlocks();
 	ERROR_LOG(HLE, "Block Allocator failed to allocate %i (%08x) bytes of contiguous memory", size, size);
@@ -94,41 +158,47 @@ u32 BlockAllocator::AllocAt(u32 position, u32 size, const char *tag)
 {
 	//upalign size
 	size=(size+15) & ~15;
-	std::list<Block>::iterator iter = GetBlockIterFromAddress(position);
+	if (size == 0)
+		size = 16;
+	BlockMap::iterator iter = GetBlockIterFromAddress(position);
 	if (iter != blocks.end())
 	{
-		Block &b = *iter;
+		Block &b = iter->second;
 		if (b.taken)
 		{
 			ERROR_LOG(HLE, "Block allocator AllocAt failed, block taken! %08x, %i", position, size);
 			return -1;
 		}
+		else if (position + size > b.start + b.size)
+		{
+			ERROR_LOG(HLE, "Block allocator AllocAt failed, free block too small! %08x, %i", position, size);
+		}
 		else
 		{
 			//good to go
+			u32 blockEnd = b.start + b.size;
+			RemoveFree(b);
 			if (b.start == position)
 			{
-				blocks.insert(++iter, Block(b.start + size, b.size - size, false));
 				b.taken = true;
 				b.size = size;
 				b.SetTag(tag);
-				return position;
 			}
 			else
 			{
-				int size1 = position - b.start;
-				blocks.insert(iter, Block(b.start, size1, false));
-				if (b.start + b.size > position + size)
-				{
-					iter++;
-					blocks.insert(iter, Block(position + size, b.size - (size + size1), false));
-				}
-				b.taken = true;
-				b.start = position;
-				b.size = size;
-				b.SetTag(tag);
-				return position;
+				b = Block(b.start, position - b.start, false);
+				AddFree(b);
+				Block taken(position, size, true);
+				taken.SetTag(tag);
+				InsertBlock(taken);
+			}
+			if (position + size < blockEnd)
+			{
+				Block rest(position + size, blockEnd - (position + size), false);
+				InsertBlock(rest);
+				AddFree(rest);
 			}
+			return position;
 		}
 	}
 	else
@@ -143,42 +213,70 @@ u32 BlockAllocator::AllocAt(u32 position, u32 size, const char *tag)
 	return -1;
 }
 
+void BlockAllocator::MergeAround(BlockMap::iterator iter)
+{
+	if (iter != blocks.begin())
+	{
+		BlockMap::iterator prev = iter;
+		--prev;
+		if (!prev->second.taken)
+		{
+			RemoveFree(prev->second);
+			prev->second.size += iter->second.size;
+			blocks.erase(iter);
+			iter = prev;
+		}
+	}
+
+	BlockMap::iterator next = iter;
+	++next;
+	if (next != blocks.end() && !next->second.taken)
+	{
+		RemoveFree(next->second);
+		iter->second.size += next->second.size;
+		blocks.erase(next);
+	}
+
+	AddFree(iter->second);
+}
+
 void BlockAllocator::MergeFreeBlocks()
 {
-	bool found;
-	do
+	BlockMap::iterator iter1 = blocks.begin();
+	while (iter1 != blocks.end())
 	{
-		found = false;
-		std::list<Block>::iterator iter1, iter2;
-		iter1 = blocks.begin();
-		iter2 = blocks.begin();
-		iter2++;
-		while (iter2 != blocks.end())
+		BlockMap::iterator iter2 = iter1;
+		++iter2;
+		if (iter2 == blocks.end())
+			break;
+
+		BlockAllocator::Block &b1 = iter1->second;
+		BlockAllocator::Block &b2 = iter2->second;
+		if (b1.taken == false && b2.taken == false)
 		{
-			BlockAllocator::Block &b1 = *iter1;
-			BlockAllocator::Block &b2 = *iter2;
-			
-			if (b1.taken == false && b2.taken == false)
-			{
-				DEBUG_LOG(HLE, "Block Alloc found adjacent free blocks - merging");
-				b1.size += b2.size;
-				blocks.erase(iter2);
-				found = true;
-				break; //iterators now invalid - we have to restart our search
-			}
-			iter1++;
-			iter2++;
+			DEBUG_LOG(HLE, "Block Alloc found adjacent free blocks - merging");
+			RemoveFree(b1);
+			RemoveFree(b2);
+			b1.size += b2.size;
+			blocks.erase(iter2);
+			AddFree(b1);
 		}
-	} while (found);
+		else
+			++iter1;
+	}
 }
 
 void BlockAllocator::Free(u32 position)
 {
-	BlockAllocator::Block *b = GetBlockFromAddress(position);
-	if (b)
+	BlockMap::iterator iter = GetBlockIterFromAddress(position);
+	if (iter != blocks.end())
 	{
-		b->taken = false;
-		MergeFreeBlocks();
+		// Freeing an already free block does nothing.
+		if (iter->second.taken)
+		{
+			iter->second.taken = false;
+			MergeAround(iter);
+		}
 	}
 	else
 	{
@@ -186,27 +284,26 @@ void BlockAllocator::Free(u32 position)
 	}
 }
 
-std::list<BlockAllocator::Block>::iterator BlockAllocator::GetBlockIterFromAddress(u32 addr)
+BlockAllocator::BlockMap::iterator BlockAllocator::GetBlockIterFromAddress(u32 addr)
 {
-	for (std::list<Block>::iterator iter = blocks.begin(); iter != blocks.end(); iter++)
-	{
-		BlockAllocator::Block &b = *iter;
-		if (b.start <= addr && b.start+b.size > addr)
-		{
-			// Got one!
-			return iter;
-		}
-	}
+	// The last block starting at or before addr is the only one that can contain it.
+	BlockMap::iterator iter = blocks.upper_bound(addr);
+	if (iter == blocks.begin())
+		return blocks.end();
+	--iter;
+	const Block &b = iter->second;
+	if (addr - b.start < b.size)
+		return iter;
 	return blocks.end();
 }
 
 BlockAllocator::Block *BlockAllocator::GetBlockFromAddress(u32 addr) 
 {
-	std::list<Block>::iterator iter = GetBlockIterFromAddress(addr);
+	BlockMap::iterator iter = GetBlockIterFromAddress(addr);
 	if (iter == blocks.end())
 		return 0;
 	else
-		return &(*iter);
+		return &iter->second;
 }
 
 
@@ -232,39 +329,59 @@ u32 BlockAllocator::GetBlockSizeFromAddress(u32 addr)
 void BlockAllocator::ListBlocks()
 {
 	INFO_LOG(HLE,"-----------");
-	for (std::list<Block>::const_iterator iter = blocks.begin(); iter != blocks.end(); iter++)
+	for (BlockMap::const_iterator iter = blocks.begin(); iter != blocks.end(); iter++)
 	{
-		const Block &b = *iter;
+		const Block &b = iter->second;
 		INFO_LOG(HLE, "Block: %08x - %08x	size %08x	taken=%i	tag=%s", b.start, b.start+b.size, b.size, b.taken ? 1:0, b.tag);
 	}
 }
 
 u32 BlockAllocator::GetLargestFreeBlockSize()
 {
-	u32 maxFreeBlock = 0;
-	for (std::list<Block>::const_iterator iter = blocks.begin(); iter != blocks.end(); iter++)
+	// The largest free block is in the highest non-empty size class.
+	for (int i = NUM_SIZE_CLASSES - 1; i >= 0; i--)
 	{
-		const Block &b = *iter;
-		if (!b.taken)
+		const FreeList &list = freeLists[i];
+		if (list.empty())
+			continue;
+		u32 maxFreeBlock = 0;
+		for (FreeList::const_iterator iter = list.begin(); iter != list.end(); ++iter)
 		{
-			if (b.size > maxFreeBlock)
-				maxFreeBlock = b.size;
+			if (iter->second > maxFreeBlock)
+				maxFreeBlock = iter->second;
 		}
+		return maxFreeBlock;
 	}
-	return maxFreeBlock;
+	return 0;
 }
 
 
 u32 BlockAllocator::GetTotalFreeBytes()
 {
-	u32 sum = 0;
-	for (std::list<Block>::const_iterator iter = blocks.begin(); iter != blocks.end(); iter++)
+	return totalFree;
+}
+
+void BlockAllocator::DoState(PointerWrap &p)
+{
+	int count = (int)blocks.size();
+	p.Do(count);
+
+	if (p.GetMode() == PointerWrap::MODE_READ)
 	{
-		const Block &b = *iter;
-		if (!b.taken)
+		Shutdown();
+		for (int i = 0; i < count; i++)
 		{
-			sum += b.size;
+			Block b(0, 0, false);
+			p.Do(b);
+			InsertBlock(b);
+			if (!b.taken)
+				AddFree(b);
 		}
 	}
-	return sum;
+	else
+	{
+		for (BlockMap::iterator iter = blocks.begin(); iter != blocks.end(); ++iter)
+			p.Do(iter->second);
+	}
+	p.DoMarker("BlockAllocator");
 }
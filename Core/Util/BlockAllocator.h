@@ -3,12 +3,18 @@
 
 #include "../../Globals.h"
 
-#include <vector>
-#include <list>
+#include <map>
 
+class PointerWrap;
 
 // Generic allocator thingy
 // Allocates blocks from a range
+//
+// Blocks, free and taken, live in a map keyed by start address so that finding the block
+// containing an address is O(log n). Free blocks are additionally indexed by size class
+// (floor(log2(size))), each class sorted by address, so that allocations only look at blocks
+// that can actually fit. Placement is unchanged: the lowest (or for fromEnd, highest) addressed
+// free block that fits is used.
 
 class BlockAllocator
 {
@@ -30,10 +36,27 @@ class BlockAllocator
 		char tag[16];
 	};
 
-	std::list<Block> blocks;
+	typedef std::map<u32, Block> BlockMap;
+	// start -> size
+	typedef std::map<u32, u32> FreeList;
+
+	enum { NUM_SIZE_CLASSES = 32 };
+
+	BlockMap blocks;
+	// Start addresses of the free blocks, per size class.
+	FreeList freeLists[NUM_SIZE_CLASSES];
+	u32 totalFree;
+
+	static int SizeClass(u32 size);
+	void AddFree(const Block &b);
+	void RemoveFree(const Block &b);
+	BlockMap::iterator InsertBlock(const Block &b);
+	BlockMap::iterator FindFreeBlock(u32 size, bool fromEnd);
+	// Merges the free block at iter with its free neighbours and indexes the result.
+	void MergeAround(BlockMap::iterator iter);
 
 	Block *GetBlockFromAddress(u32 addr);
-	std::list<Block>::iterator GetBlockIterFromAddress(u32 addr);
+	BlockMap::iterator GetBlockIterFromAddress(u32 addr);
 
 public:
 	BlockAllocator();
@@ -57,10 +80,14 @@ public:
 			return false;
 	}
 
+	// Free blocks are merged as they are freed, this only verifies that nothing was missed.
 	void MergeFreeBlocks();
 
 	u32 GetBlockStartFromAddress(u32 addr);
 	u32 GetBlockSizeFromAddress(u32 addr);
 	u32 GetLargestFreeBlockSize();
 	u32 GetTotalFreeBytes();
+
+	// The free lists are rebuilt from the blocks on load.
+	void DoState(PointerWrap &p);
 };
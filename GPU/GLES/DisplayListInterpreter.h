@@ -18,14 +18,14 @@
 #pragma once
 
 #include "../../Globals.h"
+#include "../GPUCommon.h"
 
 class ShaderManager;
 
-class GPU
+class GLES_GPU : public GPUCommon
 {
 public:
-	static u32 EnqueueList(u32 listpc, u32 stall);
-	static void UpdateStall(int listid, u32 newstall);
-	static void ExecuteOp(u32 op, u32 diff);
-	static bool InterpretList();
+	virtual void ExecuteOp(u32 op, u32 diff);
+	virtual void InvalidateCache(u32 addr, int size);
+	virtual void DoState(PointerWrap &p);
 };
@@ -37,12 +37,29 @@
 
 #include "Framebuffer.h"
 
+#if !defined(ANDROID) && (defined(_M_X64) || (defined(_M_IX86) && (defined(_MSC_VER) || defined(__SSE2__))))
+#define FRAMEBUFFER_SSE2
+#include <emmintrin.h>
+#endif
+
+static const int FB_WIDTH = 480;
+static const int FB_HEIGHT = 272;
+// Wide enough to upload a PSP framebuffer with the standard stride without repacking.
+static const int FB_TEX_WIDTH = 512;
+
 //////////////////////////////////////////////////////////////////////////
 // STATE BEGIN
 static GLuint backbufTex;
 u8 *realFB;
 GLSLProgram *draw2dprogram;
 
+// What's currently in backbufTex, per line.
+static u64 rowHashes[FB_HEIGHT];
+static bool rowValid[FB_HEIGHT];
+static u8 *lastFramebuf;
+static int lastPixelFormat;
+static int lastLinesize;
+
 // STATE END
 //////////////////////////////////////////////////////////////////////////
 
@@ -96,7 +113,7 @@ void DisplayDrawer_Init()
 	glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 480, 272, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, FB_TEX_WIDTH, FB_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
 	glBindTexture(GL_TEXTURE_2D, 0);
 
 	draw2dprogram = glsl_create_source(basic_vs, tex_fs);
@@ -112,7 +129,11 @@ void DisplayDrawer_Init()
 	glClearColor(0, 0, 0, 0);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	
-	realFB = new u8[480*272*4];
+	realFB = new u8[FB_WIDTH*FB_HEIGHT*4];
+	memset(rowValid, 0, sizeof(rowValid));
+	lastFramebuf = 0;
+	lastPixelFormat = -1;
+	lastLinesize = 0;
 }
 
 void DisplayDrawer_Shutdown()
@@ -122,78 +143,182 @@ void DisplayDrawer_Shutdown()
 	delete [] realFB;
 }
 
+// Converts one line of 16-bit PSP pixels to RGBA8888. The PSP formats have red in the low bits,
+// so 8888 is already in GL_RGBA byte order and never needs converting.
+static void ConvertRow565(u32 *dst, const u16 *src, int count)
+{
+	int x = 0;
+#ifdef FRAMEBUFFER_SSE2
+	const __m128i mask5 = _mm_set1_epi16(0x1F);
+	const __m128i mask6 = _mm_set1_epi16(0x3F);
+	const __m128i alpha = _mm_set1_epi16((short)0xFF00);
+	for (; x + 8 <= count; x += 8)
+	{
+		__m128i c = _mm_loadu_si128((const __m128i *)(src + x));
+		__m128i r = _mm_and_si128(c, mask5);
+		__m128i g = _mm_and_si128(_mm_srli_epi16(c, 5), mask6);
+		__m128i b = _mm_srli_epi16(c, 11);
+		r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+		g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+		b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+		__m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+		__m128i ba = _mm_or_si128(b, alpha);
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_unpacklo_epi16(rg, ba));
+		_mm_storeu_si128((__m128i *)(dst + x + 4), _mm_unpackhi_epi16(rg, ba));
+	}
+#endif
+	for (; x < count; x++)
+	{
+		u32 c = src[x];
+		u32 r = c & 0x1F, g = (c >> 5) & 0x3F, b = c >> 11;
+		r = (r << 3) | (r >> 2);
+		g = (g << 2) | (g >> 4);
+		b = (b << 3) | (b >> 2);
+		dst[x] = r | (g << 8) | (b << 16) | 0xFF000000;
+	}
+}
+
+static void ConvertRow5551(u32 *dst, const u16 *src, int count)
+{
+	int x = 0;
+#ifdef FRAMEBUFFER_SSE2
+	const __m128i mask5 = _mm_set1_epi16(0x1F);
+	for (; x + 8 <= count; x += 8)
+	{
+		__m128i c = _mm_loadu_si128((const __m128i *)(src + x));
+		__m128i r = _mm_and_si128(c, mask5);
+		__m128i g = _mm_and_si128(_mm_srli_epi16(c, 5), mask5);
+		__m128i b = _mm_and_si128(_mm_srli_epi16(c, 10), mask5);
+		// The top bit smeared over the whole lane, then moved to the high byte.
+		__m128i a = _mm_slli_epi16(_mm_srai_epi16(c, 15), 8);
+		r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+		g = _mm_or_si128(_mm_slli_epi16(g, 3), _mm_srli_epi16(g, 2));
+		b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+		__m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+		__m128i ba = _mm_or_si128(b, a);
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_unpacklo_epi16(rg, ba));
+		_mm_storeu_si128((__m128i *)(dst + x + 4), _mm_unpackhi_epi16(rg, ba));
+	}
+#endif
+	for (; x < count; x++)
+	{
+		u32 c = src[x];
+		u32 r = c & 0x1F, g = (c >> 5) & 0x1F, b = (c >> 10) & 0x1F;
+		r = (r << 3) | (r >> 2);
+		g = (g << 3) | (g >> 2);
+		b = (b << 3) | (b >> 2);
+		dst[x] = r | (g << 8) | (b << 16) | ((c & 0x8000) ? 0xFF000000 : 0);
+	}
+}
+
+static void ConvertRow4444(u32 *dst, const u16 *src, int count)
+{
+	int x = 0;
+#ifdef FRAMEBUFFER_SSE2
+	const __m128i maskLo = _mm_set1_epi16(0x000F);
+	const __m128i maskHi = _mm_set1_epi16(0x0F00);
+	for (; x + 8 <= count; x += 8)
+	{
+		__m128i c = _mm_loadu_si128((const __m128i *)(src + x));
+		// Spread the nibbles out to one per byte, then copy each into the upper half of its byte.
+		__m128i rg = _mm_or_si128(_mm_and_si128(c, maskLo), _mm_and_si128(_mm_slli_epi16(c, 4), maskHi));
+		__m128i ba = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(c, 8), maskLo), _mm_and_si128(_mm_srli_epi16(c, 4), maskHi));
+		rg = _mm_or_si128(rg, _mm_slli_epi16(rg, 4));
+		ba = _mm_or_si128(ba, _mm_slli_epi16(ba, 4));
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_unpacklo_epi16(rg, ba));
+		_mm_storeu_si128((__m128i *)(dst + x + 4), _mm_unpackhi_epi16(rg, ba));
+	}
+#endif
+	for (; x < count; x++)
+	{
+		u32 c = src[x];
+		u32 v = (c & 0xF) | ((c & 0xF0) << 4) | ((c & 0xF00) << 8) | ((c & 0xF000) << 12);
+		dst[x] = v | (v << 4);
+	}
+}
+
+// Cheap hash of a framebuffer line, so that lines that haven't changed since the last vblank
+// don't need to be converted or uploaded again. bytes must be a multiple of 16.
+static u64 HashRow(const u8 *src, int bytes)
+{
+	const u64 *p = (const u64 *)src;
+	u64 h1 = 0x9E3779B97F4A7C15ULL, h2 = 0xC2B2AE3D27D4EB4FULL;
+	for (int i = 0; i < bytes / 8; i += 2)
+	{
+		// Two independent lanes, so the multiplies can overlap.
+		h1 = (h1 ^ p[i]) * 0x87C37B91114253D5ULL;
+		h2 = (h2 ^ p[i + 1]) * 0x4CF5AD432745937FULL;
+		h1 ^= h1 >> 31;
+		h2 ^= h2 >> 29;
+	}
+	return h1 ^ (h2 * 0xFF51AFD7ED558CCDULL);
+}
+
 void DisplayDrawer_DrawFramebuffer(u8 *framebuf, PspDisplayPixelFormat pixelFormat, int linesize)
 {
-	float u1 = 1.0f;
+	// The texture is wider than the screen, the rest is never shown.
+	float u1 = (float)FB_WIDTH / (float)FB_TEX_WIDTH;
 	float v1 = 1.0f;
 
-	for (int y = 0; y < 272; y++)
+	bool is8888 = pixelFormat == PSP_DISPLAY_PIXEL_FORMAT_8888;
+	int bpp = is8888 ? 4 : 2;
+	// 8888 framebuffers with the usual stride can be uploaded straight from PSP memory.
+	bool direct = is8888 && linesize == FB_TEX_WIDTH;
+
+	// Anything that changes how the memory is interpreted invalidates every line.
+	if (framebuf != lastFramebuf || pixelFormat != lastPixelFormat || linesize != lastLinesize)
 	{
+		lastFramebuf = framebuf;
+		lastPixelFormat = pixelFormat;
+		lastLinesize = linesize;
+		memset(rowValid, 0, sizeof(rowValid));
+	}
+
+	int firstDirty = FB_HEIGHT, lastDirty = -1;
+	for (int y = 0; y < FB_HEIGHT; y++)
+	{
+		const u8 *src = framebuf + linesize * bpp * y;
+		u64 hash = HashRow(src, FB_WIDTH * bpp);
+		if (rowValid[y] && rowHashes[y] == hash)
+			continue;
+		rowHashes[y] = hash;
+		rowValid[y] = true;
+		if (y < firstDirty)
+			firstDirty = y;
+		lastDirty = y;
+
+		u32 *dst = (u32 *)(realFB + 4 * FB_WIDTH * y);
 		switch (pixelFormat)
 		{
 		case PSP_DISPLAY_PIXEL_FORMAT_565:
-			{
-				u16 *src = (u16 *)framebuf + linesize * y;
-				u8 *dst = realFB + 4 * 480 * y;
-				for (int x = 0; x < 480; x++)
-				{
-					u16 col = src[x];
-					dst[x * 4] = ((col) & 0x1f) << 3;
-					dst[x * 4 + 1] = ((col >> 5) & 0x3f) << 2;
-					dst[x * 4 + 2] = ((col >> 11) & 0x1f) << 3;
-					dst[x * 4 + 3] = 255;
-				}
-			}
+			ConvertRow565(dst, (const u16 *)src, FB_WIDTH);
 			break;
 
 		case PSP_DISPLAY_PIXEL_FORMAT_5551:
-			{
-				u16 *src = (u16 *)framebuf + linesize * y;
-				u8 *dst = realFB + 4 * 480 * y;
-				for (int x = 0; x < 480; x++)
-				{
-					u16 col = src[x];
-					dst[x * 4] = ((col) & 0x1f) << 3;
-					dst[x * 4 + 1] = ((col >> 5) & 0x1f) << 3;
-					dst[x * 4 + 2] = ((col >> 10) & 0x1f) << 3;
-					dst[x * 4 + 3] = (col >> 15) ? 255 : 0;
-				}
-			}
+			ConvertRow5551(dst, (const u16 *)src, FB_WIDTH);
 			break;
 
-		case PSP_DISPLAY_PIXEL_FORMAT_8888:
-			{
-				u8 *src = framebuf + linesize * 4 * y;
-				u8 *dst = realFB + 4 * 480 * y;
-				for (int x = 0; x < 480; x++)
-				{
-					dst[x * 4] = src[x * 4];
-					dst[x * 4 + 1] = src[x * 4 + 3];
-					dst[x * 4 + 2] = src[x * 4 + 2];
-					dst[x * 4 + 3] = src[x * 4 + 1];
-				}
-			}
+		case PSP_DISPLAY_PIXEL_FORMAT_4444:
+			ConvertRow4444(dst, (const u16 *)src, FB_WIDTH);
 			break;
 
-		case PSP_DISPLAY_PIXEL_FORMAT_4444:
-			{
-				u16 *src = (u16 *)framebuf + linesize * y;
-				u8 *dst = realFB + 4 * 480 * y;
-				for (int x = 0; x < 480; x++)
-				{
-					u16 col = src[x];
-					dst[x * 4] = ((col >> 8) & 0xf) << 4;
-					dst[x * 4 + 1] = ((col >> 4) & 0xf) << 4;
-					dst[x * 4 + 2] = (col & 0xf) << 4;
-					dst[x * 4 + 3] = (col >> 12) << 4;
-				}
-			}
+		case PSP_DISPLAY_PIXEL_FORMAT_8888:
+			// Same layout, just an odd stride that we can't tell GLES about.
+			if (!direct)
+				memcpy(dst, src, FB_WIDTH * 4);
 			break;
 		}
 	}
 
-	glBindTexture(GL_TEXTURE_2D,backbufTex);
-	glTexSubImage2D(GL_TEXTURE_2D,0,0,0,480,272, GL_RGBA, GL_UNSIGNED_BYTE, realFB);
+	glBindTexture(GL_TEXTURE_2D, backbufTex);
+	if (lastDirty >= firstDirty)
+	{
+		int rows = lastDirty - firstDirty + 1;
+		if (direct)
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, firstDirty, FB_TEX_WIDTH, rows, GL_RGBA, GL_UNSIGNED_BYTE, framebuf + linesize * 4 * firstDirty);
+		else
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, firstDirty, FB_WIDTH, rows, GL_RGBA, GL_UNSIGNED_BYTE, realFB + 4 * FB_WIDTH * firstDirty);
+	}
 
 	const float pos[12] = {0,0,0, 480,0,0, 480,272,0, 0,272,0};
 	const float texCoords[8] = {0, 0, u1, 0, u1, v1, 0, v1};
@@ -27,6 +27,7 @@
 #endif
 #endif
 
+#include <algorithm>
 #include <map>
 
 #include "../../Core/MemMap.h"
@@ -42,6 +43,7 @@ struct TexCacheEntry
 	u32 frameCounter;
 	u32 numMips;
 	int dim;
+	u32 sizeInRAM;
 	GLuint texture;
 };
 
@@ -66,6 +68,30 @@ void TextureCache_Clear(bool delete_them)
 	}
 }
 
+// Upper bound on sizeInRAM: 512 lines at the widest buffer width, 32 bits per texel.
+static const u32 MAX_TEXTURE_BYTES = 1024 * 512 * 4;
+
+// Drop every texture that overlaps the range, so that it gets decoded again on next use.
+// Called for every HLE memset/memcpy, so only look at entries that could start early enough.
+void TextureCache_Invalidate(u32 addr, int size)
+{
+	addr &= 0x0FFFFFFF;
+	u32 end = addr + size;
+	u32 first = addr > MAX_TEXTURE_BYTES ? addr - MAX_TEXTURE_BYTES : 0;
+	for (TexCache::iterator iter = cache.lower_bound(first); iter != cache.end() && iter->first < end; )
+	{
+		TexCacheEntry &entry = iter->second;
+		if (entry.addr < end && addr < entry.addr + entry.sizeInRAM)
+		{
+			DEBUG_LOG(G3D, "Invalidating texture %i at %08x", entry.texture, entry.addr);
+			glDeleteTextures(1, &entry.texture);
+			cache.erase(iter++);
+		}
+		else
+			++iter;
+	}
+}
+
 u32 PaletteLoad(int index)
 {
 	int pf = gstate.clutformat & 3;
@@ -492,5 +518,10 @@ void PSPSetTexture()
 	// glGenerateMipmap(GL_TEXTURE_2D);
 	UpdateSamplingParams();
 
+	// In bits per texel, for invalidation. The PSP samples at most 512 lines, which keeps this
+	// within MAX_TEXTURE_BYTES.
+	static const int bitsPerTexel[16] = {16, 16, 16, 32, 4, 8, 16, 32, 4, 8, 8, 0, 0, 0, 0, 0};
+	entry.sizeInRAM = (std::max(bufw, w) * std::min(h, 512) * bitsPerTexel[format]) / 8;
+
 	cache[texaddr] = entry;
 }
@@ -20,4 +20,5 @@
 
 
 void PSPSetTexture();
-void TextureCache_Clear(bool delete_them);
\ No newline at end of file
+void TextureCache_Clear(bool delete_them);
+void TextureCache_Invalidate(u32 addr, int size);
\ No newline at end of file
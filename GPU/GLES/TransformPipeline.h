@@ -17,6 +17,11 @@
 
 #pragma once
 
+#include "../Math3D.h"
+
 struct LinkedShader;
 
+// Software vertex lighting. Also used by the software renderer.
+void Light(float colorOut[4], const float colorIn[4], Vec3 pos, Vec3 normal, float dots[4]);
+
 void TransformAndDrawPrim(void *verts, void *inds, int prim, int count, LinkedShader *shader, float *customUV = 0, int forceIndexType = -1);
@@ -0,0 +1,403 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include "../Core/MemMap.h"
+#include "ChunkFile.h"
+
+#include "GPUState.h"
+#include "ge_constants.h"
+#include "GPUCommon.h"
+
+GPUInterface *gpu = 0;
+
+GPUCommon::GPUCommon()
+	: dlIdGenerator(1), prev(0), stackptr(0), finished(false), skipDrawing(false)
+{
+	dcontext.pc = 0;
+	dcontext.stallAddr = 0;
+}
+
+void GPUCommon::DoState(PointerWrap &p)
+{
+	p.Do(dlQueue);
+	p.Do(dcontext);
+	p.Do(dlIdGenerator);
+	p.Do(prev);
+	p.DoArray(stack, sizeof(stack) / sizeof(stack[0]));
+	p.Do(stackptr);
+	p.Do(finished);
+	p.DoMarker("GPUCommon");
+}
+
+bool GPUCommon::ProcessDLQueue()
+{
+	std::vector<DisplayList>::iterator iter = dlQueue.begin();
+	while (!(iter == dlQueue.end()))
+	{
+		DisplayList &l = *iter;
+		dcontext.pc = l.listpc;
+		dcontext.stallAddr = l.stall;
+//		DEBUG_LOG(G3D,"Okay, starting DL execution at %08 - stall = %08x", context.pc, stallAddr);
+		if (!InterpretList())
+		{
+			l.listpc = dcontext.pc;
+			l.stall = dcontext.stallAddr;
+			return false;
+		}
+		else
+		{
+			//At the end, we can remove it from the queue and continue
+			dlQueue.erase(iter);
+			//this invalidated the iterator, let's fix it
+			iter = dlQueue.begin();
+		}
+	}
+	return true; //no more lists!
+}
+
+u32 GPUCommon::EnqueueList(u32 listpc, u32 stall)
+{
+	DisplayList dl;
+	dl.id = dlIdGenerator++;
+	dl.listpc = listpc&0xFFFFFFF;
+	dl.stall = stall&0xFFFFFFF;
+	dlQueue.push_back(dl);
+	if (!ProcessDLQueue())
+		return dl.id;
+	else
+		return 0;
+}
+
+void GPUCommon::UpdateStall(int listid, u32 newstall)
+{
+	// this needs improvement....
+	for (std::vector<DisplayList>::iterator iter = dlQueue.begin(); iter != dlQueue.end(); iter++)
+	{
+		DisplayList &l = *iter;
+		if (l.id == listid)
+		{
+			l.stall = newstall & 0xFFFFFFF;
+		}
+	}
+
+	ProcessDLQueue();
+}
+
+void GPUCommon::PreExecuteOp(u32 op, u32 diff)
+{
+	u32 cmd = op >> 24;
+	u32 data = op & 0xFFFFFF;
+
+	switch (cmd)
+	{
+	case GE_CMD_VADDR:		/// <<8????
+		gstate.vertexAddr = (gstate.base<<8)|data;
+		DEBUG_LOG(G3D,"DL VADDR: %06x", gstate.vertexAddr);
+		break;
+
+	case GE_CMD_IADDR:
+		gstate.indexAddr	= (gstate.base<<8)|data;
+		DEBUG_LOG(G3D,"DL IADDR: %06x", gstate.indexAddr);
+		break;
+
+	case GE_CMD_JUMP:
+		{
+			u32 target = ((gstate.base << 8) | (op & 0xFFFFFC)) & 0x0FFFFFFF;
+			DEBUG_LOG(G3D,"DL CMD JUMP - %08x to %08x", dcontext.pc, target);
+			dcontext.pc = target - 4; // pc will be increased after we return, counteract that
+		}
+		break;
+
+	case GE_CMD_CALL:
+		{
+			u32 retval = dcontext.pc + 4;
+			stack[stackptr++] = retval;
+			u32 target = ((gstate.base << 8) | (op & 0xFFFFFC)) & 0xFFFFFFF;
+			DEBUG_LOG(G3D,"DL CMD CALL - %08x to %08x, ret=%08x", dcontext.pc, target, retval);
+			dcontext.pc = target - 4;	// pc will be increased after we return, counteract that
+		}
+		break;
+
+	case GE_CMD_RET:
+		//TODO : debug!
+		{
+			u32 target = stack[--stackptr] & 0xFFFFFFF;
+			DEBUG_LOG(G3D,"DL CMD RET - from %08x to %08x", dcontext.pc, target);
+			dcontext.pc = target - 4;
+		}
+		break;
+
+	case GE_CMD_SIGNAL:
+		ERROR_LOG(G3D, "GE_CMD_SIGNAL %08x", data & 0xFFFFFF);
+		{
+			// int behaviour = (data >> 16) & 0xFF;
+			// int signal = data & 0xFFFF;
+		}
+
+		// This should generate a GE Interrupt
+		// __TriggerInterrupt(PSP_GE_INTR);
+
+		// Apparently, these callbacks should be done in a special interrupt way.
+		//for (size_t i = 0; i < signalCallbacks.size(); i++)
+		//{
+		//	__KernelNotifyCallback(-1, signalCallbacks[i].first, signal);
+		//}
+
+		break;
+
+	case GE_CMD_ORIGIN:
+		gstate.offsetAddr = dcontext.pc & 0xFFFFFF;
+		break;
+
+	case GE_CMD_FINISH:
+		DEBUG_LOG(G3D,"DL CMD FINISH");
+		// Trigger the finish callbacks
+		{
+			// Apparently, these callbacks should be done in a special interrupt way.
+
+			//for (size_t i = 0; i < finishCallbacks.size(); i++)
+			//{
+			//	__KernelNotifyCallback(-1, finishCallbacks[i].first, 0);
+			//}
+		}
+		break;
+
+	case GE_CMD_END:
+		DEBUG_LOG(G3D,"DL CMD END");
+		{
+			switch (prev >> 24)
+			{
+			case GE_CMD_FINISH:
+				finished = true;
+				break;
+			default:
+				DEBUG_LOG(G3D,"Ah, not finished: %06x", prev & 0xFFFFFF);
+				break;
+			}
+		}
+
+		// This should generate a Reading Ended interrupt
+		// __TriggerInterrupt(PSP_GE_INTR);
+
+		break;
+
+	case GE_CMD_TEXSCALEU:
+		gstate.uScale = getFloat24(data);
+		DEBUG_LOG(G3D, "Texture U Scale: %f", gstate.uScale);
+		break;
+
+	case GE_CMD_TEXSCALEV:
+		gstate.vScale = getFloat24(data);
+		DEBUG_LOG(G3D, "Texture V Scale: %f", gstate.vScale);
+		break;
+
+	case GE_CMD_TEXOFFSETU:
+		gstate.uOff = getFloat24(data);
+		DEBUG_LOG(G3D, "Texture U Offset: %f", gstate.uOff);
+		break;
+
+	case GE_CMD_TEXOFFSETV:
+		gstate.vOff = getFloat24(data);
+		DEBUG_LOG(G3D, "Texture V Offset: %f", gstate.vOff);
+		break;
+
+	case GE_CMD_TEXADDR0:
+	case GE_CMD_TEXBUFWIDTH0:
+		gstate.textureChanged=true;
+		break;
+
+	case GE_CMD_TEXSIZE0:
+		gstate.textureChanged=true;
+		gstate.curTextureWidth = 1 << (gstate.texsize[0] & 0xf);
+		gstate.curTextureHeight = 1 << ((gstate.texsize[0]>>8) & 0xf);
+		break;
+
+	case GE_CMD_LOADCLUT:
+		{
+			u32 clutAttr = ((gstate.clutaddrupper & 0xFF0000)<<8) | (gstate.clutaddr & 0xFFFFFF);
+			if (clutAttr)
+			{
+				u16 *clut = (u16*)Memory::GetPointer(clutAttr);
+				if (clut) {
+					int numColors = 16 * (data&0x3F);
+					memcpy(&gstate.paletteMem[0], clut, numColors * 2);
+				}
+				DEBUG_LOG(G3D,"Clut load: %i palettes", data);
+			}
+			else
+			{
+				DEBUG_LOG(G3D,"Empty Clut load");
+			}
+			// Should hash and invalidate all paletted textures on use
+		}
+		break;
+
+	case GE_CMD_LX0:case GE_CMD_LY0:case GE_CMD_LZ0:
+	case GE_CMD_LX1:case GE_CMD_LY1:case GE_CMD_LZ1:
+	case GE_CMD_LX2:case GE_CMD_LY2:case GE_CMD_LZ2:
+	case GE_CMD_LX3:case GE_CMD_LY3:case GE_CMD_LZ3:
+		{
+			int n = cmd - GE_CMD_LX0;
+			int l = n / 3;
+			int c = n % 3;
+			float val = getFloat24(data);
+			DEBUG_LOG(G3D,"DL Light %i %c pos: %f", l, c+'X', val);
+			gstate.lightpos[l][c] = val;
+		}
+		break;
+
+	case GE_CMD_LDX0:case GE_CMD_LDY0:case GE_CMD_LDZ0:
+	case GE_CMD_LDX1:case GE_CMD_LDY1:case GE_CMD_LDZ1:
+	case GE_CMD_LDX2:case GE_CMD_LDY2:case GE_CMD_LDZ2:
+	case GE_CMD_LDX3:case GE_CMD_LDY3:case GE_CMD_LDZ3:
+		{
+			int n = cmd - GE_CMD_LDX0;
+			int l = n / 3;
+			int c = n % 3;
+			float val = getFloat24(data);
+			DEBUG_LOG(G3D,"DL Light %i %c dir: %f", l, c+'X', val);
+			gstate.lightdir[l][c] = val;
+		}
+		break;
+
+	case GE_CMD_LKA0:case GE_CMD_LKB0:case GE_CMD_LKC0:
+	case GE_CMD_LKA1:case GE_CMD_LKB1:case GE_CMD_LKC1:
+	case GE_CMD_LKA2:case GE_CMD_LKB2:case GE_CMD_LKC2:
+	case GE_CMD_LKA3:case GE_CMD_LKB3:case GE_CMD_LKC3:
+		{
+			int n = cmd - GE_CMD_LKA0;
+			int l = n / 3;
+			int c = n % 3;
+			float val = getFloat24(data);
+			DEBUG_LOG(G3D,"DL Light %i %c att: %f", l, c+'X', val);
+			gstate.lightatt[l][c] = val;
+		}
+		break;
+
+	case GE_CMD_LAC0:case GE_CMD_LAC1:case GE_CMD_LAC2:case GE_CMD_LAC3:
+	case GE_CMD_LDC0:case GE_CMD_LDC1:case GE_CMD_LDC2:case GE_CMD_LDC3:
+	case GE_CMD_LSC0:case GE_CMD_LSC1:case GE_CMD_LSC2:case GE_CMD_LSC3:
+		{
+			float r = (float)(data>>16)/255.0f;
+			float g = (float)((data>>8) & 0xff)/255.0f;
+			float b = (float)(data & 0xff)/255.0f;
+
+			int l = (cmd - GE_CMD_LAC0) / 3;
+			int t = (cmd - GE_CMD_LAC0) % 3;
+			gstate.lightColor[t][l].r = r;
+			gstate.lightColor[t][l].g = g;
+			gstate.lightColor[t][l].b = b;
+		}
+		break;
+
+	case GE_CMD_PATCHDIVISION:
+		gstate.patch_div_s = data & 0xFF;
+		gstate.patch_div_t = (data >> 8) & 0xFF;
+		break;
+
+	case GE_CMD_MORPHWEIGHT0:
+	case GE_CMD_MORPHWEIGHT1:
+	case GE_CMD_MORPHWEIGHT2:
+	case GE_CMD_MORPHWEIGHT3:
+	case GE_CMD_MORPHWEIGHT4:
+	case GE_CMD_MORPHWEIGHT5:
+	case GE_CMD_MORPHWEIGHT6:
+	case GE_CMD_MORPHWEIGHT7:
+		gstate.morphWeights[cmd-GE_CMD_MORPHWEIGHT0] = getFloat24(data);
+		break;
+
+	case GE_CMD_WORLDMATRIXNUMBER:
+		DEBUG_LOG(G3D,"DL World matrix # %i", data);
+		gstate.worldmtxnum = data&0xF;
+		break;
+
+	case GE_CMD_WORLDMATRIXDATA:
+		DEBUG_LOG(G3D,"DL World matrix data # %f", getFloat24(data));
+		gstate.worldMatrix[gstate.worldmtxnum++] = getFloat24(data);
+		break;
+
+	case GE_CMD_VIEWMATRIXNUMBER:
+		DEBUG_LOG(G3D,"DL VIEW matrix # %i", data);
+		gstate.viewmtxnum = data&0xF;
+		break;
+
+	case GE_CMD_VIEWMATRIXDATA:
+		DEBUG_LOG(G3D,"DL VIEW matrix data # %f", getFloat24(data));
+		gstate.viewMatrix[gstate.viewmtxnum++] = getFloat24(data);
+		break;
+
+	case GE_CMD_PROJMATRIXNUMBER:
+		DEBUG_LOG(G3D,"DL PROJECTION matrix # %i", data);
+		gstate.projmtxnum = data&0xF;
+		break;
+
+	case GE_CMD_PROJMATRIXDATA:
+		DEBUG_LOG(G3D,"DL PROJECTION matrix data # %f", getFloat24(data));
+		gstate.projMatrix[gstate.projmtxnum++] = getFloat24(data);
+		break;
+
+	case GE_CMD_TGENMATRIXNUMBER:
+		DEBUG_LOG(G3D,"DL TGEN matrix # %i", data);
+		gstate.texmtxnum = data&0xF;
+		break;
+
+	case GE_CMD_TGENMATRIXDATA:
+		DEBUG_LOG(G3D,"DL TGEN matrix data # %f", getFloat24(data));
+		gstate.tgenMatrix[gstate.texmtxnum++] = getFloat24(data);
+		break;
+
+	case GE_CMD_BONEMATRIXNUMBER:
+		DEBUG_LOG(G3D,"DL BONE matrix #%i", data);
+		gstate.boneMatrixNumber = data;
+		break;
+
+	case GE_CMD_BONEMATRIXDATA:
+		DEBUG_LOG(G3D,"DL BONE matrix data #%i %f", gstate.boneMatrixNumber, getFloat24(data));
+		gstate.boneMatrix[gstate.boneMatrixNumber++] = getFloat24(data);
+		break;
+
+	default:
+		break;
+	}
+}
+
+bool GPUCommon::InterpretList()
+{
+	// Reset stackptr for safety
+	stackptr = 0;
+	u32 op = 0;
+	prev = 0;
+	finished = false;
+	while (!finished)
+	{
+		if (dcontext.pc == dcontext.stallAddr)
+			return false;
+
+		op = Memory::ReadUnchecked_U32(dcontext.pc); //read from memory
+		u32 cmd = op >> 24;
+		u32 diff = op ^ gstate.cmdmem[cmd];
+		gstate.cmdmem[cmd] = op;	 // crashes if I try to put the whole op there??
+
+		PreExecuteOp(op, diff);
+		if (!skipDrawing || (cmd != GE_CMD_PRIM && cmd != GE_CMD_BEZIER && cmd != GE_CMD_SPLINE))
+			ExecuteOp(op, diff);
+
+		dcontext.pc += 4;
+		prev = op;
+	}
+	return true;
+}
@@ -0,0 +1,67 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <vector>
+
+#include "GPUInterface.h"
+
+// Display list handling shared by all backends. Walks the lists, handles flow control
+// (jump/call/ret/end) and keeps the parts of gstate that are not raw command words
+// (matrices, light parameters, texture scale...) up to date, then hands each command to
+// the backend's ExecuteOp.
+class GPUCommon : public GPUInterface
+{
+public:
+	GPUCommon();
+
+	virtual u32 EnqueueList(u32 listpc, u32 stall);
+	virtual void UpdateStall(int listid, u32 newstall);
+	virtual bool InterpretList();
+	virtual void Flush() {}
+	virtual void SetSkipDrawing(bool skip) { skipDrawing = skip; }
+	virtual void DoState(PointerWrap &p);
+
+protected:
+	// Updates gstate and handles list flow control for a command. Called before ExecuteOp.
+	void PreExecuteOp(u32 op, u32 diff);
+	bool ProcessDLQueue();
+
+	struct DisplayList
+	{
+		int id;
+		u32 listpc;
+		u32 stall;
+	};
+
+	struct DisplayState
+	{
+		u32 pc;
+		u32 stallAddr;
+	};
+
+	std::vector<DisplayList> dlQueue;
+	DisplayState dcontext;
+	int dlIdGenerator;
+
+	u32 prev;
+	u32 stack[2];
+	u32 stackptr;
+	bool finished;
+	bool skipDrawing;
+};
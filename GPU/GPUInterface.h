@@ -0,0 +1,55 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include "../Globals.h"
+
+class PointerWrap;
+
+// The interface that the HLE (sceGe, sceDisplay) talks to. Each backend (GLES, Software)
+// implements this. Lives in the global "gpu", which is NULL when running with GPU_NULL.
+class GPUInterface
+{
+public:
+	virtual ~GPUInterface() {}
+
+	// Display list queue management.
+	virtual u32 EnqueueList(u32 listpc, u32 stall) = 0;
+	virtual void UpdateStall(int listid, u32 newstall) = 0;
+	virtual bool InterpretList() = 0;
+
+	// Executes a single GE command. Also used to reapply state from gstate.cmdmem.
+	virtual void ExecuteOp(u32 op, u32 diff) = 0;
+
+	// Called at the start of each vblank, before the framebuffer is displayed.
+	// Backends that render asynchronously must finish their work here.
+	virtual void Flush() = 0;
+
+	// While set, drawing commands are dropped but everything else, including state changes
+	// and block transfers, still executes. Used for frameskipping.
+	virtual void SetSkipDrawing(bool skip) = 0;
+
+	// The CPU has written to this range of memory, drop anything cached from it.
+	virtual void InvalidateCache(u32 addr, int size) = 0;
+
+	// Saves or restores the display list state. On load, anything cached from memory must be
+	// dropped, gstate itself is handled by the caller.
+	virtual void DoState(PointerWrap &p) = 0;
+};
+
+extern GPUInterface *gpu;
@@ -0,0 +1,837 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "Thread.h"
+
+#include "../../Core/MemMap.h"
+#include "../GPUState.h"
+#include "../ge_constants.h"
+
+#include "Rasterizer.h"
+
+namespace Rasterizer
+{
+
+enum
+{
+	TILE_SHIFT = 5,
+	TILE_SIZE = 1 << TILE_SHIFT,
+	// The GE can address 1024x1024 but nothing displays more than 512 wide.
+	MAX_WIDTH = 512,
+	MAX_HEIGHT = 512,
+	TILES_X = MAX_WIDTH / TILE_SIZE,
+	TILES_Y = MAX_HEIGHT / TILE_SIZE,
+	MAX_TRIANGLES = 8192,
+	// Below this many triangles, waking the workers costs more than it saves.
+	MIN_PARALLEL_TRIANGLES = 8,
+};
+
+// Everything the pixel pipeline needs, captured when a batch starts.
+struct RasterState
+{
+	GPUgstate gs;
+
+	u8 *fb;
+	int fbStride;
+	GEBufferFormat fbFormat;
+	u16 *zb;
+	int zbStride;
+
+	int scissorX1, scissorY1, scissorX2, scissorY2;
+
+	bool clearMode;
+	bool textureEnable;
+	bool gouraud;
+
+	const u8 *tex;
+	int texWidth, texHeight, texBufWidth;
+	GETextureFormat texFormat;
+	bool texSwizzled;
+};
+
+struct Triangle
+{
+	ScreenVertex v[3];
+	// Vertex positions in 28.4 fixed point.
+	s64 fx[3], fy[3];
+	// Edge i is opposite vertex i. E(px, py) = a * px + b * py + c, >= 0 inside.
+	s64 a[3], b[3], c[3];
+	float invArea;
+	int minX, minY, maxX, maxY;
+	bool flat;
+};
+
+static RasterState state;
+static std::vector<Triangle> triangles;
+static std::vector<u16> bins[TILES_Y][TILES_X];
+static std::vector<int> activeTiles;
+
+// Worker pool. Slice 0 is always run by the emulation thread.
+static std::vector<std::thread *> workers;
+static std::mutex jobMutex;
+static std::condition_variable jobCond;
+static std::condition_variable doneCond;
+static u32 jobGeneration;
+static int workersDone;
+static int numSlices = 1;
+static bool quitting;
+
+static void RasterizeSlice(int slice, int sliceCount);
+
+static void WorkerThread(int slice)
+{
+	char name[32];
+	sprintf(name, "SoftGPU worker %i", slice);
+	Common::SetCurrentThreadName(name);
+
+	u32 seenGeneration = 0;
+	while (true)
+	{
+		int sliceCount;
+		{
+			std::unique_lock<std::mutex> lk(jobMutex);
+			while (!quitting && jobGeneration == seenGeneration)
+				jobCond.wait(lk);
+			if (quitting)
+				return;
+			seenGeneration = jobGeneration;
+			sliceCount = numSlices;
+		}
+
+		RasterizeSlice(slice, sliceCount);
+
+		{
+			std::unique_lock<std::mutex> lk(jobMutex);
+			workersDone++;
+		}
+		doneCond.notify_one();
+	}
+}
+
+void Init(int numThreads)
+{
+	if (numThreads < 1)
+		numThreads = 1;
+	if (numThreads > 16)
+		numThreads = 16;
+
+	quitting = false;
+	jobGeneration = 0;
+	workersDone = 0;
+	numSlices = numThreads;
+	triangles.reserve(MAX_TRIANGLES);
+	for (int i = 1; i < numThreads; i++)
+		workers.push_back(new std::thread(WorkerThread, i));
+
+	INFO_LOG(G3D, "Software rasterizer: %i threads, %ix%i tiles", numThreads, (int)TILE_SIZE, (int)TILE_SIZE);
+}
+
+void Shutdown()
+{
+	{
+		std::unique_lock<std::mutex> lk(jobMutex);
+		quitting = true;
+	}
+	jobCond.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i]->join();
+		delete workers[i];
+	}
+	workers.clear();
+	triangles.clear();
+	activeTiles.clear();
+	for (int y = 0; y < TILES_Y; y++)
+		for (int x = 0; x < TILES_X; x++)
+			bins[y][x].clear();
+}
+
+bool HasPendingWork()
+{
+	return !triangles.empty();
+}
+
+// Returns the byte offset of texel (x, y), handling the swizzled 16x8 byte block layout.
+static inline u32 TexelOffset(int x, int y, int bitsPerPixel)
+{
+	u32 rowBytes = (state.texBufWidth * bitsPerPixel) >> 3;
+	u32 xBytes = (x * bitsPerPixel) >> 3;
+	if (!state.texSwizzled)
+		return y * rowBytes + xBytes;
+	u32 blocksPerRow = rowBytes >> 4;
+	u32 block = (y >> 3) * blocksPerRow + (xBytes >> 4);
+	return block * 128 + (y & 7) * 16 + (xBytes & 15);
+}
+
+static int TexelBits(GETextureFormat format)
+{
+	switch (format)
+	{
+	case GE_TFMT_CLUT4: return 4;
+	case GE_TFMT_CLUT8: return 8;
+	case GE_TFMT_8888:
+	case GE_TFMT_CLUT32: return 32;
+	case GE_TFMT_5650:
+	case GE_TFMT_5551:
+	case GE_TFMT_4444:
+	case GE_TFMT_CLUT16: return 16;
+	default: return 0;
+	}
+}
+
+// How many bytes sampling can touch. Texel offsets grow with both x and y, swizzled or not, so
+// it's up to the end of the last texel, or of the last block when swizzled.
+static u32 TextureBytes()
+{
+	int bits = TexelBits(state.texFormat);
+	if (bits == 0)
+		return 0;
+	u32 last = TexelOffset(state.texWidth - 1, state.texHeight - 1, bits);
+	if (state.texSwizzled)
+		return (last & ~127) + 128;
+	return last + (bits + 7) / 8;
+}
+
+static void SnapshotState()
+{
+	const GPUgstate &gs = gstate;
+	state.gs = gs;
+
+	state.fbFormat = (GEBufferFormat)(gs.framebufpixformat & 3);
+	state.fbStride = gs.fbwidth & 0x7FC;
+	state.zbStride = gs.zbwidth & 0x7FC;
+	u32 fbOffset = gs.fbptr & 0x1FFFF0;
+	u32 zbOffset = gs.zbptr & 0x1FFFF0;
+	state.fb = Memory::m_pVRAM + fbOffset;
+	state.zb = (u16 *)(Memory::m_pVRAM + zbOffset);
+
+	state.scissorX1 = gs.scissor1 & 0x3FF;
+	state.scissorY1 = (gs.scissor1 >> 10) & 0x3FF;
+	state.scissorX2 = gs.scissor2 & 0x3FF;
+	state.scissorY2 = (gs.scissor2 >> 10) & 0x3FF;
+	if (state.scissorX2 >= MAX_WIDTH)
+		state.scissorX2 = MAX_WIDTH - 1;
+	if (state.scissorY2 >= MAX_HEIGHT)
+		state.scissorY2 = MAX_HEIGHT - 1;
+	if (state.scissorX2 >= state.fbStride)
+		state.scissorX2 = state.fbStride - 1;
+
+	// Never let a bad pointer or stride make us write outside VRAM.
+	int bpp = state.fbFormat == GE_FORMAT_8888 ? 4 : 2;
+	if (state.fbStride > 0)
+	{
+		int maxRows = (Memory::VRAM_SIZE - fbOffset) / (state.fbStride * bpp);
+		if (state.scissorY2 >= maxRows)
+			state.scissorY2 = maxRows - 1;
+	}
+	if (state.zbStride > 0)
+	{
+		int maxRows = (Memory::VRAM_SIZE - zbOffset) / (state.zbStride * 2);
+		if (state.scissorY2 >= maxRows)
+			state.scissorY2 = maxRows - 1;
+	}
+	else
+	{
+		state.zb = 0;
+	}
+
+	state.clearMode = (gs.clearmode & 1) != 0;
+	state.gouraud = (gs.lmode & 1) != 0;
+	state.textureEnable = (gs.textureMapEnable & 1) && !state.clearMode;
+
+	state.tex = 0;
+	if (state.textureEnable)
+	{
+		u32 texaddr = (gs.texaddr[0] & 0xFFFFF0) | ((gs.texbufwidth[0] << 8) & 0x0F000000);
+		state.texWidth = 1 << (gs.texsize[0] & 0xf);
+		state.texHeight = 1 << ((gs.texsize[0] >> 8) & 0xf);
+		state.texBufWidth = gs.texbufwidth[0] & 0x7FF;
+		if (state.texBufWidth == 0)
+			state.texBufWidth = state.texWidth;
+		state.texFormat = (GETextureFormat)(gs.texformat & 0xF);
+		state.texSwizzled = (gs.texmode & 1) != 0;
+		// The sizes come straight from the game, don't sample past the end of memory. Sampling
+		// goes through one host pointer, so the texture can't cross into another mirror either.
+		if (Memory::IsValidAddress(texaddr) && Memory::ContiguousSize(texaddr) >= TextureBytes())
+			state.tex = Memory::GetPointer(texaddr);
+		else
+			state.textureEnable = false;
+	}
+}
+
+static inline bool IsTopLeft(s64 a, s64 b)
+{
+	// Any rule works as long as exactly one of two triangles sharing an edge owns it.
+	return a > 0 || (a == 0 && b > 0);
+}
+
+static void BinTriangle(int index)
+{
+	const Triangle &t = triangles[index];
+	int tx1 = t.minX >> TILE_SHIFT;
+	int ty1 = t.minY >> TILE_SHIFT;
+	int tx2 = t.maxX >> TILE_SHIFT;
+	int ty2 = t.maxY >> TILE_SHIFT;
+
+	for (int ty = ty1; ty <= ty2; ty++)
+	{
+		for (int tx = tx1; tx <= tx2; tx++)
+		{
+			// Reject the tile if it's completely outside one of the edges.
+			s64 x0 = (tx << TILE_SHIFT) * 16 + 8, y0 = (ty << TILE_SHIFT) * 16 + 8;
+			s64 x1 = x0 + (TILE_SIZE - 1) * 16, y1 = y0 + (TILE_SIZE - 1) * 16;
+			bool outside = false;
+			for (int e = 0; e < 3 && !outside; e++)
+			{
+				s64 ex = t.a[e] > 0 ? x1 : x0;
+				s64 ey = t.b[e] > 0 ? y1 : y0;
+				if (t.a[e] * ex + t.b[e] * ey + t.c[e] < 0)
+					outside = true;
+			}
+			if (outside)
+				continue;
+
+			std::vector<u16> &bin = bins[ty][tx];
+			if (bin.empty())
+				activeTiles.push_back(ty * TILES_X + tx);
+			bin.push_back((u16)index);
+		}
+	}
+}
+
+static void AddTriangleInternal(const ScreenVertex &v0, const ScreenVertex &v1, const ScreenVertex &v2, bool flat)
+{
+	if (triangles.empty())
+		SnapshotState();
+	if (state.scissorX2 < state.scissorX1 || state.scissorY2 < state.scissorY1)
+		return;
+
+	Triangle t;
+	t.v[0] = v0;
+	t.v[1] = v1;
+	t.v[2] = v2;
+	t.flat = flat || !state.gouraud;
+
+	for (int i = 0; i < 3; i++)
+	{
+		// Keep the fixed point math well inside 64 bits even for garbage coordinates.
+		float x = t.v[i].x, y = t.v[i].y;
+		if (!(x > -4096.0f)) x = -4096.0f;
+		if (!(x < 4096.0f)) x = 4096.0f;
+		if (!(y > -4096.0f)) y = -4096.0f;
+		if (!(y < 4096.0f)) y = 4096.0f;
+		t.fx[i] = (s64)(x * 16.0f);
+		t.fy[i] = (s64)(y * 16.0f);
+	}
+
+	s64 area = (t.fx[1] - t.fx[0]) * (t.fy[2] - t.fy[0]) - (t.fy[1] - t.fy[0]) * (t.fx[2] - t.fx[0]);
+	if (area == 0)
+		return;
+	if (area < 0)
+	{
+		// Culling has already been done, make the winding consistent. The provoking vertex stays last.
+		std::swap(t.v[0], t.v[1]);
+		std::swap(t.fx[0], t.fx[1]);
+		std::swap(t.fy[0], t.fy[1]);
+		area = -area;
+	}
+	t.invArea = 1.0f / (float)area;
+
+	for (int e = 0; e < 3; e++)
+	{
+		int i0 = (e + 1) % 3, i1 = (e + 2) % 3;
+		t.a[e] = t.fy[i0] - t.fy[i1];
+		t.b[e] = t.fx[i1] - t.fx[i0];
+		t.c[e] = t.fx[i0] * t.fy[i1] - t.fy[i0] * t.fx[i1];
+		if (!IsTopLeft(t.a[e], t.b[e]))
+			t.c[e] -= 1;
+	}
+
+	s64 minFX = std::min(t.fx[0], std::min(t.fx[1], t.fx[2]));
+	s64 maxFX = std::max(t.fx[0], std::max(t.fx[1], t.fx[2]));
+	s64 minFY = std::min(t.fy[0], std::min(t.fy[1], t.fy[2]));
+	s64 maxFY = std::max(t.fy[0], std::max(t.fy[1], t.fy[2]));
+	t.minX = std::max((int)((minFX + 7) >> 4), state.scissorX1);
+	t.minY = std::max((int)((minFY + 7) >> 4), state.scissorY1);
+	t.maxX = std::min((int)((maxFX - 8) >> 4), state.scissorX2);
+	t.maxY = std::min((int)((maxFY - 8) >> 4), state.scissorY2);
+	if (t.minX > t.maxX || t.minY > t.maxY)
+		return;
+
+	triangles.push_back(t);
+	BinTriangle((int)triangles.size() - 1);
+
+	if (triangles.size() >= MAX_TRIANGLES)
+		Flush();
+}
+
+void AddTriangle(const ScreenVertex &v0, const ScreenVertex &v1, const ScreenVertex &v2)
+{
+	AddTriangleInternal(v0, v1, v2, false);
+}
+
+void AddRectangle(const ScreenVertex &tl, const ScreenVertex &br)
+{
+	// Split into two triangles. UVs are affine across the rectangle so this is exact,
+	// and the color always comes from the second vertex.
+	ScreenVertex tr = br, bl = br;
+	tr.y = tl.y;
+	tr.uv[1] = tl.uv[1];
+	bl.x = tl.x;
+	bl.uv[0] = tl.uv[0];
+	ScreenVertex a = tl;
+	memcpy(a.color, br.color, sizeof(a.color));
+	a.z = br.z;
+	AddTriangleInternal(a, tr, br, true);
+	AddTriangleInternal(a, bl, br, true);
+}
+
+// Pixel pipeline
+
+struct Color
+{
+	int r, g, b, a;
+};
+
+static inline int Clamp255(int v)
+{
+	return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+static inline Color DecodeColor(u32 c)
+{
+	Color col;
+	col.r = c & 0xFF;
+	col.g = (c >> 8) & 0xFF;
+	col.b = (c >> 16) & 0xFF;
+	col.a = c >> 24;
+	return col;
+}
+
+static inline u32 Convert565(u16 c)
+{
+	u32 r = (c & 0x1F), g = (c >> 5) & 0x3F, b = (c >> 11) & 0x1F;
+	r = (r << 3) | (r >> 2);
+	g = (g << 2) | (g >> 4);
+	b = (b << 3) | (b >> 2);
+	return 0xFF000000 | (b << 16) | (g << 8) | r;
+}
+
+static inline u32 Convert5551(u16 c)
+{
+	u32 r = (c & 0x1F), g = (c >> 5) & 0x1F, b = (c >> 10) & 0x1F;
+	r = (r << 3) | (r >> 2);
+	g = (g << 3) | (g >> 2);
+	b = (b << 3) | (b >> 2);
+	u32 a = (c & 0x8000) ? 0xFF000000 : 0;
+	return a | (b << 16) | (g << 8) | r;
+}
+
+static inline u32 Convert4444(u16 c)
+{
+	u32 r = c & 0xF, g = (c >> 4) & 0xF, b = (c >> 8) & 0xF, a = c >> 12;
+	return ((a * 0x11) << 24) | ((b * 0x11) << 16) | ((g * 0x11) << 8) | (r * 0x11);
+}
+
+static inline u32 LookupClut(const GPUgstate &gs, int index)
+{
+	int pf = gs.clutformat & 3;
+	int shift = (gs.clutformat >> 2) & 31;
+	int mask = (gs.clutformat >> 8) & 255;
+	int start = ((gs.clutformat >> 16) & 31) * 16;
+	int i = ((index >> shift) & mask) | start;
+	const u16 *pal16 = (const u16 *)gs.paletteMem;
+	switch (pf)
+	{
+	case GE_FORMAT_565: return Convert565(pal16[i]);
+	case GE_FORMAT_5551: return Convert5551(pal16[i]);
+	case GE_FORMAT_4444: return Convert4444(pal16[i]);
+	default: return ((const u32 *)gs.paletteMem)[i & 255];
+	}
+}
+
+static u32 SampleTexture(float u, float v)
+{
+	const GPUgstate &gs = state.gs;
+	int x = (int)floorf(u * state.texWidth);
+	int y = (int)floorf(v * state.texHeight);
+	if (gs.texwrap & 1)
+		x = x < 0 ? 0 : (x >= state.texWidth ? state.texWidth - 1 : x);
+	else
+		x &= state.texWidth - 1;
+	if ((gs.texwrap >> 8) & 1)
+		y = y < 0 ? 0 : (y >= state.texHeight ? state.texHeight - 1 : y);
+	else
+		y &= state.texHeight - 1;
+
+	const u8 *tex = state.tex;
+	switch (state.texFormat)
+	{
+	case GE_TFMT_5650:
+		return Convert565(*(const u16 *)(tex + TexelOffset(x, y, 16)));
+	case GE_TFMT_5551:
+		return Convert5551(*(const u16 *)(tex + TexelOffset(x, y, 16)));
+	case GE_TFMT_4444:
+		return Convert4444(*(const u16 *)(tex + TexelOffset(x, y, 16)));
+	case GE_TFMT_8888:
+		return *(const u32 *)(tex + TexelOffset(x, y, 32));
+	case GE_TFMT_CLUT4:
+		{
+			u8 pair = tex[TexelOffset(x, y, 4)];
+			return LookupClut(gs, (x & 1) ? (pair >> 4) : (pair & 0xF));
+		}
+	case GE_TFMT_CLUT8:
+		return LookupClut(gs, tex[TexelOffset(x, y, 8)]);
+	case GE_TFMT_CLUT16:
+		return LookupClut(gs, *(const u16 *)(tex + TexelOffset(x, y, 16)));
+	case GE_TFMT_CLUT32:
+		return LookupClut(gs, *(const u32 *)(tex + TexelOffset(x, y, 32)));
+	default:
+		// TODO: DXT formats.
+		return 0xFFFFFFFF;
+	}
+}
+
+static inline Color ApplyTexFunc(const Color &prim, const Color &tex)
+{
+	const GPUgstate &gs = state.gs;
+	bool useTexAlpha = ((gs.texfunc >> 8) & 1) != 0;
+	Color out;
+	switch (gs.texfunc & 7)
+	{
+	case GE_TEXFUNC_MODULATE:
+		out.r = (prim.r * tex.r) / 255;
+		out.g = (prim.g * tex.g) / 255;
+		out.b = (prim.b * tex.b) / 255;
+		out.a = useTexAlpha ? (prim.a * tex.a) / 255 : prim.a;
+		break;
+	case GE_TEXFUNC_DECAL:
+		if (useTexAlpha)
+		{
+			out.r = (prim.r * (255 - tex.a) + tex.r * tex.a) / 255;
+			out.g = (prim.g * (255 - tex.a) + tex.g * tex.a) / 255;
+			out.b = (prim.b * (255 - tex.a) + tex.b * tex.a) / 255;
+		}
+		else
+		{
+			out.r = tex.r;
+			out.g = tex.g;
+			out.b = tex.b;
+		}
+		out.a = prim.a;
+		break;
+	case GE_TEXFUNC_BLEND:
+		{
+			Color env = DecodeColor(gs.texenvcolor);
+			out.r = (prim.r * (255 - tex.r) + env.r * tex.r) / 255;
+			out.g = (prim.g * (255 - tex.g) + env.g * tex.g) / 255;
+			out.b = (prim.b * (255 - tex.b) + env.b * tex.b) / 255;
+			out.a = useTexAlpha ? (prim.a * tex.a) / 255 : prim.a;
+		}
+		break;
+	case GE_TEXFUNC_REPLACE:
+		out = tex;
+		if (!useTexAlpha)
+			out.a = prim.a;
+		break;
+	case GE_TEXFUNC_ADD:
+	default:
+		out.r = Clamp255(prim.r + tex.r);
+		out.g = Clamp255(prim.g + tex.g);
+		out.b = Clamp255(prim.b + tex.b);
+		out.a = useTexAlpha ? (prim.a * tex.a) / 255 : prim.a;
+		break;
+	}
+
+	// Color doubling.
+	if ((gs.texfunc >> 16) & 1)
+	{
+		out.r = Clamp255(out.r * 2);
+		out.g = Clamp255(out.g * 2);
+		out.b = Clamp255(out.b * 2);
+	}
+	return out;
+}
+
+static inline bool Compare(int func, int a, int b)
+{
+	switch (func)
+	{
+	case GE_COMP_NEVER: return false;
+	case GE_COMP_ALWAYS: return true;
+	case GE_COMP_EQUAL: return a == b;
+	case GE_COMP_NOTEQUAL: return a != b;
+	case GE_COMP_LESS: return a < b;
+	case GE_COMP_LEQUAL: return a <= b;
+	case GE_COMP_GREATER: return a > b;
+	case GE_COMP_GEQUAL: return a >= b;
+	}
+	return true;
+}
+
+static inline u32 ReadPixel(int x, int y)
+{
+	switch (state.fbFormat)
+	{
+	case GE_FORMAT_565: return Convert565(((u16 *)state.fb)[y * state.fbStride + x]);
+	case GE_FORMAT_5551: return Convert5551(((u16 *)state.fb)[y * state.fbStride + x]);
+	case GE_FORMAT_4444: return Convert4444(((u16 *)state.fb)[y * state.fbStride + x]);
+	default: return ((u32 *)state.fb)[y * state.fbStride + x];
+	}
+}
+
+static inline void WritePixel(int x, int y, u32 c)
+{
+	int r = c & 0xFF, g = (c >> 8) & 0xFF, b = (c >> 16) & 0xFF, a = c >> 24;
+	switch (state.fbFormat)
+	{
+	case GE_FORMAT_565:
+		((u16 *)state.fb)[y * state.fbStride + x] = (r >> 3) | ((g >> 2) << 5) | ((b >> 3) << 11);
+		break;
+	case GE_FORMAT_5551:
+		((u16 *)state.fb)[y * state.fbStride + x] = (r >> 3) | ((g >> 3) << 5) | ((b >> 3) << 10) | ((a >> 7) << 15);
+		break;
+	case GE_FORMAT_4444:
+		((u16 *)state.fb)[y * state.fbStride + x] = (r >> 4) | ((g >> 4) << 4) | ((b >> 4) << 8) | ((a >> 4) << 12);
+		break;
+	default:
+		((u32 *)state.fb)[y * state.fbStride + x] = c;
+		break;
+	}
+}
+
+static inline int BlendFactor(int factor, bool isSrc, const Color &src, const Color &dst, int channel, int fixedColor)
+{
+	int srcC = channel == 0 ? src.r : (channel == 1 ? src.g : src.b);
+	int dstC = channel == 0 ? dst.r : (channel == 1 ? dst.g : dst.b);
+	switch (factor)
+	{
+	// The first two factors are the "other" color: dst for the source side, src for the dest side.
+	case 0: return isSrc ? dstC : srcC;
+	case 1: return 255 - (isSrc ? dstC : srcC);
+	case 2: return src.a;
+	case 3: return 255 - src.a;
+	case 4: return dst.a;
+	case 5: return 255 - dst.a;
+	case 6: return Clamp255(src.a * 2);
+	case 7: return Clamp255((255 - src.a) * 2);
+	case 8: return Clamp255(dst.a * 2);
+	case 9: return Clamp255((255 - dst.a) * 2);
+	default: return (fixedColor >> (channel * 8)) & 0xFF;
+	}
+}
+
+static inline Color Blend(const Color &src, const Color &dst)
+{
+	const GPUgstate &gs = state.gs;
+	int srcFactor = gs.blend & 0xF;
+	int dstFactor = (gs.blend >> 4) & 0xF;
+	int eq = (gs.blend >> 8) & 0x7;
+
+	int s[3] = {src.r, src.g, src.b};
+	int d[3] = {dst.r, dst.g, dst.b};
+	int out[3];
+	for (int i = 0; i < 3; i++)
+	{
+		int sf = BlendFactor(srcFactor, true, src, dst, i, gs.blendfixa);
+		int df = BlendFactor(dstFactor, false, src, dst, i, gs.blendfixb);
+		int sv = (s[i] * sf) / 255;
+		int dv = (d[i] * df) / 255;
+		switch (eq)
+		{
+		case GE_BLENDMODE_MUL_AND_ADD: out[i] = sv + dv; break;
+		case GE_BLENDMODE_MUL_AND_SUBTRACT: out[i] = sv - dv; break;
+		case GE_BLENDMODE_MUL_AND_SUBTRACT_REVERSE: out[i] = dv - sv; break;
+		case GE_BLENDMODE_MIN: out[i] = std::min(s[i], d[i]); break;
+		case GE_BLENDMODE_MAX: out[i] = std::max(s[i], d[i]); break;
+		case GE_BLENDMODE_ABSDIFF: out[i] = abs(s[i] - d[i]); break;
+		default: out[i] = sv + dv; break;
+		}
+	}
+	Color c;
+	c.r = Clamp255(out[0]);
+	c.g = Clamp255(out[1]);
+	c.b = Clamp255(out[2]);
+	c.a = src.a;
+	return c;
+}
+
+static void DrawPixel(int x, int y, Color prim, int z, float u, float v)
+{
+	const GPUgstate &gs = state.gs;
+
+	if (state.clearMode)
+	{
+		u32 mask = 0;
+		if (gs.clearmode & GE_CLEARMODE_COLOR)
+			mask |= 0x00FFFFFF;
+		if (gs.clearmode & GE_CLEARMODE_ALPHA)
+			mask |= 0xFF000000;
+		if (mask)
+		{
+			u32 newColor = prim.r | (prim.g << 8) | (prim.b << 16) | (prim.a << 24);
+			u32 old = mask == 0xFFFFFFFF ? 0 : ReadPixel(x, y);
+			WritePixel(x, y, (newColor & mask) | (old & ~mask));
+		}
+		if ((gs.clearmode & GE_CLEARMODE_Z) && state.zb)
+			state.zb[y * state.zbStride + x] = (u16)z;
+		return;
+	}
+
+	Color c = prim;
+	if (state.textureEnable)
+		c = ApplyTexFunc(prim, DecodeColor(SampleTexture(u, v)));
+
+	if (gs.alphaTestEnable & 1)
+	{
+		int ref = (gs.alphatest >> 8) & 0xFF;
+		int mask = (gs.alphatest >> 16) & 0xFF;
+		if (!Compare(gs.alphatest & 7, c.a & mask, ref & mask))
+			return;
+	}
+
+	if ((gs.zTestEnable & 1) && state.zb)
+	{
+		u16 &depth = state.zb[y * state.zbStride + x];
+		if (!Compare(gs.ztestfunc & 7, z, depth))
+			return;
+		if (!(gs.zmsk & 1))
+			depth = (u16)z;
+	}
+
+	u32 dstColor = ReadPixel(x, y);
+	if (gs.alphaBlendEnable & 1)
+		c = Blend(c, DecodeColor(dstColor));
+
+	// Outside clear mode the alpha channel holds stencil, which we don't emulate yet. Keep it.
+	u32 newColor = c.r | (c.g << 8) | (c.b << 16) | (dstColor & 0xFF000000);
+	u32 writeMask = ~((gs.pmsk1 & 0xFFFFFF) | ((gs.pmsk2 & 0xFF) << 24));
+	WritePixel(x, y, (newColor & writeMask) | (dstColor & ~writeMask));
+}
+
+static void RasterizeTriangleInTile(const Triangle &t, int tileX1, int tileY1, int tileX2, int tileY2)
+{
+	int x1 = std::max(t.minX, tileX1), x2 = std::min(t.maxX, tileX2);
+	int y1 = std::max(t.minY, tileY1), y2 = std::min(t.maxY, tileY2);
+	if (x1 > x2 || y1 > y2)
+		return;
+
+	const ScreenVertex &v0 = t.v[0], &v1 = t.v[1], &v2 = t.v[2];
+	Color flatColor;
+	flatColor.r = (int)(v2.color[0] * 255.0f + 0.5f);
+	flatColor.g = (int)(v2.color[1] * 255.0f + 0.5f);
+	flatColor.b = (int)(v2.color[2] * 255.0f + 0.5f);
+	flatColor.a = (int)(v2.color[3] * 255.0f + 0.5f);
+
+	for (int y = y1; y <= y2; y++)
+	{
+		s64 py = y * 16 + 8;
+		s64 px = x1 * 16 + 8;
+		s64 e0 = t.a[0] * px + t.b[0] * py + t.c[0];
+		s64 e1 = t.a[1] * px + t.b[1] * py + t.c[1];
+		s64 e2 = t.a[2] * px + t.b[2] * py + t.c[2];
+		s64 step0 = t.a[0] * 16, step1 = t.a[1] * 16, step2 = t.a[2] * 16;
+
+		for (int x = x1; x <= x2; x++, e0 += step0, e1 += step1, e2 += step2)
+		{
+			if ((e0 | e1 | e2) < 0)
+				continue;
+
+			float w0 = (float)e0 * t.invArea;
+			float w1 = (float)e1 * t.invArea;
+			float w2 = 1.0f - w0 - w1;
+
+			float zf = v0.z * w0 + v1.z * w1 + v2.z * w2;
+			int z = zf < 0.0f ? 0 : (zf > 65535.0f ? 65535 : (int)zf);
+
+			Color c;
+			if (t.flat)
+			{
+				c = flatColor;
+			}
+			else
+			{
+				c.r = Clamp255((int)((v0.color[0] * w0 + v1.color[0] * w1 + v2.color[0] * w2) * 255.0f + 0.5f));
+				c.g = Clamp255((int)((v0.color[1] * w0 + v1.color[1] * w1 + v2.color[1] * w2) * 255.0f + 0.5f));
+				c.b = Clamp255((int)((v0.color[2] * w0 + v1.color[2] * w1 + v2.color[2] * w2) * 255.0f + 0.5f));
+				c.a = Clamp255((int)((v0.color[3] * w0 + v1.color[3] * w1 + v2.color[3] * w2) * 255.0f + 0.5f));
+			}
+
+			float u = 0.0f, v = 0.0f;
+			if (state.textureEnable)
+			{
+				float q0 = v0.invw * w0, q1 = v1.invw * w1, q2 = v2.invw * w2;
+				float invq = 1.0f / (q0 + q1 + q2);
+				u = (v0.uv[0] * q0 + v1.uv[0] * q1 + v2.uv[0] * q2) * invq;
+				v = (v0.uv[1] * q0 + v1.uv[1] * q1 + v2.uv[1] * q2) * invq;
+			}
+
+			DrawPixel(x, y, c, z, u, v);
+		}
+	}
+}
+
+static void RasterizeSlice(int slice, int sliceCount)
+{
+	for (size_t i = slice; i < activeTiles.size(); i += sliceCount)
+	{
+		int tile = activeTiles[i];
+		int tx = tile % TILES_X, ty = tile / TILES_X;
+		int x1 = tx << TILE_SHIFT, y1 = ty << TILE_SHIFT;
+		int x2 = x1 + TILE_SIZE - 1, y2 = y1 + TILE_SIZE - 1;
+		const std::vector<u16> &bin = bins[ty][tx];
+		for (size_t j = 0; j < bin.size(); j++)
+			RasterizeTriangleInTile(triangles[bin[j]], x1, y1, x2, y2);
+	}
+}
+
+void Flush()
+{
+	if (triangles.empty())
+		return;
+
+	if (workers.empty() || triangles.size() < MIN_PARALLEL_TRIANGLES || activeTiles.size() == 1)
+	{
+		RasterizeSlice(0, 1);
+	}
+	else
+	{
+		{
+			std::unique_lock<std::mutex> lk(jobMutex);
+			workersDone = 0;
+			jobGeneration++;
+		}
+		jobCond.notify_all();
+
+		RasterizeSlice(0, numSlices);
+
+		std::unique_lock<std::mutex> lk(jobMutex);
+		while (workersDone < (int)workers.size())
+			doneCond.wait(lk);
+	}
+
+	for (size_t i = 0; i < activeTiles.size(); i++)
+		bins[activeTiles[i] / TILES_X][activeTiles[i] % TILES_X].clear();
+	activeTiles.clear();
+	triangles.clear();
+}
+
+}  // namespace Rasterizer
@@ -0,0 +1,57 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include "../../Globals.h"
+
+// Tile based triangle rasterizer that writes straight into emulated VRAM/RAM.
+//
+// Triangles are set up and binned into 32x32 pixel tiles on the emulation thread. On Flush,
+// the tiles are handed out to worker threads, each of which rasterizes every triangle
+// touching its tiles in submission order, so the output does not depend on the thread count.
+//
+// All the raster state is snapshotted from gstate when the first triangle of a batch is
+// added, so the caller must Flush before changing any state that the rasterizer reads.
+
+namespace Rasterizer
+{
+
+// A vertex after transform and viewport mapping.
+struct ScreenVertex
+{
+	float x, y;     // Pixels, relative to the framebuffer origin.
+	float z;        // 0..65535
+	float invw;     // 1/w for perspective correct texturing. 1.0 in through mode.
+	float color[4]; // 0..1
+	float uv[2];    // Normalized texture coordinates.
+};
+
+// numThreads includes the emulation thread, which also rasterizes tiles while waiting.
+void Init(int numThreads);
+void Shutdown();
+
+// v2 is the provoking vertex, used for flat shading.
+void AddTriangle(const ScreenVertex &v0, const ScreenVertex &v1, const ScreenVertex &v2);
+// Sprites are axis aligned and not interpolated, like GE_PRIM_RECTANGLES.
+void AddRectangle(const ScreenVertex &tl, const ScreenVertex &br);
+
+// Rasterizes everything added so far. Blocks until all tiles are done.
+void Flush();
+bool HasPendingWork();
+
+}  // namespace Rasterizer
@@ -0,0 +1,146 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstring>
+
+#include "../../Core/MemMap.h"
+#include "../../Common/CPUDetect.h"
+#include "../../Common/ChunkFile.h"
+#include "../GPUState.h"
+#include "../ge_constants.h"
+
+#include "Rasterizer.h"
+#include "TransformUnit.h"
+#include "SoftGpu.h"
+
+// More than this rarely helps, the tiles of a 480x272 framebuffer run out quickly.
+static const int MAX_RASTER_THREADS = 8;
+
+SoftGPU::SoftGPU()
+{
+	int numThreads = cpu_info.num_cores;
+	if (numThreads < 1)
+		numThreads = 1;
+	if (numThreads > MAX_RASTER_THREADS)
+		numThreads = MAX_RASTER_THREADS;
+	Rasterizer::Init(numThreads);
+}
+
+SoftGPU::~SoftGPU()
+{
+	Rasterizer::Shutdown();
+}
+
+bool SoftGPU::InterpretList()
+{
+	bool result = GPUCommon::InterpretList();
+	// The list may be stalled, but everything drawn so far must be visible to the CPU.
+	Rasterizer::Flush();
+	return result;
+}
+
+void SoftGPU::DoState(PointerWrap &p)
+{
+	// Drawing still in flight would land in VRAM after it was saved or loaded.
+	Rasterizer::Flush();
+	GPUCommon::DoState(p);
+}
+
+void SoftGPU::Flush()
+{
+	Rasterizer::Flush();
+}
+
+void SoftGPU::ExecuteOp(u32 op, u32 diff)
+{
+	u32 cmd = op >> 24;
+	u32 data = op & 0xFFFFFF;
+
+	// The rasterizer snapshots gstate when a batch starts, so anything that affects rasterization
+	// must flush the current batch before the next triangle picks up the new state.
+	if (diff && (cmd >= GE_CMD_FRAMEBUFPTR || (cmd >= GE_CMD_CLIPENABLE && cmd <= GE_CMD_LOGICOPENABLE) || cmd == GE_CMD_LMODE))
+		Rasterizer::Flush();
+
+	switch (cmd)
+	{
+	case GE_CMD_PRIM:
+		{
+			u32 count = data & 0xFFFF;
+			u32 type = data >> 16;
+			DEBUG_LOG(G3D, "Software DrawPrim type: %i count: %i", type, count);
+
+			void *verts = Memory::GetPointer(gstate.vertexAddr);
+			void *inds = 0;
+			if ((gstate.vertType & GE_VTYPE_IDX_MASK) != GE_VTYPE_IDX_NONE)
+				inds = Memory::GetPointer(gstate.indexAddr);
+			TransformUnit::SubmitPrimitive(verts, inds, type, count);
+		}
+		break;
+
+	case GE_CMD_BEZIER:
+	case GE_CMD_SPLINE:
+		ERROR_LOG(G3D, "Software: Bezier/spline patches not supported yet");
+		break;
+
+	case GE_CMD_LOADCLUT:
+	case GE_CMD_TEXFLUSH:
+		// The palette and texture memory are read directly, so never let a batch straddle these.
+		Rasterizer::Flush();
+		break;
+
+	case GE_CMD_TRANSFERSTART:
+		Rasterizer::Flush();
+		DoBlockTransfer();
+		break;
+
+	default:
+		// Everything else only updates gstate, which the rasterizer reads when it needs it.
+		break;
+	}
+}
+
+void SoftGPU::DoBlockTransfer()
+{
+	u32 srcBase = gstate.transfersrc | ((gstate.transfersrcw & 0xFF0000) << 8);
+	u32 srcStride = gstate.transfersrcw & 0x3FF;
+	u32 dstBase = gstate.transferdst | ((gstate.transferdstw & 0xFF0000) << 8);
+	u32 dstStride = gstate.transferdstw & 0x3FF;
+
+	u32 srcPos = gstate.cmdmem[GE_CMD_TRANSFERSRCPOS];
+	u32 dstPos = gstate.cmdmem[GE_CMD_TRANSFERDSTPOS];
+	u32 size = gstate.cmdmem[GE_CMD_TRANSFERSIZE];
+	int srcX = srcPos & 0x3FF, srcY = (srcPos >> 10) & 0x3FF;
+	int dstX = dstPos & 0x3FF, dstY = (dstPos >> 10) & 0x3FF;
+	int width = (size & 0x3FF) + 1, height = ((size >> 10) & 0x3FF) + 1;
+	int bpp = (gstate.cmdmem[GE_CMD_TRANSFERSTART] & 1) ? 4 : 2;
+
+	DEBUG_LOG(G3D, "Software block transfer: %08x (%i,%i) -> %08x (%i,%i), %ix%i, %i bpp", srcBase, srcX, srcY, dstBase, dstX, dstY, width, height, bpp * 8);
+
+	for (int y = 0; y < height; y++)
+	{
+		u32 src = srcBase + ((srcY + y) * srcStride + srcX) * bpp;
+		u32 dst = dstBase + ((dstY + y) * dstStride + dstX) * bpp;
+		u32 bytes = width * bpp;
+		if (!Memory::IsValidAddress(src) || !Memory::IsValidAddress(src + bytes - 1) ||
+			!Memory::IsValidAddress(dst) || !Memory::IsValidAddress(dst + bytes - 1))
+		{
+			ERROR_LOG(G3D, "Software block transfer: Bad line %i, %08x -> %08x", y, src, dst);
+			return;
+		}
+		memmove(Memory::GetPointer(dst), Memory::GetPointer(src), bytes);
+	}
+}
@@ -0,0 +1,40 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include "../GPUCommon.h"
+
+// Renders entirely on the CPU, straight into emulated VRAM. Slow, but doesn't depend on
+// the host GPU and reads/writes the framebuffer the way games expect, which makes it useful
+// as a reference and for headless testing.
+class SoftGPU : public GPUCommon
+{
+public:
+	SoftGPU();
+	~SoftGPU();
+
+	virtual bool InterpretList();
+	virtual void ExecuteOp(u32 op, u32 diff);
+	virtual void Flush();
+	// Textures are read straight from memory, there's nothing to invalidate.
+	virtual void InvalidateCache(u32 addr, int size) {}
+	virtual void DoState(PointerWrap &p);
+
+private:
+	void DoBlockTransfer();
+};
@@ -0,0 +1,269 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "../../Core/MemMap.h"
+#include "../Math3D.h"
+#include "../GPUState.h"
+#include "../ge_constants.h"
+#include "../GLES/VertexDecoder.h"
+#include "../GLES/TransformPipeline.h"
+
+#include "Rasterizer.h"
+#include "TransformUnit.h"
+
+namespace TransformUnit
+{
+
+using Rasterizer::ScreenVertex;
+
+// Separate from the GLES backend's buffers, both backends can be linked in at once.
+static DecodedVertex decodedVerts[65536];
+
+static inline int GetIndex(const void *inds, int indexType, int i)
+{
+	if (indexType == GE_VTYPE_IDX_8BIT)
+		return ((const u8 *)inds)[i];
+	else if (indexType == GE_VTYPE_IDX_16BIT)
+		return ((const u16 *)inds)[i];
+	return i;
+}
+
+// Returns false if the vertex is behind the eye. We don't clip, so triangles touching such
+// vertices are dropped entirely.
+static bool TransformVertex(ScreenVertex &sv, const DecodedVertex &dv)
+{
+	if (gstate.vertType & GE_VTYPE_THROUGH_MASK)
+	{
+		sv.x = dv.pos[0];
+		sv.y = dv.pos[1];
+		sv.z = dv.pos[2];
+		sv.invw = 1.0f;
+		memcpy(sv.color, dv.color, sizeof(sv.color));
+		sv.uv[0] = dv.uv[0];
+		sv.uv[1] = dv.uv[1];
+	}
+	else
+	{
+		float out[3], norm[3];
+		if ((gstate.vertType & GE_VTYPE_WEIGHT_MASK) == GE_VTYPE_WEIGHT_NONE)
+		{
+			Vec3ByMatrix43(out, dv.pos, gstate.worldMatrix);
+			Norm3ByMatrix43(norm, dv.normal, gstate.worldMatrix);
+		}
+		else
+		{
+			Vec3 psum(0,0,0);
+			Vec3 nsum(0,0,0);
+			int nweights = (gstate.vertType & GE_VTYPE_WEIGHT_MASK) >> GE_VTYPE_WEIGHT_SHIFT;
+			for (int i = 0; i < nweights; i++)
+			{
+				Vec3ByMatrix43(out, dv.pos, gstate.boneMatrix+i*12);
+				Norm3ByMatrix43(norm, dv.normal, gstate.boneMatrix+i*12);
+				Vec3 tpos(out), tnorm(norm);
+				psum += tpos*dv.weights[i];
+				nsum += tnorm*dv.weights[i];
+			}
+			nsum.Normalize();
+			psum.Write(out);
+			nsum.Write(norm);
+		}
+
+		float dots[4] = {0,0,0,0};
+		if (gstate.lightingEnable & 1)
+			Light(sv.color, dv.color, out, norm, dots);
+		else
+			memcpy(sv.color, dv.color, sizeof(sv.color));
+
+		// Same texture coordinate generation as the GLES path.
+		switch (gstate.texmapmode & 0x3)
+		{
+		case 0:	// UV mapping
+			sv.uv[0] = dv.uv[0]*gstate.uScale + gstate.uOff;
+			sv.uv[1] = dv.uv[1]*gstate.vScale + gstate.vOff;
+			break;
+		case 1:
+			{
+				// Projection mapping
+				Vec3 source;
+				switch ((gstate.texmapmode >> 8) & 0x3)
+				{
+				case 0: // Use model space XYZ as source
+					source = dv.pos;
+					break;
+				case 1: // Use unscaled UV as source
+					source = Vec3(dv.uv[0], dv.uv[1], 0.0f);
+					break;
+				case 2: // Use normalized normal as source
+					source = Vec3(norm).Normalized();
+					break;
+				case 3: // Use non-normalized normal as source!
+					source = Vec3(norm);
+					break;
+				}
+				float uvw[3];
+				Vec3ByMatrix43(uvw, &source.x, gstate.tgenMatrix);
+				sv.uv[0] = uvw[0];
+				sv.uv[1] = uvw[1];
+			}
+			break;
+		case 2:
+			// Shade mapping
+			sv.uv[0] = dots[gstate.texshade & 0x3];
+			sv.uv[1] = dots[(gstate.texshade >> 8) & 0x3];
+			break;
+		default:
+			sv.uv[0] = 0.0f;
+			sv.uv[1] = 0.0f;
+			break;
+		}
+
+		float view[3];
+		Vec3ByMatrix43(view, out, gstate.viewMatrix);
+
+		// The projection matrix is stored column major, like GL.
+		const float *p = gstate.projMatrix;
+		float clipX = p[0]*view[0] + p[4]*view[1] + p[8]*view[2] + p[12];
+		float clipY = p[1]*view[0] + p[5]*view[1] + p[9]*view[2] + p[13];
+		float clipZ = p[2]*view[0] + p[6]*view[1] + p[10]*view[2] + p[14];
+		float clipW = p[3]*view[0] + p[7]*view[1] + p[11]*view[2] + p[15];
+		if (!(clipW > 0.0f))
+			return false;
+
+		// Viewport transform. The offset is 12.4 fixed point.
+		float invw = 1.0f / clipW;
+		sv.x = clipX * invw * getFloat24(gstate.viewportx1) + getFloat24(gstate.viewportx2) - (float)(gstate.offsetx & 0xFFFF) / 16.0f;
+		sv.y = clipY * invw * getFloat24(gstate.viewporty1) + getFloat24(gstate.viewporty2) - (float)(gstate.offsety & 0xFFFF) / 16.0f;
+		sv.z = clipZ * invw * getFloat24(gstate.viewportz1) + getFloat24(gstate.viewportz2);
+		sv.invw = invw;
+	}
+
+	if (sv.z < 0.0f)
+		sv.z = 0.0f;
+	else if (sv.z > 65535.0f)
+		sv.z = 65535.0f;
+	return true;
+}
+
+// GL style: front faces are counter clockwise in NDC. cullmode 1 culls back faces, 0 front faces.
+static bool IsCulled(const ScreenVertex &v0, const ScreenVertex &v1, const ScreenVertex &v2)
+{
+	if (!(gstate.cullfaceEnable & 1) || (gstate.vertType & GE_VTYPE_THROUGH_MASK) || (gstate.clearmode & 1))
+		return false;
+
+	float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+	// Screen space is NDC scaled by the viewport, which usually flips Y.
+	if (getFloat24(gstate.viewportx1) * getFloat24(gstate.viewporty1) < 0.0f)
+		area = -area;
+	bool front = area > 0.0f;
+	return (gstate.cullmode & 1) ? !front : front;
+}
+
+void SubmitPrimitive(void *verts, void *inds, int prim, int vertexCount)
+{
+	if (vertexCount <= 0)
+		return;
+
+	int indexType = gstate.vertType & GE_VTYPE_IDX_MASK;
+	if (indexType != GE_VTYPE_IDX_NONE && !inds)
+	{
+		ERROR_LOG(G3D, "Software: Indexed draw with a bad index address %08x", gstate.indexAddr);
+		return;
+	}
+	if (!verts)
+	{
+		ERROR_LOG(G3D, "Software: Draw with a bad vertex address %08x", gstate.vertexAddr);
+		return;
+	}
+
+	VertexDecoder dec;
+	dec.SetVertexType(gstate.vertType);
+	dec.DecodeVerts(decodedVerts, verts, inds, prim, vertexCount);
+
+	switch (prim)
+	{
+	case GE_PRIM_RECTANGLES:
+		for (int i = 0; i + 1 < vertexCount; i += 2)
+		{
+			ScreenVertex tl, br;
+			if (!TransformVertex(tl, decodedVerts[GetIndex(inds, indexType, i)]) ||
+				!TransformVertex(br, decodedVerts[GetIndex(inds, indexType, i + 1)]))
+				continue;
+			Rasterizer::AddRectangle(tl, br);
+		}
+		break;
+
+	case GE_PRIM_TRIANGLES:
+	case GE_PRIM_TRIANGLE_STRIP:
+	case GE_PRIM_TRIANGLE_FAN:
+		{
+			ScreenVertex sv[3];
+			bool valid[3];
+			int numInWindow = 0;
+			for (int i = 0; i < vertexCount; i++)
+			{
+				int slot;
+				if (prim == GE_PRIM_TRIANGLE_FAN)
+					slot = i == 0 ? 0 : 1 + ((i - 1) & 1);
+				else
+					slot = i % 3;
+
+				valid[slot] = TransformVertex(sv[slot], decodedVerts[GetIndex(inds, indexType, i)]);
+				numInWindow++;
+
+				if (prim == GE_PRIM_TRIANGLES)
+				{
+					if (slot != 2)
+						continue;
+					if (valid[0] && valid[1] && valid[2] && !IsCulled(sv[0], sv[1], sv[2]))
+						Rasterizer::AddTriangle(sv[0], sv[1], sv[2]);
+				}
+				else if (numInWindow >= 3)
+				{
+					int a, b;
+					if (prim == GE_PRIM_TRIANGLE_FAN)
+					{
+						// Center, previous, current.
+						a = 0;
+						b = slot == 1 ? 2 : 1;
+					}
+					else
+					{
+						// Flip every other strip triangle so they all have the winding of the first.
+						a = (i + 1) % 3;
+						b = (i + 2) % 3;
+						if (i & 1)
+							std::swap(a, b);
+					}
+					if (valid[a] && valid[b] && valid[slot] && !IsCulled(sv[a], sv[b], sv[slot]))
+						Rasterizer::AddTriangle(sv[a], sv[b], sv[slot]);
+				}
+			}
+		}
+		break;
+
+	default:
+		// TODO: Points and lines.
+		DEBUG_LOG(G3D, "Software: Unsupported primitive type %i", prim);
+		break;
+	}
+}
+
+}  // namespace TransformUnit
@@ -63,11 +63,12 @@ DWORD TheThread(LPVOID x)
   CoreParameter coreParameter;
   coreParameter.fileToStart = fileToStart;
   coreParameter.enableSound = true;
-  coreParameter.gpuCore = GPU_GLES;
+  coreParameter.gpuCore = g_Config.bSoftwareRendering ? GPU_SOFTWARE : GPU_GLES;
   coreParameter.cpuCore = g_Config.bJIT ? CPU_JIT : CPU_INTERPRETER;
   coreParameter.enableDebugging = true;
   coreParameter.printfEmuLog = false;
   coreParameter.headLess = false; //true;
+  coreParameter.jitProfile = false;
 
 	std::string error_string;
 	if (!PSP_Init(coreParameter, &error_string))
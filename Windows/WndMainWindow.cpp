@@ -29,6 +29,7 @@
 #include "W32Util/ShellUtil.h"
 #include "W32Util/Misc.h"
 #include "../Core/Config.h"
+#include "../Core/SaveState.h"
 
 #ifdef THEMES
 #include "XPTheme.h"
@@ -304,16 +305,15 @@ namespace MainWindow
 			case ID_FILE_LOADSTATE:
 				if (W32Util::BrowseForFileName(true, hWnd, "Load state",0,"Save States (*.gcs)\0*.gcs\0All files\0*.*\0\0","gcs",fn))
 				{
-					SetCursor(LoadCursor(0,IDC_WAIT));
-					SetCursor(LoadCursor(0,IDC_ARROW));
+					// Carried out by the emu thread at the next vblank.
+					SaveState::Load(fn);
 				}
 				break;
 
 			case ID_FILE_SAVESTATE:
 				if (W32Util::BrowseForFileName(false, hWnd, "Save state",0,"Save States (*.gcs)\0*.gcs\0All files\0*.*\0\0","gcs",fn))
 				{
-					SetCursor(LoadCursor(0,IDC_WAIT));
-					SetCursor(LoadCursor(0,IDC_ARROW));
+					SaveState::Save(fn);
 				}
 				break;
 
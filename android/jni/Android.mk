@@ -63,6 +63,7 @@ LOCAL_SRC_FILES := \
   $(SRC)/Common/Misc.cpp \
   $(SRC)/GPU/Math3D.cpp \
   $(SRC)/GPU/GpuState.cpp \
+  $(SRC)/GPU/GPUCommon.cpp \
   $(SRC)/GPU/GLES/Framebuffer.cpp \
   $(SRC)/GPU/GLES/DisplayListInterpreter.cpp \
   $(SRC)/GPU/GLES/TextureCache.cpp \
@@ -71,16 +72,21 @@ LOCAL_SRC_FILES := \
   $(SRC)/GPU/GLES/ShaderManager.cpp \
   $(SRC)/GPU/GLES/VertexShaderGenerator.cpp \
   $(SRC)/GPU/GLES/FragmentShaderGenerator.cpp \
+  $(SRC)/GPU/Software/Rasterizer.cpp \
+  $(SRC)/GPU/Software/SoftGpu.cpp \
+  $(SRC)/GPU/Software/TransformUnit.cpp \
   $(SRC)/Core/ELF/ElfReader.cpp \
   $(SRC)/Core/Core.cpp \
   $(SRC)/Core/Config.cpp \
   $(SRC)/Core/CoreTiming.cpp \
+  $(SRC)/Core/FramePacer.cpp \
   $(SRC)/Core/CPU.cpp \
   $(SRC)/Core/Host.cpp \
   $(SRC)/Core/Loaders.cpp \
   $(SRC)/Core/PSPLoaders.cpp \
   $(SRC)/Core/MemMap.cpp \
   $(SRC)/Core/MemmapFunctions.cpp \
+  $(SRC)/Core/SaveState.cpp \
   $(SRC)/Core/System.cpp \
   $(SRC)/Core/PSPMixer.cpp \
   $(SRC)/Core/Debugger/Breakpoints.cpp \
@@ -89,6 +95,7 @@ LOCAL_SRC_FILES := \
   $(SRC)/Core/HLE/HLE.cpp \
   $(SRC)/Core/HLE/sceAtrac.cpp \
   $(SRC)/Core/HLE/__sceAudio.cpp \
+  $(SRC)/Core/HLE/__sceSas.cpp \
   $(SRC)/Core/HLE/sceAudio.cpp \
   $(SRC)/Core/HLE/sceCtrl.cpp \
   $(SRC)/Core/HLE/sceDisplay.cpp \
@@ -120,6 +127,7 @@ LOCAL_SRC_FILES := \
   $(SRC)/Core/HLE/sceUmd.cpp \
   $(SRC)/Core/HLE/sceUtility.cpp \
   $(SRC)/Core/FileSystems/BlockDevices.cpp \
+  $(SRC)/Core/FileSystems/CISOWorkerPool.cpp \
   $(SRC)/Core/FileSystems/ISOFileSystem.cpp \
   $(SRC)/Core/FileSystems/MetaFileSystem.cpp \
   $(SRC)/Core/FileSystems/DirectoryFileSystem.cpp \
@@ -138,6 +146,7 @@ LOCAL_SRC_FILES := \
   $(SRC)/Core/MIPS/ARM/CompALU.cpp \
   $(SRC)/Core/MIPS/ARM/CompBranch.cpp \
   $(SRC)/Core/MIPS/ARM/CompFPU.cpp \
+  $(SRC)/Core/MIPS/ARM/CompVFPU.cpp \
   $(SRC)/Core/MIPS/ARM/Asm.cpp \
   $(SRC)/Core/MIPS/ARM/Jit.cpp \
   $(SRC)/Core/MIPS/ARM/CompLoadStore.cpp \
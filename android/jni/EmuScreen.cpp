@@ -15,10 +15,13 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <stdio.h>
+
 #include "gfx_es2/glsl_program.h"
 
 #include "input/input_state.h"
 #include "ui/ui.h"
+#include "ui_atlas.h"
 
 #include "../../Core/Config.h"
 #include "../../Core/CoreTiming.h"
@@ -26,6 +29,8 @@
 #include "../../Core/Core.h"
 #include "../../Core/Host.h"
 #include "../../Core/System.h"
+#include "../../Core/SaveState.h"
+#include "../../Core/FramePacer.h"
 #include "../../Core/MIPS/MIPS.h"
 #include "../../GPU/GLES/TextureCache.h"
 #include "../../GPU/GLES/ShaderManager.h"
@@ -48,7 +53,7 @@ EmuScreen::EmuScreen(const std::string &filename) : invalid_(true)
 
 	CoreParameter coreParam;
 	coreParam.cpuCore = CPU_INTERPRETER;
-	coreParam.gpuCore = GPU_GLES;
+	coreParam.gpuCore = g_Config.bSoftwareRendering ? GPU_SOFTWARE : GPU_GLES;
 	coreParam.enableSound = g_Config.bEnableSound;
 	coreParam.fileToStart = fileToStart;
 	coreParam.mountIso = "";
@@ -56,6 +61,7 @@ EmuScreen::EmuScreen(const std::string &filename) : invalid_(true)
 	coreParam.enableDebugging = false;
 	coreParam.printfEmuLog = false;
 	coreParam.headLess = false;
+	coreParam.jitProfile = false;
 
 	std::string error_string;
 	if (PSP_Init(coreParam, &error_string)) {
@@ -148,6 +154,8 @@ void EmuScreen::render()
 	u64 nowTicks = CoreTiming::GetTicks();
 	u64 frameTicks = usToCycles(1000000 / 60);
 	mipsr4k.RunLoopUntil(nowTicks + frameTicks);  // should really be relative to the last frame but whatever
+	if (coreState == CORE_NEXTFRAME)
+		SaveState::Process();
 
 	//if (hasRendered)
 	{
@@ -164,6 +172,15 @@ void EmuScreen::render()
 
 		DrawWatermark();
 
+		if (g_Config.bShowFPSCounter) {
+			const FrameTimings &t = FramePacer::GetLastFrameTimings();
+			char stats[256];
+			int idlePercent = t.cycles > 0 ? (int)(t.idledCycles * 100 / t.cycles) : 0;
+			sprintf(stats, "%0.1f fps  cpu %0.1f  ge %0.1f  present %0.1f ms  idle %i%%  skipped %i",
+				FramePacer::GetActualFPS(), t.cpu * 1000.0, t.ge * 1000.0, t.present * 1000.0, idlePercent, FramePacer::GetSkippedFrames());
+			ui_draw2d.DrawTextShadow(UBUNTU24, stats, dp_xres - 8, 8, 0xFFFFFFFF, ALIGN_RIGHT | ALIGN_TOP);
+		}
+
 		glsl_bind(UIShader_Get());
 		ui_draw2d.End();
 		ui_draw2d.Flush(UIShader_Get());
@@ -0,0 +1,229 @@
+// CSO compressor and decompressor, using the same worker pool as the CSO block device, so it
+// doubles as a benchmark of both directions.
+// To build on non-windows systems, just run CMake in the SDL directory, it builds ppsspp-csotool
+// along with the rest.
+//
+// Usage: ppsspp-csotool [-t threads] [-l level] game.iso game.cso
+//        ppsspp-csotool -d game.cso game.iso
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "../Core/FileSystems/BlockDevices.h"
+#include "../Core/FileSystems/CISOWorkerPool.h"
+#include "CPUDetect.h"
+#include "Timer.h"
+
+enum
+{
+	BLOCK_SIZE = 2048,
+	// Blocks given to the pool at once, and written out together.
+	BATCH_BLOCKS = 1024,
+	CSO_HEADER_SIZE = 0x18,
+};
+
+void printUsage()
+{
+	fprintf(stderr, "PPSSPP CSO tool\n");
+	fprintf(stderr, "Usage: ppsspp-csotool [-t threads] [-l level] game.iso game.cso\n");
+	fprintf(stderr, "       ppsspp-csotool -d game.cso game.iso\n");
+	fprintf(stderr, "Compresses with as many threads as there are cores by default, at level 9.\n");
+}
+
+void printSpeed(const char *what, u64 bytes, u32 ms)
+{
+	ms = std::max(ms, (u32)1);
+	printf("%s %lld bytes in %u ms, %0.1f MB/s\n", what, (long long)bytes, ms, (double)bytes / (1024.0 * 1024.0) / (ms / 1000.0));
+}
+
+static void writeU32(u8 *p, u32 value)
+{
+	p[0] = value & 0xFF;
+	p[1] = (value >> 8) & 0xFF;
+	p[2] = (value >> 16) & 0xFF;
+	p[3] = (value >> 24) & 0xFF;
+}
+
+int compressIso(const char *inFilename, const char *outFilename, int numThreads, int level)
+{
+	FILE *in = fopen(inFilename, "rb");
+	if (!in)
+	{
+		fprintf(stderr, "Could not open %s\n", inFilename);
+		return 1;
+	}
+	fseek(in, 0, SEEK_END);
+	u64 isoSize = (u64)ftell(in);
+	fseek(in, 0, SEEK_SET);
+	u32 numBlocks = (u32)((isoSize + BLOCK_SIZE - 1) / BLOCK_SIZE);
+
+	FILE *out = fopen(outFilename, "wb");
+	if (!out)
+	{
+		fprintf(stderr, "Could not create %s\n", outFilename);
+		fclose(in);
+		return 1;
+	}
+
+	// The index goes right after the header, it's filled in and written again at the end.
+	u8 header[CSO_HEADER_SIZE] = {0};
+	memcpy(header, "CISO", 4);
+	writeU32(header + 4, CSO_HEADER_SIZE);
+	writeU32(header + 8, (u32)((u64)numBlocks * BLOCK_SIZE));
+	writeU32(header + 12, 0);
+	writeU32(header + 16, BLOCK_SIZE);
+	header[20] = 1;
+	header[21] = 0;
+	std::vector<u32> index(numBlocks + 1);
+	fwrite(header, 1, CSO_HEADER_SIZE, out);
+	fwrite(&index[0], 4, index.size(), out);
+	u64 pos = CSO_HEADER_SIZE + index.size() * 4;
+
+	CISOWorkerPool pool(numThreads, level);
+	std::vector<u8> inBuffer(BATCH_BLOCKS * BLOCK_SIZE);
+	std::vector<u8> outBuffer(BATCH_BLOCKS * BLOCK_SIZE);
+	std::vector<CISOWorkerPool::Job> jobs(BATCH_BLOCKS);
+
+	u32 startMs = Common::Timer::GetTimeMs();
+	bool failed = false;
+	for (u32 batchStart = 0; batchStart < numBlocks && !failed; batchStart += BATCH_BLOCKS)
+	{
+		u32 count = std::min(numBlocks - batchStart, (u32)BATCH_BLOCKS);
+		size_t readSize = fread(&inBuffer[0], 1, count * BLOCK_SIZE, in);
+		// The last block of an odd sized image is padded out.
+		memset(&inBuffer[readSize], 0, count * BLOCK_SIZE - readSize);
+
+		for (u32 i = 0; i < count; i++)
+		{
+			CISOWorkerPool::Job &job = jobs[i];
+			job.type = CISOWorkerPool::JOB_DEFLATE;
+			job.in = &inBuffer[i * BLOCK_SIZE];
+			job.inSize = BLOCK_SIZE;
+			job.out = &outBuffer[i * BLOCK_SIZE];
+			job.outSize = BLOCK_SIZE;
+			pool.Submit(&job);
+		}
+
+		// Written in order as they finish.
+		for (u32 i = 0; i < count; i++)
+		{
+			CISOWorkerPool::Job &job = jobs[i];
+			pool.Wait(&job);
+			if (pos > 0x7FFFFFFF)
+			{
+				fprintf(stderr, "Output too large for a CSO without alignment\n");
+				failed = true;
+				break;
+			}
+			index[batchStart + i] = (u32)pos;
+			if (job.ok && job.resultSize < BLOCK_SIZE)
+			{
+				fwrite(job.out, 1, job.resultSize, out);
+				pos += job.resultSize;
+			}
+			else
+			{
+				// Doesn't compress, stored as it is.
+				index[batchStart + i] |= 0x80000000;
+				fwrite(job.in, 1, BLOCK_SIZE, out);
+				pos += BLOCK_SIZE;
+			}
+		}
+	}
+	index[numBlocks] = (u32)pos;
+	u32 elapsedMs = Common::Timer::GetTimeMs() - startMs;
+
+	fseek(out, CSO_HEADER_SIZE, SEEK_SET);
+	fwrite(&index[0], 4, index.size(), out);
+	fclose(out);
+	fclose(in);
+	if (failed)
+		return 1;
+
+	printf("%u blocks, %lld bytes compressed to %lld (%0.1f%%), %d threads\n", numBlocks, (long long)isoSize, (long long)pos, isoSize ? 100.0 * pos / isoSize : 0.0, pool.GetNumThreads());
+	printSpeed("Compressed", isoSize, elapsedMs);
+	return 0;
+}
+
+int decompressCso(const char *inFilename, const char *outFilename)
+{
+	FILE *test = fopen(inFilename, "rb");
+	if (!test)
+	{
+		fprintf(stderr, "Could not open %s\n", inFilename);
+		return 1;
+	}
+	fclose(test);
+
+	FILE *out = fopen(outFilename, "wb");
+	if (!out)
+	{
+		fprintf(stderr, "Could not create %s\n", outFilename);
+		return 1;
+	}
+
+	// Sequential reads, so the device fans the blocks out and prefetches like it does for a game.
+	CISOFileBlockDevice device(inFilename);
+	u32 numBlocks = device.GetNumBlocks();
+	std::vector<u8> buffer(BATCH_BLOCKS * BLOCK_SIZE);
+
+	u32 startMs = Common::Timer::GetTimeMs();
+	for (u32 batchStart = 0; batchStart < numBlocks; batchStart += BATCH_BLOCKS)
+	{
+		u32 count = std::min(numBlocks - batchStart, (u32)BATCH_BLOCKS);
+		if (!device.ReadBlocks(batchStart, count, &buffer[0]))
+		{
+			fprintf(stderr, "Could not read blocks %u-%u\n", batchStart, batchStart + count - 1);
+			fclose(out);
+			return 1;
+		}
+		fwrite(&buffer[0], 1, count * BLOCK_SIZE, out);
+	}
+	u32 elapsedMs = Common::Timer::GetTimeMs() - startMs;
+	fclose(out);
+
+	printf("%u blocks\n", numBlocks);
+	printSpeed("Decompressed", (u64)numBlocks * BLOCK_SIZE, elapsedMs);
+	return 0;
+}
+
+int main(int argc, const char *argv[])
+{
+	bool decompress = false;
+	int numThreads = cpu_info.num_cores;
+	int level = 9;
+	const char *inFilename = 0;
+	const char *outFilename = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-d"))
+			decompress = true;
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+			numThreads = std::max(atoi(argv[++i]), 0);
+		else if (!strcmp(argv[i], "-l") && i + 1 < argc)
+			level = std::min(std::max(atoi(argv[++i]), 1), 9);
+		else if (argv[i][0] != '-' && !inFilename)
+			inFilename = argv[i];
+		else if (argv[i][0] != '-' && !outFilename)
+			outFilename = argv[i];
+		else
+		{
+			printUsage();
+			return 1;
+		}
+	}
+
+	if (!inFilename || !outFilename)
+	{
+		printUsage();
+		return 1;
+	}
+
+	if (decompress)
+		return decompressCso(inFilename, outFilename);
+	return compressIso(inFilename, outFilename, numThreads, level);
+}
@@ -0,0 +1,367 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <list>
+#include <stdio.h>
+#include <vector>
+
+#include "../Core/Util/BlockAllocator.h"
+#include "Timer.h"
+
+#include "HeadlessTests.h"
+
+namespace
+{
+
+// The list based allocator BlockAllocator replaced, to check placement against. Blocks are
+// kept in address order and every operation walks the list. It has the two fixes the new one
+// made: zero sized requests take 16 bytes, and AllocAt checks that the range fits.
+class ListAllocator
+{
+	struct Block
+	{
+		Block(u32 _start, u32 _size, bool _taken) : start(_start), size(_size), taken(_taken) {}
+		u32 start;
+		u32 size;
+		bool taken;
+	};
+	std::list<Block> blocks;
+
+	std::list<Block>::iterator GetBlockIterFromAddress(u32 addr)
+	{
+		for (std::list<Block>::iterator iter = blocks.begin(); iter != blocks.end(); ++iter)
+		{
+			if (iter->start <= addr && iter->start + iter->size > addr)
+				return iter;
+		}
+		return blocks.end();
+	}
+
+	void MergeFreeBlocks()
+	{
+		std::list<Block>::iterator iter = blocks.begin();
+		while (iter != blocks.end())
+		{
+			std::list<Block>::iterator next = iter;
+			++next;
+			if (next == blocks.end())
+				break;
+			if (!iter->taken && !next->taken)
+			{
+				iter->size += next->size;
+				blocks.erase(next);
+			}
+			else
+				iter = next;
+		}
+	}
+
+public:
+	void Init(u32 start, u32 size)
+	{
+		blocks.clear();
+		blocks.push_back(Block(start, size, false));
+	}
+
+	u32 Alloc(u32 &size, bool fromEnd)
+	{
+		size = (size + 15) & ~15;
+		if (size == 0)
+			size = 16;
+
+		if (!fromEnd)
+		{
+			for (std::list<Block>::iterator iter = blocks.begin(); iter != blocks.end(); ++iter)
+			{
+				Block &b = *iter;
+				if (b.taken || b.size < size)
+					continue;
+				if (b.size != size)
+					blocks.insert(++iter, Block(b.start + size, b.size - size, false));
+				b.taken = true;
+				b.size = size;
+				return b.start;
+			}
+		}
+		else
+		{
+			for (std::list<Block>::reverse_iterator iter = blocks.rbegin(); iter != blocks.rend(); ++iter)
+			{
+				Block &b = *iter;
+				if (b.taken || b.size < size)
+					continue;
+				if (b.size != size)
+				{
+					blocks.insert((++iter).base(), Block(b.start, b.size - size, false));
+					b.start += b.size - size;
+					b.size = size;
+				}
+				b.taken = true;
+				return b.start;
+			}
+		}
+		return -1;
+	}
+
+	u32 AllocAt(u32 position, u32 size)
+	{
+		size = (size + 15) & ~15;
+		if (size == 0)
+			size = 16;
+		std::list<Block>::iterator iter = GetBlockIterFromAddress(position);
+		if (iter == blocks.end() || iter->taken || position + size > iter->start + iter->size)
+			return -1;
+
+		Block &b = *iter;
+		u32 blockEnd = b.start + b.size;
+		if (b.start != position)
+			blocks.insert(iter, Block(b.start, position - b.start, false));
+		if (position + size < blockEnd)
+		{
+			std::list<Block>::iterator next = iter;
+			blocks.insert(++next, Block(position + size, blockEnd - (position + size), false));
+		}
+		b.taken = true;
+		b.start = position;
+		b.size = size;
+		return position;
+	}
+
+	void Free(u32 position)
+	{
+		std::list<Block>::iterator iter = GetBlockIterFromAddress(position);
+		if (iter == blocks.end())
+			return;
+		iter->taken = false;
+		MergeFreeBlocks();
+	}
+
+	u32 GetBlockStartFromAddress(u32 addr)
+	{
+		std::list<Block>::iterator iter = GetBlockIterFromAddress(addr);
+		return iter == blocks.end() ? -1 : iter->start;
+	}
+
+	u32 GetBlockSizeFromAddress(u32 addr)
+	{
+		std::list<Block>::iterator iter = GetBlockIterFromAddress(addr);
+		return iter == blocks.end() ? -1 : iter->size;
+	}
+
+	bool IsBlockFree(u32 addr)
+	{
+		std::list<Block>::iterator iter = GetBlockIterFromAddress(addr);
+		return iter != blocks.end() && !iter->taken;
+	}
+
+	u32 GetLargestFreeBlockSize()
+	{
+		u32 largest = 0;
+		for (std::list<Block>::iterator iter = blocks.begin(); iter != blocks.end(); ++iter)
+		{
+			if (!iter->taken)
+				largest = std::max(largest, iter->size);
+		}
+		return largest;
+	}
+
+	u32 GetTotalFreeBytes()
+	{
+		u32 total = 0;
+		for (std::list<Block>::iterator iter = blocks.begin(); iter != blocks.end(); ++iter)
+		{
+			if (!iter->taken)
+				total += iter->size;
+		}
+		return total;
+	}
+};
+
+const u32 RANGE_START = 0x08800000;
+const u32 RANGE_SIZE = 0x01800000;
+
+struct Random
+{
+	Random(u32 seed) : state(seed) {}
+	u32 Next()
+	{
+		state = state * 1103515245 + 12345;
+		return state >> 8;
+	}
+	u32 state;
+};
+
+// Mostly small sizes, some large, like the kernel partition sees.
+u32 RandomSize(Random &rng)
+{
+	u32 r = rng.Next();
+	if (r % 8 == 0)
+		return rng.Next() % 0x80000;
+	return rng.Next() % 0x2000;
+}
+
+// Walks the whole range in both, block by block.
+bool SameLayout(BlockAllocator &a, ListAllocator &b)
+{
+	if (a.GetTotalFreeBytes() != b.GetTotalFreeBytes() || a.GetLargestFreeBlockSize() != b.GetLargestFreeBlockSize())
+		return false;
+	u32 addr = RANGE_START;
+	while (addr < RANGE_START + RANGE_SIZE)
+	{
+		u32 start = a.GetBlockStartFromAddress(addr);
+		u32 size = a.GetBlockSizeFromAddress(addr);
+		if (start != addr || start != b.GetBlockStartFromAddress(addr) || size != b.GetBlockSizeFromAddress(addr))
+			return false;
+		if (a.IsBlockFree(addr) != b.IsBlockFree(addr))
+			return false;
+		addr += size;
+	}
+	return true;
+}
+
+// Runs the same random operations on both, returns false at the first disagreement.
+bool FuzzSeed(u32 seed, int numOps)
+{
+	BlockAllocator a;
+	ListAllocator b;
+	a.Init(RANGE_START, RANGE_SIZE);
+	b.Init(RANGE_START, RANGE_SIZE);
+	std::vector<u32> live;
+	Random rng(seed);
+
+	for (int op = 0; op < numOps; op++)
+	{
+		u32 r = rng.Next() % 16;
+		if (r < 7 || live.empty())
+		{
+			u32 sizeA = RandomSize(rng), sizeB = sizeA;
+			bool fromEnd = (rng.Next() & 3) == 0;
+			u32 addrA = a.Alloc(sizeA, fromEnd, "fuzz");
+			u32 addrB = b.Alloc(sizeB, fromEnd);
+			if (addrA != addrB || sizeA != sizeB)
+			{
+				printf("Seed %08x op %d: Alloc(%08x, %d) gave %08x, the old allocator %08x\n", seed, op, sizeA, fromEnd, addrA, addrB);
+				return false;
+			}
+			if (addrA != (u32)-1)
+				live.push_back(addrA);
+		}
+		else if (r < 9)
+		{
+			// Anywhere, inside something already taken, or running into it.
+			u32 position = RANGE_START + (rng.Next() % RANGE_SIZE & ~15);
+			u32 size = RandomSize(rng);
+			u32 kind = rng.Next() % 3;
+			if (kind == 1)
+				position = live[rng.Next() % live.size()] + (rng.Next() % 4) * 16;
+			else if (kind == 2)
+			{
+				position = live[rng.Next() % live.size()] - (1 + rng.Next() % 8) * 16;
+				size = rng.Next() % 0x100;
+			}
+			u32 addrA = a.AllocAt(position, size, "fuzz");
+			u32 addrB = b.AllocAt(position, size);
+			if (addrA != addrB)
+			{
+				printf("Seed %08x op %d: AllocAt(%08x, %08x) gave %08x, the old allocator %08x\n", seed, op, position, size, addrA, addrB);
+				return false;
+			}
+			if (addrA != (u32)-1)
+				live.push_back(addrA);
+		}
+		else
+		{
+			size_t i = rng.Next() % live.size();
+			a.Free(live[i]);
+			b.Free(live[i]);
+			live[i] = live.back();
+			live.pop_back();
+		}
+
+		if (op % 64 == 0 && !SameLayout(a, b))
+		{
+			printf("Seed %08x op %d: block layouts differ\n", seed, op);
+			return false;
+		}
+	}
+	if (!SameLayout(a, b))
+	{
+		printf("Seed %08x: block layouts differ at the end\n", seed);
+		return false;
+	}
+	return true;
+}
+
+// Keeps about numLive blocks allocated while doing numOps alloc/free pairs.
+template <class Allocator>
+u32 TimeAllocator(Allocator &allocator, int numLive, int numOps)
+{
+	allocator.Init(RANGE_START, RANGE_SIZE);
+	std::vector<u32> live;
+	Random rng(0x5EED);
+
+	u32 startMs = Common::Timer::GetTimeMs();
+	for (int i = 0; i < numLive; i++)
+	{
+		u32 size = rng.Next() % 0x2000;
+		live.push_back(allocator.Alloc(size, false));
+	}
+	for (int op = 0; op < numOps; op++)
+	{
+		size_t i = rng.Next() % live.size();
+		allocator.Free(live[i]);
+		u32 size = rng.Next() % 0x2000;
+		live[i] = allocator.Alloc(size, (op & 7) == 0);
+	}
+	return std::max(Common::Timer::GetTimeMs() - startMs, (u32)1);
+}
+
+// The timing loop only uses what both have in common, tags aside.
+struct TaggedAllocator
+{
+	BlockAllocator allocator;
+	void Init(u32 start, u32 size) { allocator.Init(start, size); }
+	u32 Alloc(u32 &size, bool fromEnd) { return allocator.Alloc(size, fromEnd, "bench"); }
+	void Free(u32 position) { allocator.Free(position); }
+};
+
+}  // namespace
+
+int runAllocatorTest()
+{
+	const int numSeeds = 300;
+	const int numFuzzOps = 2000;
+	int failed = 0;
+	for (int s = 0; s < numSeeds; s++)
+	{
+		if (!FuzzSeed(0x1000 + s, numFuzzOps))
+			failed++;
+	}
+	printf("Allocator: %d of %d random sequences matched the old allocator\n", numSeeds - failed, numSeeds);
+
+	const int numLive = 2000;
+	const int numOps = 50000;
+	TaggedAllocator newAllocator;
+	ListAllocator oldAllocator;
+	u32 newMs = TimeAllocator(newAllocator, numLive, numOps);
+	u32 oldMs = TimeAllocator(oldAllocator, numLive, numOps);
+	printf("Allocator: %d alloc/free pairs with %d blocks live in %u ms, the old allocator took %u ms (%.1fx)\n",
+		numOps, numLive, newMs, oldMs, (double)oldMs / newMs);
+
+	return failed ? 1 : 0;
+}
@@ -2,15 +2,37 @@
 // See headless.txt.
 // To build on non-windows systems, just run CMake in the SDL directory, it will build both a normal ppsspp and the headless version.
 
+#include <algorithm>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
 
 #include "../Core/Core.h"
 #include "../Core/CoreTiming.h"
 #include "../Core/System.h"
+#include "../Core/SaveState.h"
 #include "../Core/MIPS/MIPS.h"
+#include "../Core/MIPS/JitCommon/JitCommon.h"
+#include "../Core/Debugger/SymbolMap.h"
 #include "../Core/Host.h"
+#include "../Core/PSPLoaders.h"
+#include "../Core/FileSystems/ISOFileSystem.h"
+#include "../Core/HLE/__sceAudio.h"
+#include "../Core/HLE/__sceSas.h"
 #include "Log.h"
 #include "LogManager.h"
+#include "CPUDetect.h"
+#include "FileUtil.h"
+#include "Thread.h"
+#include "Timer.h"
+
+#include "HeadlessTests.h"
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
 
 // TODO: Get rid of this junk
 class HeadlessHost : public Host
@@ -41,39 +63,442 @@ public:
 	virtual bool AttemptLoadSymbolMap() {return false;}
 };
 
+// Audio dump, a plain 16-bit stereo 44.1kHz WAV. The sizes in the header are patched at exit,
+// since tests usually end in sceKernelExitGame's exit().
+static FILE *wavFile = 0;
+static u32 wavFrames = 0;
+
+static void writeWavHeader(FILE *f, u32 frames)
+{
+	const u32 dataSize = frames * 4;
+	const u32 riffSize = 36 + dataSize;
+	const u32 fmtSize = 16;
+	const u16 pcm = 1, channels = 2, blockAlign = 4, bits = 16;
+	const u32 rate = 44100, byteRate = 44100 * 4;
+
+	fwrite("RIFF", 1, 4, f);
+	fwrite(&riffSize, 4, 1, f);
+	fwrite("WAVEfmt ", 1, 8, f);
+	fwrite(&fmtSize, 4, 1, f);
+	fwrite(&pcm, 2, 1, f);
+	fwrite(&channels, 2, 1, f);
+	fwrite(&rate, 4, 1, f);
+	fwrite(&byteRate, 4, 1, f);
+	fwrite(&blockAlign, 2, 1, f);
+	fwrite(&bits, 2, 1, f);
+	fwrite("data", 1, 4, f);
+	fwrite(&dataSize, 4, 1, f);
+}
+
+static void dumpAudio(const s16 *stereo, int numFrames)
+{
+	fwrite(stereo, 4, numFrames, wavFile);
+	wavFrames += numFrames;
+}
+
+static void closeWav()
+{
+	if (!wavFile)
+		return;
+	fseek(wavFile, 0, SEEK_SET);
+	writeWavHeader(wavFile, wavFrames);
+	fclose(wavFile);
+	wavFile = 0;
+}
+
+// Mixes 32 looping voices at assorted pitches through a sas instance, with envelopes and the
+// reverb on, for 10 seconds of 44.1kHz output in 256 sample grains, and reports how much
+// faster than realtime that was.
+int runSasBenchmark()
+{
+	const int numVoices = SasInstance::NUM_VOICES;
+	const int grainSize = 256;
+	const int sampleRate = 44100;
+	const int seconds = 10;
+
+	// A second of noise-ish VAG, looping over the whole thing.
+	const int numBlocks = sampleRate / 28;
+	std::vector<u8> vagData(numBlocks * 16);
+	u32 seed = 0x12345678;
+	for (int b = 0; b < numBlocks; b++)
+	{
+		u8 *block = &vagData[b * 16];
+		seed = seed * 1103515245 + 12345;
+		block[0] = (u8)((((seed >> 16) % 5) << 4) | (4 + (seed >> 8) % 8));
+		block[1] = b == 0 ? 0x04 : (b == numBlocks - 1 ? 0x03 : 0);
+		for (int i = 2; i < 16; i++)
+		{
+			seed = seed * 1103515245 + 12345;
+			block[i] = (u8)(seed >> 24);
+		}
+	}
+
+	u32 decodeStartMs = Common::Timer::GetTimeMs();
+	VagSamples vag;
+	DecodeVag(&vagData[0], (int)vagData.size(), vag);
+	u32 decodeMs = Common::Timer::GetTimeMs() - decodeStartMs;
+	// Owned here, the voices only borrow it.
+	vag.refCount = numVoices + 1;
+	vag.stale = false;
+
+	SasInstance sas(grainSize, numVoices, 0, sampleRate);
+	sas.reverb.SetType(PSP_SAS_EFFECT_TYPE_HALL);
+	sas.reverb.wetOn = true;
+	sas.reverb.volumeLeft = PSP_SAS_VOL_MAX / 2;
+	sas.reverb.volumeRight = PSP_SAS_VOL_MAX / 2;
+	for (int v = 0; v < numVoices; v++)
+	{
+		SasVoice &voice = sas.voices[v];
+		voice.loop = 1;
+		// Half at the original rate, the rest from about half to double speed.
+		voice.pitch = (v & 1) ? PSP_SAS_PITCH_BASE : PSP_SAS_PITCH_BASE / 2 + v * 190;
+		voice.volumeLeft = PSP_SAS_VOL_MAX / 8;
+		voice.volumeRight = PSP_SAS_VOL_MAX / 4;
+		voice.volumeLeftSend = PSP_SAS_VOL_MAX / 16;
+		voice.volumeRightSend = PSP_SAS_VOL_MAX / 16;
+		voice.envelope.SetSimple(0x0A0F, 0x1FC0);
+		sas.KeyOn(v, &vag);
+		voice.samplePos = v * 997 % (int)vag.pcm.size();
+	}
+
+	std::vector<s16> out(grainSize * 2);
+	const int numGrains = sampleRate * seconds / grainSize;
+	s64 checksum = 0;
+
+	u32 startMs = Common::Timer::GetTimeMs();
+	for (int g = 0; g < numGrains; g++)
+	{
+		sas.Mix(&out[0]);
+		checksum += out[g % (grainSize * 2)];
+	}
+	u32 elapsedMs = std::max(Common::Timer::GetTimeMs() - startMs, (u32)1);
+
+	printf("Sas: %d voices, %d seconds of audio in %u ms (decode %u ms), %.1fx realtime (checksum %lld)\n",
+		numVoices, seconds, elapsedMs, decodeMs, seconds * 1000.0 / elapsedMs, (long long)checksum);
+	return 0;
+}
+
+class BenchHandleAllocator : public IHandleAllocator
+{
+public:
+	BenchHandleAllocator() : next(0) {}
+	virtual u32 GetNewHandle() { return ++next; }
+	virtual void FreeHandle(u32 handle) {}
+private:
+	u32 next;
+};
+
+static void collectIsoPaths(ISOFileSystem &fs, const std::string &dir, std::vector<std::string> &files, std::vector<std::string> &dirs)
+{
+	// An empty path is the whole device.
+	std::vector<PSPFileInfo> listing = fs.GetDirListing(dir.empty() ? "/" : dir);
+	for (size_t i = 0; i < listing.size(); i++)
+	{
+		if (listing[i].name == "." || listing[i].name == "..")
+			continue;
+		std::string path = dir + "/" + listing[i].name;
+		if (listing[i].type == FILETYPE_DIRECTORY)
+		{
+			dirs.push_back(path);
+			collectIsoPaths(fs, path, files, dirs);
+		}
+		else
+			files.push_back(path);
+	}
+}
+
+// Stats every file and directory on an ISO, and opens and closes every file, over and over,
+// and reports how many of each the file system manages per second. Half the lookups are in
+// lower case, which the PSP allows.
+int runIsoBenchmark(const char *filename)
+{
+	const int rounds = 100;
+
+	u32 indexStartMs = Common::Timer::GetTimeMs();
+	BenchHandleAllocator handles;
+	ISOFileSystem fs(&handles, constructBlockDevice(filename));
+	u32 indexMs = Common::Timer::GetTimeMs() - indexStartMs;
+
+	std::vector<std::string> files, dirs;
+	collectIsoPaths(fs, "", files, dirs);
+	std::vector<std::string> paths(files);
+	paths.insert(paths.end(), dirs.begin(), dirs.end());
+	for (size_t i = 1; i < paths.size(); i += 2)
+		std::transform(paths[i].begin(), paths[i].end(), paths[i].begin(), ::tolower);
+	if (files.empty())
+	{
+		fprintf(stderr, "No files found in %s\n", filename);
+		return 1;
+	}
+
+	int missing = 0;
+	u32 statStartMs = Common::Timer::GetTimeMs();
+	for (int r = 0; r < rounds; r++)
+	{
+		for (size_t i = 0; i < paths.size(); i++)
+		{
+			if (fs.GetFileInfo(paths[i]).size == 0 && i < files.size())
+				missing++;
+		}
+	}
+	u32 statMs = std::max(Common::Timer::GetTimeMs() - statStartMs, (u32)1);
+
+	u32 openStartMs = Common::Timer::GetTimeMs();
+	for (int r = 0; r < rounds; r++)
+	{
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			u32 handle = fs.OpenFile(paths[i], FILEACCESS_READ);
+			if (handle)
+				fs.CloseFile(handle);
+			else
+				missing++;
+		}
+	}
+	u32 openMs = std::max(Common::Timer::GetTimeMs() - openStartMs, (u32)1);
+
+	printf("ISO: %d files, %d directories, opened in %u ms\n", (int)files.size(), (int)dirs.size(), indexMs);
+	printf("  stat: %.0f/s, open+close: %.0f/s, %d lookups failed\n",
+		paths.size() * rounds * 1000.0 / statMs, files.size() * rounds * 1000.0 / openMs, missing);
+	return missing == 0 ? 0 : 1;
+}
+
 void printUsage()
 {
 	fprintf(stderr, "PPSSPP Headless\n");
-	fprintf(stderr, "Usage: ppsspp-headless file.elf [-c] [-m] [-j] [-c]\n");
+	fprintf(stderr, "Usage: ppsspp-headless file.elf [-c] [-m] [-j] [-s] [-p] [-t seconds] [-w out.wav]\n");
+	fprintf(stderr, "       ppsspp-headless -b [threads] file.elf file2.elf ... [-m] [-j] [-s] [-p] [-t seconds]\n");
+	fprintf(stderr, "       ppsspp-headless -sasbench\n");
+	fprintf(stderr, "       ppsspp-headless -isobench game.iso\n");
+	fprintf(stderr, "       ppsspp-headless -allocbench\n");
+	fprintf(stderr, "       ppsspp-headless -vfputest\n");
+	fprintf(stderr, "       ppsspp-headless -syncbench\n");
+	fprintf(stderr, "       ppsspp-headless -timingtest\n");
 	fprintf(stderr, "See headless.txt for details.\n");
 }
 
+static bool hotBlocksPrinted = false;
+
+// Also registered with atexit, since the game exiting ends the process from inside the core.
+void printHotBlocks()
+{
+	if (hotBlocksPrinted)
+		return;
+	hotBlocksPrinted = true;
+
+	const size_t HOT_BLOCKS_COUNT = 20;
+	std::vector<MIPSComp::JitBlockProfile> hottest;
+	MIPSComp::GetHottestBlocks(hottest, HOT_BLOCKS_COUNT);
+
+	printf("Hottest JIT blocks:\n");
+	printf("  address   instrs        runs  symbol\n");
+	for (size_t i = 0; i < hottest.size(); i++)
+	{
+		const MIPSComp::JitBlockProfile &p = hottest[i];
+		printf("  %08x  %6d  %10llu  %s\n", p.address, p.numInstructions, (unsigned long long)p.runCount, symbolMap.GetDescription(p.address));
+	}
+}
+
+// Batch mode. Every test runs in a process of its own: the core is all global state, and
+// sceKernelExitGame ends the process. A pool of threads keeps that many tests going at once.
+struct BatchTest
+{
+	std::string filename;
+	std::string output;
+	int status;
+	u32 timeMs;
+	bool passed;
+};
+
+static std::mutex batchMutex;
+static std::vector<BatchTest> batchTests;
+static size_t batchNext;
+
+static std::string GetExpectedFilename(const std::string &filename)
+{
+	size_t dot = filename.rfind('.');
+	size_t slash = filename.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return filename + ".expected";
+	return filename.substr(0, dot) + ".expected";
+}
+
+static std::string StripCarriageReturns(const std::string &str)
+{
+	std::string result;
+	result.reserve(str.size());
+	for (size_t i = 0; i < str.size(); i++)
+	{
+		if (str[i] != '\r')
+			result += str[i];
+	}
+	return result;
+}
+
+static void RunBatchTest(BatchTest &test, const std::string &command)
+{
+	u32 startMs = Common::Timer::GetTimeMs();
+	test.output.clear();
+	test.status = -1;
+
+	FILE *f = popen((command + " \"" + test.filename + "\"").c_str(), "r");
+	if (f)
+	{
+		char buffer[4096];
+		size_t count;
+		while ((count = fread(buffer, 1, sizeof(buffer), f)) > 0)
+			test.output.append(buffer, count);
+		test.status = pclose(f);
+	}
+	test.timeMs = Common::Timer::GetTimeMs() - startMs;
+
+	// Without an expectation, all we can go on is whether it ran to the end.
+	std::string expected;
+	if (File::ReadFileToString(true, GetExpectedFilename(test.filename).c_str(), expected))
+		test.passed = test.status == 0 && StripCarriageReturns(test.output) == StripCarriageReturns(expected);
+	else
+		test.passed = test.status == 0;
+}
+
+static void BatchWorker(std::string command)
+{
+	Common::SetCurrentThreadName("Headless batch worker");
+
+	while (true)
+	{
+		size_t index;
+		{
+			std::lock_guard<std::mutex> guard(batchMutex);
+			if (batchNext >= batchTests.size())
+				return;
+			index = batchNext++;
+		}
+
+		BatchTest &test = batchTests[index];
+		RunBatchTest(test, command);
+
+		std::lock_guard<std::mutex> guard(batchMutex);
+		printf("%s %s (%u ms)\n", test.passed ? "PASS" : "FAIL", test.filename.c_str(), test.timeMs);
+		fflush(stdout);
+	}
+}
+
+static int RunBatch(const std::vector<std::string> &files, int numThreads, const std::string &command)
+{
+	if (numThreads <= 0)
+		numThreads = cpu_info.num_cores;
+	if (numThreads > (int)files.size())
+		numThreads = (int)files.size();
+
+	batchTests.resize(files.size());
+	for (size_t i = 0; i < files.size(); i++)
+		batchTests[i].filename = files[i];
+	batchNext = 0;
+
+	u32 startMs = Common::Timer::GetTimeMs();
+	std::vector<std::thread *> workers;
+	for (int i = 0; i < numThreads; i++)
+		workers.push_back(new std::thread(BatchWorker, command));
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i]->join();
+		delete workers[i];
+	}
+
+	int failed = 0;
+	for (size_t i = 0; i < batchTests.size(); i++)
+	{
+		if (!batchTests[i].passed)
+			failed++;
+	}
+	printf("%d of %d tests passed, %d threads, %u ms\n", (int)batchTests.size() - failed, (int)batchTests.size(), numThreads, Common::Timer::GetTimeMs() - startMs);
+	return failed == 0 ? 0 : 1;
+}
+
 int main(int argc, const char* argv[])
 {
 	bool fullLog = false;
 	bool useJit = false;
 	bool autoCompare = false;
+	bool useSoftGpu = false;
+	bool jitProfile = false;
+	bool batch = false;
+	int batchThreads = 0;
+	int timeout = 0;
 	
-	const char *bootFilename = argc > 1 ? argv[1] : 0;
+	const char *bootFilename = 0;
 	const char *mountIso = 0;
-	bool readMount = false;
+	const char *wavFilename = 0;
+	std::vector<std::string> batchFiles;
+	// What each test in a batch is run with.
+	std::string batchCommand = std::string("\"") + argv[0] + "\"";
 
-	for (int i = 2; i < argc; i++)
+	for (int i = 1; i < argc; i++)
 	{
-		if (readMount)
+		if (!strcmp(argv[i], "-sasbench"))
+			return runSasBenchmark();
+		else if (!strcmp(argv[i], "-isobench") && i + 1 < argc)
+			return runIsoBenchmark(argv[i + 1]);
+		else if (!strcmp(argv[i], "-allocbench"))
+			return runAllocatorTest();
+		else if (!strcmp(argv[i], "-vfputest"))
+			return runVFPUTest();
+		else if (!strcmp(argv[i], "-syncbench"))
 		{
-			mountIso = argv[i];
-			readMount = false;
-			continue;
+			// The kernel runs for real here, and vblanks and audio talk to the host.
+			host = new HeadlessHost();
+			return runSyncBenchmark();
+		}
+		else if (!strcmp(argv[i], "-timingtest"))
+			return runTimingTest();
+		else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+		{
+			mountIso = argv[++i];
+			batchCommand += std::string(" -m \"") + argv[i] + "\"";
+		}
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+		{
+			timeout = atoi(argv[++i]);
+			batchCommand += std::string(" -t ") + argv[i];
+		}
+		else if (!strcmp(argv[i], "-w") && i + 1 < argc)
+			wavFilename = argv[++i];
+		else if (!strcmp(argv[i], "-b"))
+		{
+			batch = true;
+			// Only a plain number is a thread count, not a test that starts with digits.
+			const char *next = i + 1 < argc ? argv[i + 1] : "";
+			if (next[0] && strspn(next, "0123456789") == strlen(next) && atoi(next) > 0)
+				batchThreads = atoi(argv[++i]);
 		}
-		if (!strcmp(argv[i], "-m"))
-			readMount = true;
 		else if (!strcmp(argv[i], "-l"))
 			fullLog = true;
 		else if (!strcmp(argv[i], "-j"))
+		{
 			useJit = true;
+			batchCommand += " -j";
+		}
 		else if (!strcmp(argv[i], "-c"))
 			autoCompare = true;
+		else if (!strcmp(argv[i], "-s"))
+		{
+			useSoftGpu = true;
+			batchCommand += " -s";
+		}
+		else if (!strcmp(argv[i], "-p"))
+		{
+			// Only the JIT can count block runs.
+			useJit = true;
+			jitProfile = true;
+			// Each test writes its own perf map and prints its own hot blocks.
+			batchCommand += " -j -p";
+		}
+		else if (argv[i][0] != '-')
+		{
+			if (!bootFilename)
+				bootFilename = argv[i];
+			batchFiles.push_back(argv[i]);
+		}
 	}
 
 	if (!bootFilename)
@@ -82,6 +507,9 @@ int main(int argc, const char* argv[])
 		return 1;
 	}
 
+	if (batch)
+		return RunBatch(batchFiles, batchThreads, batchCommand);
+
 	host = new HeadlessHost();
 
 	LogManager::Init();
@@ -100,9 +528,10 @@ int main(int argc, const char* argv[])
 	coreParameter.mountIso = mountIso ? mountIso : "";
 	coreParameter.startPaused = false;
 	coreParameter.cpuCore = useJit ? CPU_JIT : CPU_INTERPRETER;
-	coreParameter.gpuCore = GPU_NULL;
+	coreParameter.gpuCore = useSoftGpu ? GPU_SOFTWARE : GPU_NULL;
 	coreParameter.enableSound = false;
 	coreParameter.headLess = true;
+	coreParameter.jitProfile = jitProfile;
 
 	std::string error_string;
 
@@ -111,10 +540,37 @@ int main(int argc, const char* argv[])
 		return 1;
 	}
 
+	if (jitProfile)
+		atexit(printHotBlocks);
+
+	if (wavFilename)
+	{
+		wavFile = fopen(wavFilename, "wb");
+		if (!wavFile)
+		{
+			fprintf(stderr, "Failed to open %s for writing\n", wavFilename);
+			return 1;
+		}
+		writeWavHeader(wavFile, 0);
+		__AudioSetDumpCallback(&dumpAudio);
+		atexit(closeWav);
+	}
+
 	coreState = CORE_RUNNING;
 
-	while (coreState == CORE_RUNNING)
+	u32 startMs = Common::Timer::GetTimeMs();
+	while (coreState == CORE_RUNNING || coreState == CORE_NEXTFRAME)
 	{
+		if (coreState == CORE_NEXTFRAME)
+			SaveState::Process();
+
+		// Tests that never exit would hold up a batch forever.
+		if (timeout > 0 && Common::Timer::GetTimeMs() - startMs > (u32)timeout * 1000)
+		{
+			fprintf(stderr, "Timed out after %d seconds\n", timeout);
+			return 2;
+		}
+
 		// Run for a frame at a time, just because.
 		u64 nowTicks = CoreTiming::GetTicks();
 		u64 frameTicks = usToCycles(1000000/60);
@@ -123,6 +579,12 @@ int main(int argc, const char* argv[])
 
 	// NOTE: we won't get here until I've gotten rid of the exit(0) in sceExitProcess or whatever it's called
 
+	if (jitProfile)
+		printHotBlocks();
+
+	__AudioSetDumpCallback(0);
+	closeWav();
+
 	PSP_Shutdown();
 
 	if (autoCompare)
@@ -0,0 +1,36 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+// Self checks and benchmarks that headless runs instead of a test, see headless.txt.
+
+// Drives BlockAllocator and the old list based allocator with the same random operations,
+// checks that they agree, and times both.
+int runAllocatorTest();
+
+// Runs random VFPU ops that the x86 JIT compiles natively, with random inputs and prefixes,
+// through both the interpreter and the JIT, and checks that the results match bit for bit.
+int runVFPUTest();
+
+// Runs producer and consumer threads passing items through a semaphore guarded buffer on the
+// emulated kernel, and reports syscalls per second.
+int runSyncBenchmark();
+
+// Runs several CoreTiming instances, each on its own thread with its own context, and checks
+// that each schedules exactly as it does alone.
+int runTimingTest();
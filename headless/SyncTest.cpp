@@ -0,0 +1,389 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <stdio.h>
+#include <vector>
+
+#include "../Core/Core.h"
+#include "../Core/CoreTiming.h"
+#include "../Core/CPU.h"
+#include "../Core/MemMap.h"
+#include "../Core/MIPS/MIPS.h"
+#include "../Core/HLE/HLE.h"
+#include "../Core/HLE/sceKernel.h"
+#include "../Core/HLE/sceKernelThread.h"
+#include "Timer.h"
+
+#include "HeadlessTests.h"
+
+namespace
+{
+
+const u32 PROGRAM_ADDRESS = 0x08804000;
+const u32 DATA_ADDRESS = 0x08808000;
+
+// Offsets into the data the threads share.
+enum
+{
+	DATA_NAME = 0x00,
+	DATA_TIMEOUT = 0x10,
+	DATA_DONE = 0x20,
+	DATA_ERRORS = 0x24,
+	DATA_SUM = 0x28,
+	DATA_HEAD = 0x2C,
+	DATA_TAIL = 0x30,
+	DATA_EMPTY_SEMA = 0x40,
+	DATA_FULL_SEMA = 0x44,
+	DATA_QUEUE_SEMA = 0x48,
+	DATA_HEAD_TIMEOUT = 0x50,
+	DATA_NEXT_TIMEOUT = 0x54,
+	DATA_HEAD_RESULT = 0x58,
+	DATA_NEXT_RESULT = 0x5C,
+	DATA_BUFFER = 0x100,
+};
+
+const int BUFFER_SIZE = 8;
+const int NUM_PRODUCERS = 2;
+const int NUM_CONSUMERS = 2;
+const int ITEMS_PER_PRODUCER = 50000;
+const int PRODUCER_DELAY_INTERVAL = 64;
+const int PRODUCER_DELAY_US = 500;
+// More cycles than an int holds, so a timeout that overflows shows up as failed waits.
+const u32 CONSUMER_TIMEOUT_US = 15000000;
+const int MAX_EMULATED_SECONDS = 600;
+// For the queue check, the head waiter wants more than the count and gives up quickly, the one
+// behind it wants less and should get it right then, long before its own timeout.
+const int QUEUE_SEMA_COUNT = 3;
+const int QUEUE_HEAD_WANTS = 5;
+const int QUEUE_NEXT_WANTS = 1;
+const u32 QUEUE_HEAD_TIMEOUT_US = 1000;
+const u32 QUEUE_NEXT_TIMEOUT_US = 1000000;
+const u32 THREAD_ATTR_USER = 0x80000000;
+
+enum
+{
+	REG_ZERO = 0, REG_V0 = 2, REG_A0 = 4, REG_A1 = 5, REG_A2 = 6, REG_A3 = 7,
+	REG_T0 = 8, REG_T1 = 9, REG_S0 = 16, REG_S1 = 17, REG_S2 = 18, REG_S3 = 19,
+};
+
+// Just enough of an assembler for the threads below.
+class Assembler
+{
+public:
+	Assembler() : address(PROGRAM_ADDRESS) {}
+
+	u32 GetAddress() const { return address; }
+
+	void LI(int rt, u32 value)
+	{
+		Emit(0x3C000000 | (rt << 16) | (value >> 16));  // lui
+		Emit(0x34000000 | (rt << 21) | (rt << 16) | (value & 0xFFFF));  // ori
+	}
+	void ADDIU(int rt, int rs, s16 imm) { Emit(0x24000000 | (rs << 21) | (rt << 16) | (u16)imm); }
+	void ANDI(int rt, int rs, u16 imm) { Emit(0x30000000 | (rs << 21) | (rt << 16) | imm); }
+	void LW(int rt, int base, s16 offset) { Emit(0x8C000000 | (base << 21) | (rt << 16) | (u16)offset); }
+	void SW(int rt, int base, s16 offset) { Emit(0xAC000000 | (base << 21) | (rt << 16) | (u16)offset); }
+	void ADDU(int rd, int rs, int rt) { Emit((rs << 21) | (rt << 16) | (rd << 11) | 0x21); }
+	void SLTU(int rd, int rs, int rt) { Emit((rs << 21) | (rt << 16) | (rd << 11) | 0x2B); }
+	void SLL(int rd, int rt, int sa) { Emit((rt << 16) | (rd << 11) | (sa << 6)); }
+	void MOVE(int rd, int rs) { ADDU(rd, rs, REG_ZERO); }
+	void NOP() { Emit(0); }
+
+	// Branches back to an address from GetAddress(), with a nop in the delay slot.
+	void BNE(int rs, int rt, u32 target)
+	{
+		Emit(0x14000000 | (rs << 21) | (rt << 16) | (((target - address - 4) >> 2) & 0xFFFF));
+		NOP();
+	}
+	void B(u32 target)
+	{
+		Emit(0x10000000 | (((target - address - 4) >> 2) & 0xFFFF));  // beq zero, zero
+		NOP();
+	}
+	// Forward branches get their target from SetBranchTarget().
+	u32 BNEForward(int rs, int rt)
+	{
+		u32 branch = address;
+		Emit(0x14000000 | (rs << 21) | (rt << 16));
+		NOP();
+		return branch;
+	}
+	void SetBranchTarget(u32 branch)
+	{
+		Memory::Write_U32(Memory::Read_U32(branch) | (((address - branch - 4) >> 2) & 0xFFFF), branch);
+	}
+
+	void Syscall(u32 nid) { Emit(GetSyscallOp("ThreadManForUser", nid)); }
+
+	// Adds 1 to the word at offset(s0) if v0 is nonzero, that is if the call failed.
+	void CountError(int offset)
+	{
+		SLTU(REG_T0, REG_ZERO, REG_V0);
+		LW(REG_T1, REG_S0, offset);
+		ADDU(REG_T1, REG_T1, REG_T0);
+		SW(REG_T1, REG_S0, offset);
+	}
+
+private:
+	void Emit(u32 op)
+	{
+		Memory::Write_U32(op, address);
+		address += 4;
+	}
+
+	u32 address;
+};
+
+const u32 NID_CREATE_SEMA = 0xD6DA4BA1;
+const u32 NID_SIGNAL_SEMA = 0x3F53E640;
+const u32 NID_WAIT_SEMA = 0x4E3A1105;
+const u32 NID_CREATE_THREAD = 0x446D8DE6;
+const u32 NID_START_THREAD = 0xF475845D;
+const u32 NID_EXIT_THREAD = 0xAA73C935;
+const u32 NID_SLEEP_THREAD = 0x9ACE131E;
+const u32 NID_DELAY_THREAD = 0xCEADEB47;
+
+// Takes a slot from one semaphore, moves an item through the ring buffer, and gives a slot to
+// the other one, count times. Threads only switch in syscalls, so the buffer needs no lock.
+u32 WriteWorker(Assembler &a, bool producer, int count)
+{
+	u32 entry = a.GetAddress();
+	a.LI(REG_S0, DATA_ADDRESS);
+	a.LW(REG_S2, REG_S0, producer ? DATA_EMPTY_SEMA : DATA_FULL_SEMA);
+	a.LW(REG_S3, REG_S0, producer ? DATA_FULL_SEMA : DATA_EMPTY_SEMA);
+	a.LI(REG_S1, count);
+
+	u32 loop = a.GetAddress();
+	a.MOVE(REG_A0, REG_S2);
+	a.LI(REG_A1, 1);
+	if (producer)
+		a.MOVE(REG_A2, REG_ZERO);
+	else
+		a.ADDIU(REG_A2, REG_S0, DATA_TIMEOUT);
+	a.Syscall(NID_WAIT_SEMA);
+	a.CountError(DATA_ERRORS);
+
+	int indexOffset = producer ? DATA_HEAD : DATA_TAIL;
+	a.LW(REG_T0, REG_S0, indexOffset);
+	a.ANDI(REG_T1, REG_T0, BUFFER_SIZE - 1);
+	a.SLL(REG_T1, REG_T1, 2);
+	a.ADDU(REG_T1, REG_T1, REG_S0);
+	if (producer)
+	{
+		// The items are the loop counter, count down to 1.
+		a.SW(REG_S1, REG_T1, DATA_BUFFER);
+	}
+	else
+	{
+		a.LW(REG_T1, REG_T1, DATA_BUFFER);
+		a.LW(REG_A0, REG_S0, DATA_SUM);
+		a.ADDU(REG_A0, REG_A0, REG_T1);
+		a.SW(REG_A0, REG_S0, DATA_SUM);
+	}
+	a.ADDIU(REG_T0, REG_T0, 1);
+	a.SW(REG_T0, REG_S0, indexOffset);
+
+	a.MOVE(REG_A0, REG_S3);
+	a.LI(REG_A1, 1);
+	a.Syscall(NID_SIGNAL_SEMA);
+	a.CountError(DATA_ERRORS);
+
+	if (producer)
+	{
+		// Now and then, leave the consumers waiting for a while, so that time passes with
+		// their timeouts pending.
+		a.ANDI(REG_T0, REG_S1, PRODUCER_DELAY_INTERVAL - 1);
+		u32 skipDelay = a.BNEForward(REG_T0, REG_ZERO);
+		a.LI(REG_A0, PRODUCER_DELAY_US);
+		a.Syscall(NID_DELAY_THREAD);
+		a.SetBranchTarget(skipDelay);
+	}
+
+	a.ADDIU(REG_S1, REG_S1, -1);
+	a.BNE(REG_S1, REG_ZERO, loop);
+
+	a.LW(REG_T0, REG_S0, DATA_DONE);
+	a.ADDIU(REG_T0, REG_T0, 1);
+	a.SW(REG_T0, REG_S0, DATA_DONE);
+	a.MOVE(REG_A0, REG_ZERO);
+	a.Syscall(NID_EXIT_THREAD);
+	return entry;
+}
+
+// Waits once on the queue semaphore and stores what the wait returned.
+u32 WriteQueueWaiter(Assembler &a, int count, int timeoutOffset, int resultOffset)
+{
+	u32 entry = a.GetAddress();
+	a.LI(REG_S0, DATA_ADDRESS);
+	a.LW(REG_A0, REG_S0, DATA_QUEUE_SEMA);
+	a.LI(REG_A1, count);
+	a.ADDIU(REG_A2, REG_S0, timeoutOffset);
+	a.Syscall(NID_WAIT_SEMA);
+	a.SW(REG_V0, REG_S0, resultOffset);
+
+	a.LW(REG_T0, REG_S0, DATA_DONE);
+	a.ADDIU(REG_T0, REG_T0, 1);
+	a.SW(REG_T0, REG_S0, DATA_DONE);
+	a.MOVE(REG_A0, REG_ZERO);
+	a.Syscall(NID_EXIT_THREAD);
+	return entry;
+}
+
+// The root thread creates the semaphores, starts the workers at a lower priority, and sleeps.
+// The workers start in order, so they queue on a semaphore in that order too.
+u32 WriteRoot(Assembler &a, const int *initial, const int *offsets, int numSemas, const std::vector<u32> &workers)
+{
+	u32 entry = a.GetAddress();
+	a.LI(REG_S0, DATA_ADDRESS);
+	for (int i = 0; i < numSemas; i++)
+	{
+		a.MOVE(REG_A0, REG_S0);
+		a.MOVE(REG_A1, REG_ZERO);
+		a.LI(REG_A2, initial[i]);
+		a.LI(REG_A3, BUFFER_SIZE);
+		a.MOVE(REG_T0, REG_ZERO);
+		a.Syscall(NID_CREATE_SEMA);
+		a.SW(REG_V0, REG_S0, offsets[i]);
+	}
+
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		a.MOVE(REG_A0, REG_S0);
+		a.LI(REG_A1, workers[i]);
+		a.LI(REG_A2, 0x30);
+		a.LI(REG_A3, 0x1000);
+		a.LI(REG_T0, THREAD_ATTR_USER);
+		a.MOVE(REG_T1, REG_ZERO);
+		a.Syscall(NID_CREATE_THREAD);
+		a.MOVE(REG_A0, REG_V0);
+		a.MOVE(REG_A1, REG_ZERO);
+		a.MOVE(REG_A2, REG_ZERO);
+		a.Syscall(NID_START_THREAD);
+	}
+
+	u32 sleep = a.GetAddress();
+	a.Syscall(NID_SLEEP_THREAD);
+	a.B(sleep);
+	return entry;
+}
+
+void StartKernel()
+{
+	currentCPU = &mipsr4k;
+	numCPUs = 1;
+	Memory::Init();
+	mipsr4k.Reset();
+	HLEInit();
+	__KernelInit();
+
+	Memory::Memset(DATA_ADDRESS, 0, DATA_BUFFER + BUFFER_SIZE * 4);
+	Memory::Memcpy(DATA_ADDRESS + DATA_NAME, "sync", 5);
+}
+
+// Boots the root thread at rootEntry and runs until numThreads workers are done.
+void RunThreads(u32 rootEntry, u32 numThreads)
+{
+	mipsr4k.pc = rootEntry;
+	__KernelSetupRootThread(0, 0, "", 0x20, 0x4000, THREAD_ATTR_USER);
+	__KernelStartIdleThreads();
+
+	coreState = CORE_RUNNING;
+	u64 endTicks = CoreTiming::GetTicks() + usToCycles((u64)MAX_EMULATED_SECONDS * 1000000);
+	while (coreState == CORE_RUNNING && Memory::Read_U32(DATA_ADDRESS + DATA_DONE) < numThreads && CoreTiming::GetTicks() < endTicks)
+		mipsr4k.RunLoopUntil(CoreTiming::GetTicks() + usToCycles(1000000 / 60));
+}
+
+void StopKernel()
+{
+	CoreTiming::ClearPendingEvents();
+	CoreTiming::UnregisterAllEvents();
+	__KernelShutdown();
+	HLEShutdown();
+	Memory::Shutdown();
+	currentCPU = 0;
+}
+
+// A waiter that times out at the head of a semaphore's queue shouldn't leave the ones behind it
+// waiting when the count would already do for them.
+bool RunQueueCheck()
+{
+	StartKernel();
+	Memory::Write_U32(QUEUE_HEAD_TIMEOUT_US, DATA_ADDRESS + DATA_HEAD_TIMEOUT);
+	Memory::Write_U32(QUEUE_NEXT_TIMEOUT_US, DATA_ADDRESS + DATA_NEXT_TIMEOUT);
+
+	Assembler a;
+	std::vector<u32> workers;
+	workers.push_back(WriteQueueWaiter(a, QUEUE_HEAD_WANTS, DATA_HEAD_TIMEOUT, DATA_HEAD_RESULT));
+	workers.push_back(WriteQueueWaiter(a, QUEUE_NEXT_WANTS, DATA_NEXT_TIMEOUT, DATA_NEXT_RESULT));
+	const int initial[1] = {QUEUE_SEMA_COUNT};
+	const int offsets[1] = {DATA_QUEUE_SEMA};
+	RunThreads(WriteRoot(a, initial, offsets, 1, workers), (u32)workers.size());
+
+	u32 done = Memory::Read_U32(DATA_ADDRESS + DATA_DONE);
+	u32 headResult = Memory::Read_U32(DATA_ADDRESS + DATA_HEAD_RESULT);
+	u32 nextResult = Memory::Read_U32(DATA_ADDRESS + DATA_NEXT_RESULT);
+	// Most of the next waiter's timeout should be left over.
+	u32 nextLeftUs = Memory::Read_U32(DATA_ADDRESS + DATA_NEXT_TIMEOUT);
+	bool ok = done == workers.size() && headResult == SCE_KERNEL_ERROR_WAIT_TIMEOUT && nextResult == 0 && nextLeftUs > QUEUE_NEXT_TIMEOUT_US / 2;
+
+	printf("Sema queue: head waiter returned %08x, the one behind it %08x with %u us of its timeout left%s\n", headResult, nextResult, nextLeftUs, ok ? "" : ", FAILED");
+
+	StopKernel();
+	return ok;
+}
+
+}  // namespace
+
+int runSyncBenchmark()
+{
+	StartKernel();
+	Memory::Write_U32(CONSUMER_TIMEOUT_US, DATA_ADDRESS + DATA_TIMEOUT);
+
+	Assembler a;
+	std::vector<u32> workers;
+	for (int i = 0; i < NUM_PRODUCERS; i++)
+		workers.push_back(WriteWorker(a, true, ITEMS_PER_PRODUCER));
+	for (int i = 0; i < NUM_CONSUMERS; i++)
+		workers.push_back(WriteWorker(a, false, ITEMS_PER_PRODUCER * NUM_PRODUCERS / NUM_CONSUMERS));
+	const int initial[2] = {BUFFER_SIZE, 0};
+	const int offsets[2] = {DATA_EMPTY_SEMA, DATA_FULL_SEMA};
+	u32 rootEntry = WriteRoot(a, initial, offsets, 2, workers);
+
+	u32 startMs = Common::Timer::GetTimeMs();
+	RunThreads(rootEntry, (u32)workers.size());
+	u32 runMs = std::max(Common::Timer::GetTimeMs() - startMs, (u32)1);
+
+	u32 done = Memory::Read_U32(DATA_ADDRESS + DATA_DONE);
+	u32 errors = Memory::Read_U32(DATA_ADDRESS + DATA_ERRORS);
+	u32 sum = Memory::Read_U32(DATA_ADDRESS + DATA_SUM);
+	// Each producer sends 1 to ITEMS_PER_PRODUCER once.
+	u32 expectedSum = (u32)NUM_PRODUCERS * (u32)((u64)ITEMS_PER_PRODUCER * (ITEMS_PER_PRODUCER + 1) / 2);
+	// A wait and a signal per item on both sides, and the producers' delays.
+	int syscalls = NUM_PRODUCERS * (ITEMS_PER_PRODUCER * 4 + ITEMS_PER_PRODUCER / PRODUCER_DELAY_INTERVAL);
+
+	printf("Sync: %d producers and %d consumers, %d items through a %d slot buffer\n", NUM_PRODUCERS, NUM_CONSUMERS, NUM_PRODUCERS * ITEMS_PER_PRODUCER, BUFFER_SIZE);
+	printf("  %d syscalls in %u ms, %.0f/s, %.2f emulated seconds\n", syscalls, runMs, syscalls * 1000.0 / runMs, cyclesToUs(CoreTiming::GetTicks()) / 1000000.0);
+	printf("  %u of %d threads finished, %u failed waits or signals, sum %u (expected %u)\n", done, (int)workers.size(), errors, sum, expectedSum);
+
+	StopKernel();
+	bool ok = done == workers.size() && errors == 0 && sum == expectedSum;
+
+	if (!RunQueueCheck())
+		ok = false;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <stdio.h>
+#include <vector>
+
+#include "../Core/CoreTiming.h"
+#include "StdThread.h"
+#include "Timer.h"
+
+#include "HeadlessTests.h"
+
+namespace
+{
+
+const int NUM_INSTANCES = 8;
+const u32 NUM_TICKS = 200000;
+
+// One scheduler user: a periodic event that reschedules itself, and a second event type
+// that it posts through the threadsafe queue now and then. Everything the callbacks see
+// goes into the log, which must come out the same however many instances run at once.
+struct Instance
+{
+	int tickEvent;
+	int postEvent;
+	u32 seed;
+	std::vector<u64> log;
+};
+
+Instance instances[NUM_INSTANCES];
+
+u32 NextRandom(u32 &seed)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+// userdata is the instance in the low byte and the tick number above it.
+void TickCallback(u64 userdata, int cyclesLate)
+{
+	Instance &inst = instances[userdata & 0xFF];
+	u32 tick = (u32)(userdata >> 8);
+	inst.log.push_back(CoreTiming::GetTicks());
+	inst.log.push_back((u64)cyclesLate);
+
+	u32 r = NextRandom(inst.seed);
+	if ((r & 7) == 0)
+		CoreTiming::ScheduleEvent_Threadsafe(r & 0xFFF, inst.postEvent, userdata);
+	if (tick < NUM_TICKS)
+		CoreTiming::ScheduleEvent(100 + (r % 5000) - cyclesLate, inst.tickEvent, userdata + 0x100);
+}
+
+void PostCallback(u64 userdata, int cyclesLate)
+{
+	Instance &inst = instances[userdata & 0xFF];
+	inst.log.push_back(CoreTiming::GetTicks() | (1ULL << 63));
+	inst.log.push_back((u64)cyclesLate);
+}
+
+// Runs one instance to the end on the calling thread, with its own context.
+void RunInstance(int index)
+{
+	Instance &inst = instances[index];
+	inst.seed = 0x1234 + index * 7919;
+	inst.log.clear();
+
+	CoreTiming::Context *ctx = CoreTiming::CreateContext();
+	CoreTiming::SetCurrentContext(ctx);
+	CoreTiming::Init();
+
+	// Different registration orders, so the ids only match within a context.
+	if (index & 1)
+	{
+		inst.postEvent = CoreTiming::RegisterEvent("TimingTestPost", PostCallback);
+		inst.tickEvent = CoreTiming::RegisterEvent("TimingTestTick", TickCallback);
+	}
+	else
+	{
+		inst.tickEvent = CoreTiming::RegisterEvent("TimingTestTick", TickCallback);
+		inst.postEvent = CoreTiming::RegisterEvent("TimingTestPost", PostCallback);
+	}
+	CoreTiming::ScheduleEvent(1000, inst.tickEvent, (u64)index);
+
+	// Stand in for the CPU: burn the downcount in uneven steps, and idle sometimes.
+	int *downcount = CoreTiming::GetDowncountPtr();
+	u32 cpuSeed = index;
+	while (CoreTiming::IsScheduled(inst.tickEvent))
+	{
+		u32 r = NextRandom(cpuSeed);
+		if ((r & 15) == 0)
+			CoreTiming::Idle();
+		else
+			*downcount -= 1 + (r % 300);
+		if (*downcount < 0)
+			CoreTiming::Advance();
+	}
+
+	CoreTiming::Shutdown();
+	CoreTiming::DestroyContext(ctx);
+}
+
+}  // namespace
+
+int runTimingTest()
+{
+	// The reference: every instance alone, one after the other.
+	std::vector<u64> expected[NUM_INSTANCES];
+	u32 startMs = Common::Timer::GetTimeMs();
+	for (int i = 0; i < NUM_INSTANCES; i++)
+	{
+		RunInstance(i);
+		expected[i].swap(instances[i].log);
+	}
+	u32 serialMs = Common::Timer::GetTimeMs() - startMs;
+
+	startMs = Common::Timer::GetTimeMs();
+	std::vector<std::thread *> threads;
+	for (int i = 0; i < NUM_INSTANCES; i++)
+		threads.push_back(new std::thread(RunInstance, i));
+	for (size_t i = 0; i < threads.size(); i++)
+	{
+		threads[i]->join();
+		delete threads[i];
+	}
+	u32 parallelMs = Common::Timer::GetTimeMs() - startMs;
+
+	int failed = 0;
+	for (int i = 0; i < NUM_INSTANCES; i++)
+	{
+		const std::vector<u64> &log = instances[i].log;
+		if (log == expected[i])
+			continue;
+		size_t diff = 0;
+		while (diff < log.size() && diff < expected[i].size() && log[diff] == expected[i][diff])
+			diff++;
+		printf("Instance %d: %d callbacks alone, %d with the others, first difference at %d\n", i,
+			(int)expected[i].size() / 2, (int)log.size() / 2, (int)diff / 2);
+		failed++;
+	}
+
+	printf("%d scheduler instances, %d callbacks each: %u ms one at a time, %u ms at once\n",
+		NUM_INSTANCES, (int)expected[0].size() / 2, serialMs, parallelMs);
+	if (failed)
+		printf("%d instances ran differently alongside the others\n", failed);
+	return failed == 0 ? 0 : 1;
+}
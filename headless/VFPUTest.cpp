@@ -0,0 +1,397 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "../Core/Core.h"
+#include "../Core/CoreTiming.h"
+#include "../Core/MemMap.h"
+#include "../Core/MIPS/MIPS.h"
+#include "../Core/MIPS/MIPSTables.h"
+#include "../Core/MIPS/MIPSVFPUUtils.h"
+#include "../Core/MIPS/JitCommon/JitCommon.h"
+
+#include "HeadlessTests.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+
+namespace
+{
+
+const u32 PROGRAM_ADDRESS = 0x08804000;
+const u32 DATA_ADDRESS = 0x08900000;
+const u32 DATA_SIZE = 0x1000;
+
+const int NUM_TESTS = 20000;
+const int MAX_REPORTED = 10;
+
+struct Random
+{
+	Random(u32 seed) : state(seed) {}
+	u32 Next()
+	{
+		state = state * 1103515245 + 12345;
+		u32 hi = state >> 16;
+		state = state * 1103515245 + 12345;
+		return (hi << 16) | (state >> 16);
+	}
+	u32 state;
+};
+
+// Plenty of the values where rounding, NaN and signed zero handling show up.
+u32 RandomFloatBits(Random &rng)
+{
+	static const u32 specials[] = {
+		0x00000000, 0x80000000, 0x3F800000, 0xBF800000, 0x3F000000, 0x40000000,
+		0x7F800000, 0xFF800000, 0x7FC00000, 0xFFC00000, 0x7F800001, 0x00000001,
+		0x807FFFFF, 0x7F7FFFFF, 0x3F7FFFFF, 0x3F800001,
+	};
+	switch (rng.Next() % 4)
+	{
+	case 0:
+		return specials[rng.Next() % (sizeof(specials) / sizeof(specials[0]))];
+	case 1:
+		return rng.Next();
+	default:
+		{
+			// Ordinary values, around -4 to 4.
+			float f = (float)((int)(rng.Next() % 2000001) - 1000000) / 250000.0f;
+			u32 bits;
+			memcpy(&bits, &f, 4);
+			return bits;
+		}
+	}
+}
+
+// An S or T prefix that never swizzles past the end of the vector, which would make the
+// interpreter read uninitialized lanes.
+u32 RandomPrefixST(Random &rng, int n)
+{
+	if (rng.Next() % 3 == 0)
+		return 0xE4;
+	u32 prefix = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		bool constant = (rng.Next() & 3) == 0;
+		int regnum = rng.Next() % (constant ? 4 : n);
+		prefix |= regnum << (i * 2);
+		if (constant)
+			prefix |= 1 << (12 + i);
+		if (rng.Next() & 1)
+			prefix |= 1 << (8 + i);
+		if (rng.Next() & 1)
+			prefix |= 1 << (16 + i);
+	}
+	return prefix;
+}
+
+u32 RandomPrefixD(Random &rng)
+{
+	if (rng.Next() % 3 == 0)
+		return 0;
+	return rng.Next() & 0xFFF;
+}
+
+u32 VecSizeBits(int n)
+{
+	static const u32 bits[4] = {0x0000, 0x0080, 0x8000, 0x8080};
+	return bits[n - 1];
+}
+
+u32 RandomVReg(Random &rng)
+{
+	return rng.Next() & 0x7F;
+}
+
+// One of the ops the x86 JIT compiles natively, with random registers and size. usesPrefixes
+// is set for the ones that apply S/T/D prefixes, n to the vector size.
+u32 RandomOp(Random &rng, const char *&name, bool &usesPrefixes, int &n)
+{
+	n = 1 + rng.Next() % 4;
+	usesPrefixes = true;
+	u32 vd = RandomVReg(rng), vs = RandomVReg(rng), vt = RandomVReg(rng);
+	u32 regs = (vt << 16) | (vs << 8) | vd;
+	u32 rt = 1 + rng.Next() % 31;
+
+	switch (rng.Next() % 16)
+	{
+	case 0: name = "vadd"; return 0x60000000 | regs | VecSizeBits(n);
+	case 1: name = "vsub"; return 0x60800000 | regs | VecSizeBits(n);
+	case 2: name = "vdiv"; return 0x63800000 | regs | VecSizeBits(n);
+	case 3: name = "vmul"; return 0x64000000 | regs | VecSizeBits(n);
+	case 4: n = 2 + rng.Next() % 3; name = "vdot"; return 0x64800000 | regs | VecSizeBits(n);
+	case 5: name = "vscl"; return 0x65000000 | regs | VecSizeBits(n);
+	case 6: name = "vmov"; return 0xD0000000 | (vs << 8) | vd | VecSizeBits(n);
+	case 7: name = "vabs"; return 0xD0010000 | (vs << 8) | vd | VecSizeBits(n);
+	case 8: name = "vneg"; return 0xD0020000 | (vs << 8) | vd | VecSizeBits(n);
+	case 9: name = "vsat0"; return 0xD0040000 | (vs << 8) | vd | VecSizeBits(n);
+	case 10: name = "vsat1"; return 0xD0050000 | (vs << 8) | vd | VecSizeBits(n);
+	case 11:
+		usesPrefixes = false;
+		n = 2 + rng.Next() % 3;
+		name = "vmmul";
+		return 0xF0000000 | regs | VecSizeBits(n);
+	case 12:
+		{
+			// vtfmN has an N wide vector, vhtfmN an N-1 wide one.  A single wide vhtfm
+			// has no valid matrix size, so it's left out.
+			usesPrefixes = false;
+			int ins = 1 + rng.Next() % 3;
+			n = (ins > 1 && (rng.Next() & 1)) ? ins : ins + 1;
+			static const char *names[4] = {"", "v(h)tfm2", "v(h)tfm3", "v(h)tfm4"};
+			name = names[ins];
+			return 0xF0000000 | (ins << 23) | regs | VecSizeBits(n);
+		}
+	case 13:
+		usesPrefixes = false;
+		if (rng.Next() & 1)
+		{
+			name = "mfv";
+			return 0x48600000 | (rt << 16) | vd;
+		}
+		name = "mtv";
+		return 0x48E00000 | (rt << 16) | vd;
+	case 14:
+		{
+			usesPrefixes = false;
+			u32 imm = (rng.Next() % 64) * 4;
+			u32 v = RandomVReg(rng);
+			u32 vfield = ((v & 0x1F) << 16) | ((v >> 5) & 3);
+			if (rng.Next() & 1)
+			{
+				name = "lv.s";
+				return 0xC8000000 | (4 << 21) | vfield | imm;
+			}
+			name = "sv.s";
+			return 0xE8000000 | (4 << 21) | vfield | imm;
+		}
+	default:
+		{
+			usesPrefixes = false;
+			u32 imm = (rng.Next() % 16) * 16;
+			u32 v = RandomVReg(rng);
+			u32 vfield = ((v & 0x1F) << 16) | ((v >> 5) & 1);
+			if (rng.Next() & 1)
+			{
+				name = "lv.q";
+				return 0xD8000000 | (4 << 21) | vfield | imm;
+			}
+			name = "sv.q";
+			return 0xF8000000 | (4 << 21) | vfield | imm;
+		}
+	}
+}
+
+struct TestState
+{
+	u32 r[32];
+	u32 v[128];
+	u32 vfpuCtrl[16];
+	u8 data[DATA_SIZE];
+
+	void Save()
+	{
+		memcpy(r, mipsr4k.r, sizeof(r));
+		memcpy(v, mipsr4k.v, sizeof(v));
+		memcpy(vfpuCtrl, mipsr4k.vfpuCtrl, sizeof(vfpuCtrl));
+		Memory::Memcpy(data, DATA_ADDRESS, DATA_SIZE);
+	}
+
+	void Restore() const
+	{
+		memcpy(mipsr4k.r, r, sizeof(r));
+		memcpy(mipsr4k.v, v, sizeof(v));
+		memcpy(mipsr4k.vfpuCtrl, vfpuCtrl, sizeof(vfpuCtrl));
+		Memory::Memcpy(DATA_ADDRESS, data, DATA_SIZE);
+	}
+};
+
+static bool IsNaN(u32 bits)
+{
+	return (bits & 0x7F800000) == 0x7F800000 && (bits & 0x007FFFFF) != 0;
+}
+
+// When two different NaNs meet, x86 returns the first operand's, and which one comes first in
+// the interpreter is up to the host compiler.  So a NaN is allowed to differ from a NaN in the
+// registers, and everything else has to match exactly.
+static bool SameResults(const TestState &interp, const TestState &jit, bool &nanOnly)
+{
+	nanOnly = false;
+	for (int i = 0; i < 128; i++)
+	{
+		if (interp.v[i] == jit.v[i])
+			continue;
+		if (!IsNaN(interp.v[i]) || !IsNaN(jit.v[i]))
+			return false;
+		nanOnly = true;
+	}
+	if (memcmp(interp.r, jit.r, sizeof(jit.r)) != 0 || memcmp(interp.vfpuCtrl, jit.vfpuCtrl, sizeof(jit.vfpuCtrl)) != 0)
+		return false;
+	return memcmp(interp.data, jit.data, DATA_SIZE) == 0;
+}
+
+void RunInterpreter(const std::vector<u32> &code)
+{
+	mipsr4k.pc = PROGRAM_ADDRESS;
+	for (size_t i = 0; i < code.size(); i++)
+		MIPSInterpret(code[i]);
+}
+
+// Runs the code, then a break to stop the core and a branch to itself to end the slice.
+void RunJit(const std::vector<u32> &code)
+{
+	static const u32 tail[3] = {0x0000000D, 0x1000FFFF, 0x00000000};
+
+	// Destroying blocks puts their first instruction back, so do it before writing.
+	MIPSComp::jit->GetBlockCache()->InvalidateICache(PROGRAM_ADDRESS, (u32)(code.size() + 3) * 4);
+	for (size_t i = 0; i < code.size(); i++)
+		Memory::Write_U32(code[i], PROGRAM_ADDRESS + (u32)i * 4);
+	for (int i = 0; i < 3; i++)
+		Memory::Write_U32(tail[i], PROGRAM_ADDRESS + (u32)(code.size() + i) * 4);
+
+	mipsr4k.pc = PROGRAM_ADDRESS;
+	coreState = CORE_RUNNING;
+	MIPSComp::jit->RunLoopUntil(0);
+}
+
+void ReportMismatch(const std::vector<u32> &code, const TestState &initial, const TestState &interp, const TestState &jit)
+{
+	char disasm[256];
+	printf("Mismatch after:\n");
+	for (size_t i = 0; i < code.size(); i++)
+	{
+		MIPSDisAsm(code[i], PROGRAM_ADDRESS + (u32)i * 4, disasm);
+		printf("  %08x  %s\n", code[i], disasm);
+	}
+	if (code.size() == 1)
+		printf("  with prefixes S %05x T %05x D %03x\n", initial.vfpuCtrl[VFPU_CTRL_SPREFIX], initial.vfpuCtrl[VFPU_CTRL_TPREFIX], initial.vfpuCtrl[VFPU_CTRL_DPREFIX]);
+	for (int i = 0; i < 128; i++)
+	{
+		if (interp.v[i] != jit.v[i])
+			printf("  v%d: %08x, interpreter %08x, jit %08x\n", i, initial.v[i], interp.v[i], jit.v[i]);
+	}
+	for (int i = 0; i < 32; i++)
+	{
+		if (interp.r[i] != jit.r[i])
+			printf("  r%d: %08x, interpreter %08x, jit %08x\n", i, initial.r[i], interp.r[i], jit.r[i]);
+	}
+	for (int i = 0; i < 16; i++)
+	{
+		if (interp.vfpuCtrl[i] != jit.vfpuCtrl[i])
+			printf("  vfpuCtrl[%d]: %08x, interpreter %08x, jit %08x\n", i, initial.vfpuCtrl[i], interp.vfpuCtrl[i], jit.vfpuCtrl[i]);
+	}
+	if (memcmp(interp.data, jit.data, DATA_SIZE) != 0)
+		printf("  memory at %08x differs\n", DATA_ADDRESS);
+}
+
+}  // namespace
+
+int runVFPUTest()
+{
+	CoreTiming::Init();
+	Memory::Init();
+	mipsr4k.Reset();
+	MIPSComp::jit = new MIPSComp::Jit(&mipsr4k);
+
+	Random rng(0xF00D);
+	int failed = 0, badEncodings = 0, runtimePrefixTests = 0, nanOnlyTests = 0;
+	for (int t = 0; t < NUM_TESTS; t++)
+	{
+		const char *expectedName;
+		bool usesPrefixes;
+		int n;
+		u32 op = RandomOp(rng, expectedName, usesPrefixes, n);
+		if (strcmp(MIPSGetName(op), expectedName) != 0)
+		{
+			if (badEncodings++ < MAX_REPORTED)
+				printf("Generated %08x as %s, but it decodes as %s\n", op, expectedName, MIPSGetName(op));
+			continue;
+		}
+
+		for (int i = 0; i < 128; i++)
+		{
+			u32 bits = RandomFloatBits(rng);
+			memcpy(&mipsr4k.v[i], &bits, 4);
+		}
+		for (int i = 1; i < 32; i++)
+			mipsr4k.r[i] = RandomFloatBits(rng);
+		mipsr4k.r[4] = DATA_ADDRESS + (rng.Next() % 64) * 16;
+		for (u32 i = 0; i < DATA_SIZE; i += 4)
+			Memory::Write_U32(RandomFloatBits(rng), DATA_ADDRESS + i);
+		mipsr4k.vfpuCtrl[VFPU_CTRL_SPREFIX] = 0xE4;
+		mipsr4k.vfpuCtrl[VFPU_CTRL_TPREFIX] = 0xE4;
+		mipsr4k.vfpuCtrl[VFPU_CTRL_DPREFIX] = 0;
+
+		// Prefixes either come from vpfx ops in the same block, so the JIT knows them while
+		// compiling, or are already set when the block starts and have to be checked at runtime.
+		std::vector<u32> code;
+		if (usesPrefixes && (rng.Next() & 1))
+		{
+			code.push_back(0xDC000000 | RandomPrefixST(rng, n));
+			code.push_back(0xDD000000 | RandomPrefixST(rng, n));
+			code.push_back(0xDE000000 | RandomPrefixD(rng));
+		}
+		else if (usesPrefixes)
+		{
+			mipsr4k.vfpuCtrl[VFPU_CTRL_SPREFIX] = RandomPrefixST(rng, n);
+			mipsr4k.vfpuCtrl[VFPU_CTRL_TPREFIX] = RandomPrefixST(rng, n);
+			mipsr4k.vfpuCtrl[VFPU_CTRL_DPREFIX] = RandomPrefixD(rng);
+			runtimePrefixTests++;
+		}
+		code.push_back(op);
+
+		TestState initial, interp, jit;
+		initial.Save();
+		RunInterpreter(code);
+		interp.Save();
+		initial.Restore();
+		RunJit(code);
+		jit.Save();
+
+		bool nanOnly;
+		if (!SameResults(interp, jit, nanOnly))
+		{
+			if (failed++ < MAX_REPORTED)
+				ReportMismatch(code, initial, interp, jit);
+		}
+		else if (nanOnly)
+			nanOnlyTests++;
+	}
+
+	printf("VFPU: %d of %d random ops matched the interpreter bit for bit (%d with prefixes set before the block)\n",
+		NUM_TESTS - badEncodings - failed - nanOnlyTests, NUM_TESTS - badEncodings, runtimePrefixTests);
+	if (nanOnlyTests)
+		printf("VFPU: %d more only differed in which NaN came out\n", nanOnlyTests);
+
+	delete MIPSComp::jit;
+	MIPSComp::jit = 0;
+	Memory::Shutdown();
+	CoreTiming::Shutdown();
+	return failed || badEncodings ? 1 : 0;
+}
+
+#else
+
+int runVFPUTest()
+{
+	printf("VFPU: there's no native VFPU compiler on this platform to test\n");
+	return 0;
+}
+
+#endif